@@ -0,0 +1,124 @@
+// Elevation Engine
+//
+// Copyright (c) 2024 Azimuth Studios
+
+#include "pch.h"
+
+#include <memory>
+
+#include <ee/io/MappedFile.h>
+
+#include <drivers/windows/core/WinCheck.h>
+#include <drivers/windows/core/WinUtil.h>
+
+#include "WinMappedFile.h"
+#include "WinFileUtils.h"
+
+using namespace ee;
+
+namespace ee
+{
+	std::unique_ptr< MappedFile > MakeMappedFile( const char* filename )
+	{
+		return std::make_unique< WinMappedFile >( filename );
+	}
+
+	std::unique_ptr< MappedFile > MakeMappedFile( std::shared_ptr< File > file )
+	{
+		return std::make_unique< WinMappedFile >( file );
+	}
+
+} // namespace ee
+
+WinMappedFile::WinMappedFile( const char* filename )
+{
+	mFile = std::make_shared< File >( filename );
+	// Note: If this fails, we're not going to abort construction here
+	WinFileUtils::BuildFileStatus( *mFile, mFile->GetStatus() );
+}
+
+WinMappedFile::WinMappedFile( std::shared_ptr< File > file )
+	: mFile( file )
+{
+	// Note: If this fails, we're not going to abort construction here
+	WinFileUtils::BuildFileStatus( *mFile, mFile->GetStatus() );
+}
+
+WinMappedFile::~WinMappedFile()
+{
+	Close();
+}
+
+bool WinMappedFile::Open( void )
+{
+	Close();
+
+	mHandle = CreateFile( mFile->GetFilename(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+						  FILE_ATTRIBUTE_NORMAL, NULL );
+
+	if( mHandle == INVALID_HANDLE_VALUE )
+	{
+		DWORD error = GetLastError();
+		eeUnusedVariable( error );
+
+		eeDebug( "WinMappedFile::Open: CreateFile( %s ) returned error %d: %s\n", mFile->GetFilename(), error,
+				 WinUtil::GetErrorString( error ).c_str() );
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if( !eeCheckBool( GetFileSizeEx( mHandle, &size ) ) )
+	{
+		Close();
+		return false;
+	}
+
+	mSize = WinUtil::ToSize( size );
+
+	// CreateFileMapping() fails on an empty file, which has nothing to map
+	if( mSize == 0 )
+		return true;
+
+	mMapping = CreateFileMapping( mHandle, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( mMapping != NULL )
+	{
+		mData = static_cast< const uint8_t* >( MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 ) );
+	}
+
+	if( mData == nullptr )
+	{
+		DWORD error = GetLastError();
+		eeUnusedVariable( error );
+
+		eeDebug( "WinMappedFile::Open: can't map %s; error %d: %s\n", mFile->GetFilename(), error,
+				 WinUtil::GetErrorString( error ).c_str() );
+
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void WinMappedFile::Close( void )
+{
+	if( mData != nullptr )
+	{
+		eeCheckBool( UnmapViewOfFile( mData ) );
+		mData = nullptr;
+	}
+
+	if( mMapping != NULL )
+	{
+		eeCheckBool( CloseHandle( mMapping ) );
+		mMapping = NULL;
+	}
+
+	if( mHandle != INVALID_HANDLE_VALUE )
+	{
+		eeCheckBool( CloseHandle( mHandle ) );
+		mHandle = INVALID_HANDLE_VALUE;
+	}
+
+	mSize = 0;
+}
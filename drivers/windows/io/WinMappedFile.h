@@ -0,0 +1,66 @@
+// Elevation Engine
+//
+// Copyright (c) 2024 Azimuth Studios
+
+#pragma once
+
+#include <memory>
+
+#include <ee/io/Common.h>
+#include <ee/io/File.h>
+
+namespace ee
+{
+	// A whole file mapped read-only into memory. The file's contents can be
+	// used in place, with pages read from disk as they're first touched and
+	// shared with every other process that maps the same file.
+	class WinMappedFile
+	{
+	public:
+		WinMappedFile()								 = delete;
+		WinMappedFile( const WinMappedFile& other )	 = delete;
+		WinMappedFile( const WinMappedFile&& other ) = delete;
+
+		// Both fill in the File's status, without opening the file
+		WinMappedFile( const char* filename );
+		WinMappedFile( std::shared_ptr< File > file );
+		~WinMappedFile();
+
+		// Open() maps the file; an empty file opens, but has no data.
+		bool Open( void );
+
+		// Close() unmaps the file, after which pointers into it aren't valid.
+		void Close( void );
+
+		// Returns true if the file is open.
+		inline bool Valid( void ) const;
+
+		// The file's contents, and their size in bytes.
+		inline const uint8_t* GetData( void ) const;
+		inline size_t GetSize( void ) const;
+
+	private:
+		std::shared_ptr< File > mFile;
+		HANDLE					mHandle	 = INVALID_HANDLE_VALUE;
+		HANDLE					mMapping = NULL;
+		const uint8_t*			mData	 = nullptr;
+		size_t					mSize	 = 0;
+
+	}; // class WinMappedFile
+
+	inline bool WinMappedFile::Valid( void ) const
+	{
+		return ( mHandle != INVALID_HANDLE_VALUE );
+	}
+
+	inline const uint8_t* WinMappedFile::GetData( void ) const
+	{
+		return mData;
+	}
+
+	inline size_t WinMappedFile::GetSize( void ) const
+	{
+		return mSize;
+	}
+
+} // namespace ee
@@ -0,0 +1,33 @@
+// Elevation Engine
+//
+// Copyright (c) 2024 Azimuth Studios
+
+#pragma once
+
+#include <ee/core/PlatformDetection.h>
+#include <ee/io/File.h>
+
+#if defined( EE_BUILD_WINDOWS )
+#include <drivers/windows/io/WinMappedFile.h>
+#else // assume the POSIX interface is supported
+#include <drivers/posix/io/PosixMappedFile.h>
+#endif
+
+namespace ee
+{
+#if defined( EE_BUILD_WINDOWS )
+	using MappedFile = WinMappedFile;
+#else // assume the POSIX interface is supported
+	using MappedFile = PosixMappedFile;
+#endif
+
+	// Use these functions to instantiate the appropriate MappedFile
+	// for the System you're running on. They'll be implemented in a driver.
+	// Making a MappedFile fills in its File's status from the file system,
+	// without opening or mapping the file; a file that doesn't exist gets
+	// a status of type kNone.
+	std::unique_ptr< MappedFile > MakeMappedFile( const char* filename );
+
+	std::unique_ptr< MappedFile > MakeMappedFile( std::shared_ptr< File > file );
+
+} // namespace ee
@@ -36,14 +36,66 @@ namespace ee
 			return mMax;
 		}
 
+		inline vec3 GetCenter( void ) const
+		{
+			return 0.5f * ( mMin + mMax );
+		}
+
+		inline float GetSurfaceArea( void ) const
+		{
+			vec3 d = mMax - mMin;
+			return 2.0f * ( d.x * d.y + d.y * d.z + d.z * d.x );
+		}
+
 		bool Hit( const Ray& r, float tmin, float tmax ) const;
 
+		// A faster variant for testing one ray against many boxes, where
+		// the per-ray work is done once by the caller: invDirection holds
+		// the reciprocals of the ray direction's components and
+		// dirIsNegative[ i ] is nonzero if invDirection[ i ] < 0
+		inline bool Hit( const vec3& origin, const vec3& invDirection, const int dirIsNegative[ 3 ],
+						 float tmin, float tmax ) const;
+
+		// As above, also returning the distance at which the ray enters the
+		// box (clamped to tmin) so that traversals can order and cull boxes
+		inline bool Hit( const vec3& origin, const vec3& invDirection, const int dirIsNegative[ 3 ],
+						 float tmin, float tmax, float& tEntry ) const;
+
 	private:
 		vec3 mMin;
 		vec3 mMax;
 
 	}; // class AABB
 
+	inline bool AABB::Hit( const vec3& origin, const vec3& invDirection, const int dirIsNegative[ 3 ],
+						   float tmin, float tmax ) const
+	{
+		float tEntry;
+		return Hit( origin, invDirection, dirIsNegative, tmin, tmax, tEntry );
+	}
+
+	inline bool AABB::Hit( const vec3& origin, const vec3& invDirection, const int dirIsNegative[ 3 ],
+						   float tmin, float tmax, float& tEntry ) const
+	{
+		// Selecting the near and far slab by the direction's sign keeps
+		// each interval's endpoints in increasing order without a swap
+		for( int i = 0; i < 3; ++i )
+		{
+			float t0 = ( ( dirIsNegative[ i ] ? mMax : mMin )[ i ] - origin[ i ] ) * invDirection[ i ];
+			float t1 = ( ( dirIsNegative[ i ] ? mMin : mMax )[ i ] - origin[ i ] ) * invDirection[ i ];
+
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+
+			if( tmax <= tmin )
+				return false;
+
+		} // for( int i = 0; i < 3; ++i )
+
+		tEntry = tmin;
+		return true;
+	}
+
 	// Return the union of the two axis-aligned bounding boxes
 	// ("union" is a C++ reserved keyword, of course)
 	inline AABB Enclose( const AABB& box0, const AABB& box1 )
@@ -4,11 +4,9 @@
 
 #pragma once
 
-#include <functional>
-#include <random>
-
 #include "vec3.h"
 #include "AABB.h"
+#include "PCG32.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979
@@ -16,38 +14,82 @@
 
 namespace ee
 {
+	// Returns a float in [ 0, 1 ) from a per-thread generator. Fine for
+	// setting up scenes; code that needs reproducible sequences should own
+	// its generator and use the overloads below that take one.
 	inline float RandomFloat( void )
 	{
-		static thread_local std::uniform_real_distribution< float > distribution( 0.0, 1.0 );
-		static thread_local std::mt19937 generator;
-		static thread_local std::function< float() > randomGenerator = std::bind( distribution, generator );
-		return randomGenerator();
+		static thread_local PCG32 generator;
+		return generator.NextFloat();
 	}
 
-	inline vec3 RandomInUnitSphere( void )
+	// Maps a point in the unit square to a point in the unit disk in the
+	// xy plane, with Shirley and Chiu's concentric mapping. Points spread
+	// evenly over the square stay evenly spread over the disk.
+	inline vec3 SampleUnitDisk( float u1, float u2 )
 	{
-		vec3 p;
-		do
+		// [ 0, 1 ] -> [ -1, 1 ]
+		float a = 2.0f * u1 - 1.0f;
+		float b = 2.0f * u2 - 1.0f;
+
+		if( ( a == 0.0f ) && ( b == 0.0f ) )
+			return vec3( 0.0f, 0.0f, 0.0f );
+
+		float radius, phi;
+		if( a * a > b * b )
+		{
+			radius = a;
+			phi = float( M_PI / 4.0 ) * ( b / a );
+		}
+		else
 		{
-			// [ 0, 1 ] -> [ -1, 1 ]
-			p = 2.0f * vec3( RandomFloat(), RandomFloat(), RandomFloat() ) - vec3( 1.0f, 1.0f, 1.0f );
+			radius = b;
+			phi = float( M_PI / 2.0 ) - float( M_PI / 4.0 ) * ( a / b );
 		}
-		while( p.LengthSquared() >= 1.0f );
 
-		return p;
+		return vec3( radius * cos( phi ), radius * sin( phi ), 0.0f );
 	}
 
-	inline vec3 RandomInUnitDisk( void )
+	// Maps a point in the unit square to a direction, uniformly over the
+	// unit sphere
+	inline vec3 SampleUnitSphere( float u1, float u2 )
 	{
-		vec3 p;
+		float z = 1.0f - 2.0f * u1;
+		float r = sqrt( 1.0f - z * z );
+		float phi = 2.0f * float( M_PI ) * u2;
 
-		do
-		{
-			p = 2.0f * vec3( RandomFloat(), RandomFloat(), 0.0f ) - vec3( 1.0f, 1.0f, 0.0f );
-		}
-		while( Dot( p, p ) >= 1.0f );
+		return vec3( r * cos( phi ), r * sin( phi ), z );
+	}
 
-		return p;
+	// Maps a point in the unit cube to a point in the unit ball, uniformly:
+	// u1 and u2 pick a direction and u3 the distance from the center
+	inline vec3 SampleUnitBall( float u1, float u2, float u3 )
+	{
+		// The volume within radius d of the center grows as d^3
+		return cbrt( u3 ) * SampleUnitSphere( u1, u2 );
+	}
+
+	// Makes t and b unit vectors that are perpendicular to each other and
+	// to the unit vector n, without branching on which axis n is nearest
+	// (Duff et al., "Building an Orthonormal Basis, Revisited", 2017)
+	inline void BuildOrthonormalBasis( const vec3& n, vec3& t, vec3& b )
+	{
+		float sign = copysign( 1.0f, n.z );
+		float a = -1.0f / ( sign + n.z );
+		float c = n.x * n.y * a;
+
+		t = vec3( 1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x );
+		b = vec3( c, sign + n.y * n.y * a, -n.y );
+	}
+
+	inline vec3 RandomInUnitSphere( void )
+	{
+		return SampleUnitBall( RandomFloat(), RandomFloat(), RandomFloat() );
+	}
+
+	inline vec3 RandomInUnitDisk( void )
+	{
+		return SampleUnitDisk( RandomFloat(), RandomFloat() );
 	}
 
 	inline vec3 Reflect( const vec3& v, const vec3& n )
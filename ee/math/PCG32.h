@@ -0,0 +1,79 @@
+// Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+
+namespace ee
+{
+	// The PCG32 random number generator (pcg32_random_r from the PCG
+	// family by M.E. O'Neill): 64 bits of state and an odd increment that
+	// selects one of 2^63 independent streams. Much smaller and faster than
+	// std::mt19937, and good enough for Monte Carlo sampling.
+	class PCG32
+	{
+	public:
+		PCG32()
+		{
+			Seed( 0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL );
+		}
+
+		PCG32( uint64_t seed, uint64_t stream )
+		{
+			Seed( seed, stream );
+		}
+
+		inline void Seed( uint64_t seed, uint64_t stream );
+
+		inline uint32_t NextUInt( void );
+
+		// Returns a float in [ 0, 1 )
+		inline float NextFloat( void );
+
+	private:
+		uint64_t mState;
+		uint64_t mIncrement;
+
+	}; // class PCG32
+
+	// Scrambles the bits of key, so that nearby keys (such as consecutive
+	// pixel or sample indices) give unrelated results; from SplitMix64
+	inline uint64_t MixBits( uint64_t key )
+	{
+		key ^= key >> 30;
+		key *= 0xbf58476d1ce4e5b9ULL;
+		key ^= key >> 27;
+		key *= 0x94d049bb133111ebULL;
+		key ^= key >> 31;
+		return key;
+	}
+
+	inline void PCG32::Seed( uint64_t seed, uint64_t stream )
+	{
+		mState = 0;
+		mIncrement = ( stream << 1 ) | 1;
+		NextUInt();
+		mState += seed;
+		NextUInt();
+	}
+
+	inline uint32_t PCG32::NextUInt( void )
+	{
+		uint64_t oldState = mState;
+		mState = oldState * 6364136223846793005ULL + mIncrement;
+
+		uint32_t xorShifted = uint32_t( ( ( oldState >> 18 ) ^ oldState ) >> 27 );
+		uint32_t rotation = uint32_t( oldState >> 59 );
+		return ( xorShifted >> rotation ) | ( xorShifted << ( ( 32 - rotation ) & 31 ) );
+	}
+
+	inline float PCG32::NextFloat( void )
+	{
+		// The top 24 bits fill a float's mantissa exactly, so the result
+		// is never rounded up to 1
+		return float( NextUInt() >> 8 ) * ( 1.0f / 16777216.0f );
+	}
+
+} // namespace ee
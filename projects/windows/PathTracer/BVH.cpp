@@ -78,10 +78,13 @@ int boxCompareZ( const void* a, const void* b )
 }
 
 BVHNode::BVHNode( Traceable** list, uint32_t listCount, float t0, float t1 )
+	: mAxis( 0 )
+	, mOwnsChildren( false )
 {
 	if( listCount > 2 )
 	{
 		int axis = int( 3 * RandomFloat() );
+		mAxis = axis;
 
 		if( axis == 0 ) // x
 		{
@@ -111,6 +114,7 @@ BVHNode::BVHNode( Traceable** list, uint32_t listCount, float t0, float t1 )
 		uint32_t halfCount = listCount / 2;
 		mLeft = new BVHNode( list, halfCount, t0, t1 );
 		mRight = new BVHNode( list + halfCount, listCount - halfCount, t0, t1 );
+		mOwnsChildren = true;
 	}
 
 	AABB leftBounds, rightBounds;
@@ -122,38 +126,46 @@ BVHNode::BVHNode( Traceable** list, uint32_t listCount, float t0, float t1 )
 	mBounds = Enclose( leftBounds, rightBounds );
 }
 
-bool BVHNode::Hit( const Ray& ray, float t_min, float t_max, HitRecord& hit ) const
+bool BVHNode::Intersect( const Ray& ray, float t_min, float t_max, RayHit& hit ) const
 {
-	if( mBounds.Hit( ray, t_min, t_max ) )
+	if( !mBounds.Hit( ray, t_min, t_max ) )
+		return false;
+
+	// Visit the child nearer along the sort axis first, so that a hit in it
+	// shrinks the interval the farther child is tested over. Intersect()
+	// only writes to hit when it reports a hit closer than t_max, so the
+	// closest hit ends up in hit without comparing temporary records.
+	const Traceable* nearChild = mLeft;
+	const Traceable* farChild = mRight;
+	if( ray.GetDirection()[ mAxis ] < 0.0f )
 	{
-		HitRecord leftHit, rightHit;
-		bool hitLeft = mLeft->Hit( ray, t_min, t_max, leftHit );
-		bool hitRight = mRight->Hit( ray, t_min, t_max, rightHit );
-		if( hitLeft && hitRight )
-		{
-			if( leftHit.t < rightHit.t )
-			{
-				hit = leftHit;
-			}
-			else
-			{
-				hit = rightHit;
-			}
-
-			return true;
-		}
-		else if( hitLeft )
-		{
-			hit = leftHit;
-			return true;
-		}
-		else if( hitRight )
-		{
-			hit = rightHit;
-			return true;
-		}
+		nearChild = mRight;
+		farChild = mLeft;
 	}
 
-	// else
-	return false;
+	bool hitAnything = false;
+
+	if( nearChild->Intersect( ray, t_min, t_max, hit ) )
+	{
+		hitAnything = true;
+		t_max = hit.t;
+	}
+
+	// mLeft == mRight when the node holds a single object
+	if( ( farChild != nearChild ) && farChild->Intersect( ray, t_min, t_max, hit ) )
+	{
+		hitAnything = true;
+	}
+
+	return hitAnything;
+}
+
+bool BVHNode::Occluded( const Ray& ray, float t_min, float t_max ) const
+{
+	if( !mBounds.Hit( ray, t_min, t_max ) )
+		return false;
+
+	// Any hit will do, so there's no need to order the children
+	return mLeft->Occluded( ray, t_min, t_max ) ||
+		   ( ( mRight != mLeft ) && mRight->Occluded( ray, t_min, t_max ) );
 }
@@ -16,11 +16,16 @@ class BVHNode : public Traceable
 {
 public:
 	BVHNode();
+	// Note: list is sorted in place; the Traceable objects in it are not
+	// owned by the tree and must outlive it
 	BVHNode( Traceable** list, uint32_t listCount, float t0, float t1 );
+	virtual ~BVHNode();
 
 	// Traceable interface implementation
 
-	virtual bool Hit( const Ray& r, float t_min, float t_max, HitRecord& rec ) const;
+	virtual bool Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const;
+
+	virtual bool Occluded( const Ray& r, float t_min, float t_max ) const;
 
 	virtual bool GetBoundingBox( float t0, float t1, AABB& box ) const;
 
@@ -28,13 +33,26 @@ private:
 	Traceable*	mLeft;
 	Traceable*	mRight;
 	AABB		mBounds;
+	int			mAxis;			// the axis the children were sorted on
+	bool		mOwnsChildren; // true if mLeft and mRight are BVHNodes we allocated
 
 }; // class BVHNode
 
 inline BVHNode::BVHNode()
 	: mLeft( nullptr )
 	, mRight( nullptr )
+	, mAxis( 0 )
+	, mOwnsChildren( false )
+{
+}
+
+inline BVHNode::~BVHNode()
 {
+	if( mOwnsChildren )
+	{
+		delete mLeft;
+		delete mRight;
+	}
 }
 
 inline bool BVHNode::GetBoundingBox( float t0, float t1, AABB& box ) const
@@ -10,6 +10,8 @@
 #include <ee/math/vec3.h>
 #include <ee/math/Ray.h>
 
+#include "Sampler.h"
+
 using namespace ee;
 
 class Camera
@@ -26,7 +28,9 @@ public:
 			float aperture, float focalDistance,
 			float t0 = 0.0f, float t1 = 0.0f );
 
-	Ray GetRay( float u, float v ) const;
+	// u and v are the ray's position on the image plane, in [ 0, 1 ];
+	// the lens position and time are drawn from sampler
+	Ray GetRay( float u, float v, Sampler& sampler ) const;
 
 private:
 	vec3 mOrigin;
@@ -79,7 +83,7 @@ inline Camera::Camera( vec3 eye, vec3 lookat, vec3 up,
 	mLensRadius = aperture / 2.0f;
 }
 
-inline Ray Camera::GetRay( float s, float t ) const
+inline Ray Camera::GetRay( float s, float t, Sampler& sampler ) const
 {
 	if( mLensRadius == 0.0f )
 	{
@@ -87,10 +91,15 @@ inline Ray Camera::GetRay( float s, float t ) const
 	}
 	else
 	{
-		vec3 rd = mLensRadius * RandomInUnitDisk();
+		float lensU, lensV;
+		sampler.SetDimension( Sampler::kLensDimension );
+		sampler.Get2D( lensU, lensV );
+
+		vec3 rd = mLensRadius * SampleUnitDisk( lensU, lensV );
 		vec3 offset = mU * rd.x + mV * rd.y;
 		// Pick a random time in the interval the camera shutter is open
-		float time = mTime0 + RandomFloat() * ( mTime1 - mTime0 );
+		sampler.SetDimension( Sampler::kTimeDimension );
+		float time = mTime0 + sampler.Get1D() * ( mTime1 - mTime0 );
 		return Ray( mOrigin + offset,
 					mLowerLeftCorner + s * mHorizontal + t * mVertical - mOrigin - offset,
 					time );
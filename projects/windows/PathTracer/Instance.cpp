@@ -0,0 +1,53 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include "Instance.h"
+
+bool Instance::Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const
+{
+	if( !mObject->Intersect( ToObjectSpace( r ), t_min, t_max, hit ) )
+		return false;
+
+	// hit.t, u, v and index are the object's, and FinalizeHit() hands
+	// them back to it
+	hit.object = this;
+	return true;
+}
+
+void Instance::FinalizeHit( const Ray& r, const RayHit& hit, HitRecord& rec ) const
+{
+	RayHit objectHit = hit;
+	objectHit.object = mObject.get();
+
+	mObject->FinalizeHit( ToObjectSpace( r ), objectHit, rec );
+
+	// The point is worked out again in world space, rather than transformed,
+	// so that it's exactly where the world ray puts it
+	rec.p = r.PointAtParameter( hit.t );
+	rec.normal = mTransform.TransformNormal( rec.normal ).GetNormalized();
+
+	if( mHasMaterial )
+	{
+		rec.material = mMaterial;
+	}
+
+	rec.object = this;
+}
+
+bool Instance::Occluded( const Ray& r, float t_min, float t_max ) const
+{
+	return mObject->Occluded( ToObjectSpace( r ), t_min, t_max );
+}
+
+bool Instance::GetBoundingBox( float t0, float t1, AABB& box ) const
+{
+	AABB objectBox;
+	if( !mObject || !mObject->GetBoundingBox( t0, t1, objectBox ) )
+		return false;
+
+	box = mTransform.TransformBox( objectBox );
+	return true;
+}
@@ -0,0 +1,109 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <memory>
+
+#include "Traceable.h"
+#include "Transform.h"
+
+using namespace ee;
+
+// A copy of an object placed in the scene by a transform. Any number of
+// instances can share one object, such as a Mesh and the BVH over its
+// triangles, so a scene's memory grows with the geometry it holds rather
+// than the number of times it appears; the scene's BVH is built over the
+// instances' boxes, and is all that needs rebuilding when they move.
+//
+// Rays are transformed into the object's space rather than the object into
+// the world. Their directions aren't renormalized, so a hit's t is the same
+// in both spaces, and hits can be compared with the rest of the scene's.
+//
+// The object must be a primitive that reports itself as hit.object, as
+// Sphere, xyRect and Mesh do; instances of instances aren't supported.
+// Instances are never lights, whatever their material.
+class Instance : public Traceable
+{
+public:
+	Instance();
+	Instance( const std::shared_ptr< const Traceable >& object, const Transform& transform );
+
+	// Traceable interface implementation
+
+	virtual bool Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const;
+	virtual void FinalizeHit( const Ray& r, const RayHit& hit, HitRecord& rec ) const;
+
+	virtual bool Occluded( const Ray& r, float t_min, float t_max ) const;
+
+	virtual bool GetBoundingBox( float t0, float t1, AABB& box ) const;
+
+	// Instance member functions
+
+	inline const std::shared_ptr< const Traceable >& GetObject( void ) const;
+
+	// Moving an instance changes its bounding box, so the scene's BVH must
+	// be rebuilt afterwards; see Scene::SetInstanceTransform()
+	inline const Transform& GetTransform( void ) const;
+	inline void SetTransform( const Transform& transform );
+
+	// Gives the instance a material of its own in place of the object's
+	inline void SetMaterial( MaterialId material );
+	inline void ClearMaterial( void );
+
+private:
+	inline Ray ToObjectSpace( const Ray& r ) const;
+
+	std::shared_ptr< const Traceable >	mObject;
+	Transform							mTransform;
+	MaterialId							mMaterial;
+	bool								mHasMaterial;
+
+}; // class Instance
+
+inline Instance::Instance()
+	: mMaterial( 0 )
+	, mHasMaterial( false )
+{
+}
+
+inline Instance::Instance( const std::shared_ptr< const Traceable >& object, const Transform& transform )
+	: mObject( object )
+	, mTransform( transform )
+	, mMaterial( 0 )
+	, mHasMaterial( false )
+{
+}
+
+inline const std::shared_ptr< const Traceable >& Instance::GetObject( void ) const
+{
+	return mObject;
+}
+
+inline const Transform& Instance::GetTransform( void ) const
+{
+	return mTransform;
+}
+
+inline void Instance::SetTransform( const Transform& transform )
+{
+	mTransform = transform;
+}
+
+inline void Instance::SetMaterial( MaterialId material )
+{
+	mMaterial = material;
+	mHasMaterial = true;
+}
+
+inline void Instance::ClearMaterial( void )
+{
+	mHasMaterial = false;
+}
+
+inline Ray Instance::ToObjectSpace( const Ray& r ) const
+{
+	return Ray( mTransform.InverseTransformPoint( r.GetOrigin() ),
+				mTransform.InverseTransformVector( r.GetDirection() ), r.GetTime() );
+}
@@ -0,0 +1,157 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "LineReader.h"
+
+void TextChunk::Parse( void )
+{
+	const char* p = text.data();
+	const char* end = p + text.size();
+
+	while( p < end )
+	{
+		const char* lineEnd = static_cast< const char* >( memchr( p, '\n', end - p ) );
+		if( lineEnd == nullptr )
+		{
+			lineEnd = end;
+		}
+
+		++lineCount;
+
+		if( !ParseLine( p, lineEnd ) )
+			break; // the whole read fails
+
+		p = lineEnd + 1;
+	}
+
+	std::vector< char >().swap( text );
+}
+
+bool ReadLines( InputStream& stream, uint32_t threadCount, uint32_t chunkSize, const NewChunkFunction& newChunk )
+{
+	// The workers parse the chunks the queue holds, and the reading loop
+	// waits when there are more than it can hold in memory at once
+	std::mutex mutex;
+	std::condition_variable chunkRead, chunkParsed;
+	std::deque< TextChunk* > queue;
+	uint32_t unparsedCount = 0;
+	bool finished = false;
+
+	const uint32_t maxUnparsedCount = 2 * threadCount;
+
+	auto parseChunks = [&]()
+	{
+		for( ;; )
+		{
+			TextChunk* chunk;
+			{
+				std::unique_lock< std::mutex > lock( mutex );
+				chunkRead.wait( lock, [&]() { return !queue.empty() || finished; } );
+
+				if( queue.empty() )
+					return;
+
+				chunk = queue.front();
+				queue.pop_front();
+			}
+
+			chunk->Parse();
+
+			{
+				std::lock_guard< std::mutex > lock( mutex );
+				--unparsedCount;
+			}
+
+			chunkParsed.notify_one();
+		}
+	};
+
+	std::vector< std::thread > threads;
+	threads.reserve( threadCount );
+
+	for( uint32_t t = 0; t < threadCount; ++t )
+	{
+		threads.emplace_back( parseChunks );
+	}
+
+	// Each chunk ends at the last line break read; the partial line after
+	// it starts the next chunk
+	std::vector< char > text, partialLine;
+	bool readFailed = false;
+
+	for( ;; )
+	{
+		{
+			std::unique_lock< std::mutex > lock( mutex );
+			chunkParsed.wait( lock, [&]() { return unparsedCount < maxUnparsedCount; } );
+		}
+
+		text.swap( partialLine );
+		partialLine.clear();
+
+		const size_t start = text.size();
+		text.resize( start + chunkSize );
+
+		size_t bytesRead = 0;
+		if( stream.Read( text.data() + start, chunkSize, &bytesRead ) != FileResult::kSuccess )
+		{
+			readFailed = true;
+			break;
+		}
+
+		text.resize( start + bytesRead );
+		const bool atEnd = ( bytesRead == 0 );
+
+		if( !atEnd )
+		{
+			size_t lineEnd = text.size();
+			while( ( lineEnd > 0 ) && ( text[ lineEnd - 1 ] != '\n' ) )
+			{
+				--lineEnd;
+			}
+
+			partialLine.assign( text.begin() + lineEnd, text.end() );
+			text.resize( lineEnd );
+		}
+
+		if( !text.empty() )
+		{
+			TextChunk* chunk = newChunk();
+			chunk->text.swap( text );
+
+			{
+				std::lock_guard< std::mutex > lock( mutex );
+				queue.push_back( chunk );
+				++unparsedCount;
+			}
+
+			chunkRead.notify_one();
+		}
+
+		if( atEnd )
+			break;
+	}
+
+	{
+		std::lock_guard< std::mutex > lock( mutex );
+		finished = true;
+	}
+
+	chunkRead.notify_all();
+
+	for( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+
+	return !readFailed;
+}
@@ -0,0 +1,98 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <ee/io/InputStream.h>
+
+using namespace ee;
+
+// A chunk of whole lines of a text file, and what parsing it found.
+// Readers derive their chunks from it, adding what their lines define.
+struct TextChunk
+{
+	std::vector< char >	text; // whole lines; freed once parsed
+
+	uint64_t	lineCount = 0;
+	const char*	error = nullptr; // why the last line parsed couldn't be
+
+	virtual ~TextChunk() {}
+
+	// Parses each line of text, until one fails, and frees it
+	void Parse( void );
+
+	// Parses one line, [ p, end ), which doesn't include its line break.
+	// Returns false, with the reason in error, if it isn't valid.
+	virtual bool ParseLine( const char* p, const char* end ) = 0;
+
+}; // struct TextChunk
+
+typedef std::function< TextChunk*( void ) > NewChunkFunction;
+
+// Reads stream to its end, chunkSize bytes at a time, on the calling
+// thread, while threadCount worker threads Parse() the chunks it has read;
+// a line longer than a chunk is read on into the next. At most two chunks
+// per thread are held in memory at once, however big the file is.
+//
+// newChunk is called on the calling thread for each chunk, in file order,
+// and returns an empty chunk that the caller owns, for the text to be read
+// into. Returns false if the stream can't be read; otherwise every chunk
+// has been parsed, and the caller checks their errors.
+bool ReadLines( InputStream& stream, uint32_t threadCount, uint32_t chunkSize, const NewChunkFunction& newChunk );
+
+// Skips spaces, tabs and the carriage returns of CRLF line breaks
+static inline const char* SkipSpace( const char* p, const char* end )
+{
+	while( ( p < end ) && ( ( *p == ' ' ) || ( *p == '\t' ) || ( *p == '\r' ) ) )
+	{
+		++p;
+	}
+
+	return p;
+}
+
+// Where the line's comment starts, or end if it has none. Only a # at the
+// start of a word starts one, so that file names can contain #s.
+static inline const char* FindComment( const char* p, const char* end )
+{
+	for( const char* c = p; c < end; ++c )
+	{
+		c = static_cast< const char* >( memchr( c, '#', end - c ) );
+		if( c == nullptr )
+			break;
+
+		if( ( c == p ) || ( c[ -1 ] == ' ' ) || ( c[ -1 ] == '\t' ) )
+			return c;
+	}
+
+	return end;
+}
+
+static inline bool ParseFloat( const char*& p, const char* end, float& value )
+{
+	p = SkipSpace( p, end );
+	if( ( p < end ) && ( *p == '+' ) )
+	{
+		++p; // from_chars() doesn't take a plus sign
+	}
+
+	std::from_chars_result result = std::from_chars( p, end, value );
+	if( result.ec == std::errc::result_out_of_range )
+	{
+		value = 0.0f; // in practice, too small to be a normal float
+	}
+	else if( result.ec != std::errc() )
+	{
+		return false;
+	}
+
+	p = result.ptr;
+	return true;
+}
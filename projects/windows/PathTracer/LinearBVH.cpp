@@ -0,0 +1,537 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <thread>
+
+#include "LinearBVH.h"
+
+#include <ee/math/AABB.h>
+#include <ee/math/Math.h>
+
+// Below this many primitives a subtree or a pass over primitives is cheaper
+// to do on the current thread than to hand off to a new one
+static const uint32_t kMinParallelCount = 16 * 1024;
+
+// The number of chunks ParallelFor() will split count items into
+static uint32_t GetChunkCount( uint32_t count, uint32_t threadCount )
+{
+	return eeMax( 1u, eeMin( threadCount, count / ( kMinParallelCount / 4 ) ) );
+}
+
+// Calls function( begin, end, chunk ) for GetChunkCount() contiguous chunks
+// of [start, end), running all but the last chunk on their own threads
+template< class Function >
+static void ParallelFor( uint32_t start, uint32_t end, uint32_t threadCount, const Function& function )
+{
+	uint32_t count = end - start;
+	threadCount = GetChunkCount( count, threadCount );
+
+	std::vector< std::thread > threads;
+	threads.reserve( threadCount - 1 );
+
+	for( uint32_t t = 0; t < threadCount; ++t )
+	{
+		uint32_t chunkStart = start + uint32_t( uint64_t( count ) * t / threadCount );
+		uint32_t chunkEnd = start + uint32_t( uint64_t( count ) * ( t + 1 ) / threadCount );
+
+		if( t + 1 < threadCount )
+		{
+			threads.emplace_back( [&function, chunkStart, chunkEnd, t]()
+			{
+				function( chunkStart, chunkEnd, t );
+			} );
+		}
+		else
+		{
+			function( chunkStart, chunkEnd, t );
+		}
+	}
+
+	for( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+}
+
+bool LinearBVH::Build( const AABB* bounds, uint32_t count, const BVHBuildOptions& options )
+{
+	Clear();
+
+	if( ( bounds == nullptr ) || ( count == 0 ) )
+		return false;
+
+	mOptions = options;
+
+	// A leaf's primitive count has to fit in LinearBVHNode::primitiveCount
+	mOptions.maxLeafSize = eeMax( 1u, eeMin( mOptions.maxLeafSize, 0xFFFFu ) );
+	mOptions.binCount = eeMax( 2u, eeMin( mOptions.binCount, kMaxBinCount ) );
+	mOptions.intersectionBatchSize = eeMax( 1u, mOptions.intersectionBatchSize );
+
+	if( mOptions.threadCount == 0 )
+	{
+		mOptions.threadCount = eeMax( 1u, std::thread::hardware_concurrency() );
+	}
+
+	std::vector< BuildPrimitive > primitives( count );
+	ParallelFor( 0, count, mOptions.threadCount, [&]( uint32_t chunkStart, uint32_t chunkEnd, uint32_t )
+	{
+		for( uint32_t i = chunkStart; i < chunkEnd; ++i )
+		{
+			primitives[ i ].bounds = bounds[ i ];
+			primitives[ i ].centroid = bounds[ i ].GetCenter();
+			primitives[ i ].index = i;
+		}
+	} );
+
+	// A binary tree over count primitives has at most 2 * count - 1 nodes
+	mNodes.reserve( 2 * count - 1 );
+
+	BuildRecursive( mNodes, primitives.data(), 0, count, 1, mOptions.threadCount );
+
+	mPrimitiveIndices.resize( count );
+	ParallelFor( 0, count, mOptions.threadCount, [&]( uint32_t chunkStart, uint32_t chunkEnd, uint32_t )
+	{
+		for( uint32_t i = chunkStart; i < chunkEnd; ++i )
+		{
+			mPrimitiveIndices[ i ] = primitives[ i ].index;
+		}
+	} );
+
+	return true;
+}
+
+void LinearBVH::Clear( void )
+{
+	mNodes.clear();
+	mPrimitiveIndices.clear();
+}
+
+bool LinearBVH::Assign( const LinearBVHNode* nodes, uint32_t nodeCount, const uint32_t* primitiveIndices,
+						uint32_t primitiveCount, const BVHBuildOptions& options )
+{
+	Clear();
+
+	if( ( nodes == nullptr ) || ( nodeCount == 0 ) || ( primitiveIndices == nullptr ) || ( primitiveCount == 0 ) )
+		return false;
+
+	// Children always follow their parents, so each node's depth is known
+	// by the time it's reached
+	std::vector< uint32_t > depths( nodeCount, 0 );
+	depths[ 0 ] = 1;
+
+	for( uint32_t i = 0; i < nodeCount; ++i )
+	{
+		const LinearBVHNode& node = nodes[ i ];
+		if( depths[ i ] > kMaxDepth )
+			return false;
+
+		if( node.primitiveCount > 0 )
+		{
+			if( uint64_t( node.primitivesOffset ) + node.primitiveCount > primitiveCount )
+				return false;
+		}
+		else
+		{
+			if( ( node.secondChildOffset <= i + 1 ) || ( node.secondChildOffset >= nodeCount ) || ( node.axis >= 3 ) )
+				return false;
+
+			depths[ i + 1 ] = eeMax( depths[ i + 1 ], depths[ i ] + 1 );
+			depths[ node.secondChildOffset ] = eeMax( depths[ node.secondChildOffset ], depths[ i ] + 1 );
+		}
+	}
+
+	for( uint32_t i = 0; i < primitiveCount; ++i )
+	{
+		if( primitiveIndices[ i ] >= primitiveCount )
+			return false;
+	}
+
+	mNodes.assign( nodes, nodes + nodeCount );
+	mPrimitiveIndices.assign( primitiveIndices, primitiveIndices + primitiveCount );
+	mOptions = options;
+
+	return true;
+}
+
+float LinearBVH::GetSAHCost( void ) const
+{
+	if( mNodes.empty() )
+		return 0.0f;
+
+	float rootArea = mNodes[ 0 ].bounds.GetSurfaceArea();
+	if( rootArea <= 0.0f )
+		return mOptions.intersectionCost * GetBatchCount( uint32_t( mPrimitiveIndices.size() ) );
+
+	// The probability that a ray through the root hits a node is
+	// proportional to the node's surface area
+	float cost = 0.0f;
+	for( const LinearBVHNode& node : mNodes )
+	{
+		float area = node.bounds.GetSurfaceArea();
+		if( node.primitiveCount > 0 )
+		{
+			cost += area * mOptions.intersectionCost * GetBatchCount( node.primitiveCount );
+		}
+		else
+		{
+			cost += area * mOptions.traversalCost;
+		}
+	}
+
+	return cost / rootArea;
+}
+
+uint32_t LinearBVH::GetMaxDepth( void ) const
+{
+	if( mNodes.empty() )
+		return 0;
+
+	struct Entry
+	{
+		uint32_t node;
+		uint32_t depth;
+	};
+
+	Entry stack[ kMaxDepth + 1 ];
+	uint32_t stackSize = 0;
+	stack[ stackSize++ ] = { 0, 1 };
+
+	uint32_t maxDepth = 0;
+	while( stackSize > 0 )
+	{
+		Entry entry = stack[ --stackSize ];
+		maxDepth = eeMax( maxDepth, entry.depth );
+
+		const LinearBVHNode& node = mNodes[ entry.node ];
+		if( node.primitiveCount == 0 )
+		{
+			stack[ stackSize++ ] = { entry.node + 1, entry.depth + 1 };
+			stack[ stackSize++ ] = { node.secondChildOffset, entry.depth + 1 };
+		}
+	}
+
+	return maxDepth;
+}
+
+// Builds the subtree over primitives [start, end) into nodes and returns
+// the index of its root node. Up to threadCount threads may be used; each
+// half of a large enough split is built concurrently into its own array,
+// and the second half is then appended to the first with its node indices
+// relocated, so the result is the same depth-first layout a single thread
+// would produce.
+uint32_t LinearBVH::BuildRecursive( std::vector< LinearBVHNode >& nodes, BuildPrimitive* primitives,
+									uint32_t start, uint32_t end, uint32_t depth, uint32_t threadCount ) const
+{
+	uint32_t nodeIndex = uint32_t( nodes.size() );
+	nodes.emplace_back();
+
+	uint32_t count = end - start;
+
+	AABB bounds, centroidBounds;
+	ComputeBounds( primitives, start, end, threadCount, bounds, centroidBounds );
+
+	int axis = 0;
+	uint32_t mid = end;
+
+	if( count > 1 )
+	{
+		// The traversal stack holds one entry per level, and a median split
+		// adds at most 32 more levels below any node; past this depth stop
+		// looking for good splits and just make sure the tree stays shallow
+		if( ( mOptions.splitMethod == BVHSplitMethod::kSAH ) && ( depth < kMaxDepth - 32 ) )
+		{
+			mid = PartitionSAH( primitives, start, end, bounds, centroidBounds, threadCount, axis );
+		}
+		else if( count > mOptions.maxLeafSize )
+		{
+			mid = PartitionMedian( primitives, start, end, centroidBounds, axis );
+		}
+	}
+
+	if( mid == end )
+	{
+		LinearBVHNode& leaf = nodes[ nodeIndex ];
+		leaf.bounds = bounds;
+		leaf.primitivesOffset = start;
+		leaf.primitiveCount = uint16_t( count );
+		leaf.axis = 0;
+		leaf.pad = 0;
+		return nodeIndex;
+	}
+
+	uint32_t secondChild;
+
+	if( ( threadCount > 1 ) && ( mid - start >= kMinParallelCount ) && ( end - mid >= kMinParallelCount ) )
+	{
+		// Split the threads between the halves in proportion to their sizes
+		uint32_t secondThreadCount = eeMax( 1u, eeMin( threadCount - 1, uint32_t( uint64_t( threadCount ) * ( end - mid ) / count ) ) );
+
+		std::vector< LinearBVHNode > secondNodes;
+		secondNodes.reserve( 2 * ( end - mid ) - 1 );
+
+		std::thread secondThread( [&]()
+		{
+			BuildRecursive( secondNodes, primitives, mid, end, depth + 1, secondThreadCount );
+		} );
+
+		BuildRecursive( nodes, primitives, start, mid, depth + 1, threadCount - secondThreadCount );
+
+		secondThread.join();
+
+		secondChild = uint32_t( nodes.size() );
+		for( LinearBVHNode& node : secondNodes )
+		{
+			if( node.primitiveCount == 0 )
+			{
+				node.secondChildOffset += secondChild;
+			}
+		}
+
+		nodes.insert( nodes.end(), secondNodes.begin(), secondNodes.end() );
+	}
+	else
+	{
+		// At most one half is large enough to be worth parallelizing, and
+		// the halves are built one after the other, so each can use every thread
+		BuildRecursive( nodes, primitives, start, mid, depth + 1, threadCount );
+		secondChild = BuildRecursive( nodes, primitives, mid, end, depth + 1, threadCount );
+	}
+
+	LinearBVHNode& interior = nodes[ nodeIndex ];
+	interior.bounds = bounds;
+	interior.secondChildOffset = secondChild;
+	interior.primitiveCount = 0;
+	interior.axis = uint8_t( axis );
+	interior.pad = 0;
+
+	return nodeIndex;
+}
+
+void LinearBVH::ComputeBounds( const BuildPrimitive* primitives, uint32_t start, uint32_t end, uint32_t threadCount,
+							   AABB& bounds, AABB& centroidBounds ) const
+{
+	if( ( threadCount > 1 ) && ( end - start >= kMinParallelCount ) )
+	{
+		uint32_t chunkCount = GetChunkCount( end - start, threadCount );
+		std::vector< AABB > chunkBounds( chunkCount ), chunkCentroidBounds( chunkCount );
+
+		ParallelFor( start, end, threadCount, [&]( uint32_t chunkStart, uint32_t chunkEnd, uint32_t chunk )
+		{
+			ComputeBounds( primitives, chunkStart, chunkEnd, 1, chunkBounds[ chunk ], chunkCentroidBounds[ chunk ] );
+		} );
+
+		bounds = chunkBounds[ 0 ];
+		centroidBounds = chunkCentroidBounds[ 0 ];
+		for( uint32_t c = 1; c < chunkCount; ++c )
+		{
+			bounds = Enclose( bounds, chunkBounds[ c ] );
+			centroidBounds = Enclose( centroidBounds, chunkCentroidBounds[ c ] );
+		}
+
+		return;
+	}
+
+	bounds = primitives[ start ].bounds;
+	centroidBounds = AABB( primitives[ start ].centroid, primitives[ start ].centroid );
+	for( uint32_t i = start + 1; i < end; ++i )
+	{
+		bounds = Enclose( bounds, primitives[ i ].bounds );
+		centroidBounds = Enclose( centroidBounds, AABB( primitives[ i ].centroid, primitives[ i ].centroid ) );
+	}
+}
+
+uint32_t LinearBVH::PartitionMedian( BuildPrimitive* primitives, uint32_t start, uint32_t end,
+									 const AABB& centroidBounds, int& axis ) const
+{
+	// Split along the axis the centroids spread out over the most
+	vec3 extent = centroidBounds.GetMax() - centroidBounds.GetMin();
+	axis = 0;
+	if( extent.y > extent.x )
+		axis = 1;
+	if( extent.z > extent[ axis ] )
+		axis = 2;
+
+	uint32_t mid = start + ( end - start ) / 2;
+	int splitAxis = axis;
+	std::nth_element( primitives + start, primitives + mid, primitives + end,
+		[splitAxis]( const BuildPrimitive& a, const BuildPrimitive& b )
+		{
+			return a.centroid[ splitAxis ] < b.centroid[ splitAxis ];
+		} );
+
+	return mid;
+}
+
+uint32_t LinearBVH::PartitionSAH( BuildPrimitive* primitives, uint32_t start, uint32_t end,
+								  const AABB& bounds, const AABB& centroidBounds, uint32_t threadCount,
+								  int& axis ) const
+{
+	const uint32_t binCount = mOptions.binCount;
+	const uint32_t count = end - start;
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	uint32_t bestSplit = 0; // primitives in bins [0, bestSplit) go left
+
+	BinSet bins;
+	if( ( threadCount > 1 ) && ( count >= kMinParallelCount ) )
+	{
+		// Bin each chunk of primitives separately, then merge the chunks' bins
+		uint32_t chunkCount = GetChunkCount( count, threadCount );
+		std::vector< BinSet > chunkBins( chunkCount );
+
+		ParallelFor( start, end, threadCount, [&]( uint32_t chunkStart, uint32_t chunkEnd, uint32_t chunk )
+		{
+			BinCentroids( primitives, chunkStart, chunkEnd, centroidBounds, chunkBins[ chunk ] );
+		} );
+
+		bins = chunkBins[ 0 ];
+		for( uint32_t c = 1; c < chunkCount; ++c )
+		{
+			for( int a = 0; a < 3; ++a )
+			{
+				for( uint32_t b = 0; b < binCount; ++b )
+				{
+					const Bin& from = chunkBins[ c ].bins[ a ][ b ];
+					Bin& to = bins.bins[ a ][ b ];
+					if( from.count > 0 )
+					{
+						to.bounds = ( to.count == 0 ) ? from.bounds : Enclose( to.bounds, from.bounds );
+						to.count += from.count;
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		BinCentroids( primitives, start, end, centroidBounds, bins );
+	}
+
+	// Evaluate the cost of splitting between every pair of bins on each axis
+	for( int a = 0; a < 3; ++a )
+	{
+		if( centroidBounds.GetMax()[ a ] <= centroidBounds.GetMin()[ a ] )
+			continue; // every centroid is in the same place on this axis
+
+		const Bin* axisBins = bins.bins[ a ];
+
+		// Sweep from the right to find the area and count to the right of each split...
+		float rightArea[ kMaxBinCount ];
+		uint32_t rightCount[ kMaxBinCount ];
+		AABB accumulated;
+		uint32_t accumulatedCount = 0;
+		for( uint32_t b = binCount - 1; b > 0; --b )
+		{
+			if( axisBins[ b ].count > 0 )
+			{
+				accumulated = ( accumulatedCount == 0 ) ? axisBins[ b ].bounds : Enclose( accumulated, axisBins[ b ].bounds );
+				accumulatedCount += axisBins[ b ].count;
+			}
+
+			rightArea[ b ] = ( accumulatedCount > 0 ) ? accumulated.GetSurfaceArea() : 0.0f;
+			rightCount[ b ] = accumulatedCount;
+		}
+
+		// ...then from the left, costing each split as we go
+		accumulatedCount = 0;
+		for( uint32_t b = 0; b < binCount - 1; ++b )
+		{
+			if( axisBins[ b ].count > 0 )
+			{
+				accumulated = ( accumulatedCount == 0 ) ? axisBins[ b ].bounds : Enclose( accumulated, axisBins[ b ].bounds );
+				accumulatedCount += axisBins[ b ].count;
+			}
+
+			if( ( accumulatedCount == 0 ) || ( rightCount[ b + 1 ] == 0 ) )
+				continue;
+
+			float cost = accumulated.GetSurfaceArea() * GetBatchCount( accumulatedCount ) +
+						 rightArea[ b + 1 ] * GetBatchCount( rightCount[ b + 1 ] );
+			if( cost < bestCost )
+			{
+				bestCost = cost;
+				bestAxis = a;
+				bestSplit = b + 1;
+			}
+		}
+
+	} // for( int a = 0; a < 3; ++a )
+
+	if( bestAxis < 0 )
+	{
+		// Every centroid is at the same point, so binning can't separate them
+		if( count > mOptions.maxLeafSize )
+		{
+			return PartitionMedian( primitives, start, end, centroidBounds, axis );
+		}
+
+		return end;
+	}
+
+	// Turn the summed area * batch count into the expected cost of the
+	// split, and compare it with the cost of intersecting every primitive
+	// in a leaf
+	float area = bounds.GetSurfaceArea();
+	float splitCost = mOptions.traversalCost +
+					  ( area > 0.0f ? mOptions.intersectionCost * bestCost / area : 0.0f );
+	float leafCost = mOptions.intersectionCost * GetBatchCount( count );
+
+	if( ( count <= mOptions.maxLeafSize ) && ( leafCost <= splitCost ) )
+	{
+		return end;
+	}
+
+	axis = bestAxis;
+
+	float minCentroid = centroidBounds.GetMin()[ axis ];
+	float binScale = float( binCount ) / ( centroidBounds.GetMax()[ axis ] - minCentroid );
+	int splitAxis = axis;
+
+	BuildPrimitive* midPrimitive = std::partition( primitives + start, primitives + end,
+		[=]( const BuildPrimitive& p )
+		{
+			uint32_t b = eeMin( binCount - 1, uint32_t( ( p.centroid[ splitAxis ] - minCentroid ) * binScale ) );
+			return b < bestSplit;
+		} );
+
+	return uint32_t( midPrimitive - primitives );
+}
+
+void LinearBVH::BinCentroids( const BuildPrimitive* primitives, uint32_t start, uint32_t end,
+							  const AABB& centroidBounds, BinSet& bins ) const
+{
+	const uint32_t binCount = mOptions.binCount;
+
+	for( int a = 0; a < 3; ++a )
+	{
+		for( uint32_t b = 0; b < binCount; ++b )
+		{
+			bins.bins[ a ][ b ].count = 0;
+		}
+	}
+
+	vec3 minCentroid = centroidBounds.GetMin();
+	vec3 extent = centroidBounds.GetMax() - minCentroid;
+	vec3 binScale( extent.x > 0.0f ? float( binCount ) / extent.x : 0.0f,
+				   extent.y > 0.0f ? float( binCount ) / extent.y : 0.0f,
+				   extent.z > 0.0f ? float( binCount ) / extent.z : 0.0f );
+
+	for( uint32_t i = start; i < end; ++i )
+	{
+		const BuildPrimitive& primitive = primitives[ i ];
+
+		for( int a = 0; a < 3; ++a )
+		{
+			uint32_t b = eeMin( binCount - 1, uint32_t( ( primitive.centroid[ a ] - minCentroid[ a ] ) * binScale[ a ] ) );
+			Bin& bin = bins.bins[ a ][ b ];
+			bin.bounds = ( bin.count == 0 ) ? primitive.bounds : Enclose( bin.bounds, primitive.bounds );
+			bin.count++;
+		}
+	}
+}
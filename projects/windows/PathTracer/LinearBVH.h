@@ -0,0 +1,461 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <ee/math/AABB.h>
+#include <ee/math/Ray.h>
+
+#include "RayPacket.h"
+
+using namespace ee;
+
+// One node of a LinearBVH. Nodes are stored in depth-first order, so an
+// interior node's first child immediately follows it in the node array and
+// only the offset of the second child needs to be stored. Leaves store
+// a range of primitive indices instead of children.
+struct alignas( 32 ) LinearBVHNode
+{
+	AABB		bounds;
+	union
+	{
+		uint32_t	primitivesOffset;	// leaf
+		uint32_t	secondChildOffset;	// interior
+	};
+	uint16_t	primitiveCount;			// 0 -> interior node
+	uint8_t		axis;					// interior node: the axis the children were split on
+	uint8_t		pad;
+
+}; // struct LinearBVHNode
+
+static_assert( sizeof( LinearBVHNode ) == 32, "LinearBVHNode should fit two to a cache line" );
+
+enum class BVHSplitMethod
+{
+	kMedian,	// Split at the median centroid on the axis of greatest centroid extent
+	kSAH		// Surface area heuristic, evaluated over binned centroids
+};
+
+struct BVHBuildOptions
+{
+	BVHSplitMethod	splitMethod = BVHSplitMethod::kSAH;
+
+	// Leaves will contain at most this many primitives
+	uint32_t		maxLeafSize = 4;
+
+	// How many of a leaf's primitives are intersected at once, e.g. by
+	// SIMD code; the SAH charges intersectionCost per batch rather than
+	// per primitive, which favors leaves that fill whole batches. Set
+	// maxLeafSize to at least this, so that a leaf can fill a batch.
+	uint32_t		intersectionBatchSize = 1;
+
+	// The number of centroid bins per axis the SAH builder evaluates splits
+	// between; more bins find better splits at the cost of build time
+	uint32_t		binCount = 16;
+
+	// The relative costs of visiting a node and intersecting a primitive,
+	// used by the SAH builder and by LinearBVH::GetSAHCost()
+	float			traversalCost = 1.0f;
+	float			intersectionCost = 1.0f;
+
+	// The number of threads the builder may use; 0 means one per hardware
+	// thread. Large subtrees are built concurrently and large nodes are
+	// binned in parallel; the tree is the same whatever the thread count.
+	uint32_t		threadCount = 0;
+
+}; // struct BVHBuildOptions
+
+// A bounding volume hierarchy flattened into a single array of nodes, built
+// over an array of primitive bounding boxes. The BVH doesn't know what the
+// primitives are; after Build() the owner reorders its primitives with
+// GetPrimitiveIndices() so each leaf references a contiguous range of them.
+class LinearBVH
+{
+public:
+	LinearBVH();
+
+	// bounds holds one bounding box per primitive
+	bool Build( const AABB* bounds, uint32_t count, const BVHBuildOptions& options = BVHBuildOptions() );
+	void Clear( void );
+
+	// Copies a tree that was built before, such as the GetNodes() and
+	// GetPrimitiveIndices() of one saved to a file, rather than building
+	// one; options are the options it was built with. Returns false, and
+	// leaves the BVH empty, unless every node's children, primitives and
+	// split axis are in range and the tree is no deeper than kMaxDepth.
+	bool Assign( const LinearBVHNode* nodes, uint32_t nodeCount, const uint32_t* primitiveIndices,
+				 uint32_t primitiveCount, const BVHBuildOptions& options );
+
+	// Returns the expected cost of tracing a random ray through the tree
+	// according to the surface area heuristic, using the costs in the
+	// options the tree was built with. Lower is better; this is how trees
+	// from different builders or options should be compared.
+	float GetSAHCost( void ) const;
+
+	uint32_t GetMaxDepth( void ) const;
+
+	// The options the tree was built with, with defaults such as a zero
+	// thread count replaced by the values that were actually used
+	inline const BVHBuildOptions& GetBuildOptions( void ) const;
+
+	// Maps the BVH's primitive order to indices in the bounds array
+	// passed to Build(); leaf ranges index into this array
+	inline const uint32_t* GetPrimitiveIndices( void ) const;
+	inline uint32_t GetPrimitiveCount( void ) const;
+
+	inline const LinearBVHNode* GetNodes( void ) const;
+	inline uint32_t GetNodeCount( void ) const;
+
+	inline bool IsEmpty( void ) const;
+	inline const AABB& GetBounds( void ) const;
+
+	// Walk the hierarchy, calling leafHit for each leaf whose bounds the ray
+	// intersects in [t_min, t_max]. leafHit has the signature
+	//   bool leafHit( uint32_t first, uint32_t count, float t_min, float& t_max )
+	// and should return true and reduce t_max to the hit distance if any
+	// of primitives [first, first + count) is hit closer than t_max.
+	// Children are visited nearest first, and subtrees the ray enters
+	// beyond the closest hit found so far are skipped.
+	template< class LeafHit >
+	inline bool Hit( const Ray& r, float t_min, float t_max, LeafHit& leafHit ) const;
+
+	// Walk the hierarchy until any primitive is found in [t_min, t_max],
+	// calling leafOccluded for the leaves the ray intersects. leafOccluded
+	// has the signature
+	//   bool leafOccluded( uint32_t first, uint32_t count, float t_min, float t_max )
+	// and should return true as soon as any of primitives
+	// [first, first + count) is hit. Children are not sorted by distance,
+	// only visited in the order the ray's direction favors.
+	template< class LeafOccluded >
+	inline bool Occluded( const Ray& r, float t_min, float t_max, LeafOccluded& leafOccluded ) const;
+
+	// Hit() for a coherent packet of rays (see RayPacket::IsCoherent()),
+	// calling leafHit for each leaf that any of them enters, with a bitmask
+	// of the lanes of the rays that do. leafHit has the signature
+	//   void leafHit( uint32_t first, uint32_t count, uint32_t laneMask )
+	// and should reduce tMax[ lane ] to the hit distance for each ray in
+	// laneMask that hits any of primitives [first, first + count) closer
+	// than that. Each node is tested against every ray at once, and
+	// children are visited nearest first along the packet's direction.
+	template< class LeafHit >
+	inline void HitPacket( const RayPacket& packet, float t_min, float tMax[ RayPacket::kSize ], LeafHit& leafHit ) const;
+
+	// The deepest tree the traversal stack can handle
+	static const uint32_t kMaxDepth = 64;
+
+	// The most bins BVHBuildOptions::binCount can ask for
+	static const uint32_t kMaxBinCount = 32;
+
+private:
+	struct BuildPrimitive
+	{
+		AABB		bounds;
+		vec3		centroid;
+		uint32_t	index;
+	};
+
+	struct Bin
+	{
+		AABB		bounds;
+		uint32_t	count;
+	};
+
+	// A set of centroid bins for each axis
+	struct BinSet
+	{
+		Bin			bins[ 3 ][ kMaxBinCount ];
+	};
+
+	uint32_t BuildRecursive( std::vector< LinearBVHNode >& nodes, BuildPrimitive* primitives,
+							 uint32_t start, uint32_t end, uint32_t depth, uint32_t threadCount ) const;
+
+	void ComputeBounds( const BuildPrimitive* primitives, uint32_t start, uint32_t end, uint32_t threadCount,
+						AABB& bounds, AABB& centroidBounds ) const;
+
+	// Returns the index that primitives [start, end) should be split at, or
+	// end if the SAH says they should stay together in one leaf
+	uint32_t PartitionMedian( BuildPrimitive* primitives, uint32_t start, uint32_t end,
+							  const AABB& centroidBounds, int& axis ) const;
+	uint32_t PartitionSAH( BuildPrimitive* primitives, uint32_t start, uint32_t end,
+						   const AABB& bounds, const AABB& centroidBounds, uint32_t threadCount,
+						   int& axis ) const;
+
+	void BinCentroids( const BuildPrimitive* primitives, uint32_t start, uint32_t end,
+					   const AABB& centroidBounds, BinSet& bins ) const;
+
+	// The number of intersection batches a leaf of count primitives takes
+	inline float GetBatchCount( uint32_t count ) const;
+
+	std::vector< LinearBVHNode >	mNodes;
+	std::vector< uint32_t >			mPrimitiveIndices;
+	BVHBuildOptions					mOptions;
+
+}; // class LinearBVH
+
+inline LinearBVH::LinearBVH()
+{
+}
+
+inline float LinearBVH::GetBatchCount( uint32_t count ) const
+{
+	return float( ( count + mOptions.intersectionBatchSize - 1 ) / mOptions.intersectionBatchSize );
+}
+
+inline const uint32_t* LinearBVH::GetPrimitiveIndices( void ) const
+{
+	return mPrimitiveIndices.data();
+}
+
+inline uint32_t LinearBVH::GetPrimitiveCount( void ) const
+{
+	return uint32_t( mPrimitiveIndices.size() );
+}
+
+inline const BVHBuildOptions& LinearBVH::GetBuildOptions( void ) const
+{
+	return mOptions;
+}
+
+inline const LinearBVHNode* LinearBVH::GetNodes( void ) const
+{
+	return mNodes.data();
+}
+
+inline uint32_t LinearBVH::GetNodeCount( void ) const
+{
+	return uint32_t( mNodes.size() );
+}
+
+inline bool LinearBVH::IsEmpty( void ) const
+{
+	return mNodes.empty();
+}
+
+inline const AABB& LinearBVH::GetBounds( void ) const
+{
+	return mNodes[ 0 ].bounds;
+}
+
+template< class LeafHit >
+inline bool LinearBVH::Hit( const Ray& r, float t_min, float t_max, LeafHit& leafHit ) const
+{
+	if( mNodes.empty() )
+		return false;
+
+	const vec3& origin = r.GetOrigin();
+	const vec3 invDirection( 1.0f / r.GetDirection().x, 1.0f / r.GetDirection().y, 1.0f / r.GetDirection().z );
+	const int dirIsNegative[ 3 ] = { invDirection.x < 0.0f, invDirection.y < 0.0f, invDirection.z < 0.0f };
+
+	const LinearBVHNode* nodes = mNodes.data();
+
+	float tEntry;
+	if( !nodes[ 0 ].bounds.Hit( origin, invDirection, dirIsNegative, t_min, t_max, tEntry ) )
+		return false;
+
+	// Deferred farther children, with the distance at which the ray enters
+	// them; by the time one is popped a closer hit may have made it moot
+	struct StackEntry
+	{
+		uint32_t	node;
+		float		tEntry;
+	};
+
+	StackEntry stack[ kMaxDepth ];
+	uint32_t stackSize = 0;
+	uint32_t current = 0;
+
+	bool hitAnything = false;
+
+	for( ;; )
+	{
+		const LinearBVHNode& node = nodes[ current ];
+
+		if( node.primitiveCount > 0 )
+		{
+			if( leafHit( node.primitivesOffset, node.primitiveCount, t_min, t_max ) )
+			{
+				hitAnything = true;
+			}
+		}
+		else
+		{
+			// Test both children here rather than when they're visited, so
+			// the nearer one can be visited first
+			uint32_t first = current + 1;
+			uint32_t second = node.secondChildOffset;
+
+			float tFirst, tSecond;
+			bool hitFirst = nodes[ first ].bounds.Hit( origin, invDirection, dirIsNegative, t_min, t_max, tFirst );
+			bool hitSecond = nodes[ second ].bounds.Hit( origin, invDirection, dirIsNegative, t_min, t_max, tSecond );
+
+			if( hitFirst && hitSecond )
+			{
+				if( tSecond < tFirst )
+				{
+					stack[ stackSize++ ] = { first, tFirst };
+					current = second;
+				}
+				else
+				{
+					stack[ stackSize++ ] = { second, tSecond };
+					current = first;
+				}
+
+				continue;
+			}
+			else if( hitFirst )
+			{
+				current = first;
+				continue;
+			}
+			else if( hitSecond )
+			{
+				current = second;
+				continue;
+			}
+		}
+
+		// Pop the next subtree that could still hold a closer hit
+		while( ( stackSize > 0 ) && ( stack[ stackSize - 1 ].tEntry >= t_max ) )
+		{
+			--stackSize;
+		}
+
+		if( stackSize == 0 )
+			break;
+
+		current = stack[ --stackSize ].node;
+
+	} // for( ;; )
+
+	return hitAnything;
+}
+
+template< class LeafOccluded >
+inline bool LinearBVH::Occluded( const Ray& r, float t_min, float t_max, LeafOccluded& leafOccluded ) const
+{
+	if( mNodes.empty() )
+		return false;
+
+	const vec3& origin = r.GetOrigin();
+	const vec3 invDirection( 1.0f / r.GetDirection().x, 1.0f / r.GetDirection().y, 1.0f / r.GetDirection().z );
+	const int dirIsNegative[ 3 ] = { invDirection.x < 0.0f, invDirection.y < 0.0f, invDirection.z < 0.0f };
+
+	const LinearBVHNode* nodes = mNodes.data();
+
+	if( !nodes[ 0 ].bounds.Hit( origin, invDirection, dirIsNegative, t_min, t_max ) )
+		return false;
+
+	uint32_t stack[ kMaxDepth ];
+	uint32_t stackSize = 0;
+	uint32_t current = 0;
+
+	for( ;; )
+	{
+		const LinearBVHNode& node = nodes[ current ];
+
+		if( node.primitiveCount > 0 )
+		{
+			if( leafOccluded( node.primitivesOffset, node.primitiveCount, t_min, t_max ) )
+				return true;
+		}
+		else
+		{
+			// Test both children here, as Hit() does, so that only the ones
+			// the ray enters are stacked; the one on the ray's side of the
+			// split goes first
+			uint32_t first = current + 1;
+			uint32_t second = node.secondChildOffset;
+			if( dirIsNegative[ node.axis ] )
+			{
+				first = node.secondChildOffset;
+				second = current + 1;
+			}
+
+			bool hitFirst = nodes[ first ].bounds.Hit( origin, invDirection, dirIsNegative, t_min, t_max );
+			bool hitSecond = nodes[ second ].bounds.Hit( origin, invDirection, dirIsNegative, t_min, t_max );
+
+			if( hitFirst )
+			{
+				if( hitSecond )
+				{
+					stack[ stackSize++ ] = second;
+				}
+
+				current = first;
+				continue;
+			}
+			else if( hitSecond )
+			{
+				current = second;
+				continue;
+			}
+		}
+
+		if( stackSize == 0 )
+			break;
+
+		current = stack[ --stackSize ];
+
+	} // for( ;; )
+
+	return false;
+}
+
+template< class LeafHit >
+inline void LinearBVH::HitPacket( const RayPacket& packet, float t_min, float tMax[ RayPacket::kSize ],
+								  LeafHit& leafHit ) const
+{
+	if( mNodes.empty() )
+		return;
+
+	const uint32_t laneMask = packet.GetLaneMask();
+
+	const LinearBVHNode* nodes = mNodes.data();
+
+	uint32_t stack[ kMaxDepth ];
+	uint32_t stackSize = 0;
+	uint32_t current = 0;
+
+	for( ;; )
+	{
+		const LinearBVHNode& node = nodes[ current ];
+
+		// One SIMD test tells which rays enter the node; the packet only
+		// moves on if none do
+		uint32_t mask = packet.IntersectBounds( node.bounds, t_min, tMax ) & laneMask;
+		if( mask != 0 )
+		{
+			if( node.primitiveCount > 0 )
+			{
+				leafHit( node.primitivesOffset, node.primitiveCount, mask );
+			}
+			else
+			{
+				// Every ray crosses the split axis the same way, so the
+				// child on the side the rays start from is nearer for all
+				uint32_t first = current + 1;
+				uint32_t second = node.secondChildOffset;
+				if( packet.dirIsNegative[ node.axis ] )
+				{
+					first = node.secondChildOffset;
+					second = current + 1;
+				}
+
+				stack[ stackSize++ ] = second;
+				current = first;
+				continue;
+			}
+		}
+
+		if( stackSize == 0 )
+			break;
+
+		current = stack[ --stackSize ];
+
+	} // for( ;; )
+}
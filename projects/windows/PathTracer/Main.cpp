@@ -57,6 +57,12 @@ public:
 
 	void SetBitmap( HBITMAP bitmap )
 	{
+		// The bitmap is replaced after every pass of a progressive trace
+		if( mBitmap != NULL )
+		{
+			DeleteObject( mBitmap );
+		}
+
 		mBitmap = bitmap;
 	}
 
@@ -139,6 +145,17 @@ static LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM
 		}
 		break;
 
+		case IDM_BENCHMARK:
+		{
+			PathTracerApplication* application = reinterpret_cast< PathTracerApplication* >( GetWindowLongPtr( hWnd, GWLP_USERDATA ) );
+
+			// Blocks the GUI for several seconds; the results go to the debug output
+			application->GetTracer().RunBVHBenchmark();
+			application->GetTracer().RunWavefrontBenchmark();
+			application->GetTracer().RunObjReaderCheck();
+		}
+		break;
+
 		case IDM_ABOUT:
 		{
 			PathTracerApplication* application = reinterpret_cast< PathTracerApplication* >( GetWindowLongPtr( hWnd, GWLP_USERDATA ) );
@@ -208,7 +225,7 @@ static LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM
 	return 0;
 }
 
-static void CopyBitmap( PathTracerApplication& application )
+static void CopyBitmap( PathTracerApplication& application, const uint8_t* pixels )
 {
 	HWND hwnd = application.GetApplicationWindow().GetHWND();
 
@@ -241,8 +258,6 @@ static void CopyBitmap( PathTracerApplication& application )
 
 	HDC dc = GetDC( hwnd );
 
-	const uint8_t* pixels = tracer.GetPixels();
-
 	void* bits;
 	HBITMAP bitmap = CreateDIBSection( dc, &info, DIB_RGB_COLORS, &bits, nullptr, 0 );
 
@@ -264,7 +279,7 @@ static void TracerCompleteCallback( const PathTracer& tracer, const void* data )
 	PathTracerApplication* application = reinterpret_cast< PathTracerApplication* >( const_cast< void * >( data ) );
 
 	// Copy the results to the HBITMAP
-	CopyBitmap( *application );
+	CopyBitmap( *application, tracer.GetPixels() );
 
 	// Make sure that they're visible
 	InvalidateRect( application->GetApplicationWindow().GetHWND(), NULL, TRUE );
@@ -272,6 +287,20 @@ static void TracerCompleteCallback( const PathTracer& tracer, const void* data )
 	application->GetProgressBar().Close();
 }
 
+static void TracerPassCallback( const PathTracer& tracer, const uint8_t* pixels, uint32_t sampleCount, const void* data )
+{
+	if( data == nullptr )
+		return;
+
+	// data is const void* because PathTracer won't touch it;
+	// the const_cast here is safe
+	PathTracerApplication* application = reinterpret_cast< PathTracerApplication* >( const_cast< void * >( data ) );
+
+	// Show the image traced so far
+	CopyBitmap( *application, pixels );
+	InvalidateRect( application->GetApplicationWindow().GetHWND(), NULL, FALSE );
+}
+
 static void TracerProgressCallback( uint16_t step, const void* data )
 {
 	if( data != nullptr )
@@ -290,11 +319,13 @@ int PathTracerApplication::Main( int argCount, const char* args[] )
 
 	mTracer.SetProgressCallback( TracerProgressCallback, this );
 	mTracer.SetCompleteCallback( TracerCompleteCallback, this );
+	mTracer.SetPassCallback( TracerPassCallback, this );
 
 	mTracer.StartTrace();
 
-	// Spawn the tracing threads
-	mTracer.Trace();
+	// Spawn the tracing threads; they run in the background while the
+	// main loop keeps the window responsive and reports their progress
+	TraceJob* job = mTracer.BeginTrace();
 
 	// Main loop:
 	while( mRunning )
@@ -304,8 +335,28 @@ int PathTracerApplication::Main( int argCount, const char* args[] )
 			break;
 		}
 
+		if( job != nullptr )
+		{
+			// Sleeps until the trace advances, or long enough for the
+			// window to keep up with its messages
+			if( job->WaitFor( 16 ) != TraceJob::Status::kRunning )
+			{
+				job = nullptr;
+			}
+		}
+		else
+		{
+			WaitMessage();
+		}
+
 	} // while( mRunning )
 
+	if( job != nullptr )
+	{
+		job->Cancel();
+		job->Wait();
+	}
+
 	return 0;
 }
 
@@ -315,7 +366,6 @@ int APIENTRY wWinMain( _In_ HINSTANCE hInstance,
 					   _In_ int nCmdShow )
 {
 	UNREFERENCED_PARAMETER( hPrevInstance );
-	UNREFERENCED_PARAMETER( lpCmdLine );
 
 	static constexpr size_t MAX_LOADSTRING = 100;
 
@@ -363,6 +413,26 @@ int APIENTRY wWinMain( _In_ HINSTANCE hInstance,
 		return -1;
 	}
 
+	// The command line may name a scene file to trace, in quotes or not
+	const wchar_t* sceneFile = lpCmdLine;
+	size_t sceneFileLength = wcslen( sceneFile );
+	if( ( sceneFileLength >= 2 ) && ( sceneFile[ 0 ] == L'"' ) && ( sceneFile[ sceneFileLength - 1 ] == L'"' ) )
+	{
+		++sceneFile;
+		sceneFileLength -= 2;
+	}
+
+	if( sceneFileLength > 0 )
+	{
+		CHAR filename[ MAX_PATH ];
+		int length = WideCharToMultiByte( CP_UTF8, 0, sceneFile, int( sceneFileLength ), filename, MAX_PATH - 1, nullptr, nullptr );
+		if( length > 0 )
+		{
+			filename[ length ] = '\0';
+			application.GetTracer().SetSceneFile( filename );
+		}
+	}
+
 	uint16_t width, height;
 	application.GetTracer().GetDimensions( width, height );
 
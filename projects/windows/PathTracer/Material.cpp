@@ -4,11 +4,145 @@
 
 #include "pch.h"
 
+#include <cstring>
+
 #include "Material.h"
 
-bool Glass::Scatter( const Ray& ray, const HitRecord& hit,
-					 vec3& attenuation, Ray& scattered ) const
+#include <ee/math/PCG32.h>
+
+MaterialTable::~MaterialTable()
+{
+	for( Texture* texture : mTextures )
+	{
+		delete texture;
+	}
+}
+
+MaterialId MaterialTable::AddLambertian( const vec3& albedo )
+{
+	return Add( MaterialType::kLambertian, 0.0f, albedo, nullptr );
+}
+
+MaterialId MaterialTable::AddMetal( const vec3& albedo, float fuzziness )
+{
+	return Add( MaterialType::kMetal, eeMin( fuzziness, 1.0f ), albedo, nullptr );
+}
+
+MaterialId MaterialTable::AddGlass( float refractiveIndex )
+{
+	return Add( MaterialType::kGlass, refractiveIndex, vec3( 1.0f, 1.0f, 1.0f ), nullptr );
+}
+
+MaterialId MaterialTable::AddDiffuseLight( const vec3& emitted )
+{
+	return Add( MaterialType::kDiffuseLight, 0.0f, emitted, nullptr );
+}
+
+MaterialId MaterialTable::AddLambertian( Texture* albedo )
+{
+	return Add( MaterialType::kLambertian, 0.0f, vec3( 0.0f, 0.0f, 0.0f ), albedo );
+}
+
+MaterialId MaterialTable::AddDiffuseLight( Texture* emitted )
+{
+	return Add( MaterialType::kDiffuseLight, 0.0f, vec3( 0.0f, 0.0f, 0.0f ), emitted );
+}
+
+MaterialId MaterialTable::Add( MaterialType type, float parameter, const vec3& color, Texture* texture )
 {
+	Material material;
+	material.type = type;
+	material.parameter = parameter;
+	material.color = color;
+	material.texture = texture;
+
+	if( texture != nullptr )
+	{
+		mTextures.push_back( texture );
+	}
+	else
+	{
+		// Textures can't be compared, but plain parameters can
+		uint32_t bits[ 5 ];
+		bits[ 0 ] = uint32_t( type );
+		memcpy( &bits[ 1 ], &parameter, sizeof( float ) );
+		memcpy( &bits[ 2 ], &color.x, sizeof( float ) );
+		memcpy( &bits[ 3 ], &color.y, sizeof( float ) );
+		memcpy( &bits[ 4 ], &color.z, sizeof( float ) );
+
+		uint64_t key = 0;
+		for( uint32_t bit : bits )
+		{
+			key = MixBits( key ^ bit );
+		}
+
+		auto shared = mShared.find( key );
+		if( shared != mShared.end() )
+		{
+			const Material& match = mMaterials[ shared->second ];
+			if( ( match.type == type ) && ( match.parameter == parameter ) && ( match.color == color ) &&
+				( match.texture == nullptr ) )
+			{
+				return shared->second;
+			}
+		}
+		else
+		{
+			mShared[ key ] = MaterialId( mMaterials.size() );
+		}
+	}
+
+	mMaterials.push_back( material );
+	return MaterialId( mMaterials.size() - 1 );
+}
+
+void MaterialTable::ScatterBatch( MaterialType type, ScatterQuery* queries, const uint32_t* indices, uint32_t count ) const
+{
+	switch( type )
+	{
+	case MaterialType::kLambertian:
+		for( uint32_t i = 0; i < count; ++i )
+		{
+			ScatterQuery& query = queries[ indices[ i ] ];
+			const Material& material = mMaterials[ query.hit.material ];
+			query.scatters = ScatterLambertian( GetColor( material, query.hit.p ), query.ray, query.hit, query.samples,
+												query.attenuation, query.scattered );
+		}
+		break;
+
+	case MaterialType::kMetal:
+		for( uint32_t i = 0; i < count; ++i )
+		{
+			ScatterQuery& query = queries[ indices[ i ] ];
+			query.scatters = ScatterMetal( mMaterials[ query.hit.material ], query.ray, query.hit, query.samples,
+										   query.attenuation, query.scattered );
+		}
+		break;
+
+	case MaterialType::kGlass:
+		for( uint32_t i = 0; i < count; ++i )
+		{
+			ScatterQuery& query = queries[ indices[ i ] ];
+			query.scatters = ScatterGlass( mMaterials[ query.hit.material ], query.ray, query.hit, query.samples,
+										   query.attenuation, query.scattered );
+		}
+		break;
+
+	case MaterialType::kDiffuseLight:
+		for( uint32_t i = 0; i < count; ++i )
+		{
+			queries[ indices[ i ] ].scatters = false;
+		}
+		break;
+
+	} // switch( type )
+}
+
+bool MaterialTable::ScatterGlass( const Material& material, const Ray& ray, const HitRecord& hit,
+								  const ScatterSamples& samples, vec3& attenuation, Ray& scattered )
+{
+	const float refractIndex = material.parameter;
+
 	vec3 reflected = Reflect( ray.GetDirection(), hit.normal );
 
 	// Glass absorbs nothing
@@ -20,13 +154,13 @@ bool Glass::Scatter( const Ray& ray, const HitRecord& hit,
 	if( Dot( ray.GetDirection(), hit.normal ) > 0.0f )
 	{
 		outwardNormal = -hit.normal;
-		ni_over_nt = mRefractIndex;
-		cosine = mRefractIndex * Dot( ray.GetDirection(), hit.normal ) / ray.GetDirection().Length();
+		ni_over_nt = refractIndex;
+		cosine = refractIndex * Dot( ray.GetDirection(), hit.normal ) / ray.GetDirection().Length();
 	}
 	else
 	{
 		outwardNormal = hit.normal;
-		ni_over_nt = 1.0f / mRefractIndex;
+		ni_over_nt = 1.0f / refractIndex;
 		cosine = -Dot( ray.GetDirection(), hit.normal ) / ray.GetDirection().Length();
 	}
 
@@ -35,14 +169,14 @@ bool Glass::Scatter( const Ray& ray, const HitRecord& hit,
 
 	if( Refract( ray.GetDirection(), outwardNormal, ni_over_nt, refracted ) )
 	{
-		reflectProbability = Schlick( cosine, mRefractIndex );
+		reflectProbability = Schlick( cosine, refractIndex );
 	}
 	else
 	{
 		reflectProbability = 1.0f;
 	}
 
-	if( RandomFloat() < reflectProbability )
+	if( samples.u[ 0 ] < reflectProbability )
 	{
 		scattered = Ray( hit.p, reflected );
 	}
@@ -4,129 +4,271 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
 #include <ee/math/vec3.h>
 #include <ee/math/Ray.h>
 #include <ee/math/Math.h>
 #include "Traceable.h"
 #include "Texture.h"
+#include "Sampler.h"
 
 using namespace ee;
 
-class Material
+enum class MaterialType : uint8_t
 {
-public:
-	virtual bool Scatter( const Ray& ray, const HitRecord& hit,
-						  vec3& attenuation, Ray& scattered ) const = 0;
+	kLambertian,	// diffuse; albedo is the color
+	kMetal,			// a mirror, blurred by parameter (the fuzziness, 0 to 1)
+	kGlass,			// "dielectric" in "Ray Tracing in One Weekend"; parameter is the refractive index
+	kDiffuseLight	// emits the color, and scatters nothing
+};
 
-	virtual vec3 Emitted( float u, float v, const vec3& p ) const
-	{
-		return vec3( 0.0f, 0.0f, 0.0f );
-	}
+static const uint32_t kMaterialTypeCount = 4;
 
-}; // class Material
+// One entry of a MaterialTable. Every type's parameters are held inline;
+// the color is a texture's value when texture is set.
+struct Material
+{
+	MaterialType	type;
+	float			parameter;
+	vec3			color;
+	const Texture*	texture; // owned by the MaterialTable
+};
+
+// The numbers in [ 0, 1 ) that scattering one hit uses, drawn ahead of
+// time so that hits can be scattered in batches
+struct ScatterSamples
+{
+	float	u[ 3 ];
+};
 
-class Lambertian : public Material
+// One hit to scatter in a batch, and what scattering it gave
+struct ScatterQuery
+{
+	// Input
+	Ray				ray;
+	HitRecord		hit;
+	ScatterSamples	samples;
+
+	// Output
+	vec3			attenuation;
+	Ray				scattered;
+	bool			scatters;
+};
+
+// Every material of a scene, in one contiguous array; primitives refer to
+// them by MaterialId, so any number of primitives can share a material.
+// The functions that evaluate a material switch on its type instead of
+// making virtual calls, and ScatterBatch() scatters many hits on materials
+// of the same type with the switch taken once.
+class MaterialTable
 {
 public:
-	Lambertian( const vec3& albedo )
-	{
-		mAlbedo = new ConstantTexture( albedo );
-	}
+	MaterialTable();
+	~MaterialTable();
 
-	// Takes ownership of the given Texture pointer
-	Lambertian( Texture* albedo )
-		: mAlbedo( albedo )
-	{}
+	// These add a material and return its id. Materials without a texture
+	// that match one already in the table share its id instead.
+	MaterialId AddLambertian( const vec3& albedo );
+	MaterialId AddMetal( const vec3& albedo, float fuzziness );
+	MaterialId AddGlass( float refractiveIndex );
+	MaterialId AddDiffuseLight( const vec3& emitted );
 
-	virtual ~Lambertian()
-	{
-		if( mAlbedo != nullptr )
-			delete mAlbedo;
-	}
+	// These take ownership of the texture
+	MaterialId AddLambertian( Texture* albedo );
+	MaterialId AddDiffuseLight( Texture* emitted );
 
-	// Material interface implementation
+	inline uint32_t GetCount( void ) const;
+	inline const Material& Get( MaterialId id ) const;
 
-	virtual bool Scatter( const Ray& ray, const HitRecord& hit,
-						  vec3& attenuation, Ray& scattered ) const
-	{
-		vec3 target = hit.p + hit.normal + RandomInUnitSphere();
-		scattered = Ray( hit.p, target - hit.p, ray.GetTime() );
-		attenuation = mAlbedo->GetValue( 0.0f, 0.0f, hit.p );
-		return true;
-	}
+	// Scatters ray at hit, drawing from no more than
+	// Sampler::kScatterDimensionCount dimensions of sampler, starting at
+	// its current one. Returns false if the light is absorbed.
+	inline bool Scatter( const Ray& ray, const HitRecord& hit,
+						 vec3& attenuation, Ray& scattered, Sampler& sampler ) const;
+
+	// Draws the samples Scatter() would for a material of the given type
+	static inline void DrawScatterSamples( MaterialType type, Sampler& sampler, ScatterSamples& samples );
+
+	// Scatters queries[ indices[ 0 ] ] to queries[ indices[ count - 1 ] ],
+	// whose hits must all be on materials of the given type
+	void ScatterBatch( MaterialType type, ScatterQuery* queries, const uint32_t* indices, uint32_t count ) const;
+
+	inline vec3 Emitted( MaterialId id, float u, float v, const vec3& p ) const;
+
+	// Whether Emitted() can return anything but black
+	inline bool IsEmitter( MaterialId id ) const;
+
+	// For materials that scatter light over a continuous spread of
+	// directions, and so can be lit by sampling the lights directly:
+	// HasScatteringPdf() returns true, GetScattering() returns the
+	// fraction of the light arriving from direction (a unit vector) that
+	// leaves along -ray per unit solid angle, which is the BRDF times the
+	// cosine of the angle of incidence, and GetScatteringPdf() returns
+	// the probability density per unit solid angle of Scatter() picking
+	// direction. Mirrors and glass, which scatter in only one or two
+	// directions, and fuzzy metal, whose density isn't known, have no
+	// scattering pdf; lights are only found through Scatter() from them.
+	inline bool HasScatteringPdf( MaterialId id ) const;
+	inline vec3 GetScattering( const Ray& ray, const HitRecord& hit, const vec3& direction ) const;
+	inline float GetScatteringPdf( const Ray& ray, const HitRecord& hit, const vec3& direction ) const;
 
 private:
-	Texture* mAlbedo;
+	MaterialId Add( MaterialType type, float parameter, const vec3& color, Texture* texture );
+
+	inline vec3 GetColor( const Material& material, const vec3& p ) const;
+
+	// One function per type, so that a batch of one type needs no switch
+	static inline bool ScatterLambertian( const vec3& albedo, const Ray& ray, const HitRecord& hit,
+										  const ScatterSamples& samples, vec3& attenuation, Ray& scattered );
+	static inline bool ScatterMetal( const Material& material, const Ray& ray, const HitRecord& hit,
+									 const ScatterSamples& samples, vec3& attenuation, Ray& scattered );
+	static bool ScatterGlass( const Material& material, const Ray& ray, const HitRecord& hit,
+							  const ScatterSamples& samples, vec3& attenuation, Ray& scattered );
+
+	std::vector< Material >	mMaterials;
+	std::vector< Texture* >	mTextures;
 
-}; // class Lambertian
+	// The untextured materials, by a hash of their parameters, for sharing
+	std::unordered_map< uint64_t, MaterialId >	mShared;
 
-class Metal : public Material
+}; // class MaterialTable
+
+inline MaterialTable::MaterialTable()
 {
-public:
-	Metal( const vec3& albedo, float fuzziness )
-		: mAlbedo( albedo )
+}
+
+inline uint32_t MaterialTable::GetCount( void ) const
+{
+	return uint32_t( mMaterials.size() );
+}
+
+inline const Material& MaterialTable::Get( MaterialId id ) const
+{
+	return mMaterials[ id ];
+}
+
+inline vec3 MaterialTable::GetColor( const Material& material, const vec3& p ) const
+{
+	return ( material.texture != nullptr ) ? material.texture->GetValue( 0.0f, 0.0f, p ) : material.color;
+}
+
+inline void MaterialTable::DrawScatterSamples( MaterialType type, Sampler& sampler, ScatterSamples& samples )
+{
+	switch( type )
 	{
-		if( fuzziness > 1.0f )
-			mFuzziness = 1.0f;
-		else
-			mFuzziness = fuzziness;
-	}
+	case MaterialType::kLambertian:
+		sampler.Get2D( samples.u[ 0 ], samples.u[ 1 ] );
+		break;
+
+	case MaterialType::kMetal:
+		sampler.Get2D( samples.u[ 0 ], samples.u[ 1 ] );
+		samples.u[ 2 ] = sampler.Get1D();
+		break;
+
+	case MaterialType::kGlass:
+		samples.u[ 0 ] = sampler.Get1D();
+		break;
 
-	// Material interface implementation
+	case MaterialType::kDiffuseLight:
+		break;
 
-	virtual bool Scatter( const Ray& ray, const HitRecord& hit,
-						  vec3& attenuation, Ray& scattered ) const
+	} // switch( type )
+}
+
+inline bool MaterialTable::ScatterLambertian( const vec3& albedo, const Ray& ray, const HitRecord& hit,
+											  const ScatterSamples& samples, vec3& attenuation, Ray& scattered )
+{
+	// The normal plus a random unit vector is cosine distributed about
+	// the normal, which is exactly how a Lambertian surface scatters,
+	// so the albedo is the whole of the attenuation
+	vec3 direction = hit.normal + SampleUnitSphere( samples.u[ 0 ], samples.u[ 1 ] );
+	if( direction.LengthSquared() < 1e-8f )
 	{
-		vec3 reflected = Reflect( ray.GetDirection().GetNormalized(), hit.normal );
-		scattered = Ray( hit.p, reflected + mFuzziness * RandomInUnitSphere() );
-		attenuation = mAlbedo;
-		return Dot( scattered.GetDirection(), hit.normal ) > 0.0f;
+		direction = hit.normal; // the unit vector was almost -normal
 	}
 
-private:
-	vec3	mAlbedo;
-	float	mFuzziness;
+	scattered = Ray( hit.p, direction, ray.GetTime() );
+	attenuation = albedo;
+	return true;
+}
 
-}; // class Metal
+inline bool MaterialTable::ScatterMetal( const Material& material, const Ray& ray, const HitRecord& hit,
+										 const ScatterSamples& samples, vec3& attenuation, Ray& scattered )
+{
+	vec3 reflected = Reflect( ray.GetDirection().GetNormalized(), hit.normal );
+	scattered = Ray( hit.p, reflected + material.parameter * SampleUnitBall( samples.u[ 0 ], samples.u[ 1 ], samples.u[ 2 ] ) );
+	attenuation = material.color;
+	return Dot( scattered.GetDirection(), hit.normal ) > 0.0f;
+}
 
-// This class is called dialetric in "Ray Tracing in One Weekend"
-class Glass : public Material
+inline bool MaterialTable::Scatter( const Ray& ray, const HitRecord& hit,
+									vec3& attenuation, Ray& scattered, Sampler& sampler ) const
 {
-public:
-	Glass( float index )
-		: mRefractIndex( index )
-	{}
+	const Material& material = mMaterials[ hit.material ];
+
+	ScatterSamples samples;
+	DrawScatterSamples( material.type, sampler, samples );
 
-	// Material interface implementation
+	switch( material.type )
+	{
+	case MaterialType::kLambertian:
+		return ScatterLambertian( GetColor( material, hit.p ), ray, hit, samples, attenuation, scattered );
 
-	virtual bool Scatter( const Ray& ray, const HitRecord& hit,
-						  vec3& attenuation, Ray& scattered ) const;
+	case MaterialType::kMetal:
+		return ScatterMetal( material, ray, hit, samples, attenuation, scattered );
 
-private:
-	float mRefractIndex;
+	case MaterialType::kGlass:
+		return ScatterGlass( material, ray, hit, samples, attenuation, scattered );
 
-}; // class Glass
+	case MaterialType::kDiffuseLight:
+		return false;
+
+	} // switch( material.type )
 
-class DiffuseLight : public Material
+	return false;
+}
+
+inline vec3 MaterialTable::Emitted( MaterialId id, float u, float v, const vec3& p ) const
 {
-public:
-	DiffuseLight() : mEmitter( nullptr ) {}
-	DiffuseLight( Texture* emitter ) : mEmitter( emitter ) {}
+	const Material& material = mMaterials[ id ];
+	if( material.type != MaterialType::kDiffuseLight )
+		return vec3( 0.0f, 0.0f, 0.0f );
 
-	// Material interface implementation
+	return ( material.texture != nullptr ) ? material.texture->GetValue( u, v, p ) : material.color;
+}
 
-	virtual bool Scatter( const Ray& ray, const HitRecord& hit,
-						  vec3& attenuation, Ray& scattered ) const
-	{
-		return false;
-	}
+inline bool MaterialTable::IsEmitter( MaterialId id ) const
+{
+	return mMaterials[ id ].type == MaterialType::kDiffuseLight;
+}
 
-	virtual vec3 Emitted( float u, float v, const vec3& p ) const
-	{
-		return mEmitter->GetValue( u, v, p );
-	}
+inline bool MaterialTable::HasScatteringPdf( MaterialId id ) const
+{
+	return mMaterials[ id ].type == MaterialType::kLambertian;
+}
 
-private:
-	Texture* mEmitter;
+inline vec3 MaterialTable::GetScattering( const Ray& ray, const HitRecord& hit, const vec3& direction ) const
+{
+	const Material& material = mMaterials[ hit.material ];
+	if( material.type != MaterialType::kLambertian )
+		return vec3( 0.0f, 0.0f, 0.0f );
+
+	// albedo / pi is the Lambertian BRDF
+	float cosine = Dot( hit.normal, direction );
+	if( cosine <= 0.0f )
+		return vec3( 0.0f, 0.0f, 0.0f );
+
+	return GetColor( material, hit.p ) * ( cosine / float( M_PI ) );
+}
+
+inline float MaterialTable::GetScatteringPdf( const Ray& ray, const HitRecord& hit, const vec3& direction ) const
+{
+	if( mMaterials[ hit.material ].type != MaterialType::kLambertian )
+		return 0.0f;
 
-}; // DiffuseLight
+	float cosine = Dot( hit.normal, direction );
+	return cosine > 0.0f ? cosine / float( M_PI ) : 0.0f;
+}
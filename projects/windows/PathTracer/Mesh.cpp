@@ -0,0 +1,530 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include <cmath>
+#include <chrono>
+#include <utility>
+
+#if defined( EE_BUILD_X86 )
+#  include <immintrin.h>
+#endif
+
+#include "Mesh.h"
+
+#include <ee/core/Debug.h>
+#include <ee/math/AABB.h>
+#include <ee/math/Math.h>
+
+// A ray set up for the watertight ray/triangle test of Woop, Benthin and
+// Wald, "Watertight Ray/Triangle Intersection" (JCGT 2013). The axes are
+// renamed so that the ray's direction is longest along z, and vertices
+// are sheared so that the ray runs down the z axis from the origin; then
+// the ray hits a triangle where the 2D edge functions of its sheared
+// vertices agree in sign. Triangles that share an edge work its edge
+// function out from the same two vertices, so a ray crossing the edge
+// hits at least one of them, and can't slip through the crack.
+struct ShearedRay
+{
+	vec3	origin;
+	int		kx, ky, kz;
+	float	sx, sy, sz;
+
+	inline void Initialize( const Ray& r );
+
+}; // struct ShearedRay
+
+inline void ShearedRay::Initialize( const Ray& r )
+{
+	const vec3& direction = r.GetDirection();
+	origin = r.GetOrigin();
+
+	kz = 0;
+	if( fabsf( direction.y ) > fabsf( direction[ kz ] ) )
+		kz = 1;
+	if( fabsf( direction.z ) > fabsf( direction[ kz ] ) )
+		kz = 2;
+
+	kx = ( kz + 1 ) % 3;
+	ky = ( kx + 1 ) % 3;
+
+	// Keep the triangles' winding when the ray runs down the new z axis
+	if( direction[ kz ] < 0.0f )
+		std::swap( kx, ky );
+
+	sx = direction[ kx ] / direction[ kz ];
+	sy = direction[ ky ] / direction[ kz ];
+	sz = 1.0f / direction[ kz ];
+}
+
+// Tests ray against triangles [ first, first + count ) of data, count being
+// at most Mesh::kBatchWidth, and returns a bitmask of those hit in
+// (t_min, t_max), with their distances in t and the barycentric weights
+// of their second and third vertices in u and v
+static inline uint32_t IntersectBatch( const ShearedRay& ray, const MeshData& data, uint32_t first, uint32_t count,
+									   float t_min, float t_max, float* t, float* u, float* v )
+{
+	static const uint32_t kWidth = Mesh::kBatchWidth;
+
+	alignas( 32 ) float ax[ kWidth ], ay[ kWidth ], az[ kWidth ];
+	alignas( 32 ) float bx[ kWidth ], by[ kWidth ], bz[ kWidth ];
+	alignas( 32 ) float cx[ kWidth ], cy[ kWidth ], cz[ kWidth ];
+
+	// Gather the triangles' vertices relative to the ray's origin, sheared;
+	// lanes past count repeat the first triangle
+	for( uint32_t lane = 0; lane < kWidth; ++lane )
+	{
+		const uint32_t* triangle = &data.indices[ 3 * ( first + ( lane < count ? lane : 0 ) ) ];
+		const vec3 a = data.positions[ triangle[ 0 ] ] - ray.origin;
+		const vec3 b = data.positions[ triangle[ 1 ] ] - ray.origin;
+		const vec3 c = data.positions[ triangle[ 2 ] ] - ray.origin;
+
+		ax[ lane ] = a[ ray.kx ] - ray.sx * a[ ray.kz ];
+		ay[ lane ] = a[ ray.ky ] - ray.sy * a[ ray.kz ];
+		az[ lane ] = ray.sz * a[ ray.kz ];
+		bx[ lane ] = b[ ray.kx ] - ray.sx * b[ ray.kz ];
+		by[ lane ] = b[ ray.ky ] - ray.sy * b[ ray.kz ];
+		bz[ lane ] = ray.sz * b[ ray.kz ];
+		cx[ lane ] = c[ ray.kx ] - ray.sx * c[ ray.kz ];
+		cy[ lane ] = c[ ray.ky ] - ray.sy * c[ ray.kz ];
+		cz[ lane ] = ray.sz * c[ ray.kz ];
+	}
+
+	// The edge functions, which are each the barycentric weight of the
+	// vertex opposite the edge, scaled by the determinant
+	alignas( 32 ) float edgeU[ kWidth ], edgeV[ kWidth ], edgeW[ kWidth ];
+	uint32_t onEdge = 0;
+
+#if defined( EE_BUILD_X86 ) && defined( __AVX__ )
+	__m256 U = _mm256_sub_ps( _mm256_mul_ps( _mm256_load_ps( cx ), _mm256_load_ps( by ) ),
+							  _mm256_mul_ps( _mm256_load_ps( cy ), _mm256_load_ps( bx ) ) );
+	__m256 V = _mm256_sub_ps( _mm256_mul_ps( _mm256_load_ps( ax ), _mm256_load_ps( cy ) ),
+							  _mm256_mul_ps( _mm256_load_ps( ay ), _mm256_load_ps( cx ) ) );
+	__m256 W = _mm256_sub_ps( _mm256_mul_ps( _mm256_load_ps( bx ), _mm256_load_ps( ay ) ),
+							  _mm256_mul_ps( _mm256_load_ps( by ), _mm256_load_ps( ax ) ) );
+
+	const __m256 zero = _mm256_setzero_ps();
+	onEdge = uint32_t( _mm256_movemask_ps( _mm256_or_ps( _mm256_or_ps( _mm256_cmp_ps( U, zero, _CMP_EQ_OQ ),
+																		_mm256_cmp_ps( V, zero, _CMP_EQ_OQ ) ),
+														  _mm256_cmp_ps( W, zero, _CMP_EQ_OQ ) ) ) );
+
+	_mm256_store_ps( edgeU, U );
+	_mm256_store_ps( edgeV, V );
+	_mm256_store_ps( edgeW, W );
+#elif defined( EE_BUILD_X86 )
+	__m128 U = _mm_sub_ps( _mm_mul_ps( _mm_load_ps( cx ), _mm_load_ps( by ) ),
+						   _mm_mul_ps( _mm_load_ps( cy ), _mm_load_ps( bx ) ) );
+	__m128 V = _mm_sub_ps( _mm_mul_ps( _mm_load_ps( ax ), _mm_load_ps( cy ) ),
+						   _mm_mul_ps( _mm_load_ps( ay ), _mm_load_ps( cx ) ) );
+	__m128 W = _mm_sub_ps( _mm_mul_ps( _mm_load_ps( bx ), _mm_load_ps( ay ) ),
+						   _mm_mul_ps( _mm_load_ps( by ), _mm_load_ps( ax ) ) );
+
+	const __m128 zero = _mm_setzero_ps();
+	onEdge = uint32_t( _mm_movemask_ps( _mm_or_ps( _mm_or_ps( _mm_cmpeq_ps( U, zero ), _mm_cmpeq_ps( V, zero ) ),
+												   _mm_cmpeq_ps( W, zero ) ) ) );
+
+	_mm_store_ps( edgeU, U );
+	_mm_store_ps( edgeV, V );
+	_mm_store_ps( edgeW, W );
+#else
+	for( uint32_t lane = 0; lane < kWidth; ++lane )
+	{
+		edgeU[ lane ] = cx[ lane ] * by[ lane ] - cy[ lane ] * bx[ lane ];
+		edgeV[ lane ] = ax[ lane ] * cy[ lane ] - ay[ lane ] * cx[ lane ];
+		edgeW[ lane ] = bx[ lane ] * ay[ lane ] - by[ lane ] * ax[ lane ];
+
+		if( ( edgeU[ lane ] == 0.0f ) || ( edgeV[ lane ] == 0.0f ) || ( edgeW[ lane ] == 0.0f ) )
+		{
+			onEdge |= 1u << lane;
+		}
+	}
+#endif
+
+	// An edge function is only zero when the ray passes through the edge
+	// or a vertex, or when rounding made it so; working those out again
+	// in double precision settles which side of the edge the ray is on
+	onEdge &= ( 1u << count ) - 1;
+
+	while( onEdge != 0 )
+	{
+		uint32_t lane = 0;
+		while( ( onEdge & ( 1u << lane ) ) == 0 )
+		{
+			++lane;
+		}
+		onEdge &= onEdge - 1;
+
+		edgeU[ lane ] = float( double( cx[ lane ] ) * double( by[ lane ] ) - double( cy[ lane ] ) * double( bx[ lane ] ) );
+		edgeV[ lane ] = float( double( ax[ lane ] ) * double( cy[ lane ] ) - double( ay[ lane ] ) * double( cx[ lane ] ) );
+		edgeW[ lane ] = float( double( bx[ lane ] ) * double( ay[ lane ] ) - double( by[ lane ] ) * double( ax[ lane ] ) );
+	}
+
+	// The ray hits a triangle if its edge functions don't differ in sign
+	// and aren't all zero; the hit's distance is the sheared z coordinate
+	// interpolated with them
+#if defined( EE_BUILD_X86 ) && defined( __AVX__ )
+	U = _mm256_load_ps( edgeU );
+	V = _mm256_load_ps( edgeV );
+	W = _mm256_load_ps( edgeW );
+
+	__m256 negative = _mm256_or_ps( _mm256_or_ps( _mm256_cmp_ps( U, zero, _CMP_LT_OQ ), _mm256_cmp_ps( V, zero, _CMP_LT_OQ ) ),
+									_mm256_cmp_ps( W, zero, _CMP_LT_OQ ) );
+	__m256 positive = _mm256_or_ps( _mm256_or_ps( _mm256_cmp_ps( U, zero, _CMP_GT_OQ ), _mm256_cmp_ps( V, zero, _CMP_GT_OQ ) ),
+									_mm256_cmp_ps( W, zero, _CMP_GT_OQ ) );
+
+	__m256 determinant = _mm256_add_ps( _mm256_add_ps( U, V ), W );
+	__m256 T = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( U, _mm256_load_ps( az ) ), _mm256_mul_ps( V, _mm256_load_ps( bz ) ) ),
+							  _mm256_mul_ps( W, _mm256_load_ps( cz ) ) );
+	__m256 inverse = _mm256_div_ps( _mm256_set1_ps( 1.0f ), determinant );
+	__m256 distance = _mm256_mul_ps( T, inverse );
+
+	__m256 hit = _mm256_and_ps( _mm256_cmp_ps( determinant, zero, _CMP_NEQ_OQ ),
+								_mm256_and_ps( _mm256_cmp_ps( distance, _mm256_set1_ps( t_min ), _CMP_GT_OQ ),
+											   _mm256_cmp_ps( distance, _mm256_set1_ps( t_max ), _CMP_LT_OQ ) ) );
+	hit = _mm256_andnot_ps( _mm256_and_ps( negative, positive ), hit );
+
+	_mm256_storeu_ps( t, distance );
+	_mm256_storeu_ps( u, _mm256_mul_ps( V, inverse ) );
+	_mm256_storeu_ps( v, _mm256_mul_ps( W, inverse ) );
+
+	return uint32_t( _mm256_movemask_ps( hit ) ) & ( ( 1u << count ) - 1 );
+#elif defined( EE_BUILD_X86 )
+	U = _mm_load_ps( edgeU );
+	V = _mm_load_ps( edgeV );
+	W = _mm_load_ps( edgeW );
+
+	__m128 negative = _mm_or_ps( _mm_or_ps( _mm_cmplt_ps( U, zero ), _mm_cmplt_ps( V, zero ) ), _mm_cmplt_ps( W, zero ) );
+	__m128 positive = _mm_or_ps( _mm_or_ps( _mm_cmpgt_ps( U, zero ), _mm_cmpgt_ps( V, zero ) ), _mm_cmpgt_ps( W, zero ) );
+
+	__m128 determinant = _mm_add_ps( _mm_add_ps( U, V ), W );
+	__m128 T = _mm_add_ps( _mm_add_ps( _mm_mul_ps( U, _mm_load_ps( az ) ), _mm_mul_ps( V, _mm_load_ps( bz ) ) ),
+						   _mm_mul_ps( W, _mm_load_ps( cz ) ) );
+	__m128 inverse = _mm_div_ps( _mm_set1_ps( 1.0f ), determinant );
+	__m128 distance = _mm_mul_ps( T, inverse );
+
+	__m128 hit = _mm_and_ps( _mm_cmpneq_ps( determinant, zero ),
+							 _mm_and_ps( _mm_cmpgt_ps( distance, _mm_set1_ps( t_min ) ),
+										 _mm_cmplt_ps( distance, _mm_set1_ps( t_max ) ) ) );
+	hit = _mm_andnot_ps( _mm_and_ps( negative, positive ), hit );
+
+	_mm_storeu_ps( t, distance );
+	_mm_storeu_ps( u, _mm_mul_ps( V, inverse ) );
+	_mm_storeu_ps( v, _mm_mul_ps( W, inverse ) );
+
+	return uint32_t( _mm_movemask_ps( hit ) ) & ( ( 1u << count ) - 1 );
+#else
+	uint32_t mask = 0;
+
+	for( uint32_t lane = 0; lane < count; ++lane )
+	{
+		const float U = edgeU[ lane ];
+		const float V = edgeV[ lane ];
+		const float W = edgeW[ lane ];
+
+		if( ( ( U < 0.0f ) || ( V < 0.0f ) || ( W < 0.0f ) ) && ( ( U > 0.0f ) || ( V > 0.0f ) || ( W > 0.0f ) ) )
+			continue;
+
+		const float determinant = U + V + W;
+		if( determinant == 0.0f )
+			continue;
+
+		const float inverse = 1.0f / determinant;
+		t[ lane ] = ( U * az[ lane ] + V * bz[ lane ] + W * cz[ lane ] ) * inverse;
+		u[ lane ] = V * inverse;
+		v[ lane ] = W * inverse;
+
+		if( ( t[ lane ] > t_min ) && ( t[ lane ] < t_max ) )
+		{
+			mask |= 1u << lane;
+		}
+	}
+
+	return mask;
+#endif
+}
+
+// Returns false, with the reason in the debug output, if data has no
+// triangles, or an index that's out of range of its buffer
+static bool IsValid( const MeshData& data )
+{
+	const uint32_t triangleCount = data.GetTriangleCount();
+	if( ( triangleCount == 0 ) || ( data.indices.size() != 3 * size_t( triangleCount ) ) )
+	{
+		eeDebug( "Mesh::Initialize: the mesh has no triangles, or a partial one\n" );
+		return false;
+	}
+
+	// Each attribute's indices must be in range of its buffer
+	auto checkIndices = [&]( const std::vector< uint32_t >& indices, size_t vertexCount, const char* name )
+	{
+		if( indices.empty() )
+			return true; // an attribute the mesh doesn't have
+
+		if( indices.size() != data.indices.size() )
+		{
+			eeDebug( "Mesh::Initialize: there are %zu %s indices for %u triangles\n", indices.size(), name, triangleCount );
+			return false;
+		}
+
+		for( uint32_t index : indices )
+		{
+			if( index >= vertexCount )
+			{
+				eeDebug( "Mesh::Initialize: %s index %u is out of range; there are %zu\n", name, index, vertexCount );
+				return false;
+			}
+		}
+
+		return true;
+	};
+
+	if( !checkIndices( data.indices, data.positions.size(), "position" ) ||
+		!checkIndices( data.normalIndices, data.normals.size(), "normal" ) ||
+		!checkIndices( data.uvIndices, data.uvs.size() / 2, "texture coordinate" ) )
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool Mesh::Initialize( MeshData&& data, MaterialId material, const BVHBuildOptions& options )
+{
+	if( !IsValid( data ) )
+		return false;
+
+	const uint32_t triangleCount = data.GetTriangleCount();
+
+	mData = std::move( data );
+	mMaterial = material;
+
+	// The BVH's slab tests are strict, so a ray that only touches a box, on
+	// its edge or corner, misses it. Vertices are on the corners of their
+	// triangles' boxes, and triangles in an axis-aligned plane have flat
+	// boxes, so the boxes are padded by a little more than rounding could
+	// lose, relative to the size of the mesh, to keep rays through the
+	// vertices and edges from slipping through.
+	vec3 meshLower = mData.positions[ mData.indices[ 0 ] ];
+	vec3 meshUpper = meshLower;
+
+	for( const vec3& position : mData.positions )
+	{
+		for( int a = 0; a < 3; ++a )
+		{
+			meshLower[ a ] = eeMin( meshLower[ a ], position[ a ] );
+			meshUpper[ a ] = eeMax( meshUpper[ a ], position[ a ] );
+		}
+	}
+
+	const vec3 extent = meshUpper - meshLower;
+	float pad = 1e-5f * eeMax( extent.x, extent.y, extent.z );
+	if( !( pad > 0.0f ) )
+	{
+		pad = 0.0001f; // as xyRect pads its flat box
+	}
+
+	const vec3 padding( pad, pad, pad );
+	std::vector< AABB > bounds( triangleCount );
+
+	for( uint32_t i = 0; i < triangleCount; ++i )
+	{
+		const vec3& p0 = mData.positions[ mData.indices[ 3 * i ] ];
+		const vec3& p1 = mData.positions[ mData.indices[ 3 * i + 1 ] ];
+		const vec3& p2 = mData.positions[ mData.indices[ 3 * i + 2 ] ];
+
+		vec3 lower, upper;
+		for( int a = 0; a < 3; ++a )
+		{
+			lower[ a ] = eeMin( p0[ a ], p1[ a ], p2[ a ] );
+			upper[ a ] = eeMax( p0[ a ], p1[ a ], p2[ a ] );
+		}
+
+		bounds[ i ] = AABB( lower - padding, upper + padding );
+	}
+
+	auto buildStart = std::chrono::steady_clock::now();
+
+	// Leaves' triangles are intersected a batch at a time
+	BVHBuildOptions bvhOptions = options;
+	bvhOptions.maxLeafSize = eeMax( bvhOptions.maxLeafSize, kBatchWidth );
+	bvhOptions.intersectionBatchSize = eeMax( bvhOptions.intersectionBatchSize, kBatchWidth );
+
+	if( !mBVH.Build( bounds.data(), triangleCount, bvhOptions ) )
+		return false;
+
+	std::chrono::duration< double, std::milli > buildTime = std::chrono::steady_clock::now() - buildStart;
+
+	eeDebug( "Mesh: built a BVH over %u triangles in %.3f ms: %u nodes, depth %u, SAH cost %.2f\n",
+			 triangleCount, buildTime.count(), mBVH.GetNodeCount(), mBVH.GetMaxDepth(), mBVH.GetSAHCost() );
+
+	// Store the triangles in leaf order so each leaf's are contiguous
+	const uint32_t* order = mBVH.GetPrimitiveIndices();
+
+	auto reorder = [&]( std::vector< uint32_t >& indices )
+	{
+		if( indices.empty() )
+			return;
+
+		std::vector< uint32_t > reordered( indices.size() );
+		for( uint32_t i = 0; i < triangleCount; ++i )
+		{
+			reordered[ 3 * i ] = indices[ 3 * order[ i ] ];
+			reordered[ 3 * i + 1 ] = indices[ 3 * order[ i ] + 1 ];
+			reordered[ 3 * i + 2 ] = indices[ 3 * order[ i ] + 2 ];
+		}
+
+		indices.swap( reordered );
+	};
+
+	reorder( mData.indices );
+	reorder( mData.normalIndices );
+	reorder( mData.uvIndices );
+
+	return true;
+}
+
+bool Mesh::Initialize( MeshData&& data, MaterialId material, const LinearBVH& bvh )
+{
+	if( !IsValid( data ) )
+		return false;
+
+	if( bvh.GetPrimitiveCount() != data.GetTriangleCount() )
+	{
+		eeDebug( "Mesh::Initialize: the BVH is over %u triangles, but the mesh has %u\n", bvh.GetPrimitiveCount(),
+				 data.GetTriangleCount() );
+		return false;
+	}
+
+	mData = std::move( data );
+	mMaterial = material;
+	mBVH = bvh;
+
+	return true;
+}
+
+bool Mesh::Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const
+{
+	ShearedRay ray;
+	ray.Initialize( r );
+
+	auto leafHit = [&]( uint32_t first, uint32_t count, float t_min, float& t_max )
+	{
+		bool hitLeaf = false;
+
+		for( uint32_t batch = first; batch < first + count; batch += kBatchWidth )
+		{
+			const uint32_t remaining = first + count - batch;
+
+			float t[ kBatchWidth ], u[ kBatchWidth ], v[ kBatchWidth ];
+			uint32_t mask = IntersectBatch( ray, mData, batch, remaining < kBatchWidth ? remaining : kBatchWidth,
+											t_min, t_max, t, u, v );
+
+			// Lowest first, as in SphereSet::Intersect()
+			while( mask != 0 )
+			{
+				uint32_t i = 0;
+				while( ( mask & ( 1u << i ) ) == 0 )
+				{
+					++i;
+				}
+				mask &= mask - 1;
+
+				if( t[ i ] < t_max )
+				{
+					t_max = t[ i ];
+					hit.t = t[ i ];
+					hit.u = u[ i ];
+					hit.v = v[ i ];
+					hit.index = batch + i;
+					hit.object = this;
+					hitLeaf = true;
+				}
+			}
+		}
+
+		return hitLeaf;
+	};
+
+	return mBVH.Hit( r, t_min, t_max, leafHit );
+}
+
+bool Mesh::Occluded( const Ray& r, float t_min, float t_max ) const
+{
+	ShearedRay ray;
+	ray.Initialize( r );
+
+	auto leafOccluded = [&]( uint32_t first, uint32_t count, float t_min, float t_max )
+	{
+		for( uint32_t batch = first; batch < first + count; batch += kBatchWidth )
+		{
+			const uint32_t remaining = first + count - batch;
+
+			float t[ kBatchWidth ], u[ kBatchWidth ], v[ kBatchWidth ];
+			if( IntersectBatch( ray, mData, batch, remaining < kBatchWidth ? remaining : kBatchWidth,
+								t_min, t_max, t, u, v ) != 0 )
+			{
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	return mBVH.Occluded( r, t_min, t_max, leafOccluded );
+}
+
+void Mesh::FinalizeHit( const Ray& r, const RayHit& hit, HitRecord& rec ) const
+{
+	const uint32_t corner = 3 * hit.index;
+	const float w = 1.0f - hit.u - hit.v; // the first vertex's weight
+
+	const vec3& p0 = mData.positions[ mData.indices[ corner ] ];
+	const vec3& p1 = mData.positions[ mData.indices[ corner + 1 ] ];
+	const vec3& p2 = mData.positions[ mData.indices[ corner + 2 ] ];
+
+	rec.t = hit.t;
+	rec.p = r.PointAtParameter( hit.t );
+	rec.normal = Cross( p1 - p0, p2 - p0 ).GetNormalized();
+
+	// Smooth shading, where the mesh has vertex normals
+	if( !mData.normalIndices.empty() )
+	{
+		vec3 normal = w * mData.normals[ mData.normalIndices[ corner ] ] +
+					  hit.u * mData.normals[ mData.normalIndices[ corner + 1 ] ] +
+					  hit.v * mData.normals[ mData.normalIndices[ corner + 2 ] ];
+
+		if( normal.LengthSquared() > 0.0f )
+		{
+			rec.normal = normal.GetNormalized();
+		}
+	}
+
+	if( !mData.uvIndices.empty() )
+	{
+		const float* uv0 = &mData.uvs[ 2 * mData.uvIndices[ corner ] ];
+		const float* uv1 = &mData.uvs[ 2 * mData.uvIndices[ corner + 1 ] ];
+		const float* uv2 = &mData.uvs[ 2 * mData.uvIndices[ corner + 2 ] ];
+
+		rec.u = w * uv0[ 0 ] + hit.u * uv1[ 0 ] + hit.v * uv2[ 0 ];
+		rec.v = w * uv0[ 1 ] + hit.u * uv1[ 1 ] + hit.v * uv2[ 1 ];
+	}
+	else
+	{
+		rec.u = hit.u;
+		rec.v = hit.v;
+	}
+
+	rec.material = mMaterial;
+	rec.object = this;
+}
+
+bool Mesh::GetBoundingBox( float t0, float t1, AABB& box ) const
+{
+	if( mBVH.IsEmpty() )
+		return false;
+
+	box = mBVH.GetBounds();
+	return true;
+}
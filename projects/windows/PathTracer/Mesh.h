@@ -0,0 +1,113 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <ee/math/vec3.h>
+#include <ee/math/AABB.h>
+
+#include "Traceable.h"
+#include "LinearBVH.h"
+
+using namespace ee;
+
+// The vertices and triangles of a mesh, as ObjReader reads them. Each
+// vertex attribute has its own buffer and its own indices, as in an OBJ
+// file, so vertices that share a position but not a normal or texture
+// coordinate don't have to be duplicated.
+struct MeshData
+{
+	std::vector< vec3 >		positions;
+	std::vector< vec3 >		normals;	// optional
+	std::vector< float >	uvs;		// optional; a u and a v per texture coordinate
+
+	// Three per triangle, counterclockwise seen from the front. indices
+	// index positions; normalIndices and uvIndices are either empty or
+	// one per entry of indices.
+	std::vector< uint32_t >	indices;
+	std::vector< uint32_t >	normalIndices;
+	std::vector< uint32_t >	uvIndices;
+
+	inline uint32_t GetTriangleCount( void ) const;
+
+}; // struct MeshData
+
+// A triangle mesh with one material. The triangles share the vertex
+// buffers of a MeshData, and have a BVH of their own whose leaves
+// reference ranges of triangles; the triangles are stored in leaf order.
+// The scene's BVH sees the whole mesh as one primitive.
+class Mesh : public Traceable
+{
+public:
+	// The number of triangles tested at once: 8 with AVX, 4 otherwise
+#if defined( EE_BUILD_X86 ) && defined( __AVX__ )
+	static const uint32_t kBatchWidth = 8;
+#else
+	static const uint32_t kBatchWidth = 4;
+#endif
+
+	Mesh();
+
+	// Takes data's buffers and builds the BVH over its triangles.
+	// Returns false if data has no triangles, or an index that's out of
+	// range of its buffer.
+	bool Initialize( MeshData&& data, MaterialId material, const BVHBuildOptions& options = BVHBuildOptions() );
+
+	// Takes data's buffers, whose triangles must already be in the leaf
+	// order of bvh, and a copy of bvh rather than building a BVH; they're
+	// what GetData() and GetBVH() return for a mesh that was initialized
+	// from its triangles
+	bool Initialize( MeshData&& data, MaterialId material, const LinearBVH& bvh );
+
+	// Traceable interface implementation
+
+	// The triangles are intersected with the watertight test of Woop,
+	// Benthin and Wald, so rays can't slip through the edges triangles share
+	virtual bool Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const;
+	virtual void FinalizeHit( const Ray& r, const RayHit& hit, HitRecord& rec ) const;
+
+	virtual bool Occluded( const Ray& r, float t_min, float t_max ) const;
+
+	virtual bool GetBoundingBox( float t0, float t1, AABB& box ) const;
+
+	// Mesh member functions
+
+	inline const MeshData& GetData( void ) const;
+	inline uint32_t GetTriangleCount( void ) const;
+	inline const LinearBVH& GetBVH( void ) const;
+
+private:
+	MeshData	mData;
+	LinearBVH	mBVH;
+	MaterialId	mMaterial;
+
+}; // class Mesh
+
+inline uint32_t MeshData::GetTriangleCount( void ) const
+{
+	return uint32_t( indices.size() / 3 );
+}
+
+inline Mesh::Mesh()
+	: mMaterial( 0 )
+{
+}
+
+inline const MeshData& Mesh::GetData( void ) const
+{
+	return mData;
+}
+
+inline uint32_t Mesh::GetTriangleCount( void ) const
+{
+	return mData.GetTriangleCount();
+}
+
+inline const LinearBVH& Mesh::GetBVH( void ) const
+{
+	return mBVH;
+}
@@ -0,0 +1,469 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <thread>
+
+#include "ObjReader.h"
+#include "LineReader.h"
+
+#include <ee/core/Debug.h>
+#include <ee/io/FileInputStream.h>
+
+// An index as a face gives it: final if the file counts it from its first
+// vertex; if it counts back from the last vertex defined so far, relative
+// to the first vertex of the chunk the face is in, wrapping below zero
+// for vertices of earlier chunks
+struct ObjIndex
+{
+	uint32_t	value;
+	bool		relative;
+};
+
+// One chunk of an OBJ file, and what parsing it found. Relative indices
+// can only be made final once it's known how many vertices the chunks
+// before this one define, so where each one is stored is listed for
+// ObjReader::Merge() to add that count to.
+struct ObjChunk : public TextChunk
+{
+	std::vector< vec3 >		positions;
+	std::vector< vec3 >		normals;
+	std::vector< float >	uvs;
+
+	// Only the faces that have normals or texture coordinates add to
+	// normalIndices and uvIndices
+	std::vector< uint32_t >	indices;
+	std::vector< uint32_t >	normalIndices;
+	std::vector< uint32_t >	uvIndices;
+
+	std::vector< uint32_t >	relativeIndices;
+	std::vector< uint32_t >	relativeNormalIndices;
+	std::vector< uint32_t >	relativeUVIndices;
+
+	// Where Merge() puts this chunk's data in the MeshData
+	size_t		firstPosition, firstNormal, firstUV;
+	size_t		firstIndex, firstNormalIndex, firstUVIndex;
+
+	bool ParseLine( const char* p, const char* end ) override;
+	bool ParseFace( const char* p, const char* end );
+
+	inline void AddIndex( std::vector< uint32_t >& indices, std::vector< uint32_t >& relative, const ObjIndex& index );
+
+}; // struct ObjChunk
+
+// Parses one of a face's indices into a buffer that holds count entries
+// so far
+static inline bool ParseIndex( const char*& p, const char* end, size_t count, ObjIndex& index )
+{
+	int64_t value;
+	std::from_chars_result result = std::from_chars( p, end, value );
+	if( ( result.ec != std::errc() ) || ( value == 0 ) )
+		return false;
+
+	p = result.ptr;
+
+	if( value > 0 )
+	{
+		index.value = uint32_t( value - 1 );
+		index.relative = false;
+	}
+	else
+	{
+		index.value = uint32_t( int64_t( count ) + value );
+		index.relative = true;
+	}
+
+	return true;
+}
+
+bool ObjChunk::ParseLine( const char* p, const char* end )
+{
+	end = FindComment( p, end );
+
+	p = SkipSpace( p, end );
+	if( p == end )
+		return true;
+
+	const char* keyword = p;
+	while( ( p < end ) && ( *p != ' ' ) && ( *p != '\t' ) && ( *p != '\r' ) )
+	{
+		++p;
+	}
+
+	const size_t length = p - keyword;
+
+	if( ( length == 1 ) && ( keyword[ 0 ] == 'v' ) )
+	{
+		vec3 position;
+		if( !ParseFloat( p, end, position.x ) || !ParseFloat( p, end, position.y ) || !ParseFloat( p, end, position.z ) )
+		{
+			error = "a vertex position needs three coordinates";
+			return false;
+		}
+
+		positions.push_back( position );
+	}
+	else if( ( length == 2 ) && ( keyword[ 0 ] == 'v' ) && ( keyword[ 1 ] == 'n' ) )
+	{
+		vec3 normal;
+		if( !ParseFloat( p, end, normal.x ) || !ParseFloat( p, end, normal.y ) || !ParseFloat( p, end, normal.z ) )
+		{
+			error = "a vertex normal needs three coordinates";
+			return false;
+		}
+
+		normals.push_back( normal );
+	}
+	else if( ( length == 2 ) && ( keyword[ 0 ] == 'v' ) && ( keyword[ 1 ] == 't' ) )
+	{
+		float u, v = 0.0f;
+		if( !ParseFloat( p, end, u ) )
+		{
+			error = "a texture coordinate needs at least a u coordinate";
+			return false;
+		}
+
+		ParseFloat( p, end, v );
+
+		uvs.push_back( u );
+		uvs.push_back( v );
+	}
+	else if( ( length == 1 ) && ( keyword[ 0 ] == 'f' ) )
+	{
+		return ParseFace( p, end );
+	}
+
+	// Anything else is ignored
+	return true;
+}
+
+bool ObjChunk::ParseFace( const char* p, const char* end )
+{
+	// The corners are v, v/vt, v//vn or v/vt/vn; every corner of a face
+	// must have the same form. Faces are split into fans of triangles
+	// around their first corner.
+	ObjIndex first[ 3 ], previous[ 3 ], corner[ 3 ];
+	bool hasUV = false;
+	bool hasNormal = false;
+	uint32_t cornerCount = 0;
+
+	for( ;; )
+	{
+		p = SkipSpace( p, end );
+		if( p == end )
+			break;
+
+		if( !ParseIndex( p, end, positions.size(), corner[ 0 ] ) )
+		{
+			error = "a face has a missing or invalid vertex index";
+			return false;
+		}
+
+		bool cornerHasUV = false;
+		bool cornerHasNormal = false;
+
+		if( ( p < end ) && ( *p == '/' ) )
+		{
+			++p;
+
+			if( ( p < end ) && ( *p != '/' ) )
+			{
+				if( !ParseIndex( p, end, uvs.size() / 2, corner[ 1 ] ) )
+				{
+					error = "a face has an invalid texture coordinate index";
+					return false;
+				}
+
+				cornerHasUV = true;
+			}
+
+			if( ( p < end ) && ( *p == '/' ) )
+			{
+				++p;
+
+				if( !ParseIndex( p, end, normals.size(), corner[ 2 ] ) )
+				{
+					error = "a face has an invalid normal index";
+					return false;
+				}
+
+				cornerHasNormal = true;
+			}
+		}
+
+		if( cornerCount == 0 )
+		{
+			hasUV = cornerHasUV;
+			hasNormal = cornerHasNormal;
+
+			first[ 0 ] = corner[ 0 ];
+			first[ 1 ] = corner[ 1 ];
+			first[ 2 ] = corner[ 2 ];
+		}
+		else if( ( cornerHasUV != hasUV ) || ( cornerHasNormal != hasNormal ) )
+		{
+			error = "a face's corners don't all have the same attributes";
+			return false;
+		}
+		else if( cornerCount >= 2 )
+		{
+			AddIndex( indices, relativeIndices, first[ 0 ] );
+			AddIndex( indices, relativeIndices, previous[ 0 ] );
+			AddIndex( indices, relativeIndices, corner[ 0 ] );
+
+			if( hasUV )
+			{
+				AddIndex( uvIndices, relativeUVIndices, first[ 1 ] );
+				AddIndex( uvIndices, relativeUVIndices, previous[ 1 ] );
+				AddIndex( uvIndices, relativeUVIndices, corner[ 1 ] );
+			}
+
+			if( hasNormal )
+			{
+				AddIndex( normalIndices, relativeNormalIndices, first[ 2 ] );
+				AddIndex( normalIndices, relativeNormalIndices, previous[ 2 ] );
+				AddIndex( normalIndices, relativeNormalIndices, corner[ 2 ] );
+			}
+		}
+
+		previous[ 0 ] = corner[ 0 ];
+		previous[ 1 ] = corner[ 1 ];
+		previous[ 2 ] = corner[ 2 ];
+		++cornerCount;
+	}
+
+	if( cornerCount < 3 )
+	{
+		error = "a face has fewer than three corners";
+		return false;
+	}
+
+	return true;
+}
+
+inline void ObjChunk::AddIndex( std::vector< uint32_t >& indices, std::vector< uint32_t >& relative,
+								const ObjIndex& index )
+{
+	if( index.relative )
+	{
+		relative.push_back( uint32_t( indices.size() ) );
+	}
+
+	indices.push_back( index.value );
+}
+
+ObjReader::ObjReader( const ObjReadOptions& options )
+	: mOptions( options )
+	, mLineCount( 0 )
+{
+	if( mOptions.threadCount == 0 )
+	{
+		mOptions.threadCount = eeMax( 1u, std::thread::hardware_concurrency() );
+	}
+
+	mOptions.chunkSize = eeMax( mOptions.chunkSize, 4096u );
+}
+
+ObjReader::~ObjReader()
+{
+}
+
+bool ObjReader::Read( const char* filename, MeshData& data )
+{
+	std::unique_ptr< FileInputStream > stream = MakeFileInputStream( filename );
+	if( !stream->Open() )
+	{
+		eeDebug( "ObjReader: can't open %s\n", filename );
+		return false;
+	}
+
+	bool result = Read( *stream, data );
+	stream->Close();
+
+	eeDebugIf( !result, "ObjReader: couldn't read %s\n", filename );
+	return result;
+}
+
+bool ObjReader::Read( InputStream& stream, MeshData& data )
+{
+	mChunks.clear();
+	mLineCount = 0;
+
+	auto newChunk = [&]() -> TextChunk*
+	{
+		mChunks.push_back( std::make_unique< ObjChunk >() );
+		return mChunks.back().get();
+	};
+
+	if( !ReadLines( stream, mOptions.threadCount, mOptions.chunkSize, newChunk ) )
+	{
+		eeDebug( "ObjReader: the stream couldn't be read\n" );
+		mChunks.clear();
+		return false;
+	}
+
+	for( const std::unique_ptr< ObjChunk >& chunk : mChunks )
+	{
+		mLineCount += chunk->lineCount;
+
+		if( chunk->error != nullptr )
+		{
+			eeDebug( "ObjReader: line %llu: %s\n", static_cast< unsigned long long >( mLineCount ), chunk->error );
+			mChunks.clear();
+			return false;
+		}
+	}
+
+	bool result = Merge( data );
+	mChunks.clear();
+
+	return result;
+}
+
+bool ObjReader::Merge( MeshData& data )
+{
+	size_t positionCount = 0, normalCount = 0, uvCount = 0;
+	size_t indexCount = 0, normalIndexCount = 0, uvIndexCount = 0;
+
+	for( const std::unique_ptr< ObjChunk >& chunk : mChunks )
+	{
+		chunk->firstPosition = positionCount;
+		chunk->firstNormal = normalCount;
+		chunk->firstUV = uvCount;
+		chunk->firstIndex = indexCount;
+		chunk->firstNormalIndex = normalIndexCount;
+		chunk->firstUVIndex = uvIndexCount;
+
+		positionCount += chunk->positions.size();
+		normalCount += chunk->normals.size();
+		uvCount += chunk->uvs.size() / 2;
+		indexCount += chunk->indices.size();
+		normalIndexCount += chunk->normalIndices.size();
+		uvIndexCount += chunk->uvIndices.size();
+	}
+
+	if( indexCount == 0 )
+	{
+		eeDebug( "ObjReader: there are no faces\n" );
+		return false;
+	}
+
+	if( ( positionCount > UINT32_MAX ) || ( indexCount / 3 > UINT32_MAX ) )
+	{
+		eeDebug( "ObjReader: there are too many vertices or faces for 32 bit indices\n" );
+		return false;
+	}
+
+	// An attribute is only kept if every face has it
+	const bool hasNormals = ( normalIndexCount == indexCount );
+	const bool hasUVs = ( uvIndexCount == indexCount );
+
+	eeDebugIf( !hasNormals && ( normalIndexCount > 0 ), "ObjReader: ignoring normals, which only some faces have\n" );
+	eeDebugIf( !hasUVs && ( uvIndexCount > 0 ), "ObjReader: ignoring texture coordinates, which only some faces have\n" );
+
+	data = MeshData();
+	data.positions.resize( positionCount );
+	data.indices.resize( indexCount );
+
+	if( hasNormals )
+	{
+		data.normals.resize( normalCount );
+		data.normalIndices.resize( indexCount );
+	}
+
+	if( hasUVs )
+	{
+		data.uvs.resize( 2 * uvCount );
+		data.uvIndices.resize( indexCount );
+	}
+
+	// Each chunk is copied into place by one of the threads, which makes
+	// its relative indices final on the way, and is then freed
+	std::atomic< size_t > nextChunk( 0 );
+	std::atomic< bool > outOfRange( false );
+
+	auto resolve = []( std::vector< uint32_t >& indices, const std::vector< uint32_t >& relative, size_t first,
+					   size_t count, uint32_t* destination )
+	{
+		for( uint32_t i : relative )
+		{
+			indices[ i ] += uint32_t( first ); // wraps back from below zero
+		}
+
+		bool inRange = true;
+		for( size_t i = 0; i < indices.size(); ++i )
+		{
+			inRange &= ( indices[ i ] < count );
+			destination[ i ] = indices[ i ];
+		}
+
+		return inRange;
+	};
+
+	auto mergeChunks = [&]()
+	{
+		for( size_t c = nextChunk++; c < mChunks.size(); c = nextChunk++ )
+		{
+			ObjChunk& chunk = *mChunks[ c ];
+
+			std::copy( chunk.positions.begin(), chunk.positions.end(), data.positions.begin() + chunk.firstPosition );
+
+			bool inRange = resolve( chunk.indices, chunk.relativeIndices, chunk.firstPosition, positionCount,
+									&data.indices[ chunk.firstIndex ] );
+
+			if( hasNormals )
+			{
+				std::copy( chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + chunk.firstNormal );
+				inRange &= resolve( chunk.normalIndices, chunk.relativeNormalIndices, chunk.firstNormal, normalCount,
+									&data.normalIndices[ chunk.firstNormalIndex ] );
+			}
+
+			if( hasUVs )
+			{
+				std::copy( chunk.uvs.begin(), chunk.uvs.end(), data.uvs.begin() + 2 * chunk.firstUV );
+				inRange &= resolve( chunk.uvIndices, chunk.relativeUVIndices, chunk.firstUV, uvCount,
+									&data.uvIndices[ chunk.firstUVIndex ] );
+			}
+
+			if( !inRange )
+			{
+				outOfRange = true;
+			}
+
+			mChunks[ c ].reset();
+		}
+	};
+
+	std::vector< std::thread > threads;
+	const uint32_t threadCount = uint32_t( eeMin( size_t( mOptions.threadCount ), mChunks.size() ) );
+
+	for( uint32_t t = 1; t < threadCount; ++t )
+	{
+		threads.emplace_back( mergeChunks );
+	}
+
+	mergeChunks();
+
+	for( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+
+	if( outOfRange )
+	{
+		eeDebug( "ObjReader: a face refers to a vertex that isn't in the file\n" );
+		data = MeshData();
+		return false;
+	}
+
+	eeDebug( "ObjReader: read %zu vertices and %zu triangles from %llu lines\n", positionCount, indexCount / 3,
+			 static_cast< unsigned long long >( mLineCount ) );
+
+	return true;
+}
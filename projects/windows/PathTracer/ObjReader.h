@@ -0,0 +1,76 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include <ee/io/InputStream.h>
+
+#include "Mesh.h"
+
+using namespace ee;
+
+struct ObjReadOptions
+{
+	// The number of threads that parse the file while it's read; 0 means
+	// one per hardware thread
+	uint32_t	threadCount = 0;
+
+	// The file is read this many bytes at a time, and each chunk of whole
+	// lines is parsed by one thread. At most two chunks per thread are
+	// held in memory at once, however big the file is.
+	uint32_t	chunkSize = 8 << 20;
+
+}; // struct ObjReadOptions
+
+struct ObjChunk;
+
+// Reads the triangles of a Wavefront OBJ file into a MeshData. The file is
+// streamed: the calling thread reads it a chunk at a time while worker
+// threads parse the chunks it has read, each into buffers of its own. The
+// chunks' buffers are then copied into the MeshData's, which are only
+// allocated once their final sizes are known, so files of many gigabytes
+// are read without reallocating and copying what has been read so far.
+//
+// Vertex positions (v), normals (vn) and texture coordinates (vt) are
+// read, with faces (f) of any number of vertices split into triangle fans;
+// indices may be relative (negative). Groups, objects, smoothing groups,
+// materials, lines and points are ignored, as are normals and texture
+// coordinates that only some of the faces use. A # at the start of a word
+// starts a comment, which runs to the end of the line.
+class ObjReader
+{
+public:
+	ObjReader( const ObjReadOptions& options = ObjReadOptions() );
+	~ObjReader();
+
+	// Reads stream to its end. Returns false if it can't be read, or isn't
+	// a valid OBJ file, with the reason in the debug output.
+	bool Read( InputStream& stream, MeshData& data );
+
+	// Opens filename and reads it
+	bool Read( const char* filename, MeshData& data );
+
+	// The number of lines the last Read() parsed
+	inline uint64_t GetLineCount( void ) const;
+
+private:
+	// Copies the parsed chunks into data and resolves their indices
+	bool Merge( MeshData& data );
+
+	ObjReadOptions	mOptions;
+	uint64_t		mLineCount;
+
+	// The chunks of the file being read, in file order
+	std::vector< std::unique_ptr< ObjChunk > >	mChunks;
+
+}; // class ObjReader
+
+inline uint64_t ObjReader::GetLineCount( void ) const
+{
+	return mLineCount;
+}
@@ -4,13 +4,19 @@
 
 #include "pch.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cfloat>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <thread>
+#include <vector>
 
 #include "PathTracer.h"
 
+#include <ee/core/Debug.h>
 #include <ee/image/TGAWriter.h>
 #include <ee/math/Math.h>
 #include <ee/math/vec3.h>
@@ -21,10 +27,35 @@
 #include "Camera.h"
 #include "Material.h"
 #include "Rect.h"
+#include "SceneReader.h"
+#include "ObjReader.h"
+#include "Wavefront.h"
+
+// Rec. 709 relative luminance of a linear RGB color
+static inline float Luminance( const vec3& color )
+{
+	return 0.2126f * color[ 0 ] + 0.7152f * color[ 1 ] + 0.0722f * color[ 2 ];
+}
+
+// Veach's power heuristic, with a power of 2: the multiple importance
+// sampling weight for a sample taken with density pdf, when a second
+// technique could have taken it with density otherPdf
+static inline float PowerHeuristic( float pdf, float otherPdf )
+{
+	float a = pdf * pdf;
+	float b = otherPdf * otherPdf;
+	return a > 0.0f ? a / ( a + b ) : 0.0f;
+}
+
+// Returns true if anything blocks sample's shadow ray before the light
+static inline bool IsOccluded( const Scene& scene, const LightSample& sample )
+{
+	// Stop just short of the light, so that it doesn't block itself
+	return scene.Occluded( sample.shadowRay, 0.001f, sample.lightHit.t * 0.9999f );
+}
 
 PathTracer::PathTracer()
-	: mSampleCount( 100 )
-	, mWidth( 0 )
+	: mWidth( 0 )
 	, mHeight( 0 )
 	, mBytesPerPixel( 0 )
 	, mPixels( nullptr )
@@ -34,11 +65,17 @@ PathTracer::PathTracer()
 	, mProgressCallbackData( nullptr )
 	, mCompleteCallback( nullptr )
 	, mCompleteCallbackData( nullptr )
+	, mPassCallback( nullptr )
+	, mPassCallbackData( nullptr )
+	, mPreviewSampleCount( 0 )
 {
 }
 
 PathTracer::~PathTracer()
 {
+	// Stop any trace that's still running before its buffers go away
+	mJob.reset();
+
 	if( mPixels != nullptr )
 	{
 		delete[] mPixels;
@@ -53,6 +90,15 @@ bool PathTracer::Initialize( uint16_t width, uint16_t height )
 	mBytesPerPixel = 3; // RGB
 
 	mPixels = new uint8_t[ mWidth * mHeight * mBytesPerPixel ];
+	memset( mPixels, 0, mWidth * mHeight * mBytesPerPixel );
+
+	mPreviewPixels.resize( mWidth * mHeight * mBytesPerPixel );
+
+	mAccumulation.resize( mWidth * mHeight );
+	mPixelSampleCounts.resize( mWidth * mHeight );
+	mLuminanceSquares.resize( mWidth * mHeight );
+	mPixelConverged.resize( mWidth * mHeight );
+	mPixelErrors.resize( mWidth * mHeight );
 
 	return mPixels != nullptr;
 }
@@ -69,40 +115,89 @@ void PathTracer::SetCompleteCallback( CompleteCallback callback, const void* dat
 	mCompleteCallbackData = data;
 }
 
+void PathTracer::SetPassCallback( PassCallback callback, const void* data )
+{
+	mPassCallback = callback;
+	mPassCallbackData = data;
+}
+
+void PathTracer::SetBVHBuildOptions( const BVHBuildOptions& options )
+{
+	mBVHBuildOptions = options;
+}
+
+void PathTracer::SetTraceOptions( const TraceOptions& options )
+{
+	mTraceOptions = options;
+}
+
+void PathTracer::SetSceneFile( const char* filename )
+{
+	mSceneFile = ( filename != nullptr ) ? filename : "";
+}
+
 void PathTracer::SaveImage( const char* filename ) const
 {
 	TGAWriter::Write( mPixels, mWidth, mHeight, mBytesPerPixel, filename );
 }
 
+void PathTracer::ResolveSampleHeatmap( uint8_t* pixels ) const
+{
+	const float scale = mTraceOptions.sampleCount > 0 ? 1.0f / float( mTraceOptions.sampleCount ) : 0.0f;
+
+	for( uint32_t i = 0; i < uint32_t( mWidth * mHeight ); ++i )
+	{
+		// Black-body style ramp: red rises first, then green, then blue
+		float t = eeMin( float( mPixelSampleCounts[ i ] ) * scale, 1.0f );
+		float r = eeMin( 3.0f * t, 1.0f );
+		float g = eeMin( eeMax( 3.0f * t - 1.0f, 0.0f ), 1.0f );
+		float b = eeMax( 3.0f * t - 2.0f, 0.0f );
+
+		uint8_t* pixel = pixels + i * mBytesPerPixel;
+		pixel[ 0 ] = uint8_t( 255.0f * b );
+		pixel[ 1 ] = uint8_t( 255.0f * g );
+		pixel[ 2 ] = uint8_t( 255.0f * r );
+	}
+}
+
+void PathTracer::SaveSampleHeatmap( const char* filename ) const
+{
+	std::vector< uint8_t > heatmap( mWidth * mHeight * mBytesPerPixel );
+	ResolveSampleHeatmap( heatmap.data() );
+
+	TGAWriter::Write( heatmap.data(), mWidth, mHeight, mBytesPerPixel, filename );
+}
+
 void PathTracer::StartTrace( void )
 {
-#if 1
+	// The camera shutter interval; the scene's BVH must enclose every
+	// position a moving object can have while the shutter is open
+	const float shutterOpen = 0.0f;  // seconds
+	const float shutterClose = 1.0f; // seconds
 
-#if 1
-	vec3 eye( 23.0f, 2.0f, 3.0f );
-	vec3 lookat( 0.0f, 0.0f, 0.0f );
-	vec3 up( 0.0f, 1.0f, 0.0f );
-	float verticalFOV = 20.0f; // degrees
-	float aspect = float( mWidth ) / float( mHeight );
-	float focalDistance = 10.0f; // ( eye - lookat ).Length();
-	float aperture = 0.1f;
+	if( !mSceneFile.empty() )
+	{
+		// The file has its own shutter interval
+		SceneReadOptions options;
+		options.threadCount = mTraceOptions.threadCount;
+		options.bvhOptions = mBVHBuildOptions;
 
-	mScene = CreateTwoPerlinSpheres();
-#else
-	vec3 eye( 13.0f, 2.0f, 3.0f );
-	vec3 lookat( 0.0f, 0.0f, 0.0f );
-	vec3 up( 0.0f, 1.0f, 0.0f );
-	float verticalFOV = 20.0f; // degrees
-	float aspect = float( mWidth ) / float( mHeight );
-	float focalDistance = 10.0f;
-	float aperture = 0.0f;
+		SceneReader reader( options );
+		float aspect = mHeight > 0 ? float( mWidth ) / float( mHeight ) : 2.0f;
+		if( reader.Read( mSceneFile.c_str(), aspect, mScene, mCamera ) )
+			return;
+
+		eeDebug( "PathTracer: tracing a demo scene instead of %s\n", mSceneFile.c_str() );
+	}
 
-	mScene = CreateRandomScene();
+#if 1
 
+#if 1
+	CreateDemoScene( DemoScene::kTwoPerlinSpheres, shutterOpen, shutterClose, mScene, mCamera );
+#else
+	CreateDemoScene( DemoScene::kRandomSpheres, shutterOpen, shutterClose, mScene, mCamera );
 #endif
 
-	mCamera = new Camera( eye, lookat, up, verticalFOV, aspect, aperture, focalDistance, 0.0f, 1.0f );
-
 #else
 
 #if 0
@@ -153,212 +248,1351 @@ void PathTracer::StartTrace( void )
 #endif
 
 #endif
-
-	mProgressCounter.store( 0 );
 }
 
-void PathTracer::Trace( void )
+TraceJob* PathTracer::BeginTrace( void )
 {
-	const unsigned int threadCount = std::thread::hardware_concurrency();
-	std::vector< std::thread > threads( threadCount );
+	if( ( mJob != nullptr ) && ( mJob->Poll() == TraceJob::Status::kRunning ) )
+	{
+		eeDebug( "PathTracer: a trace is already running\n" );
+		return nullptr;
+	}
+
+	unsigned int threadCount = mTraceOptions.threadCount;
+	if( threadCount == 0 )
+	{
+		threadCount = std::thread::hardware_concurrency();
+	}
+
+	if( threadCount == 0 )
+	{
+		threadCount = 1; // hardware_concurrency() couldn't tell
+	}
 
-	uint32_t stepCount = mWidth * mHeight;
+	// The previous job's threads must be gone before the scheduler is reset
+	mJob.reset();
 
-	for( unsigned int t = 0; t < threadCount; ++t )
+	mTileScheduler.Initialize( mWidth, mHeight, mTraceOptions.tileSize, threadCount );
+
+	if( mTraceOptions.wavefront )
+	{
+		mWavefrontBatches.resize( threadCount );
+	}
+	else if( mTraceOptions.primaryRayPackets )
+	{
+		mCameraRayBatches.resize( threadCount );
+	}
+
+	std::fill( mAccumulation.begin(), mAccumulation.end(), vec3( 0.0f, 0.0f, 0.0f ) );
+	std::fill( mPixelSampleCounts.begin(), mPixelSampleCounts.end(), 0 );
+	std::fill( mLuminanceSquares.begin(), mLuminanceSquares.end(), 0.0f );
+	std::fill( mPixelConverged.begin(), mPixelConverged.end(), 0 );
+
+	const uint32_t samplesPerPass = mTraceOptions.samplesPerPass > 0 ? mTraceOptions.samplesPerPass : 1;
+	const uint32_t sampleCount = mTraceOptions.sampleCount;
+	const uint32_t passCount = ( sampleCount + samplesPerPass - 1 ) / samplesPerPass;
+
+	mSamplers.resize( threadCount );
+	for( std::unique_ptr< Sampler >& sampler : mSamplers )
 	{
-		threads[ t ] = std::thread( std::bind( [&]( int start, int end, int t )
+		sampler.reset( CreateSampler( mTraceOptions.samplerType, sampleCount ) );
+	}
+
+	auto traceStart = std::chrono::steady_clock::now();
+
+	auto traceTile = [this, samplesPerPass, sampleCount]( const Tile& tile, uint32_t pass, uint32_t worker )
+	{
+		// The last pass takes whatever is left over
+		uint32_t passSamples = sampleCount - pass * samplesPerPass;
+		if( passSamples > samplesPerPass )
+		{
+			passSamples = samplesPerPass;
+		}
+
+		Sampler& sampler = *mSamplers[ worker ];
+
+		if( mTraceOptions.wavefront )
 		{
-			for( uint16_t y = start; y < end; ++y )
+			StepTraceWavefront( tile, passSamples, sampler, mWavefrontBatches[ worker ] );
+			return;
+		}
+
+		if( mTraceOptions.primaryRayPackets )
+		{
+			StepTracePackets( tile, passSamples, sampler, mCameraRayBatches[ worker ] );
+			return;
+		}
+
+		for( uint16_t y = tile.y0; y < tile.y1; ++y )
+		{
+			for( uint16_t x = tile.x0; x < tile.x1; ++x )
 			{
-				for( uint16_t x = 0; x < mWidth; ++x )
-				{
-					StepTrace( x, y );
-					mProgressCounter++;
-				}
+				StepTrace( x, y, passSamples, sampler );
 			}
-		},
-		t * mHeight / threadCount,
-		( t + 1 ) == threadCount ? mHeight : ( t + 1 ) * mHeight / threadCount,
-		t ) );
+		}
+	};
 
-	} // for( unsigned int t = 0; t < threadCount; ++t )
+	mPreviewSampleCount = 0;
 
-	if( mProgressCallback != nullptr )
+	TraceJob::PassEndFunction endPass;
+	if( ( mTraceOptions.adaptiveThreshold > 0.0f ) || ( mPassCallback != nullptr ) )
 	{
-		uint32_t step;
-		do
+		endPass = [this, samplesPerPass, sampleCount]()
 		{
-			step = mProgressCounter.load();
-			( *mProgressCallback )( uint16_t( step * 100 / stepCount ), mProgressCallbackData );
-		}
-		while( step < stepCount );
+			if( mPassCallback != nullptr )
+			{
+				// No tile is being traced, so mPixels is the image of exactly
+				// the passes traced so far; copy it before the next pass
+				// starts writing over it
+				std::lock_guard< std::mutex > previewLock( mPreviewMutex );
+				memcpy( mPreviewPixels.data(), mPixels, mPreviewPixels.size() );
+				mPreviewSampleCount = eeMin( mPreviewSampleCount + samplesPerPass, sampleCount );
+			}
+
+			return ( mTraceOptions.adaptiveThreshold > 0.0f ) ? UpdateConvergence() : true;
+		};
 	}
 
-	for( unsigned int i = 0; i < threadCount; ++i )
+	TraceJob::Callbacks callbacks;
+
+	callbacks.onProgress = [this]( uint16_t percent )
 	{
-		threads[ i ].join();
-	}
+		if( mProgressCallback != nullptr )
+		{
+			( *mProgressCallback )( percent, mProgressCallbackData );
+		}
+	};
+
+	callbacks.onPass = [this]( uint32_t passCount )
+	{
+		if( mPassCallback != nullptr )
+		{
+			// The workers may finish another pass while the callback runs;
+			// the next preview waits until it's done with this one
+			std::lock_guard< std::mutex > previewLock( mPreviewMutex );
+			( *mPassCallback )( *this, mPreviewPixels.data(), mPreviewSampleCount, mPassCallbackData );
+		}
+	};
+
+	callbacks.onComplete = [this, traceStart, threadCount]( TraceJob::Status status )
+	{
+		std::chrono::duration< double > traceTime = std::chrono::steady_clock::now() - traceStart;
+
+		if( status == TraceJob::Status::kCancelled )
+		{
+			eeDebug( "PathTracer: trace cancelled after %.3f seconds\n", traceTime.count() );
+			return;
+		}
+
+		eeDebug( "PathTracer: traced %ux%u pixels at up to %u samples per pixel in %.3f seconds on %u threads (%u tiles)\n",
+				 mWidth, mHeight, mTraceOptions.sampleCount, traceTime.count(), threadCount, mTileScheduler.GetTileCount() );
+
+		if( mCompleteCallback != nullptr )
+		{
+			( *mCompleteCallback )( *this, mCompleteCallbackData );
+		}
+	};
+
+	mJob.reset( new TraceJob( mTileScheduler, uint32_t( mWidth ) * mHeight, passCount,
+							  std::chrono::duration< double >( mTraceOptions.timeBudget ), traceTile, endPass, callbacks ) );
+	mJob->Start();
+
+	return mJob.get();
+}
 
-	if( mCompleteCallback != nullptr )
+void PathTracer::Trace( void )
+{
+	TraceJob* job = BeginTrace();
+	if( job != nullptr )
 	{
-		( *mCompleteCallback )( *this, mCompleteCallbackData );
+		job->Wait();
 	}
 }
 
-void PathTracer::StepTrace( uint16_t x, uint16_t y )
+void PathTracer::StepTrace( uint16_t x, uint16_t y, uint32_t sampleCount, Sampler& sampler )
 {
+	uint32_t index = y * mWidth + x;
+	if( mPixelConverged[ index ] )
+		return;
+
 	vec3 color( 0.0f, 0.0f, 0.0f );
+	float luminanceSquares = 0.0f;
+
+	// Number the samples across passes, so each pass continues the
+	// pixel's sequence rather than repeating it
+	const uint32_t firstSample = mPixelSampleCounts[ index ];
 
-	for( uint32_t s = 0; s < mSampleCount; ++s )
+	for( uint32_t s = 0; s < sampleCount; ++s )
 	{
-		float u = float( x + RandomFloat() ) / float( mWidth );
-		float v = float( y + RandomFloat() ) / float( mHeight );
+		Ray ray = GetCameraRay( { x, y, firstSample + s }, *mCamera, sampler );
+		vec3 sample = GetColor( ray, *mScene, sampler );
 
-		Ray ray = mCamera->GetRay( u, v );
-		color += GetColor( ray, *mScene, 0 );
+		float luminance = Luminance( sample );
+		luminanceSquares += luminance * luminance;
+		color += sample;
 	}
 
-	color /= float( mSampleCount );
+	// Note: This is thread safe because each thread writes to a different
+	// part of the buffers, and passes over the image never overlap
+	mAccumulation[ index ] += color;
+	mLuminanceSquares[ index ] += luminanceSquares;
+	mPixelSampleCounts[ index ] += sampleCount;
 
-	// gamma correct (2.0 gamma, not 2.2)
-	color = vec3( sqrt( color[ 0 ] ), sqrt( color[ 1 ] ), sqrt( color[ 2 ] ) );
+	ResolvePixel( x, y );
+}
 
-	int r = int( 255.99f * color[ 0 ] );
-	int g = int( 255.99f * color[ 1 ] );
-	int b = int( 255.99f * color[ 2 ] );
+void PathTracer::StepTracePackets( const Tile& tile, uint32_t sampleCount, Sampler& sampler, CameraRayBatch& batch )
+{
+	// The camera rays go sample by sample, each sample in pixel order, so
+	// that each packet holds the same sample of a row of neighboring pixels
+	batch.pixelSamples.clear();
+	batch.rays.clear();
 
-	uint32_t rowOffset = y * mWidth * mBytesPerPixel;
-	uint32_t pixelOffset = x * mBytesPerPixel;
+	for( uint32_t s = 0; s < sampleCount; ++s )
+	{
+		for( uint16_t y = tile.y0; y < tile.y1; ++y )
+		{
+			for( uint16_t x = tile.x0; x < tile.x1; ++x )
+			{
+				uint32_t index = y * mWidth + x;
+				if( mPixelConverged[ index ] )
+					continue;
 
-	assert( rowOffset + pixelOffset + 2 < uint32_t( mWidth * mHeight * mBytesPerPixel ) );
+				PixelSample pixelSample = { x, y, mPixelSampleCounts[ index ] + s };
+				batch.pixelSamples.push_back( pixelSample );
+				batch.rays.push_back( GetCameraRay( pixelSample, *mCamera, sampler ) );
+			}
+		}
+	}
 
-	// Both Windows and the TGA file format expect a BGR channel order
-	// Note: This is thread safe because each thread writes to a different
-	// part of the mPixels array
-	mPixels[ rowOffset + pixelOffset     ] = b;
-	mPixels[ rowOffset + pixelOffset + 1 ] = g;
-	mPixels[ rowOffset + pixelOffset + 2 ] = r;
-}
+	const uint32_t rayCount = uint32_t( batch.rays.size() );
+	const uint32_t pixelCount = rayCount / eeMax( sampleCount, 1u );
 
-vec3 PathTracer::GetColor( const Ray& r, Scene& scene, int depth ) const
-{
-	// 0.001f : Reject rays that are too close to 0 to fix shadow acne
-	HitRecord hit;
-	if( scene.Hit( r, 0.001f, FLT_MAX, hit ) )
+	batch.hits.resize( rayCount );
+	mScene->IntersectPackets( batch.rays.data(), rayCount, 0.001f, FLT_MAX, batch.hits.data() );
+
+	batch.colors.resize( rayCount );
+
+	for( uint32_t i = 0; i < rayCount; ++i )
 	{
-		Ray scattered;
-		vec3 attenuation;
-		vec3 emitted = hit.material->Emitted( hit.u, hit.v, hit.p );
-		if( depth < 50 && hit.material->Scatter( r, hit, attenuation, scattered ) )
+		const PixelSample& pixelSample = batch.pixelSamples[ i ];
+		sampler.StartSample( pixelSample.x, pixelSample.y, pixelSample.index );
+		batch.colors[ i ] = GetColor( batch.rays[ i ], *mScene, sampler, &batch.hits[ i ] );
+	}
+
+	// Sum each pixel's samples in the same order as StepTrace() does
+	uint32_t pixel = 0;
+
+	for( uint16_t y = tile.y0; y < tile.y1; ++y )
+	{
+		for( uint16_t x = tile.x0; x < tile.x1; ++x )
 		{
-			return emitted + attenuation * GetColor( scattered, scene, depth + 1 );
+			uint32_t index = y * mWidth + x;
+			if( mPixelConverged[ index ] )
+				continue;
+
+			vec3 color( 0.0f, 0.0f, 0.0f );
+			float luminanceSquares = 0.0f;
+
+			for( uint32_t s = 0; s < sampleCount; ++s )
+			{
+				const vec3& sample = batch.colors[ s * pixelCount + pixel ];
+
+				float luminance = Luminance( sample );
+				luminanceSquares += luminance * luminance;
+				color += sample;
+			}
+
+			mAccumulation[ index ] += color;
+			mLuminanceSquares[ index ] += luminanceSquares;
+			mPixelSampleCounts[ index ] += sampleCount;
+
+			ResolvePixel( x, y );
+			++pixel;
 		}
-		else
+	}
+}
+
+void PathTracer::StepTraceWavefront( const Tile& tile, uint32_t sampleCount, Sampler& sampler, WavefrontBatch& batch )
+{
+	// A pixel's samples are kept together and in order, so that they are
+	// summed in the same order as StepTrace() sums them
+	batch.Reset();
+
+	for( uint16_t y = tile.y0; y < tile.y1; ++y )
+	{
+		for( uint16_t x = tile.x0; x < tile.x1; ++x )
 		{
-			return emitted;
+			uint32_t index = y * mWidth + x;
+			if( mPixelConverged[ index ] )
+				continue;
+
+			const uint32_t firstSample = mPixelSampleCounts[ index ];
+			for( uint32_t s = 0; s < sampleCount; ++s )
+			{
+				batch.pixelSamples.push_back( { x, y, firstSample + s } );
+			}
 		}
 	}
 
-	// else the ray did not hit any scene object, return the background color
+	TraceWavefront( *mScene, *mCamera, sampler, batch );
 
-#if 0
-	// a gradient between white at the bottom and light blue at the top
-	vec3 direction = r.GetDirection().GetNormalized();
-	float t = 0.5f * ( direction.y + 1.0f ); // [ -1, 1 ] -> [ 0, 1 ]
+	const vec3* samples = batch.colors.data();
 
-	const vec3 lightBlue( 0.5f, 0.7f, 1.0f );
-	const vec3 white( 1.0f, 1.0f, 1.0f );
-	return Lerp( white, lightBlue, t );
-#else
-	return vec3( 0.0f, 0.0f, 0.0f ); // black background
-#endif
+	for( uint16_t y = tile.y0; y < tile.y1; ++y )
+	{
+		for( uint16_t x = tile.x0; x < tile.x1; ++x )
+		{
+			uint32_t index = y * mWidth + x;
+			if( mPixelConverged[ index ] )
+				continue;
+
+			vec3 color( 0.0f, 0.0f, 0.0f );
+			float luminanceSquares = 0.0f;
+
+			for( uint32_t s = 0; s < sampleCount; ++s )
+			{
+				const vec3& sample = *samples++;
+
+				float luminance = Luminance( sample );
+				luminanceSquares += luminance * luminance;
+				color += sample;
+			}
+
+			mAccumulation[ index ] += color;
+			mLuminanceSquares[ index ] += luminanceSquares;
+			mPixelSampleCounts[ index ] += sampleCount;
+
+			ResolvePixel( x, y );
+		}
+	}
 }
 
-Scene* PathTracer::CreateRandomScene( void ) const
+float PathTracer::GetRelativeError( uint32_t index ) const
 {
-	uint32_t n = 500; // # of objects to create
+	const float n = float( mPixelSampleCounts[ index ] );
+	if( n < 2.0f )
+		return FLT_MAX;
+
+	const float mean = Luminance( mAccumulation[ index ] ) / n;
+	const float meanSquare = mLuminanceSquares[ index ] / n;
+
+	// The sample variance, and from it the variance of the pixel's mean
+	float variance = eeMax( meanSquare - mean * mean, 0.0f ) * n / ( n - 1.0f );
+	float standardError = sqrt( variance / n );
+
+	// The image is displayed with a gamma of 2, where the error is about
+	// standardError / ( 2 * sqrt( mean ) ). The floor stops near-black
+	// pixels from needing an impossibly small error.
+	const float kDarkFloor = 1.0f / 256.0f;
+	return standardError / ( 2.0f * sqrt( eeMax( mean, kDarkFloor ) ) * mTraceOptions.adaptiveThreshold );
+}
 
-	Traceable** list = new Traceable* [ n + 1 ]; // add one for the floor
+bool PathTracer::UpdateConvergence( void )
+{
+	const uint32_t pixelCount = uint32_t( mWidth ) * mHeight;
 
-	Texture* checker = new CheckerTexture( new ConstantTexture( vec3( 0.2f, 0.3f, 0.1f ) ),
-										   new ConstantTexture( vec3( 0.9f, 0.9f, 0.9f ) ) );
-	list[ 0 ] = new Sphere( vec3( 0.0f, -1000.0f, 0.0f ), 1000.0f,
-							new Lambertian( checker ) );
+	for( uint32_t i = 0; i < pixelCount; ++i )
+	{
+		mPixelErrors[ i ] = mPixelSampleCounts[ i ] >= mTraceOptions.minSampleCount ? GetRelativeError( i ) : FLT_MAX;
+	}
 
-	uint32_t i = 1;
+	// A pixel whose samples happen to agree so far, such as one that
+	// hasn't yet found the light its neighbors see, looks converged when
+	// it isn't; only stop sampling when its whole neighborhood agrees
+	bool anyNoisy = false;
 
-	for( int a = -10; a < 10; ++a )
+	for( int y = 0; y < int( mHeight ); ++y )
 	{
-		for( int b = -10; b < 10; ++b )
+		for( int x = 0; x < int( mWidth ); ++x )
 		{
-			float materialChoice = RandomFloat();
-			vec3 center( a + 0.9f * RandomFloat(), 0.2f, b + 0.9f * RandomFloat() );
-			if( ( center - vec3( 4.0f, 0.2f, 0.0f ) ).Length() > 0.9f )
+			float error = 0.0f;
+			for( int ny = eeMax( y - 1, 0 ); ny <= eeMin( y + 1, int( mHeight ) - 1 ); ++ny )
 			{
-				if( materialChoice < 0.8f ) // 80% chance of a diffuse material
+				for( int nx = eeMax( x - 1, 0 ); nx <= eeMin( x + 1, int( mWidth ) - 1 ); ++nx )
 				{
-					Lambertian* material = new Lambertian( vec3( RandomFloat() * RandomFloat(),
-																 RandomFloat() * RandomFloat(),
-																 RandomFloat() * RandomFloat() ) );
-					list[ i++ ] = new Sphere( center, center + vec3( 0.0f, 0.5f * RandomFloat(), 0.0f ),
-											  0.0f, 1.0f, 0.2f, material );
+					error = eeMax( error, mPixelErrors[ ny * mWidth + nx ] );
 				}
-				else if( materialChoice < 0.95f ) // 15% chance of Metal
-				{
-					Metal* material = new Metal( vec3( 0.5f * ( 1.0f + RandomFloat() ),
-													   0.5f * ( 1.0f + RandomFloat() ),
-													   0.5f * ( 1.0f + RandomFloat() ) ),
-												 0.5f * RandomFloat() );
+			}
 
-					list[ i++ ] = new Sphere( center, 0.2f, material );
-				}
-				else // 5% chance of Glass
-				{
-					list[ i++ ] = new Sphere( center, 0.2f, new Glass( 1.5f ) );
-				}
+			uint32_t index = y * mWidth + x;
+			mPixelConverged[ index ] = error <= 1.0f;
 
-			} // if( ( center - vec3( 4.0f, 0.2f, 0.0f ) ).Length() > 0.9f )
+			if( !mPixelConverged[ index ] )
+			{
+				anyNoisy = true;
+			}
+		}
+	}
 
-		} // for( int b = -11; b < 11; ++b )
+	return anyNoisy;
+}
 
-	} // for( int a = -11; a < 11; ++a )
+void PathTracer::ResolvePixel( uint16_t x, uint16_t y )
+{
+	uint32_t index = y * mWidth + x;
+	if( mPixelSampleCounts[ index ] == 0 )
+		return;
 
-	// Add three big "landmark" sphere in the center,
-	// showcasing the three different material types
+	vec3 color = mAccumulation[ index ] / float( mPixelSampleCounts[ index ] );
 
-	list[ i++ ] = new Sphere( vec3( 0.0f, 1.0f, 0.0f ), 1.0f, new Glass( 1.5f ) );
-	list[ i++ ] = new Sphere( vec3( -4.0f, 1.0f, 0.0f ), 1.0f, new Lambertian( vec3( 0.4f, 0.2f, 0.1f ) ) ); // brown
-	list[ i++ ] = new Sphere( vec3( 4.0f, 1.0f, 0.0f ), 1.0f, new Metal( vec3( 0.7f, 0.6f, 0.5f ), 0.0f ) );
+	// gamma correct (2.0 gamma, not 2.2), and clamp what's left of the
+	// high dynamic range to what 8 bits can hold
+	color = vec3( sqrt( color[ 0 ] ), sqrt( color[ 1 ] ), sqrt( color[ 2 ] ) );
 
-	Scene* scene = new Scene;
-	if( scene == nullptr )
-		return nullptr;
+	int r = eeMin( int( 255.99f * color[ 0 ] ), 255 );
+	int g = eeMin( int( 255.99f * color[ 1 ] ), 255 );
+	int b = eeMin( int( 255.99f * color[ 2 ] ), 255 );
 
-	if( !scene->Initialize( list, i ) )
-	{
-		delete scene;
-		return nullptr;
-	}
+	uint32_t rowOffset = y * mWidth * mBytesPerPixel;
+	uint32_t pixelOffset = x * mBytesPerPixel;
 
-	return scene;
+	assert( rowOffset + pixelOffset + 2 < uint32_t( mWidth * mHeight * mBytesPerPixel ) );
+
+	// Both Windows and the TGA file format expect a BGR channel order
+	mPixels[ rowOffset + pixelOffset     ] = b;
+	mPixels[ rowOffset + pixelOffset + 1 ] = g;
+	mPixels[ rowOffset + pixelOffset + 2 ] = r;
 }
 
-Scene* PathTracer::CreateTwoPerlinSpheres( void ) const
+Ray PathTracer::GetCameraRay( const PixelSample& sample, const Camera& camera, Sampler& sampler ) const
 {
-	static const float scale = 4.0f;
-	static const size_t kListCount = 4;
+	sampler.StartSample( sample.x, sample.y, sample.index );
+
+	float jitterU, jitterV;
+	sampler.Get2D( jitterU, jitterV );
+
+	float u = float( sample.x + jitterU ) / float( mWidth );
+	float v = float( sample.y + jitterV ) / float( mHeight );
+
+	return camera.GetRay( u, v, sampler );
+}
+
+vec3 PathTracer::GetColor( const Ray& r, const Scene& scene, Sampler& sampler, const RayHit* firstHit ) const
+{
+	vec3 color( 0.0f, 0.0f, 0.0f );
+
+	// The fraction of the light arriving along ray that makes it back to
+	// the camera, through every surface the path has bounced off so far
+	vec3 throughput( 1.0f, 1.0f, 1.0f );
+
+	Ray ray = r;
+
+	// The density Scatter() picked ray's direction with, if the light at
+	// the other end could also have been found by sampling the lights;
+	// 0 for camera rays and rays from mirrors and glass
+	float scatteringPdf = 0.0f;
+
+	const bool sampleLights = mTraceOptions.sampleLights && ( scene.GetLightCount() > 0 );
+
+	const MaterialTable& materials = scene.GetMaterials();
+
+	for( uint32_t depth = 0; ; ++depth )
+	{
+		// 0.001f : Reject rays that are too close to 0 to fix shadow acne
+		HitRecord hit;
+		bool hitAnything;
+		if( ( depth == 0 ) && ( firstHit != nullptr ) )
+		{
+			hitAnything = ( firstHit->object != nullptr );
+			if( hitAnything )
+			{
+				firstHit->object->FinalizeHit( ray, *firstHit, hit );
+			}
+		}
+		else
+		{
+			hitAnything = scene.Hit( ray, 0.001f, FLT_MAX, hit );
+		}
+
+		if( !hitAnything )
+		{
+			color += throughput * GetBackground( ray );
+			break;
+		}
+
+		if( materials.IsEmitter( hit.material ) )
+		{
+			// Light that SampleLight() could also have found is weighted
+			// by how much more likely Scatter() was to find it
+			float weight = 1.0f;
+			if( sampleLights && ( scatteringPdf > 0.0f ) )
+			{
+				weight = PowerHeuristic( scatteringPdf, scene.GetLightPdf( ray, hit ) );
+			}
+
+			color += throughput * materials.Emitted( hit.material, hit.u, hit.v, hit.p ) * weight;
+		}
+
+		if( depth >= mTraceOptions.maxDepth )
+			break;
+
+		const bool hasScatteringPdf = materials.HasScatteringPdf( hit.material );
+		LightSample lightSample;
+		if( sampleLights && hasScatteringPdf && SampleLight( ray, hit, scene, depth, sampler, lightSample ) &&
+			!IsOccluded( scene, lightSample ) )
+		{
+			color += throughput * GetLightRadiance( scene, lightSample );
+		}
+
+		sampler.SetDimension( Sampler::GetBounceDimension( depth ) );
+
+		Ray scattered;
+		vec3 attenuation;
+		if( !materials.Scatter( ray, hit, attenuation, scattered, sampler ) )
+			break;
+
+		scatteringPdf = 0.0f;
+		if( hasScatteringPdf )
+		{
+			scatteringPdf = materials.GetScatteringPdf( ray, hit, scattered.GetDirection().GetNormalized() );
+		}
+
+		throughput *= attenuation;
+
+		// Russian roulette: past the first few bounces, end paths that carry
+		// too little light to matter at random, and make up for the ones that
+		// were ended by boosting the ones that weren't. Paths above the
+		// threshold always survive, which keeps the noise this adds down.
+		if( depth + 1 >= mTraceOptions.russianRouletteDepth )
+		{
+			const float kRouletteThroughput = 0.25f;
+			float survival = eeMax( throughput[ 0 ], throughput[ 1 ], throughput[ 2 ] ) / kRouletteThroughput;
+			if( survival < 1.0f )
+			{
+				sampler.SetDimension( Sampler::GetBounceDimension( depth ) + Sampler::kRouletteDimension );
+				if( sampler.Get1D() >= survival )
+					break;
+
+				throughput /= survival;
+			}
+		}
+
+		ray = scattered;
+
+	} // for( uint32_t depth = 0; ; ++depth )
+
+	return color;
+}
+
+void PathTracer::TraceWavefront( const Scene& scene, const Camera& camera, Sampler& sampler, WavefrontBatch& batch ) const
+{
+	const uint32_t pathCount = uint32_t( batch.pixelSamples.size() );
+
+	const bool sampleLights = mTraceOptions.sampleLights && ( scene.GetLightCount() > 0 );
+
+	const MaterialTable& materials = scene.GetMaterials();
+
+	batch.colors.assign( pathCount, vec3( 0.0f, 0.0f, 0.0f ) );
+	batch.throughputs.assign( pathCount, vec3( 1.0f, 1.0f, 1.0f ) );
+	batch.scatteringPdfs.assign( pathCount, 0.0f );
+
+	batch.rayPaths.resize( pathCount );
+	batch.rays.resize( pathCount );
+
+	for( uint32_t path = 0; path < pathCount; ++path )
+	{
+		batch.rayPaths[ path ] = path;
+		batch.rays[ path ] = GetCameraRay( batch.pixelSamples[ path ], camera, sampler );
+	}
+
+	// Each stage below does for every path in its queue what the same
+	// part of GetColor()'s loop does for one path, and draws the same
+	// numbers from the sampler, so each path comes out exactly the same
+	for( uint32_t depth = 0; !batch.rays.empty(); ++depth )
+	{
+		const uint32_t rayCount = uint32_t( batch.rays.size() );
+
+		// Intersect the ray queue. The camera rays are in pixel order, so
+		// each packet of them comes from a pixel or two next to each other.
+		batch.rayHits.resize( rayCount );
+
+		if( ( depth == 0 ) && mTraceOptions.primaryRayPackets )
+		{
+			scene.IntersectPackets( batch.rays.data(), rayCount, 0.001f, FLT_MAX, batch.rayHits.data() );
+		}
+		else
+		{
+			for( uint32_t i = 0; i < rayCount; ++i )
+			{
+				batch.rayHits[ i ].object = nullptr;
+				scene.Intersect( batch.rays[ i ], 0.001f, FLT_MAX, batch.rayHits[ i ] );
+			}
+		}
+
+		// Finish the hits, add the light the paths found, and keep the
+		// hits of the paths that go on, counting them by material type
+		uint32_t typeCounts[ kMaterialTypeCount ] = {};
+
+		batch.queryPaths.clear();
+		batch.queries.clear();
+		batch.queryTypes.clear();
+
+		for( uint32_t i = 0; i < rayCount; ++i )
+		{
+			const uint32_t path = batch.rayPaths[ i ];
+			const Ray& ray = batch.rays[ i ];
+			const RayHit& rayHit = batch.rayHits[ i ];
+
+			if( rayHit.object == nullptr )
+			{
+				batch.colors[ path ] += batch.throughputs[ path ] * GetBackground( ray );
+				continue;
+			}
+
+			// The hit is finished in the query it's kept in, which is
+			// dropped again if the path ends here
+			batch.queries.emplace_back();
+			ScatterQuery& query = batch.queries.back();
+			query.ray = ray;
+			rayHit.object->FinalizeHit( ray, rayHit, query.hit );
+
+			if( materials.IsEmitter( query.hit.material ) )
+			{
+				const float scatteringPdf = batch.scatteringPdfs[ path ];
+
+				float weight = 1.0f;
+				if( sampleLights && ( scatteringPdf > 0.0f ) )
+				{
+					weight = PowerHeuristic( scatteringPdf, scene.GetLightPdf( ray, query.hit ) );
+				}
+
+				batch.colors[ path ] += batch.throughputs[ path ] *
+										materials.Emitted( query.hit.material, query.hit.u, query.hit.v, query.hit.p ) * weight;
+			}
+
+			if( depth >= mTraceOptions.maxDepth )
+			{
+				batch.queries.pop_back();
+				continue;
+			}
+
+			const MaterialType type = materials.Get( query.hit.material ).type;
+			++typeCounts[ uint32_t( type ) ];
+
+			batch.queryPaths.push_back( path );
+			batch.queryTypes.push_back( type );
+		}
+
+		// Sort the hits into the material queues, with a counting sort of
+		// their indices
+		const uint32_t hitCount = uint32_t( batch.queries.size() );
+
+		uint32_t typeEnds[ kMaterialTypeCount ];
+
+		batch.queryStarts[ 0 ] = 0;
+		for( uint32_t type = 0; type < kMaterialTypeCount; ++type )
+		{
+			typeEnds[ type ] = batch.queryStarts[ type ];
+			batch.queryStarts[ type + 1 ] = batch.queryStarts[ type ] + typeCounts[ type ];
+		}
+
+		batch.queryOrder.resize( hitCount );
+
+		for( uint32_t i = 0; i < hitCount; ++i )
+		{
+			batch.queryOrder[ typeEnds[ uint32_t( batch.queryTypes[ i ] ) ]++ ] = i;
+		}
+
+		// Aim a shadow ray at a light from every hit that can be lit that
+		// way, then test the shadow queue, before any path's throughput
+		// takes in its next bounce. Each path draws its own samples, so
+		// the hits can be taken in ray queue order.
+		if( sampleLights )
+		{
+			batch.lightPaths.clear();
+			batch.lightSamples.clear();
+
+			for( uint32_t i = 0; i < hitCount; ++i )
+			{
+				const ScatterQuery& query = batch.queries[ i ];
+				if( !materials.HasScatteringPdf( query.hit.material ) )
+					continue;
+
+				const uint32_t path = batch.queryPaths[ i ];
+				const PixelSample& pixelSample = batch.pixelSamples[ path ];
+				sampler.StartSample( pixelSample.x, pixelSample.y, pixelSample.index );
+
+				LightSample lightSample;
+				if( SampleLight( query.ray, query.hit, scene, depth, sampler, lightSample ) )
+				{
+					batch.lightPaths.push_back( path );
+					batch.lightSamples.push_back( lightSample );
+				}
+			}
+
+			for( uint32_t i = 0; i < uint32_t( batch.lightSamples.size() ); ++i )
+			{
+				const LightSample& lightSample = batch.lightSamples[ i ];
+				if( !IsOccluded( scene, lightSample ) )
+				{
+					const uint32_t path = batch.lightPaths[ i ];
+					batch.colors[ path ] += batch.throughputs[ path ] * GetLightRadiance( scene, lightSample );
+				}
+			}
+		}
+
+		// Shade each material queue in one batch
+		for( uint32_t i = 0; i < hitCount; ++i )
+		{
+			const PixelSample& pixelSample = batch.pixelSamples[ batch.queryPaths[ i ] ];
+
+			sampler.StartSample( pixelSample.x, pixelSample.y, pixelSample.index );
+			sampler.SetDimension( Sampler::GetBounceDimension( depth ) );
+			MaterialTable::DrawScatterSamples( batch.queryTypes[ i ], sampler, batch.queries[ i ].samples );
+		}
+
+		for( uint32_t type = 0; type < kMaterialTypeCount; ++type )
+		{
+			const uint32_t start = batch.queryStarts[ type ];
+			if( batch.queryStarts[ type + 1 ] > start )
+			{
+				materials.ScatterBatch( MaterialType( type ), batch.queries.data(), &batch.queryOrder[ start ],
+										batch.queryStarts[ type + 1 ] - start );
+			}
+		}
+
+		// Queue the scattered rays of the paths that go on
+		batch.nextRayPaths.clear();
+		batch.nextRays.clear();
+
+		for( uint32_t i = 0; i < hitCount; ++i )
+		{
+			const ScatterQuery& query = batch.queries[ i ];
+			if( !query.scatters )
+				continue;
+
+			const uint32_t path = batch.queryPaths[ i ];
+
+			float& scatteringPdf = batch.scatteringPdfs[ path ];
+			scatteringPdf = 0.0f;
+			if( materials.HasScatteringPdf( query.hit.material ) )
+			{
+				scatteringPdf = materials.GetScatteringPdf( query.ray, query.hit, query.scattered.GetDirection().GetNormalized() );
+			}
+
+			vec3& throughput = batch.throughputs[ path ];
+			throughput *= query.attenuation;
+
+			// Russian roulette, as in GetColor()
+			if( depth + 1 >= mTraceOptions.russianRouletteDepth )
+			{
+				const float kRouletteThroughput = 0.25f;
+				float survival = eeMax( throughput[ 0 ], throughput[ 1 ], throughput[ 2 ] ) / kRouletteThroughput;
+				if( survival < 1.0f )
+				{
+					const PixelSample& pixelSample = batch.pixelSamples[ path ];
+					sampler.StartSample( pixelSample.x, pixelSample.y, pixelSample.index );
+					sampler.SetDimension( Sampler::GetBounceDimension( depth ) + Sampler::kRouletteDimension );
+					if( sampler.Get1D() >= survival )
+						continue;
+
+					throughput /= survival;
+				}
+			}
+
+			batch.nextRayPaths.push_back( path );
+			batch.nextRays.push_back( query.scattered );
+		}
+
+		batch.rayPaths.swap( batch.nextRayPaths );
+		batch.rays.swap( batch.nextRays );
+
+	} // for( uint32_t depth = 0; !batch.rays.empty(); ++depth )
+}
+
+bool PathTracer::SampleLight( const Ray& ray, const HitRecord& hit, const Scene& scene, uint32_t depth,
+							  Sampler& sampler, LightSample& sample ) const
+{
+	const uint32_t lightCount = scene.GetLightCount();
+
+	const uint32_t bounceDimension = Sampler::GetBounceDimension( depth );
+	sampler.SetDimension( bounceDimension + Sampler::kLightChoiceDimension );
+	uint32_t lightIndex = eeMin( uint32_t( sampler.Get1D() * float( lightCount ) ), lightCount - 1 );
+
+	float u1, u2;
+	sampler.SetDimension( bounceDimension + Sampler::kLightDirectionDimension );
+	sampler.Get2D( u1, u2 );
+
+	const Traceable* light = scene.GetLight( lightIndex );
+	const MaterialTable& materials = scene.GetMaterials();
+
+	vec3 direction;
+	float lightPdf = light->SampleDirection( hit.p, ray.GetTime(), u1, u2, direction ) / float( lightCount );
+	if( lightPdf <= 0.0f )
+		return false;
+
+	sample.scattering = materials.GetScattering( ray, hit, direction );
+	if( ( sample.scattering[ 0 ] <= 0.0f ) && ( sample.scattering[ 1 ] <= 0.0f ) && ( sample.scattering[ 2 ] <= 0.0f ) )
+		return false; // the light is behind the surface
+
+	// Find where the shadow ray reaches the light; whether anything is in
+	// the way is left to the caller, so that shadow rays can be batched
+	sample.shadowRay = Ray( hit.p, direction, ray.GetTime() );
+	if( !light->Intersect( sample.shadowRay, 0.001f, FLT_MAX, sample.lightHit ) )
+		return false;
+
+	sample.weight = PowerHeuristic( lightPdf, materials.GetScatteringPdf( ray, hit, direction ) ) / lightPdf;
+	return true;
+}
+
+vec3 PathTracer::GetLightRadiance( const Scene& scene, const LightSample& sample ) const
+{
+	// Only the light's emission is left to find, for a light that is seen
+	HitRecord lightHit;
+	sample.lightHit.object->FinalizeHit( sample.shadowRay, sample.lightHit, lightHit );
+
+	return sample.scattering * scene.GetMaterials().Emitted( lightHit.material, lightHit.u, lightHit.v, lightHit.p ) *
+		   sample.weight;
+}
+
+vec3 PathTracer::GetBackground( const Ray& r ) const
+{
+#if 0
+	// a gradient between white at the bottom and light blue at the top
+	vec3 direction = r.GetDirection().GetNormalized();
+	float t = 0.5f * ( direction.y + 1.0f ); // [ -1, 1 ] -> [ 0, 1 ]
+
+	const vec3 lightBlue( 0.5f, 0.7f, 1.0f );
+	const vec3 white( 1.0f, 1.0f, 1.0f );
+	return Lerp( white, lightBlue, t );
+#else
+	return vec3( 0.0f, 0.0f, 0.0f ); // black background
+#endif
+}
+
+bool PathTracer::CreateDemoScene( DemoScene demo, float t0, float t1, Scene*& scene, Camera*& camera ) const
+{
+	vec3 lookat( 0.0f, 0.0f, 0.0f );
+	vec3 up( 0.0f, 1.0f, 0.0f );
+	float verticalFOV = 20.0f; // degrees
+	// The benchmark may run before there is an image to trace into
+	float aspect = mHeight > 0 ? float( mWidth ) / float( mHeight ) : 2.0f;
+	float focalDistance = 10.0f;
+
+	if( demo == DemoScene::kTwoPerlinSpheres )
+	{
+		vec3 eye( 23.0f, 2.0f, 3.0f );
+		float aperture = 0.1f;
+
+		scene = CreateTwoPerlinSpheres( t0, t1 );
+		camera = new Camera( eye, lookat, up, verticalFOV, aspect, aperture, focalDistance, t0, t1 );
+	}
+	else
+	{
+		vec3 eye( 13.0f, 2.0f, 3.0f );
+		float aperture = 0.0f;
+
+		scene = CreateRandomScene( t0, t1 );
+		camera = new Camera( eye, lookat, up, verticalFOV, aspect, aperture, focalDistance, t0, t1 );
+	}
+
+	return scene != nullptr;
+}
+
+void PathTracer::RunBVHBenchmark( void ) const
+{
+	struct Demo
+	{
+		DemoScene	scene;
+		const char*	name;
+	};
+
+	const Demo demos[] =
+	{
+		{ DemoScene::kRandomSpheres,	"CreateRandomScene" },
+		{ DemoScene::kTwoPerlinSpheres,	"CreateTwoPerlinSpheres" },
+	};
+
+	// Enough rays for the timings to be stable, but not so many that
+	// they take more than a few seconds to trace
+	const uint32_t kPrimaryRayCount = 256 * 1024;
+	const int kPassCount = 4;
+
+	for( const Demo& demo : demos )
+	{
+		Scene* scene = nullptr;
+		Camera* camera = nullptr;
+		if( !CreateDemoScene( demo.scene, 0.0f, 1.0f, scene, camera ) )
+		{
+			delete camera;
+			continue;
+		}
+
+		// Trace camera rays at random pixels, plus a bounce ray for every
+		// camera ray that hits something, so that the mix of coherent and
+		// incoherent rays resembles what the renderer traces
+		std::vector< Ray > rays;
+		rays.reserve( 2 * kPrimaryRayCount );
+
+		IndependentSampler sampler;
+
+		for( uint32_t i = 0; i < kPrimaryRayCount; ++i )
+		{
+			sampler.StartSample( uint16_t( i ), uint16_t( i >> 16 ), 0 );
+
+			float u, v;
+			sampler.Get2D( u, v );
+			Ray ray = camera->GetRay( u, v, sampler );
+			rays.push_back( ray );
+
+			HitRecord hit;
+			Ray scattered;
+			vec3 attenuation;
+			sampler.SetDimension( Sampler::GetBounceDimension( 0 ) );
+			if( scene->HitBinaryBVH( ray, 0.001f, FLT_MAX, hit ) &&
+				scene->GetMaterials().Scatter( ray, hit, attenuation, scattered, sampler ) )
+			{
+				rays.push_back( scattered );
+			}
+		}
+
+		struct Result
+		{
+			double		raysPerSecond;
+			uint32_t	hitCount;
+		};
+
+		auto timeHits = [&]( bool ( Scene::*hitFunction )( const Ray&, float, float, HitRecord& ) const )
+		{
+			uint32_t hitCount = 0;
+			auto start = std::chrono::steady_clock::now();
+
+			for( int pass = 0; pass < kPassCount; ++pass )
+			{
+				for( const Ray& ray : rays )
+				{
+					HitRecord hit;
+					if( ( scene->*hitFunction )( ray, 0.001f, FLT_MAX, hit ) )
+					{
+						++hitCount;
+					}
+				}
+			}
+
+			std::chrono::duration< double > elapsed = std::chrono::steady_clock::now() - start;
+			return Result{ double( rays.size() ) * kPassCount / elapsed.count(), hitCount / kPassCount };
+		};
+
+		// The same rays as occlusion queries, as if they were shadow rays
+		auto timeOccluded = [&]( bool ( Scene::*occludedFunction )( const Ray&, float, float ) const )
+		{
+			uint32_t hitCount = 0;
+			auto start = std::chrono::steady_clock::now();
+
+			for( int pass = 0; pass < kPassCount; ++pass )
+			{
+				for( const Ray& ray : rays )
+				{
+					if( ( scene->*occludedFunction )( ray, 0.001f, FLT_MAX ) )
+					{
+						++hitCount;
+					}
+				}
+			}
+
+			std::chrono::duration< double > elapsed = std::chrono::steady_clock::now() - start;
+			return Result{ double( rays.size() ) * kPassCount / elapsed.count(), hitCount / kPassCount };
+		};
+
+		Result binary = timeHits( &Scene::HitBinaryBVH );
+		Result wide = timeHits( &Scene::HitWideBVH );
+		Result binaryOccluded = timeOccluded( &Scene::OccludedBinaryBVH );
+		Result wideOccluded = timeOccluded( &Scene::OccludedWideBVH );
+
+		const bool countsMatch = ( binary.hitCount == wide.hitCount ) &&
+								 ( binary.hitCount == binaryOccluded.hitCount ) &&
+								 ( binary.hitCount == wideOccluded.hitCount );
+
+		eeDebug( "BVH benchmark, %s, %u rays: binary %.2f Mrays/s, %u-wide %.2f Mrays/s (%.2fx)%s\n",
+				 demo.name, uint32_t( rays.size() ), binary.raysPerSecond * 1e-6,
+				 Scene::kWideBVHWidth, wide.raysPerSecond * 1e-6, wide.raysPerSecond / binary.raysPerSecond,
+				 countsMatch ? "" : " - HIT COUNTS DIFFER" );
+		eeDebug( "BVH benchmark, %s, occlusion: binary %.2f Mrays/s (%.2fx closest hit), %u-wide %.2f Mrays/s (%.2fx)\n",
+				 demo.name, binaryOccluded.raysPerSecond * 1e-6, binaryOccluded.raysPerSecond / binary.raysPerSecond,
+				 Scene::kWideBVHWidth, wideOccluded.raysPerSecond * 1e-6, wideOccluded.raysPerSecond / wide.raysPerSecond );
+
+		// Camera rays through a grid of pixels, in image order, so that
+		// neighboring rays can be traced together in packets
+		const uint16_t kGridWidth = 512;
+		const uint16_t kGridHeight = 256;
+
+		std::vector< Ray > cameraRays;
+		cameraRays.reserve( kGridWidth * kGridHeight );
+
+		for( uint16_t y = 0; y < kGridHeight; ++y )
+		{
+			for( uint16_t x = 0; x < kGridWidth; ++x )
+			{
+				sampler.StartSample( x, y, 0 );
+				sampler.SetDimension( Sampler::kLensDimension );
+				cameraRays.push_back( camera->GetRay( ( x + 0.5f ) / kGridWidth, ( y + 0.5f ) / kGridHeight, sampler ) );
+			}
+		}
+
+		std::vector< RayHit > singleHits( cameraRays.size() );
+		std::vector< RayHit > packetHits( cameraRays.size() );
+
+		auto start = std::chrono::steady_clock::now();
+
+		for( int pass = 0; pass < kPassCount; ++pass )
+		{
+			for( uint32_t i = 0; i < uint32_t( cameraRays.size() ); ++i )
+			{
+				singleHits[ i ].object = nullptr;
+				scene->Intersect( cameraRays[ i ], 0.001f, FLT_MAX, singleHits[ i ] );
+			}
+		}
+
+		std::chrono::duration< double > singleTime = std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+
+		for( int pass = 0; pass < kPassCount; ++pass )
+		{
+			scene->IntersectPackets( cameraRays.data(), uint32_t( cameraRays.size() ), 0.001f, FLT_MAX, packetHits.data() );
+		}
+
+		std::chrono::duration< double > packetTime = std::chrono::steady_clock::now() - start;
+
+		bool hitsMatch = true;
+		for( uint32_t i = 0; i < uint32_t( cameraRays.size() ); ++i )
+		{
+			if( ( singleHits[ i ].object != packetHits[ i ].object ) ||
+				( ( singleHits[ i ].object != nullptr ) && ( singleHits[ i ].t != packetHits[ i ].t ) ) )
+			{
+				hitsMatch = false;
+			}
+		}
+
+		const double cameraRayCount = double( cameraRays.size() ) * kPassCount;
+
+		eeDebug( "BVH benchmark, %s, %u camera rays: one at a time %.2f Mrays/s, %u-ray packets %.2f Mrays/s (%.2fx)%s\n",
+				 demo.name, uint32_t( cameraRays.size() ), cameraRayCount / singleTime.count() * 1e-6,
+				 RayPacket::kSize, cameraRayCount / packetTime.count() * 1e-6, singleTime.count() / packetTime.count(),
+				 hitsMatch ? "" : " - HITS DIFFER" );
+
+		delete camera;
+		delete scene;
+	}
+}
+
+void PathTracer::RunWavefrontBenchmark( void ) const
+{
+	if( ( mWidth == 0 ) || ( mHeight == 0 ) )
+	{
+		eeDebug( "Wavefront benchmark: Initialize() the image size first\n" );
+		return;
+	}
+
+	struct Demo
+	{
+		DemoScene	scene;
+		const char*	name;
+	};
+
+	const Demo demos[] =
+	{
+		{ DemoScene::kRandomSpheres,	"CreateRandomScene" },
+		{ DemoScene::kTwoPerlinSpheres,	"CreateTwoPerlinSpheres" },
+	};
+
+	// Enough samples for the timings to be stable, but not so many that
+	// they take more than a few seconds to trace
+	const uint32_t kSampleCount = 4;
+
+	const uint16_t tileSize = mTraceOptions.tileSize > 0 ? mTraceOptions.tileSize : 16;
+
+	for( const Demo& demo : demos )
+	{
+		Scene* scene = nullptr;
+		Camera* camera = nullptr;
+		if( !CreateDemoScene( demo.scene, 0.0f, 1.0f, scene, camera ) )
+		{
+			delete camera;
+			continue;
+		}
+
+		std::unique_ptr< Sampler > sampler( CreateSampler( mTraceOptions.samplerType, kSampleCount ) );
+
+		// Every sample of the image, tile by tile as the renderer traces them
+		std::vector< PixelSample > samples;
+		std::vector< uint32_t > tileStarts;
+
+		for( uint16_t y0 = 0; y0 < mHeight; y0 += tileSize )
+		{
+			for( uint16_t x0 = 0; x0 < mWidth; x0 += tileSize )
+			{
+				tileStarts.push_back( uint32_t( samples.size() ) );
+
+				for( uint16_t y = y0; y < eeMin( uint16_t( y0 + tileSize ), mHeight ); ++y )
+				{
+					for( uint16_t x = x0; x < eeMin( uint16_t( x0 + tileSize ), mWidth ); ++x )
+					{
+						for( uint32_t s = 0; s < kSampleCount; ++s )
+						{
+							samples.push_back( { x, y, s } );
+						}
+					}
+				}
+			}
+		}
+
+		tileStarts.push_back( uint32_t( samples.size() ) );
+
+		std::vector< vec3 > colors( samples.size() );
+
+		auto start = std::chrono::steady_clock::now();
+
+		for( uint32_t i = 0; i < uint32_t( samples.size() ); ++i )
+		{
+			Ray ray = GetCameraRay( samples[ i ], *camera, *sampler );
+			colors[ i ] = GetColor( ray, *scene, *sampler );
+		}
+
+		std::chrono::duration< double > pathTime = std::chrono::steady_clock::now() - start;
+
+		WavefrontBatch batch;
+		bool colorsMatch = true;
+
+		start = std::chrono::steady_clock::now();
+
+		for( uint32_t tile = 0; tile + 1 < uint32_t( tileStarts.size() ); ++tile )
+		{
+			batch.Reset();
+			batch.pixelSamples.assign( samples.begin() + tileStarts[ tile ], samples.begin() + tileStarts[ tile + 1 ] );
+			TraceWavefront( *scene, *camera, *sampler, batch );
+
+			colorsMatch = colorsMatch && std::equal( batch.colors.begin(), batch.colors.end(), colors.begin() + tileStarts[ tile ] );
+		}
+
+		std::chrono::duration< double > wavefrontTime = std::chrono::steady_clock::now() - start;
+
+		const double pathCount = double( samples.size() );
+
+		eeDebug( "Wavefront benchmark, %s, %u paths: one at a time %.3f Mpaths/s, wavefront %.3f Mpaths/s (%.2fx)%s\n",
+				 demo.name, uint32_t( samples.size() ), pathCount / pathTime.count() * 1e-6,
+				 pathCount / wavefrontTime.count() * 1e-6, pathTime.count() / wavefrontTime.count(),
+				 colorsMatch ? "" : " - IMAGES DIFFER" );
+
+		delete camera;
+		delete scene;
+	}
+}
+
+// Reads a string, for RunObjReaderCheck() to read an OBJ file from memory
+class StringInputStream : public InputStream
+{
+public:
+	StringInputStream( const std::string& text ) : mText( text ), mOffset( 0 ) {}
+
+	void Close( void ) override {}
+	bool Valid( void ) const override { return true; }
+	size_t Available( void ) const override { return mText.size() - mOffset; }
+	size_t GetSize( void ) const override { return mText.size(); }
+	bool CanSeek( void ) const override { return false; }
+	bool Seek( size_t, SeekOrigin ) override { return false; }
+	size_t GetCurrentOffset( void ) const override { return mOffset; }
+
+	FileResult Read( void* buffer, size_t bytesToRead, size_t* bytesRead = nullptr ) override
+	{
+		const size_t count = eeMin( bytesToRead, Available() );
+		memcpy( buffer, mText.data() + mOffset, count );
+		mOffset += count;
+
+		if( bytesRead != nullptr )
+		{
+			*bytesRead = count;
+		}
+
+		return FileResult::kSuccess;
+	}
+
+private:
+	const std::string&	mText;
+	size_t				mOffset;
+
+}; // class StringInputStream
+
+void PathTracer::RunObjReaderCheck( void ) const
+{
+	// A grid of vertices, row by row, each row followed by the faces
+	// between it and the row before. A row is longer than a chunk, so
+	// the faces' relative indices reach back into earlier chunks.
+	const uint32_t kGridSize = 64;
+
+	std::string text = "# ObjReader check\r\ng grid\r\n";
+	char line[ 256 ];
+
+	for( uint32_t y = 0; y < kGridSize; ++y )
+	{
+		for( uint32_t x = 0; x < kGridSize; ++x )
+		{
+			const float u = float( x ) / ( kGridSize - 1 );
+			const float v = float( y ) / ( kGridSize - 1 );
+			const float height = 0.25f * sinf( 7.0f * u ) * cosf( 5.0f * v );
+
+			snprintf( line, sizeof( line ), "v %.7g %.7g %.7g\r\nvt %.7g %.7g\r\nvn 0 1 %.7g\r\n",
+					  u, height, v, u, v, height );
+			text += line;
+		}
+
+		if( y == 0 )
+			continue;
+
+		// Relative indices count back from the last vertex so far
+		const int32_t count = int32_t( ( y + 1 ) * kGridSize );
+
+		for( uint32_t x = 0; x + 1 < kGridSize; ++x )
+		{
+			const int32_t a = int32_t( ( y - 1 ) * kGridSize + x );
+			const int32_t b = a + 1;
+			const int32_t c = b + int32_t( kGridSize );
+			const int32_t d = a + int32_t( kGridSize );
+
+			// Alternate quads with relative indices and pairs of
+			// triangles with absolute ones
+			if( x % 2 == 0 )
+			{
+				snprintf( line, sizeof( line ), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\r\n",
+						  a - count, a - count, a - count, b - count, b - count, b - count,
+						  c - count, c - count, c - count, d - count, d - count, d - count );
+			}
+			else
+			{
+				snprintf( line, sizeof( line ), "f %d/%d/%d %d/%d/%d %d/%d/%d # quad half\r\nf %d/%d/%d %d/%d/%d %d/%d/%d\t#\r\n",
+						  a + 1, a + 1, a + 1, b + 1, b + 1, b + 1, c + 1, c + 1, c + 1,
+						  a + 1, a + 1, a + 1, c + 1, c + 1, c + 1, d + 1, d + 1, d + 1 );
+			}
+
+			text += line;
+		}
+	}
+
+	// A last face whose comment makes its line longer than a chunk, with
+	// no line break after it
+	text += "f 1/1/1 2/2/2 -1/-1/-1 # ";
+	text.append( 3 * 4096, '#' );
+
+	const uint32_t expectedTriangleCount = 2 * ( kGridSize - 1 ) * ( kGridSize - 1 ) + 1;
+
+	auto read = [&]( uint32_t chunkSize, MeshData& data )
+	{
+		ObjReadOptions options;
+		options.chunkSize = chunkSize;
+
+		ObjReader reader( options );
+		StringInputStream stream( text );
+		return reader.Read( stream, data ) && ( data.GetTriangleCount() == expectedTriangleCount );
+	};
+
+	MeshData chunked, whole;
+	const bool readChunked = read( 4096, chunked );
+	const bool readWhole = read( ObjReadOptions().chunkSize, whole );
+
+	const bool meshesMatch = readChunked && readWhole &&
+							 ( chunked.positions == whole.positions ) && ( chunked.normals == whole.normals ) &&
+							 ( chunked.uvs == whole.uvs ) && ( chunked.indices == whole.indices ) &&
+							 ( chunked.normalIndices == whole.normalIndices ) && ( chunked.uvIndices == whole.uvIndices );
+
+	eeDebug( "OBJ reader check, %u bytes, %u triangles: read in 4096-byte chunks and in %u-byte chunks%s\n",
+			 uint32_t( text.size() ), expectedTriangleCount, ObjReadOptions().chunkSize,
+			 !readChunked || !readWhole ? " - READ FAILED" : meshesMatch ? "" : " - MESHES DIFFER" );
+}
+
+Scene* PathTracer::CreateRandomScene( float t0, float t1 ) const
+{
+	uint32_t n = 500; // # of objects to create
+
+	Traceable** list = new Traceable* [ n + 1 ]; // add one for the floor
+	MaterialTable* materials = new MaterialTable;
+
+	Texture* checker = new CheckerTexture( new ConstantTexture( vec3( 0.2f, 0.3f, 0.1f ) ),
+										   new ConstantTexture( vec3( 0.9f, 0.9f, 0.9f ) ) );
+	list[ 0 ] = new Sphere( vec3( 0.0f, -1000.0f, 0.0f ), 1000.0f,
+							materials->AddLambertian( checker ) );
+
+	// Every glass sphere is the same glass
+	const MaterialId glass = materials->AddGlass( 1.5f );
+
+	uint32_t i = 1;
+
+	for( int a = -10; a < 10; ++a )
+	{
+		for( int b = -10; b < 10; ++b )
+		{
+			float materialChoice = RandomFloat();
+			vec3 center( a + 0.9f * RandomFloat(), 0.2f, b + 0.9f * RandomFloat() );
+			if( ( center - vec3( 4.0f, 0.2f, 0.0f ) ).Length() > 0.9f )
+			{
+				if( materialChoice < 0.8f ) // 80% chance of a diffuse material
+				{
+					MaterialId material = materials->AddLambertian( vec3( RandomFloat() * RandomFloat(),
+																		  RandomFloat() * RandomFloat(),
+																		  RandomFloat() * RandomFloat() ) );
+					list[ i++ ] = new Sphere( center, center + vec3( 0.0f, 0.5f * RandomFloat(), 0.0f ),
+											  0.0f, 1.0f, 0.2f, material );
+				}
+				else if( materialChoice < 0.95f ) // 15% chance of Metal
+				{
+					MaterialId material = materials->AddMetal( vec3( 0.5f * ( 1.0f + RandomFloat() ),
+																	 0.5f * ( 1.0f + RandomFloat() ),
+																	 0.5f * ( 1.0f + RandomFloat() ) ),
+															   0.5f * RandomFloat() );
+
+					list[ i++ ] = new Sphere( center, 0.2f, material );
+				}
+				else // 5% chance of Glass
+				{
+					list[ i++ ] = new Sphere( center, 0.2f, glass );
+				}
+
+			} // if( ( center - vec3( 4.0f, 0.2f, 0.0f ) ).Length() > 0.9f )
+
+		} // for( int b = -11; b < 11; ++b )
+
+	} // for( int a = -11; a < 11; ++a )
+
+	// Add three big "landmark" sphere in the center,
+	// showcasing the three different material types
+
+	list[ i++ ] = new Sphere( vec3( 0.0f, 1.0f, 0.0f ), 1.0f, glass );
+	list[ i++ ] = new Sphere( vec3( -4.0f, 1.0f, 0.0f ), 1.0f, materials->AddLambertian( vec3( 0.4f, 0.2f, 0.1f ) ) ); // brown
+	list[ i++ ] = new Sphere( vec3( 4.0f, 1.0f, 0.0f ), 1.0f, materials->AddMetal( vec3( 0.7f, 0.6f, 0.5f ), 0.0f ) );
+
+	Scene* scene = new Scene;
+	if( scene == nullptr )
+		return nullptr;
+
+	if( !scene->Initialize( list, i, materials, t0, t1, mBVHBuildOptions ) )
+	{
+		delete scene;
+		return nullptr;
+	}
+
+	return scene;
+}
+
+Scene* PathTracer::CreateTwoPerlinSpheres( float t0, float t1 ) const
+{
+	static const float scale = 4.0f;
+	static const size_t kListCount = 4;
+
+	MaterialTable* materials = new MaterialTable;
+	const MaterialId noise = materials->AddLambertian( new NoiseTexture( scale ) );
+	const MaterialId light = materials->AddDiffuseLight( vec3( 4.0f, 4.0f, 4.0f ) );
 
 	Traceable** list = new Traceable* [ kListCount ];
-	list[ 0 ] = new Sphere( vec3( 0.0f, -1000.0f, 0.0f ), 1000.0f, new Lambertian( new NoiseTexture( scale ) ) );
-	list[ 1 ] = new Sphere( vec3( 0.0f, 2.0f, 0.0f ), 2.0f, new Lambertian( new NoiseTexture( scale ) ) );
-	list[ 2 ] = new Sphere( vec3( 0.0f, 7.0f, 0.0f ), 2.0f, new DiffuseLight( new ConstantTexture( vec3( 4.0f, 4.0f, 4.0f ) ) ) );
-	list[ 3 ] = new xyRect( 3.0f, 5.0f, -1.0f, 3.0f, -2.0f, new DiffuseLight( new ConstantTexture( vec3( 4.0f, 4.0f, 4.0f ) ) ) );
+	list[ 0 ] = new Sphere( vec3( 0.0f, -1000.0f, 0.0f ), 1000.0f, noise );
+	list[ 1 ] = new Sphere( vec3( 0.0f, 2.0f, 0.0f ), 2.0f, noise );
+	list[ 2 ] = new Sphere( vec3( 0.0f, 7.0f, 0.0f ), 2.0f, light );
+	list[ 3 ] = new xyRect( 3.0f, 5.0f, -1.0f, 3.0f, -2.0f, light );
 
 	Scene* scene = new Scene;
 	if( scene == nullptr )
 		return nullptr;
 
-	if( !scene->Initialize( list, kListCount ) )
+	if( !scene->Initialize( list, kListCount, materials, t0, t1, mBVHBuildOptions ) )
 	{
 		delete scene;
 		return nullptr;
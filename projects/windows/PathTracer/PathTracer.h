@@ -5,21 +5,125 @@
 #pragma once
 
 #include <stdint.h>
-#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <ee/math/vec3.h>
 #include <ee/math/Ray.h>
 
 #include "Camera.h"
+#include "Sampler.h"
 #include "Scene.h"
+#include "TileScheduler.h"
+#include "TraceJob.h"
 
 using namespace ee;
 
+struct TraceOptions
+{
+	// The number of threads to trace with; 0 means one per hardware thread
+	uint32_t	threadCount = 0;
+
+	// The image is traced in square tiles of this many pixels on a side,
+	// which idle threads take from busy ones. Smaller tiles balance the
+	// load better, larger ones cost less to schedule.
+	uint16_t	tileSize = 16;
+
+	// The number of samples to take per pixel, in passes of samplesPerPass
+	// samples over the whole image. The image is resolved as each tile is
+	// traced, so there is a complete preview after the first pass.
+	uint32_t	sampleCount = 100;
+	uint32_t	samplesPerPass = 4;
+
+	// Paths end after this many bounces. From russianRouletteDepth bounces
+	// on, paths carrying little light are also ended at random, with the
+	// survivors weighted to keep the image unbiased; set it to maxDepth or
+	// more to trace every path to the full depth.
+	uint32_t	maxDepth = 50;
+	uint32_t	russianRouletteDepth = 3;
+
+	// Next event estimation: at every diffuse surface a path reaches, also
+	// aim a shadow ray at a point on a randomly chosen light, and combine
+	// the two ways of finding each light with multiple importance sampling.
+	// Scenes lit by small lights converge far faster.
+	bool		sampleLights = true;
+
+	// Adaptive sampling: once a pixel has minSampleCount samples, it gets
+	// no more when the standard error of its mean, in display (gamma 2)
+	// space, is below adaptiveThreshold for it and its eight neighbors.
+	// sampleCount is then the most samples any pixel gets, and the time
+	// saved on converged pixels goes to the noisy ones. A threshold of 0
+	// turns adaptive sampling off.
+	float		adaptiveThreshold = 0.0f;
+	uint32_t	minSampleCount = 16;
+
+	// Where the random numbers each sample needs come from. The low
+	// discrepancy samplers spread a pixel's samples evenly over the pixel,
+	// the lens and the bounce directions, so the image converges with far
+	// fewer samples than with independent random numbers; see Sampler.h.
+	SamplerType	samplerType = SamplerType::kSobol;
+
+	// Wavefront tracing: rather than following each path from the camera
+	// to its end before starting the next, trace all of a tile's samples
+	// together, a bounce at a time, with each stage of the bounce run over
+	// every path before the next stage starts; see WavefrontBatch. Makes
+	// the same image as tracing one path at a time.
+	bool		wavefront = false;
+
+	// Trace the camera rays in packets of RayPacket::kSize neighboring
+	// rays; see Scene::IntersectPackets(). Tracing one path at a time, a
+	// packet holds one sample of each of a row of neighboring pixels;
+	// tracing wavefront style, it holds samples of a pixel or two.
+	bool		primaryRayPackets = true;
+
+	// Stop tracing after this many seconds, even if not every sample has
+	// been taken; 0 means no limit. Pixels traced by the pass that was
+	// running keep their extra samples.
+	double		timeBudget = 0.0;
+
+}; // struct TraceOptions
+
+// One sample of one pixel
+struct PixelSample
+{
+	uint16_t	x, y;
+	uint32_t	index; // the sample's number within the pixel
+
+}; // struct PixelSample
+
+// A shadow ray aimed at a point on a light, for next event estimation,
+// and what reaches the surface it starts from if nothing is in its way
+struct LightSample
+{
+	Ray			shadowRay;
+	RayHit		lightHit;	// where shadowRay reaches the light
+	vec3		scattering;	// the surface's scattering towards the light
+	float		weight;		// the multiple importance sampling weight, over the light's pdf
+
+}; // struct LightSample
+
+// The camera rays of a tile's samples, traced together in packets before
+// the rest of each path is traced by GetColor(), and the light each path
+// brings back. The vectors keep their capacity from tile to tile.
+struct CameraRayBatch
+{
+	std::vector< PixelSample >	pixelSamples;
+	std::vector< Ray >			rays;
+	std::vector< RayHit >		hits;
+	std::vector< vec3 >			colors;
+
+}; // struct CameraRayBatch
+
+struct WavefrontBatch;
+
 class PathTracer
 {
 public:
 	typedef void( *ProgressCallback )( uint16_t step, const void* data ); // step is in [0, 100]
 	typedef void( *CompleteCallback )( const PathTracer& tracer, const void* data );
+	typedef void( *PassCallback )( const PathTracer& tracer, const uint8_t* pixels, uint32_t sampleCount, const void* data );
 
 	PathTracer();
 	~PathTracer();
@@ -29,6 +133,23 @@ public:
 	void SetProgressCallback( ProgressCallback callback, const void* data );
 	void SetCompleteCallback( CompleteCallback callback, const void* data );
 
+	// Called after each pass over the image, with a preview of the image
+	// laid out like GetPixels(), and the number of samples per pixel traced
+	// for it. The next pass is traced while the callback runs, so GetPixels()
+	// may be partly updated by then; the preview is a copy that stays as it
+	// is until the callback returns.
+	void SetPassCallback( PassCallback callback, const void* data );
+
+	// Controls how the scene's BVH is built; must be set before StartTrace()
+	void SetBVHBuildOptions( const BVHBuildOptions& options );
+
+	// Controls how Trace() spreads the work over threads
+	void SetTraceOptions( const TraceOptions& options );
+
+	// The scene file StartTrace() reads (see SceneReader); with none, or
+	// if it can't be read, StartTrace() creates a demo scene instead
+	void SetSceneFile( const char* filename );
+
 	inline void GetDimensions( uint16_t& width, uint16_t& height ) const;
 	inline uint8_t GetBytesPerPixel( void ) const;
 
@@ -36,29 +157,133 @@ public:
 
 	void SaveImage( const char* filename ) const;
 
-	// To run the path tracer, call startTrace() to initialize the scene
-	// and then trace() to run the actual path tracing loops
+	// The number of samples traced through each pixel, in the same order
+	// as GetPixels(); with adaptive sampling these differ from pixel to pixel
+	inline const uint32_t* GetPixelSampleCounts( void ) const;
+
+	// Writes a heatmap of GetPixelSampleCounts() to a BGR image the size of
+	// GetPixels(): black for no samples, through red and yellow, to white
+	// for TraceOptions::sampleCount samples
+	void ResolveSampleHeatmap( uint8_t* pixels ) const;
+	void SaveSampleHeatmap( const char* filename ) const;
+
+	// To run the path tracer, call StartTrace() to initialize the scene
+	// and then BeginTrace() or Trace() to run the actual path tracing loops
 	void StartTrace( void );
 
-	// Single-threaded brute force tracer loop, will block the GUI
+	// Starts tracing the image on TraceOptions::threadCount threads and
+	// returns without waiting. Use the job to poll, wait for or cancel the
+	// trace; the progress and complete callbacks are made from its Poll()
+	// and Wait() calls. The job belongs to the tracer and stays valid until
+	// the next BeginTrace(). Returns nullptr if a trace is already running.
+	TraceJob* BeginTrace( void );
+
+	// BeginTrace() and wait for the trace to finish
 	void Trace( void );
 
+	// Times closest-hit queries against the binary and wide BVHs on the
+	// demo scenes, reporting rays per second with eeDebug
+	void RunBVHBenchmark( void ) const;
+
+	// Times tracing the demo scenes one path at a time and wavefront
+	// style, on one thread at a few samples per pixel of the image size
+	// given to Initialize(), reporting paths per second with eeDebug and
+	// checking that both give the same image
+	void RunWavefrontBenchmark( void ) const;
+
+	// Reads a generated OBJ file in the smallest chunks ObjReader allows
+	// and in its default ones, reporting with eeDebug whether both give the
+	// same mesh. The file has relative indices that reach back across chunks,
+	// a line longer than a chunk, comments after faces and CRLF line breaks.
+	void RunObjReaderCheck( void ) const;
+
 private:
-	void StepTrace( uint16_t x, uint16_t y );
-	vec3 GetColor( const Ray& r, Scene& scene, int depth ) const;
+	enum class DemoScene
+	{
+		kRandomSpheres,		// CreateRandomScene()
+		kTwoPerlinSpheres	// CreateTwoPerlinSpheres()
+	};
+
+	// Adds sampleCount samples from sampler to pixel (x, y) and resolves it
+	// into mPixels
+	void StepTrace( uint16_t x, uint16_t y, uint32_t sampleCount, Sampler& sampler );
+	// The same for every pixel of tile, with the camera rays of each of
+	// the tile's samples traced in packets of neighboring pixels
+	void StepTracePackets( const Tile& tile, uint32_t sampleCount, Sampler& sampler, CameraRayBatch& batch );
+	// The same for every pixel of tile, with the samples traced together
+	// by TraceWavefront()
+	void StepTraceWavefront( const Tile& tile, uint32_t sampleCount, Sampler& sampler, WavefrontBatch& batch );
+	void ResolvePixel( uint16_t x, uint16_t y );
+	// Returns the standard error of pixel index's mean luminance in
+	// display space, divided by the adaptive sampling threshold
+	float GetRelativeError( uint32_t index ) const;
+
+	// Marks the pixels that need no more samples, between passes; returns
+	// false if every pixel has converged
+	bool UpdateConvergence( void );
+	// Starts sample in sampler and returns the camera ray it traces
+	Ray GetCameraRay( const PixelSample& sample, const Camera& camera, Sampler& sampler ) const;
+	// Traces a path from the camera along r, returning the light it carries.
+	// If firstHit isn't null, it's what r hits, found by Scene::Intersect()
+	// or IntersectPackets().
+	vec3 GetColor( const Ray& r, const Scene& scene, Sampler& sampler, const RayHit* firstHit = nullptr ) const;
+	// Traces the paths of batch.pixelSamples together and stores the light
+	// each carries in batch.colors, the same as GetColor() would find
+	void TraceWavefront( const Scene& scene, const Camera& camera, Sampler& sampler, WavefrontBatch& batch ) const;
+	// Aims a shadow ray from hit at a randomly chosen light. Returns false
+	// if the light can't be seen from hit; otherwise, unless the shadow ray
+	// is occluded, GetLightRadiance() is the light reaching hit from the
+	// light and scattered back along r, weighted for multiple importance
+	// sampling.
+	bool SampleLight( const Ray& r, const HitRecord& hit, const Scene& scene, uint32_t depth,
+					  Sampler& sampler, LightSample& sample ) const;
+	vec3 GetLightRadiance( const Scene& scene, const LightSample& sample ) const;
+	vec3 GetBackground( const Ray& r ) const;
 
-	Scene* CreateRandomScene( void ) const;
-	Scene* CreateTwoPerlinSpheres( void ) const;
+	// Creates one of the built-in scenes, with a camera to view it from;
+	// t0 and t1 are the camera shutter interval, in seconds
+	bool CreateDemoScene( DemoScene demo, float t0, float t1, Scene*& scene, Camera*& camera ) const;
+
+	// t0 and t1 are the camera shutter interval, in seconds
+	Scene* CreateRandomScene( float t0, float t1 ) const;
+	Scene* CreateTwoPerlinSpheres( float t0, float t1 ) const;
 
-	uint32_t				mSampleCount;
 	uint16_t				mWidth, mHeight; // in pixels
 	uint8_t					mBytesPerPixel;
-	uint8_t*				mPixels;
+	uint8_t*				mPixels; // resolved from mAccumulation
+
+	// The sum of the linear, unclamped radiance samples traced through
+	// each pixel, and how many there were
+	std::vector< vec3 >		mAccumulation;
+	std::vector< uint32_t >	mPixelSampleCounts;
+
+	// For adaptive sampling: the sum of the squares of each pixel's sample
+	// luminances, whether the pixel needs any more samples, and scratch
+	// space for UpdateConvergence()
+	std::vector< float >	mLuminanceSquares;
+	std::vector< uint8_t >	mPixelConverged;
+	std::vector< float >	mPixelErrors;
 
 	Camera*					mCamera;
 	Scene*					mScene;
 
-	std::atomic_uint32_t	mProgressCounter;
+	BVHBuildOptions			mBVHBuildOptions;
+	TraceOptions			mTraceOptions;
+	std::string				mSceneFile;
+	TileScheduler			mTileScheduler;
+
+	std::unique_ptr< TraceJob >	mJob;
+
+	// Each worker thread's batch for wavefront tracing, or for tracing
+	// camera rays in packets, kept from tile to tile and trace to trace so
+	// that its queues stay allocated
+	std::vector< WavefrontBatch >	mWavefrontBatches;
+	std::vector< CameraRayBatch >	mCameraRayBatches;
+
+	// Each worker thread's sampler, made for each trace's sampler type
+	// and sample count; a sample's values don't depend on what the
+	// sampler was used for before
+	std::vector< std::unique_ptr< Sampler > >	mSamplers;
 
 	ProgressCallback		mProgressCallback;
 	const void*				mProgressCallbackData;
@@ -66,6 +291,15 @@ private:
 	CompleteCallback		mCompleteCallback;
 	const void*				mCompleteCallbackData;
 
+	PassCallback			mPassCallback;
+	const void*				mPassCallbackData;
+
+	// mPixels as it was at the end of the last pass, for the pass callback,
+	// and the samples per pixel traced for it
+	std::vector< uint8_t >	mPreviewPixels;
+	uint32_t				mPreviewSampleCount;
+	std::mutex				mPreviewMutex;
+
 }; // class PathTracer
 
 inline void PathTracer::GetDimensions( uint16_t& width, uint16_t& height ) const
@@ -83,3 +317,8 @@ inline const uint8_t* PathTracer::GetPixels( void ) const
 {
 	return mPixels;
 }
+
+inline const uint32_t* PathTracer::GetPixelSampleCounts( void ) const
+{
+	return mPixelSampleCounts.data();
+}
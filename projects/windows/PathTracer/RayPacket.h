@@ -0,0 +1,166 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined( EE_BUILD_X86 )
+#  include <immintrin.h>
+#endif
+
+#include <ee/math/AABB.h>
+#include <ee/math/Ray.h>
+
+using namespace ee;
+
+// A few rays held in structure-of-arrays form, one per SIMD lane, so that
+// they can be traced together: 8 with AVX, 4 otherwise. Packets are for
+// coherent rays, such as the camera rays of neighboring pixels, which
+// mostly visit the same BVH nodes and hit the same primitives. Lanes past
+// count repeat the first ray, and are never reported as hitting anything.
+struct alignas( 32 ) RayPacket
+{
+#if defined( EE_BUILD_X86 ) && defined( __AVX__ )
+	static const uint32_t kSize = 8;
+#else
+	static const uint32_t kSize = 4;
+#endif
+
+	// Indexed by axis, then by lane
+	float		origin[ 3 ][ kSize ];
+	float		direction[ 3 ][ kSize ];
+	float		invDirection[ 3 ][ kSize ];
+	float		directionLengthSquared[ kSize ];
+	float		time[ kSize ];
+
+	// The signs the rays' directions share, when the packet is coherent
+	int			dirIsNegative[ 3 ];
+	bool		coherent;
+
+	const Ray*	rays;
+	uint32_t	count;
+
+	// Gathers packetRays[ 0 ] to packetRays[ packetCount - 1 ]; packetCount
+	// is at most kSize
+	inline void Initialize( const Ray* packetRays, uint32_t packetCount );
+
+	// The lanes that hold one of the packet's rays
+	inline uint32_t GetLaneMask( void ) const;
+
+	// Whether the rays can be traced as a packet: the signs of their
+	// directions must agree on each axis, so that they cross every box's
+	// slabs in the same order and agree on which child of a node is
+	// nearer. Rays that diverge that much get little from being traced
+	// together.
+	inline bool IsCoherent( void ) const;
+
+	// Returns a bitmask of the lanes whose rays enter box in
+	// [ t_min, tMax[ lane ] ], testing every lane at once
+	inline uint32_t IntersectBounds( const AABB& box, float t_min, const float tMax[ kSize ] ) const;
+
+}; // struct RayPacket
+
+inline void RayPacket::Initialize( const Ray* packetRays, uint32_t packetCount )
+{
+	rays = packetRays;
+	count = packetCount;
+
+	for( uint32_t lane = 0; lane < kSize; ++lane )
+	{
+		const Ray& ray = rays[ lane < count ? lane : 0 ];
+
+		for( int a = 0; a < 3; ++a )
+		{
+			origin[ a ][ lane ] = ray.GetOrigin()[ a ];
+			direction[ a ][ lane ] = ray.GetDirection()[ a ];
+			invDirection[ a ][ lane ] = 1.0f / ray.GetDirection()[ a ];
+		}
+
+		directionLengthSquared[ lane ] = Dot( ray.GetDirection(), ray.GetDirection() );
+		time[ lane ] = ray.GetTime();
+	}
+
+	coherent = true;
+
+	for( int a = 0; a < 3; ++a )
+	{
+		dirIsNegative[ a ] = invDirection[ a ][ 0 ] < 0.0f;
+
+		for( uint32_t lane = 1; lane < kSize; ++lane )
+		{
+			if( int( invDirection[ a ][ lane ] < 0.0f ) != dirIsNegative[ a ] )
+			{
+				coherent = false;
+			}
+		}
+	}
+}
+
+inline uint32_t RayPacket::GetLaneMask( void ) const
+{
+	return ( 1u << count ) - 1;
+}
+
+inline bool RayPacket::IsCoherent( void ) const
+{
+	return coherent;
+}
+
+inline uint32_t RayPacket::IntersectBounds( const AABB& box, float t_min, const float tMax[ kSize ] ) const
+{
+	// The same arithmetic as AABB::Hit(), one lane per ray
+#if defined( EE_BUILD_X86 ) && defined( __AVX__ )
+	__m256 nearT = _mm256_set1_ps( t_min );
+	__m256 farT = _mm256_loadu_ps( tMax );
+
+	for( int a = 0; a < 3; ++a )
+	{
+		const float nearSlab = dirIsNegative[ a ] ? box.GetMax()[ a ] : box.GetMin()[ a ];
+		const float farSlab = dirIsNegative[ a ] ? box.GetMin()[ a ] : box.GetMax()[ a ];
+
+		__m256 o = _mm256_load_ps( origin[ a ] );
+		__m256 d = _mm256_load_ps( invDirection[ a ] );
+		__m256 t0 = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( nearSlab ), o ), d );
+		__m256 t1 = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( farSlab ), o ), d );
+		nearT = _mm256_max_ps( t0, nearT );
+		farT = _mm256_min_ps( t1, farT );
+	}
+
+	return uint32_t( _mm256_movemask_ps( _mm256_cmp_ps( farT, nearT, _CMP_GT_OQ ) ) );
+#elif defined( EE_BUILD_X86 )
+	__m128 nearT = _mm_set1_ps( t_min );
+	__m128 farT = _mm_loadu_ps( tMax );
+
+	for( int a = 0; a < 3; ++a )
+	{
+		const float nearSlab = dirIsNegative[ a ] ? box.GetMax()[ a ] : box.GetMin()[ a ];
+		const float farSlab = dirIsNegative[ a ] ? box.GetMin()[ a ] : box.GetMax()[ a ];
+
+		__m128 o = _mm_load_ps( origin[ a ] );
+		__m128 d = _mm_load_ps( invDirection[ a ] );
+		__m128 t0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( nearSlab ), o ), d );
+		__m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( farSlab ), o ), d );
+		nearT = _mm_max_ps( t0, nearT );
+		farT = _mm_min_ps( t1, farT );
+	}
+
+	return uint32_t( _mm_movemask_ps( _mm_cmpgt_ps( farT, nearT ) ) );
+#else
+	uint32_t mask = 0;
+
+	for( uint32_t lane = 0; lane < kSize; ++lane )
+	{
+		const vec3 laneOrigin( origin[ 0 ][ lane ], origin[ 1 ][ lane ], origin[ 2 ][ lane ] );
+		const vec3 laneInvDirection( invDirection[ 0 ][ lane ], invDirection[ 1 ][ lane ], invDirection[ 2 ][ lane ] );
+
+		if( box.Hit( laneOrigin, laneInvDirection, dirIsNegative, t_min, tMax[ lane ] ) )
+		{
+			mask |= 1u << lane;
+		}
+	}
+
+	return mask;
+#endif
+}
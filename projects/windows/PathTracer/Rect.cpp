@@ -4,30 +4,22 @@
 
 #include "pch.h"
 
+#include <cfloat>
+
 #include "Rect.h"
 #include "Material.h"
 
 #include <ee/math/AABB.h>
 
-bool xyRect::Hit( const Ray& r, float t_min, float t_max, HitRecord& hit ) const
+void xyRect::FinalizeHit( const Ray& r, const RayHit& hit, HitRecord& rec ) const
 {
-	float t = ( mK - r.GetOrigin().z ) / r.GetDirection().z;
-	if( ( t < t_min ) || ( t > t_max ) )
-		return false;
-
-	float x = r.GetOrigin().x + t * r.GetDirection().x;
-	float y = r.GetOrigin().y + t * r.GetDirection().y;
-	if( ( x < mX0 ) || ( x > mX1 ) || ( y < mY0 ) || ( y > mY1 ) )
-		return false;
-
-	hit.u = ( x - mX0 ) / ( mX1 - mX0 );
-	hit.v = ( y - mY0 ) / ( mY1 - mY0 );
-	hit.t = t;
-	hit.material = mMaterial;
-	hit.p = r.PointAtParameter( t );
-	hit.normal = vec3( 0.0f, 0.0f, 1.0f );
-
-	return true;
+	rec.t = hit.t;
+	rec.u = hit.u;
+	rec.v = hit.v;
+	rec.p = r.PointAtParameter( hit.t );
+	rec.normal = vec3( 0.0f, 0.0f, 1.0f );
+	rec.material = mMaterial;
+	rec.object = this;
 }
 
 bool xyRect::GetBoundingBox( float t0, float t1, AABB& box ) const
@@ -35,3 +27,35 @@ bool xyRect::GetBoundingBox( float t0, float t1, AABB& box ) const
 	box = AABB( vec3( mX0, mY0, mK - 0.0001f ), vec3( mX1, mY1, mK + 0.0001f ) );
 	return true;
 }
+
+bool xyRect::IsLight( const MaterialTable& materials ) const
+{
+	return materials.IsEmitter( mMaterial );
+}
+
+float xyRect::SampleDirection( const vec3& origin, float time, float u1, float u2, vec3& direction ) const
+{
+	vec3 point( mX0 + u1 * ( mX1 - mX0 ), mY0 + u2 * ( mY1 - mY0 ), mK );
+	vec3 toPoint = point - origin;
+
+	float distanceSquared = toPoint.LengthSquared();
+	if( distanceSquared == 0.0f )
+		return 0.0f;
+
+	direction = toPoint / sqrt( distanceSquared );
+
+	// The rectangle can be seen from either side
+	return GetSolidAnglePdf( distanceSquared, fabs( direction.z ) );
+}
+
+float xyRect::GetDirectionPdf( const Ray& r ) const
+{
+	RayHit hit;
+	if( !Intersect( r, 0.001f, FLT_MAX, hit ) )
+		return 0.0f;
+
+	float length = r.GetDirection().Length();
+	float distance = hit.t * length;
+
+	return GetSolidAnglePdf( distance * distance, fabs( r.GetDirection().z ) / length );
+}
@@ -10,7 +10,6 @@
 
 using namespace ee;
 
-class Material;
 
 class xyRect : public Traceable
 {
@@ -18,10 +17,10 @@ public:
 	xyRect()
 		: mX0( 0.0f ), mX1( 0.0f )
 		, mY0( 0.0f ), mY1( 0.0f )
-		, mK( 0.0f ), mMaterial( nullptr )
+		, mK( 0.0f ), mMaterial( 0 )
 	{}
 
-	xyRect( float x0, float x1, float y0, float y1, float k, Material* material )
+	xyRect( float x0, float x1, float y0, float y1, float k, MaterialId material )
 		: mX0( x0 ), mX1( x1 )
 		, mY0( y0 ), mY1( y1 )
 		, mK( k ), mMaterial( material )
@@ -29,14 +28,67 @@ public:
 
 	// Traceable interface implementation
 
-	virtual bool Hit( const Ray& r, float t_min, float t_max, HitRecord& rec ) const;
+	virtual bool Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const;
+	virtual void FinalizeHit( const Ray& r, const RayHit& hit, HitRecord& rec ) const;
+
+	virtual bool Occluded( const Ray& r, float t_min, float t_max ) const;
 
 	virtual bool GetBoundingBox( float t0, float t1, AABB& box ) const;
 
+	virtual bool IsLight( const MaterialTable& materials ) const;
+
+	// Picks directions towards points spread uniformly over the rectangle
+	virtual float SampleDirection( const vec3& origin, float time, float u1, float u2, vec3& direction ) const;
+	virtual float GetDirectionPdf( const Ray& r ) const;
+
 private:
+	// Converts the density of a point uniformly picked on the rectangle,
+	// which is seen from distanceSquared away at an angle whose cosine
+	// is cosine, to a density per unit solid angle
+	inline float GetSolidAnglePdf( float distanceSquared, float cosine ) const;
+
 	float		mX0, mX1;
 	float		mY0, mY1;
 	float		mK;
-	Material*	mMaterial;
+	MaterialId	mMaterial;
 
 }; // class xyRect
+
+inline float xyRect::GetSolidAnglePdf( float distanceSquared, float cosine ) const
+{
+	if( cosine <= 0.0f )
+		return 0.0f; // edge on
+
+	float area = ( mX1 - mX0 ) * ( mY1 - mY0 );
+	return distanceSquared / ( cosine * area );
+}
+
+inline bool xyRect::Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const
+{
+	float t = ( mK - r.GetOrigin().z ) / r.GetDirection().z;
+	if( ( t < t_min ) || ( t > t_max ) )
+		return false;
+
+	float x = r.GetOrigin().x + t * r.GetDirection().x;
+	float y = r.GetOrigin().y + t * r.GetDirection().y;
+	if( ( x < mX0 ) || ( x > mX1 ) || ( y < mY0 ) || ( y > mY1 ) )
+		return false;
+
+	hit.u = ( x - mX0 ) / ( mX1 - mX0 );
+	hit.v = ( y - mY0 ) / ( mY1 - mY0 );
+	hit.t = t;
+	hit.object = this;
+
+	return true;
+}
+
+inline bool xyRect::Occluded( const Ray& r, float t_min, float t_max ) const
+{
+	float t = ( mK - r.GetOrigin().z ) / r.GetDirection().z;
+	if( ( t < t_min ) || ( t > t_max ) )
+		return false;
+
+	float x = r.GetOrigin().x + t * r.GetDirection().x;
+	float y = r.GetOrigin().y + t * r.GetDirection().y;
+	return ( x >= mX0 ) && ( x <= mX1 ) && ( y >= mY0 ) && ( y <= mY1 );
+}
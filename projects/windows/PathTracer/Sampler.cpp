@@ -0,0 +1,409 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "Sampler.h"
+
+// The largest float below 1
+static const float kOneMinusEpsilon = 0.99999994f;
+
+// The blue noise tile is kBlueNoiseSize pixels square; a power of two
+static const uint32_t kBlueNoiseSize = 64;
+
+// Returns a well mixed hash of a and b
+static inline uint32_t Hash( uint32_t a, uint32_t b )
+{
+	return uint32_t( MixBits( ( uint64_t( a ) << 32 ) | b ) );
+}
+
+static inline uint32_t GetPixelKey( uint16_t x, uint16_t y )
+{
+	return ( uint32_t( y ) << 16 ) | x;
+}
+
+// Converts a 32 bit fraction to a float in [ 0, 1 ); the top 24 bits fill
+// a float's mantissa exactly, so the result is never rounded up to 1
+static inline float ToFloat( uint32_t fraction )
+{
+	return float( fraction >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+static inline uint32_t ReverseBits( uint32_t x )
+{
+	x = ( x << 16 ) | ( x >> 16 );
+	x = ( ( x & 0x00ff00ff ) << 8 ) | ( ( x & 0xff00ff00 ) >> 8 );
+	x = ( ( x & 0x0f0f0f0f ) << 4 ) | ( ( x & 0xf0f0f0f0 ) >> 4 );
+	x = ( ( x & 0x33333333 ) << 2 ) | ( ( x & 0xcccccccc ) >> 2 );
+	x = ( ( x & 0x55555555 ) << 1 ) | ( ( x & 0xaaaaaaaa ) >> 1 );
+	return x;
+}
+
+// Laine and Karras' hash, which only lets each bit of x affect the bits
+// above it; seen from the most significant bit down, that makes it an
+// Owen scramble
+static inline uint32_t LaineKarrasPermutation( uint32_t x, uint32_t seed )
+{
+	x += seed;
+	x ^= x * 0x6c50b47c;
+	x ^= x * 0xb82f1e52;
+	x ^= x * 0xc7afe638;
+	x ^= x * 0x8d22f6e6;
+	return x;
+}
+
+// Owen scrambles the 32 bit fraction x: a random permutation of each
+// binary digit that depends only on the digits before it, which keeps
+// the stratification of a Sobol sequence and randomizes everything else
+static inline uint32_t NestedUniformScramble( uint32_t x, uint32_t seed )
+{
+	return ReverseBits( LaineKarrasPermutation( ReverseBits( x ), seed ) );
+}
+
+// The first two dimensions of the Sobol sequence, as 32 bit fractions;
+// the first is the van der Corput sequence
+static inline uint32_t Sobol0( uint32_t index )
+{
+	return ReverseBits( index );
+}
+
+static inline uint32_t Sobol1( uint32_t index )
+{
+	uint32_t result = 0;
+	for( uint32_t direction = 0x80000000; index != 0; index >>= 1, direction ^= direction >> 1 )
+	{
+		if( index & 1 )
+		{
+			result ^= direction;
+		}
+	}
+
+	return result;
+}
+
+// Returns where i goes in a random permutation of [ 0, count ) chosen by
+// seed, without storing the permutation; from Kensler, "Correlated
+// Multi-Jittered Sampling", 2013
+static uint32_t Permute( uint32_t i, uint32_t count, uint32_t seed )
+{
+	uint32_t mask = count - 1;
+	mask |= mask >> 1;
+	mask |= mask >> 2;
+	mask |= mask >> 4;
+	mask |= mask >> 8;
+	mask |= mask >> 16;
+
+	// A permutation of the next power of two up, applied until i lands
+	// back inside [ 0, count )
+	do
+	{
+		i ^= seed;
+		i *= 0xe170893d;
+		i ^= seed >> 16;
+		i ^= ( i & mask ) >> 4;
+		i ^= seed >> 8;
+		i *= 0x0929eb3f;
+		i ^= seed >> 23;
+		i ^= ( i & mask ) >> 1;
+		i *= 1 | seed >> 27;
+		i *= 0x6935fa69;
+		i ^= ( i & mask ) >> 11;
+		i *= 0x74dcb303;
+		i ^= ( i & mask ) >> 2;
+		i *= 0x9e501cc3;
+		i ^= ( i & mask ) >> 2;
+		i *= 0xc860a3df;
+		i &= mask;
+		i ^= i >> 5;
+	}
+	while( i >= count );
+
+	return ( i + seed ) % count;
+}
+
+// Builds a kBlueNoiseSize square tile of blue noise with Ulichney's
+// void-and-cluster method: points are added one at a time, each where
+// they are sparsest, and the order they go in ranks the pixels. Returns
+// the ranks as 32 bit fractions, evenly spread over [ 0, 1 ).
+static std::vector< uint32_t > CreateBlueNoise( void )
+{
+	const uint32_t size = kBlueNoiseSize;
+	const uint32_t mask = size - 1;
+	const uint32_t count = size * size;
+
+	// How crowded the points make each pixel: the sum of a Gaussian of the
+	// distance to every point, with the tile wrapping around at the edges
+	const float kSigma = 1.5f;
+
+	std::vector< float > kernel( count );
+	for( uint32_t y = 0; y < size; ++y )
+	{
+		for( uint32_t x = 0; x < size; ++x )
+		{
+			float dx = float( eeMin( x, size - x ) );
+			float dy = float( eeMin( y, size - y ) );
+			kernel[ y * size + x ] = exp( -( dx * dx + dy * dy ) / ( 2.0f * kSigma * kSigma ) );
+		}
+	}
+
+	std::vector< uint8_t > points( count, 0 );
+	std::vector< float > energy( count, 0.0f );
+
+	auto add = [&]( uint32_t point, float sign )
+	{
+		points[ point ] = sign > 0.0f;
+
+		const uint32_t px = point % size;
+		const uint32_t py = point / size;
+		for( uint32_t y = 0; y < size; ++y )
+		{
+			for( uint32_t x = 0; x < size; ++x )
+			{
+				energy[ y * size + x ] += sign * kernel[ ( ( y - py ) & mask ) * size + ( ( x - px ) & mask ) ];
+			}
+		}
+	};
+
+	auto findTightestCluster = [&]()
+	{
+		uint32_t best = 0;
+		float bestEnergy = -1.0f;
+		for( uint32_t i = 0; i < count; ++i )
+		{
+			if( points[ i ] && ( energy[ i ] > bestEnergy ) )
+			{
+				best = i;
+				bestEnergy = energy[ i ];
+			}
+		}
+
+		return best;
+	};
+
+	auto findLargestVoid = [&]()
+	{
+		uint32_t best = 0;
+		float bestEnergy = FLT_MAX;
+		for( uint32_t i = 0; i < count; ++i )
+		{
+			if( !points[ i ] && ( energy[ i ] < bestEnergy ) )
+			{
+				best = i;
+				bestEnergy = energy[ i ];
+			}
+		}
+
+		return best;
+	};
+
+	// Scatter points over a tenth of the tile at random, then move them
+	// one at a time from the tightest cluster to the largest void until
+	// the one moved would go straight back
+	PCG32 generator;
+
+	uint32_t initialCount = 0;
+	while( initialCount < count / 10 )
+	{
+		uint32_t point = generator.NextUInt() % count;
+		if( !points[ point ] )
+		{
+			add( point, 1.0f );
+			++initialCount;
+		}
+	}
+
+	for( uint32_t move = 0; move < count; ++move )
+	{
+		uint32_t cluster = findTightestCluster();
+		add( cluster, -1.0f );
+
+		uint32_t emptiest = findLargestVoid();
+		add( emptiest, 1.0f );
+
+		if( emptiest == cluster )
+			break;
+	}
+
+	const std::vector< uint8_t > initialPoints = points;
+	const std::vector< float > initialEnergy = energy;
+
+	// Rank the initial points by taking them away, tightest cluster first,
+	// and then the rest by filling in the largest void each time
+	std::vector< uint32_t > ranks( count );
+
+	for( uint32_t rank = initialCount; rank-- > 0; )
+	{
+		uint32_t cluster = findTightestCluster();
+		add( cluster, -1.0f );
+		ranks[ cluster ] = rank;
+	}
+
+	points = initialPoints;
+	energy = initialEnergy;
+
+	for( uint32_t rank = initialCount; rank < count; ++rank )
+	{
+		uint32_t emptiest = findLargestVoid();
+		add( emptiest, 1.0f );
+		ranks[ emptiest ] = rank;
+	}
+
+	std::vector< uint32_t > noise( count );
+	for( uint32_t i = 0; i < count; ++i )
+	{
+		// The middle of the rank's share of [ 0, 1 )
+		noise[ i ] = uint32_t( ( ( uint64_t( ranks[ i ] ) << 33 ) + ( uint64_t( 1 ) << 32 ) ) / ( 2 * count ) );
+	}
+
+	return noise;
+}
+
+void IndependentSampler::Seed( uint32_t dimension )
+{
+	// Each dimension of each sample has its own stream
+	uint64_t key = ( uint64_t( GetPixelKey( mX, mY ) ) << 32 ) | mSampleIndex;
+	mGenerator.Seed( MixBits( key ), dimension );
+}
+
+float IndependentSampler::Sample1D( uint32_t dimension )
+{
+	Seed( dimension );
+	return mGenerator.NextFloat();
+}
+
+void IndependentSampler::Sample2D( uint32_t dimension, float& u, float& v )
+{
+	Seed( dimension );
+	u = mGenerator.NextFloat();
+	v = mGenerator.NextFloat();
+}
+
+StratifiedSampler::StratifiedSampler( uint32_t sampleCount )
+	: mStrataCount1D( eeMax( sampleCount, 1u ) )
+	, mStrataSide2D( eeMax( uint32_t( sqrt( double( sampleCount ) ) ), 1u ) )
+{
+}
+
+float StratifiedSampler::Sample1D( uint32_t dimension )
+{
+	const uint32_t round = mSampleIndex / mStrataCount1D;
+	const uint32_t seed = Hash( GetPixelKey( mX, mY ), Hash( dimension, round ) );
+
+	uint32_t stratum = Permute( mSampleIndex % mStrataCount1D, mStrataCount1D, seed );
+	float jitter = ToFloat( Hash( seed, mSampleIndex ) );
+
+	return eeMin( ( float( stratum ) + jitter ) / float( mStrataCount1D ), kOneMinusEpsilon );
+}
+
+void StratifiedSampler::Sample2D( uint32_t dimension, float& u, float& v )
+{
+	const uint32_t strataCount = mStrataSide2D * mStrataSide2D;
+	const uint32_t round = mSampleIndex / strataCount;
+	const uint32_t seed = Hash( GetPixelKey( mX, mY ), Hash( dimension, round ) );
+
+	uint32_t stratum = Permute( mSampleIndex % strataCount, strataCount, seed );
+	uint32_t jitter = Hash( seed, mSampleIndex );
+
+	// Both jitters come from the one hash, 16 bits each
+	u = ( float( stratum % mStrataSide2D ) + float( jitter & 0xffff ) * ( 1.0f / 65536.0f ) ) / float( mStrataSide2D );
+	v = ( float( stratum / mStrataSide2D ) + float( jitter >> 16 ) * ( 1.0f / 65536.0f ) ) / float( mStrataSide2D );
+
+	u = eeMin( u, kOneMinusEpsilon );
+	v = eeMin( v, kOneMinusEpsilon );
+}
+
+uint32_t SobolSampler::GetPixelSeed( void ) const
+{
+	return uint32_t( MixBits( GetPixelKey( mX, mY ) ) );
+}
+
+uint32_t SobolSampler::GetSobol1D( uint32_t dimension, uint32_t seed ) const
+{
+	// The order the samples visit the points in, and the scrambling of the
+	// points, each get their own seed
+	uint32_t index = NestedUniformScramble( mSampleIndex, Hash( seed, 3 * dimension ) );
+	return NestedUniformScramble( Sobol0( index ), Hash( seed, 3 * dimension + 1 ) );
+}
+
+void SobolSampler::GetSobol2D( uint32_t dimension, uint32_t seed, uint32_t& u, uint32_t& v ) const
+{
+	uint32_t index = NestedUniformScramble( mSampleIndex, Hash( seed, 3 * dimension ) );
+	u = NestedUniformScramble( Sobol0( index ), Hash( seed, 3 * dimension + 1 ) );
+	v = NestedUniformScramble( Sobol1( index ), Hash( seed, 3 * dimension + 2 ) );
+}
+
+float SobolSampler::Sample1D( uint32_t dimension )
+{
+	return ToFloat( GetSobol1D( dimension, GetPixelSeed() ) );
+}
+
+void SobolSampler::Sample2D( uint32_t dimension, float& u, float& v )
+{
+	uint32_t a, b;
+	GetSobol2D( dimension, GetPixelSeed(), a, b );
+
+	u = ToFloat( a );
+	v = ToFloat( b );
+}
+
+BlueNoiseSampler::BlueNoiseSampler()
+{
+	// Built by whichever sampler gets here first, once
+	static const std::vector< uint32_t > noise = CreateBlueNoise();
+	mNoise = noise.data();
+}
+
+uint32_t BlueNoiseSampler::GetShift( uint32_t dimension, uint32_t component ) const
+{
+	// Every number of every dimension reads the tile from its own offset,
+	// so that their shifts are unrelated
+	const uint32_t mask = kBlueNoiseSize - 1;
+	const uint32_t offset = Hash( dimension, component );
+
+	uint32_t x = ( mX + offset ) & mask;
+	uint32_t y = ( mY + ( offset >> 16 ) ) & mask;
+	return mNoise[ y * kBlueNoiseSize + x ];
+}
+
+float BlueNoiseSampler::Sample1D( uint32_t dimension )
+{
+	// Adding 32 bit fractions wraps around modulo 1
+	const uint32_t kSeed = 0;
+	return ToFloat( GetSobol1D( dimension, kSeed ) + GetShift( dimension, 0 ) );
+}
+
+void BlueNoiseSampler::Sample2D( uint32_t dimension, float& u, float& v )
+{
+	const uint32_t kSeed = 0;
+
+	uint32_t a, b;
+	GetSobol2D( dimension, kSeed, a, b );
+
+	u = ToFloat( a + GetShift( dimension, 0 ) );
+	v = ToFloat( b + GetShift( dimension, 1 ) );
+}
+
+Sampler* CreateSampler( SamplerType type, uint32_t sampleCount )
+{
+	switch( type )
+	{
+	case SamplerType::kIndependent:
+		return new IndependentSampler;
+
+	case SamplerType::kStratified:
+		return new StratifiedSampler( sampleCount );
+
+	case SamplerType::kBlueNoise:
+		return new BlueNoiseSampler;
+
+	case SamplerType::kSobol:
+	default:
+		return new SobolSampler;
+
+	} // switch( type )
+}
@@ -0,0 +1,206 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+
+#include <ee/math/PCG32.h>
+
+using namespace ee;
+
+enum class SamplerType
+{
+	kIndependent,	// IndependentSampler
+	kStratified,	// StratifiedSampler
+	kSobol,			// SobolSampler
+	kBlueNoise		// BlueNoiseSampler
+};
+
+// Supplies the numbers in [ 0, 1 ) that one sample of one pixel needs: the
+// position within the pixel and on the lens, the time, and the directions
+// of the bounces. Each kind of number comes from its own dimension, so a
+// sampler can spread, say, the lens positions of a pixel's samples evenly
+// over the lens whatever the rest of their paths do. Every number depends
+// only on the pixel, the sample index and the dimension, so an image comes
+// out the same however it is split between threads or ordered into tiles.
+// A Sampler is passed explicitly to everything that draws from it, and
+// belongs to one thread.
+class Sampler
+{
+public:
+	// The dimensions of a sample. A 1D dimension gives one number and a
+	// 2D dimension two, which are well spread as a pair.
+	static const uint32_t kPixelDimension = 0;	// 2D, the position within the pixel
+	static const uint32_t kLensDimension = 1;	// 2D, the position on the lens
+	static const uint32_t kTimeDimension = 2;	// 1D, the time the ray is traced at
+
+	// Then each bounce of a path has kBounceDimensionCount dimensions,
+	// starting at GetBounceDimension( depth ): Material::Scatter() draws
+	// from up to kScatterDimensionCount of them in turn, next event
+	// estimation picks a light (1D) and a direction towards it (2D), and
+	// Russian roulette draws from the last
+	static const uint32_t kFirstBounceDimension = 3;
+	static const uint32_t kScatterDimensionCount = 2;
+	static const uint32_t kLightChoiceDimension = kScatterDimensionCount;
+	static const uint32_t kLightDirectionDimension = kScatterDimensionCount + 1;
+	static const uint32_t kRouletteDimension = kScatterDimensionCount + 2;
+	static const uint32_t kBounceDimensionCount = kScatterDimensionCount + 3;
+
+	static inline uint32_t GetBounceDimension( uint32_t depth );
+
+	Sampler();
+	virtual ~Sampler() {}
+
+	// Starts sample sampleIndex of pixel (x, y), at dimension 0
+	inline void StartSample( uint16_t x, uint16_t y, uint32_t sampleIndex );
+
+	// The dimension the next Get1D() or Get2D() draws from
+	inline void SetDimension( uint32_t dimension );
+
+	// Return the numbers of the current dimension and move to the next
+	inline float Get1D( void );
+	inline void Get2D( float& u, float& v );
+
+protected:
+	virtual float Sample1D( uint32_t dimension ) = 0;
+	virtual void Sample2D( uint32_t dimension, float& u, float& v ) = 0;
+
+	uint16_t	mX, mY;
+	uint32_t	mSampleIndex;
+
+private:
+	uint32_t	mDimension;
+
+}; // class Sampler
+
+// Plain random numbers, with nothing done to spread them out; the
+// baseline the others are measured against
+class IndependentSampler : public Sampler
+{
+protected:
+	// Sampler interface implementation
+
+	virtual float Sample1D( uint32_t dimension );
+	virtual void Sample2D( uint32_t dimension, float& u, float& v );
+
+private:
+	void Seed( uint32_t dimension );
+
+	PCG32	mGenerator;
+
+}; // class IndependentSampler
+
+// Jittered stratification: each dimension is split into sampleCount
+// strata (a square grid of about that many in 2D), and each of a pixel's
+// samples takes a random point in a different stratum, in a random order.
+// Needs to know how many samples each pixel will get; samples past that
+// start another round of strata.
+class StratifiedSampler : public Sampler
+{
+public:
+	StratifiedSampler( uint32_t sampleCount );
+
+protected:
+	// Sampler interface implementation
+
+	virtual float Sample1D( uint32_t dimension );
+	virtual void Sample2D( uint32_t dimension, float& u, float& v );
+
+private:
+	uint32_t	mStrataCount1D;
+	uint32_t	mStrataSide2D;	// the grid of 2D strata is mStrataSide2D square
+
+}; // class StratifiedSampler
+
+// The first two dimensions of the Sobol sequence, Owen scrambled (with
+// Laine and Karras' hash-based nested uniform scrambling) differently for
+// every pixel and dimension. Each dimension also visits the sequence in
+// its own scrambled order, which keeps the dimensions independent of each
+// other (Burley, "Practical Hash-based Owen Scrambling", 2020). Every
+// power of two prefix of a pixel's samples is well stratified, so it works
+// for any sample count and with progressive and adaptive sampling.
+class SobolSampler : public Sampler
+{
+protected:
+	// Sampler interface implementation
+
+	virtual float Sample1D( uint32_t dimension );
+	virtual void Sample2D( uint32_t dimension, float& u, float& v );
+
+	// Returns the Sobol point of sample mSampleIndex in dimension,
+	// scrambled with seed, as 32 bit fractions
+	uint32_t GetSobol1D( uint32_t dimension, uint32_t seed ) const;
+	void GetSobol2D( uint32_t dimension, uint32_t seed, uint32_t& u, uint32_t& v ) const;
+
+	// Returns a hash of the pixel, to seed the scrambling
+	uint32_t GetPixelSeed( void ) const;
+
+}; // class SobolSampler
+
+// Sobol points scrambled the same way in every pixel, then shifted
+// (toroidally, modulo 1) by the value of a blue noise texture at the
+// pixel. Neighboring pixels get very different shifts, so the error left
+// in an image with few samples is high frequency noise, which looks much
+// less noisy than white noise of the same strength (Georgiev and Fajardo,
+// "Blue-noise Dithered Sampling", 2016).
+class BlueNoiseSampler : public SobolSampler
+{
+public:
+	BlueNoiseSampler();
+
+protected:
+	// Sampler interface implementation
+
+	virtual float Sample1D( uint32_t dimension );
+	virtual void Sample2D( uint32_t dimension, float& u, float& v );
+
+private:
+	// Returns the blue noise shift for the pixel in one of the numbers of
+	// a dimension, as a 32 bit fraction
+	uint32_t GetShift( uint32_t dimension, uint32_t component ) const;
+
+	const uint32_t*	mNoise; // shared by every BlueNoiseSampler
+
+}; // class BlueNoiseSampler
+
+// Returns a new sampler of the given type; sampleCount is the number of
+// samples each pixel is to get
+Sampler* CreateSampler( SamplerType type, uint32_t sampleCount );
+
+inline uint32_t Sampler::GetBounceDimension( uint32_t depth )
+{
+	return kFirstBounceDimension + depth * kBounceDimensionCount;
+}
+
+inline Sampler::Sampler()
+	: mX( 0 )
+	, mY( 0 )
+	, mSampleIndex( 0 )
+	, mDimension( 0 )
+{
+}
+
+inline void Sampler::StartSample( uint16_t x, uint16_t y, uint32_t sampleIndex )
+{
+	mX = x;
+	mY = y;
+	mSampleIndex = sampleIndex;
+	mDimension = 0;
+}
+
+inline void Sampler::SetDimension( uint32_t dimension )
+{
+	mDimension = dimension;
+}
+
+inline float Sampler::Get1D( void )
+{
+	return Sample1D( mDimension++ );
+}
+
+inline void Sampler::Get2D( float& u, float& v )
+{
+	Sample2D( mDimension++, u, v );
+}
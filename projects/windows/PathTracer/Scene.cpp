@@ -4,93 +4,631 @@
 
 #include "pch.h"
 
+#include <chrono>
+#include <cstring>
+#include <typeinfo>
+
 #include "Scene.h"
+#include "Material.h"
 
+#include <ee/core/Debug.h>
 #include <ee/math/AABB.h>
 #include <ee/math/Math.h>
 
-// This function takes ownership of the Traceable objects in list
-bool Scene::Initialize( Traceable** list, uint32_t listSize )
+// Which of the scene's arrays object goes in. Spheres, rects and
+// instances are copied by value, and they and meshes are intersected
+// without virtual calls, so only objects of exactly those types go in
+// their arrays; a subclass could override what they do, and is kept as a
+// custom object instead.
+static PrimitiveType GetPrimitiveType( Traceable* object )
+{
+	const std::type_info& type = typeid( *object );
+
+	if( type == typeid( Sphere ) )
+		return PrimitiveType::kSphere;
+
+	if( type == typeid( xyRect ) )
+		return PrimitiveType::kRect;
+
+	if( type == typeid( Mesh ) )
+		return PrimitiveType::kMesh;
+
+	if( type == typeid( Instance ) )
+		return PrimitiveType::kInstance;
+
+	return PrimitiveType::kCustom;
+}
+
+// Deletes the objects and materials given to Initialize() when it fails,
+// since it owns them whether or not it succeeds
+static void DeleteSceneObjects( Traceable** list, uint32_t listSize, MaterialTable* materials )
+{
+	if( list != nullptr )
+	{
+		for( uint32_t i = 0; i < listSize; ++i )
+		{
+			delete list[ i ];
+		}
+	}
+
+	delete materials;
+}
+
+// This function takes ownership of the Traceable objects in list, and of materials
+bool Scene::Initialize( Traceable** list, uint32_t listSize, MaterialTable* materials,
+						float t0, float t1, const BVHBuildOptions& options, const LinearBVH* bvh )
 {
-	if( ( list == nullptr ) || ( listSize == 0 ) )
+	if( ( list == nullptr ) || ( listSize == 0 ) || ( materials == nullptr ) )
+	{
+		DeleteSceneObjects( list, listSize, materials );
 		return false;
+	}
 
 	Shutdown();
 
-	mListSize = listSize;
-
-	mList = new Traceable* [ mListSize ];
+	mList = new Traceable* [ listSize ];
 	if( mList == nullptr )
+	{
+		DeleteSceneObjects( list, listSize, materials );
 		return false;
+	}
+
+	mMaterials = materials;
+	mListSize = listSize;
+	mTime0 = t0;
+	mTime1 = t1;
+	mBVHOptions = options;
+
+	PrimitiveRef* refs = new PrimitiveRef[ listSize ];
+
+	// Count the objects of each type, then move them into their arrays
+	for( uint32_t i = 0; i < listSize; ++i )
+	{
+		refs[ i ].type = GetPrimitiveType( list[ i ] );
+
+		switch( refs[ i ].type )
+		{
+		case PrimitiveType::kSphere:
+			++mSphereCount;
+			break;
 
-	memcpy( mList, list, listSize * sizeof( Traceable* ) );
+		case PrimitiveType::kRect:
+			++mRectCount;
+			break;
+
+		case PrimitiveType::kMesh:
+			++mMeshCount;
+			break;
+
+		case PrimitiveType::kInstance:
+			++mInstanceCount;
+			break;
+
+		case PrimitiveType::kCustom:
+			++mCustomCount;
+			break;
+
+		} // switch( refs[ i ].type )
+	}
+
+	mSpheres = new Sphere[ mSphereCount ];
+	mRects = new xyRect[ mRectCount ];
+	mMeshes = new Mesh* [ mMeshCount ];
+	mInstances = new Instance[ mInstanceCount ];
+	mCustom = new Traceable* [ mCustomCount ];
+
+	uint32_t sphereCount = 0;
+	uint32_t rectCount = 0;
+	uint32_t meshCount = 0;
+	uint32_t instanceCount = 0;
+	uint32_t customCount = 0;
+
+	for( uint32_t i = 0; i < listSize; ++i )
+	{
+		switch( refs[ i ].type )
+		{
+		case PrimitiveType::kSphere:
+		{
+			Sphere* sphere = static_cast< Sphere* >( list[ i ] );
+			refs[ i ].index = sphereCount;
+			mSpheres[ sphereCount ] = *sphere;
+			mList[ i ] = &mSpheres[ sphereCount++ ];
+			delete sphere;
+			break;
+		}
+
+		case PrimitiveType::kRect:
+		{
+			xyRect* rect = static_cast< xyRect* >( list[ i ] );
+			refs[ i ].index = rectCount;
+			mRects[ rectCount ] = *rect;
+			mList[ i ] = &mRects[ rectCount++ ];
+			delete rect;
+			break;
+		}
+
+		case PrimitiveType::kMesh:
+		{
+			// Meshes are too big to copy
+			Mesh* mesh = static_cast< Mesh* >( list[ i ] );
+			refs[ i ].index = meshCount;
+			mMeshes[ meshCount++ ] = mesh;
+			mList[ i ] = mesh;
+			break;
+		}
+
+		case PrimitiveType::kInstance:
+		{
+			// Only the instance is copied; its object is shared
+			Instance* instance = static_cast< Instance* >( list[ i ] );
+			refs[ i ].index = instanceCount;
+			mInstances[ instanceCount ] = *instance;
+			mList[ i ] = &mInstances[ instanceCount++ ];
+			delete instance;
+			break;
+		}
+
+		case PrimitiveType::kCustom:
+			refs[ i ].index = customCount;
+			mCustom[ customCount++ ] = list[ i ];
+			mList[ i ] = list[ i ];
+			break;
+
+		} // switch( refs[ i ].type )
+	}
+
+	// Split the objects into those that can go in the BVH and those that can't
+	mPrimitives = new PrimitiveRef[ mListSize ];
+	mPrimitiveCount = 0;
+
+	mUnbounded = new Traceable* [ mListSize ];
+	mUnboundedSize = 0;
+
+	mLights = new Traceable* [ mListSize ];
+	mLightCount = 0;
+
+	for( uint32_t i = 0; i < mListSize; ++i )
+	{
+		AABB box;
+		if( mList[ i ]->GetBoundingBox( t0, t1, box ) )
+		{
+			mPrimitives[ mPrimitiveCount++ ] = refs[ i ];
+
+			if( refs[ i ].type == PrimitiveType::kSphere )
+			{
+				++mBoundedSphereCount;
+			}
+		}
+		else
+		{
+			mUnbounded[ mUnboundedSize++ ] = mList[ i ];
+		}
+
+		if( mList[ i ]->IsLight( *mMaterials ) )
+		{
+			mLights[ mLightCount++ ] = mList[ i ];
+		}
+	}
+
+	delete[] refs;
+
+	BuildBVH( bvh );
+
+	eeDebug( "Scene: %u spheres, %u rects, %u meshes, %u instances, %u other objects\n",
+			 mSphereCount, mRectCount, mMeshCount, mInstanceCount, mCustomCount );
+	eeDebugIf( mUnboundedSize > 0, "Scene: %u objects have no bounding box\n", mUnboundedSize );
+	eeDebugIf( mLightCount > 0, "Scene: %u objects are lights\n", mLightCount );
 
 	return true;
 }
 
+void Scene::BuildBVH( const LinearBVH* bvh )
+{
+	if( mPrimitiveCount == 0 )
+		return;
+
+	if( ( bvh != nullptr ) && ( bvh->GetPrimitiveCount() == mPrimitiveCount ) )
+	{
+		mBVH = *bvh;
+
+		eeDebug( "Scene: using a prebuilt BVH over %u objects: %u nodes\n", mPrimitiveCount, mBVH.GetNodeCount() );
+	}
+	else
+	{
+		eeDebugIf( bvh != nullptr, "Scene: the prebuilt BVH is over %u objects, not %u; building one\n",
+				   bvh->GetPrimitiveCount(), mPrimitiveCount );
+
+		AABB* bounds = new AABB[ mPrimitiveCount ];
+
+		for( uint32_t i = 0; i < mPrimitiveCount; ++i )
+		{
+			GetPrimitive( mPrimitives[ i ] )->GetBoundingBox( mTime0, mTime1, bounds[ i ] );
+		}
+
+		// When every leaf is all spheres, its spheres are intersected a
+		// batch at a time, and the BVH should be built to suit
+		BVHBuildOptions bvhOptions = mBVHOptions;
+		if( mBoundedSphereCount == mPrimitiveCount )
+		{
+			bvhOptions.maxLeafSize = eeMax( bvhOptions.maxLeafSize, SphereSet::kBatchWidth );
+			bvhOptions.intersectionBatchSize = eeMax( bvhOptions.intersectionBatchSize, SphereSet::kBatchWidth );
+		}
+
+		auto buildStart = std::chrono::steady_clock::now();
+
+		mBVH.Build( bounds, mPrimitiveCount, bvhOptions );
+
+		std::chrono::duration< double, std::milli > buildTime = std::chrono::steady_clock::now() - buildStart;
+
+		eeDebug( "Scene: built a %s BVH over %u objects in %.3f ms on %u threads: %u nodes, depth %u, SAH cost %.2f\n",
+				 mBVHOptions.splitMethod == BVHSplitMethod::kSAH ? "SAH" : "median split", mPrimitiveCount,
+				 buildTime.count(), mBVH.GetBuildOptions().threadCount,
+				 mBVH.GetNodeCount(), mBVH.GetMaxDepth(), mBVH.GetSAHCost() );
+
+		delete[] bounds;
+	}
+
+	mWideBVH.Build( mBVH );
+
+	// Store the references in leaf order so each leaf's are contiguous
+	const uint32_t* order = mBVH.GetPrimitiveIndices();
+
+	PrimitiveRef* unordered = new PrimitiveRef[ mPrimitiveCount ];
+	memcpy( unordered, mPrimitives, mPrimitiveCount * sizeof( PrimitiveRef ) );
+
+	const Sphere** slotSpheres = new const Sphere* [ mPrimitiveCount ];
+
+	for( uint32_t i = 0; i < mPrimitiveCount; ++i )
+	{
+		mPrimitives[ i ] = unordered[ order[ i ] ];
+		slotSpheres[ i ] = ( mPrimitives[ i ].type == PrimitiveType::kSphere ) ? &mSpheres[ mPrimitives[ i ].index ] : nullptr;
+	}
+
+	mSphereSet.Build( slotSpheres, mPrimitiveCount );
+
+	delete[] slotSpheres;
+	delete[] unordered;
+}
+
+void Scene::SetInstanceTransform( uint32_t index, const Transform& transform )
+{
+	mInstances[ index ].SetTransform( transform );
+}
+
+void Scene::RebuildBVH( void )
+{
+	if( mList == nullptr )
+		return;
+
+	BuildBVH();
+}
+
 void Scene::Shutdown( void )
 {
 	if( mList == nullptr )
 		return; // already shut down
 
-	for( uint32_t i = 0; i < mListSize; ++i )
+	mBVH.Clear();
+	mWideBVH.Clear();
+	mSphereSet.Clear();
+
+	delete[] mPrimitives;
+	mPrimitives = nullptr;
+	mPrimitiveCount = 0;
+	mBoundedSphereCount = 0;
+
+	delete[] mUnbounded;
+	mUnbounded = nullptr;
+	mUnboundedSize = 0;
+
+	delete[] mLights;
+	mLights = nullptr;
+	mLightCount = 0;
+
+	delete[] mSpheres;
+	mSpheres = nullptr;
+	mSphereCount = 0;
+
+	delete[] mRects;
+	mRects = nullptr;
+	mRectCount = 0;
+
+	for( uint32_t i = 0; i < mMeshCount; ++i )
+	{
+		delete mMeshes[ i ];
+	}
+
+	delete[] mMeshes;
+	mMeshes = nullptr;
+	mMeshCount = 0;
+
+	delete[] mInstances;
+	mInstances = nullptr;
+	mInstanceCount = 0;
+
+	for( uint32_t i = 0; i < mCustomCount; ++i )
 	{
-		delete mList[ i ];
+		delete mCustom[ i ];
 	}
 
+	delete[] mCustom;
+	mCustom = nullptr;
+	mCustomCount = 0;
+
 	delete[] mList;
+	mList = nullptr;
+	mListSize = 0;
+
+	delete mMaterials;
+	mMaterials = nullptr;
+}
+
+bool Scene::Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const
+{
+#if PATHTRACER_BVH_WIDTH > 2
+	return IntersectBVH( mWideBVH, r, t_min, t_max, hit );
+#else
+	return IntersectBVH( mBVH, r, t_min, t_max, hit );
+#endif
+}
+
+bool Scene::HitBinaryBVH( const Ray& r, float t_min, float t_max, HitRecord& rec ) const
+{
+	RayHit hit;
+	if( !IntersectBVH( mBVH, r, t_min, t_max, hit ) )
+		return false;
+
+	hit.object->FinalizeHit( r, hit, rec );
+	return true;
+}
+
+bool Scene::HitWideBVH( const Ray& r, float t_min, float t_max, HitRecord& rec ) const
+{
+	RayHit hit;
+	if( !IntersectBVH( mWideBVH, r, t_min, t_max, hit ) )
+		return false;
+
+	hit.object->FinalizeHit( r, hit, rec );
+	return true;
 }
 
-bool Scene::Hit( const Ray& r, float t_min, float t_max, HitRecord& rec ) const
+template< class BVH >
+bool Scene::IntersectBVH( const BVH& bvh, const Ray& r, float t_min, float t_max, RayHit& hit ) const
 {
-	HitRecord tempRecord;
 	bool hitAnything = false;
 	float closest = t_max;
 
-	for( uint32_t i = 0; i < mListSize; ++i )
+	const bool allSpheres = ( mBoundedSphereCount == mPrimitiveCount );
+
+	// Intersect() only writes to hit when it reports a hit closer than
+	// t_max, so hit can be passed through without a temporary copy; only
+	// the closest hit's HitRecord is ever worked out, by Hit()
+	auto leafHit = [&]( uint32_t first, uint32_t count, float t_min, float& t_max )
+	{
+		bool hitLeaf = false;
+
+		uint32_t slot;
+		if( mSphereSet.Intersect( r, first, count, t_min, t_max, slot ) )
+		{
+			hitLeaf = true;
+			hit.t = t_max;
+			hit.object = &mSpheres[ mPrimitives[ slot ].index ];
+		}
+
+		if( !allSpheres )
+		{
+			for( uint32_t i = first; i < first + count; ++i )
+			{
+				if( IntersectPrimitive( mPrimitives[ i ], r, t_min, t_max, hit ) )
+				{
+					hitLeaf = true;
+					t_max = hit.t;
+				}
+			}
+		}
+
+		return hitLeaf;
+	};
+
+	if( bvh.Hit( r, t_min, closest, leafHit ) )
 	{
-		if( mList[ i ]->Hit( r, t_min, closest, tempRecord ) )
+		hitAnything = true;
+		closest = hit.t;
+	}
+
+	for( uint32_t i = 0; i < mUnboundedSize; ++i )
+	{
+		if( mUnbounded[ i ]->Intersect( r, t_min, closest, hit ) )
 		{
 			hitAnything = true;
-			closest = tempRecord.t;
-			rec = tempRecord;
+			closest = hit.t;
 		}
 	}
 
 	return hitAnything;
 }
 
-bool Scene::GetBoundingBox( float t0, float t1, AABB& box ) const
+void Scene::IntersectPackets( const Ray* rays, uint32_t count, float t_min, float t_max, RayHit* hits ) const
 {
-	if( mListSize == 0 )
+	for( uint32_t first = 0; first < count; first += RayPacket::kSize )
 	{
-		return false;
+		RayPacket packet;
+		packet.Initialize( rays + first, count - first < RayPacket::kSize ? count - first : RayPacket::kSize );
+
+		if( packet.IsCoherent() )
+		{
+			IntersectPacket( packet, t_min, t_max, hits + first );
+			continue;
+		}
+
+		for( uint32_t i = first; i < first + packet.count; ++i )
+		{
+			hits[ i ].object = nullptr;
+			Intersect( rays[ i ], t_min, t_max, hits[ i ] );
+		}
 	}
+}
 
-	AABB temp;
-	bool hasBox = mList[ 0 ]->GetBoundingBox( t0, t1, temp );
-	if( !hasBox )
+void Scene::IntersectPacket( const RayPacket& packet, float t_min, float t_max, RayHit* hits ) const
+{
+	float tMax[ RayPacket::kSize ];
+	for( uint32_t lane = 0; lane < RayPacket::kSize; ++lane )
 	{
-		return false;
+		tMax[ lane ] = t_max;
 	}
-	else
+
+	for( uint32_t lane = 0; lane < packet.count; ++lane )
 	{
-		box = temp;
+		hits[ lane ].object = nullptr;
 	}
 
-	if( mListSize > 1 )
+	const bool allSpheres = ( mBoundedSphereCount == mPrimitiveCount );
+
+	// The same tests as IntersectBVH()'s, for every ray that enters the leaf
+	auto leafHit = [&]( uint32_t first, uint32_t count, uint32_t laneMask )
 	{
-		for( uint32_t i = 1; i < mListSize; ++i )
+		uint32_t slots[ RayPacket::kSize ];
+		uint32_t hitMask = mSphereSet.IntersectPacket( packet, laneMask, first, count, t_min, tMax, slots );
+
+		for( uint32_t lane = 0; lane < packet.count; ++lane )
 		{
-			if( mList[ i ]->GetBoundingBox( t0, t1, temp ) )
+			if( hitMask & ( 1u << lane ) )
 			{
-				box = Enclose( box, temp );
+				hits[ lane ].t = tMax[ lane ];
+				hits[ lane ].object = &mSpheres[ mPrimitives[ slots[ lane ] ].index ];
 			}
-			else
+		}
+
+		if( !allSpheres )
+		{
+			for( uint32_t lane = 0; lane < packet.count; ++lane )
 			{
-				return false;
+				if( ( laneMask & ( 1u << lane ) ) == 0 )
+					continue;
+
+				for( uint32_t i = first; i < first + count; ++i )
+				{
+					if( IntersectPrimitive( mPrimitives[ i ], packet.rays[ lane ], t_min, tMax[ lane ], hits[ lane ] ) )
+					{
+						tMax[ lane ] = hits[ lane ].t;
+					}
+				}
 			}
 		}
+	};
+
+#if PATHTRACER_BVH_WIDTH > 2
+	mWideBVH.HitPacket( packet, t_min, tMax, leafHit );
+#else
+	mBVH.HitPacket( packet, t_min, tMax, leafHit );
+#endif
+
+	for( uint32_t lane = 0; lane < packet.count; ++lane )
+	{
+		for( uint32_t i = 0; i < mUnboundedSize; ++i )
+		{
+			if( mUnbounded[ i ]->Intersect( packet.rays[ lane ], t_min, tMax[ lane ], hits[ lane ] ) )
+			{
+				tMax[ lane ] = hits[ lane ].t;
+			}
+		}
+	}
+}
+
+bool Scene::Occluded( const Ray& r, float t_min, float t_max ) const
+{
+#if PATHTRACER_BVH_WIDTH > 2
+	return OccludedBVH( mWideBVH, r, t_min, t_max );
+#else
+	return OccludedBVH( mBVH, r, t_min, t_max );
+#endif
+}
+
+bool Scene::OccludedBinaryBVH( const Ray& r, float t_min, float t_max ) const
+{
+	return OccludedBVH( mBVH, r, t_min, t_max );
+}
+
+bool Scene::OccludedWideBVH( const Ray& r, float t_min, float t_max ) const
+{
+	return OccludedBVH( mWideBVH, r, t_min, t_max );
+}
+
+template< class BVH >
+bool Scene::OccludedBVH( const BVH& bvh, const Ray& r, float t_min, float t_max ) const
+{
+	const bool allSpheres = ( mBoundedSphereCount == mPrimitiveCount );
+
+	auto leafOccluded = [&]( uint32_t first, uint32_t count, float t_min, float t_max )
+	{
+		if( mSphereSet.Occluded( r, first, count, t_min, t_max ) )
+			return true;
+
+		if( !allSpheres )
+		{
+			for( uint32_t i = first; i < first + count; ++i )
+			{
+				if( OccludedPrimitive( mPrimitives[ i ], r, t_min, t_max ) )
+					return true;
+			}
+		}
+
+		return false;
+	};
+
+	if( bvh.Occluded( r, t_min, t_max, leafOccluded ) )
+		return true;
+
+	for( uint32_t i = 0; i < mUnboundedSize; ++i )
+	{
+		if( mUnbounded[ i ]->Occluded( r, t_min, t_max ) )
+			return true;
+	}
+
+	return false;
+}
+
+float Scene::GetLightPdf( const Ray& r, const HitRecord& hit ) const
+{
+	if( ( hit.object == nullptr ) || ( mLightCount == 0 ) || !hit.object->IsLight( *mMaterials ) )
+		return 0.0f;
+
+	return hit.object->GetDirectionPdf( r ) / float( mLightCount );
+}
+
+bool Scene::GetBoundingBox( float t0, float t1, AABB& box ) const
+{
+	if( mBVH.IsEmpty() || ( mUnboundedSize > 0 ) )
+	{
+		return false;
+	}
+
+	// The BVH bounds cover the shutter interval it was built with;
+	// fall back to enclosing every object for any other interval
+	if( ( t0 == mTime0 ) && ( t1 == mTime1 ) )
+	{
+		box = mBVH.GetBounds();
+		return true;
+	}
+
+	AABB temp;
+	if( !mList[ 0 ]->GetBoundingBox( t0, t1, temp ) )
+	{
+		return false;
+	}
+
+	box = temp;
+
+	for( uint32_t i = 1; i < mListSize; ++i )
+	{
+		if( mList[ i ]->GetBoundingBox( t0, t1, temp ) )
+		{
+			box = Enclose( box, temp );
+		}
+		else
+		{
+			return false;
+		}
 	}
 
 	return true;
@@ -7,9 +7,49 @@
 #include <stdint.h>
 
 #include "Traceable.h"
+#include "LinearBVH.h"
+#include "WideBVH.h"
+#include "Sphere.h"
+#include "Rect.h"
+#include "Mesh.h"
+#include "Instance.h"
+#include "SphereSet.h"
+#include "RayPacket.h"
 
 using namespace ee;
 
+// The branching factor of the BVH that Scene::Intersect() traverses: 2 selects
+// the binary LinearBVH, 4 or 8 a WideBVH. Width 8 is only vectorized when
+// AVX code generation is enabled (e.g. /arch:AVX2), so it's the default then.
+#if !defined( PATHTRACER_BVH_WIDTH )
+#  if defined( __AVX__ )
+#    define PATHTRACER_BVH_WIDTH 8
+#  else
+#    define PATHTRACER_BVH_WIDTH 4
+#  endif
+#endif
+
+// The kinds of primitive a Scene stores by value, in one array per kind,
+// and intersects without virtual calls. Any other Traceable, including
+// a subclass of one of these, is kCustom, and is reached through the
+// Traceable interface.
+enum class PrimitiveType : uint8_t
+{
+	kSphere,	// Scene::mSpheres, moving or not
+	kRect,		// Scene::mRects
+	kMesh,		// Scene::mMeshes, each with a BVH over its triangles
+	kInstance,	// Scene::mInstances, which may share their objects
+	kCustom		// Scene::mCustom
+};
+
+// How a BVH leaf refers to a primitive: its type, and its index in the
+// array of that type
+struct PrimitiveRef
+{
+	PrimitiveType	type;
+	uint32_t		index;
+};
+
 // Called "hittable_list" in the "Ray Tracing in One Weekend" book
 class Scene : public Traceable
 {
@@ -19,27 +59,171 @@ public:
 
 	// Traceable interface implementation
 
-	virtual bool Hit( const Ray& r, float t_min, float t_max, HitRecord& rec ) const;
+	virtual bool Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const;
+
+	virtual bool Occluded( const Ray& r, float t_min, float t_max ) const;
 
 	virtual bool GetBoundingBox( float t0, float t1, AABB& box ) const;
 
 	// Scene member functions
 
-	// This function takes ownership of the Traceable objects in list
-	bool Initialize( Traceable** list, uint32_t listSize );
+	// This function takes ownership of the Traceable objects in list, and
+	// of materials, the table of the materials they use; if it fails, it
+	// deletes them before returning false. Spheres, rects and instances
+	// are copied into the scene's arrays and the originals deleted, so
+	// pointers to them don't stay valid; meshes and other objects are kept
+	// as they are. A BVH is built over every object that has a bounding
+	// box; t0 and t1 are the camera shutter interval, so that moving
+	// objects are bounded over the whole time they can be seen. Objects
+	// with infinite extent are kept in a separate list and tested against
+	// every ray.
+	// If bvh isn't null it's used instead of building a BVH: it must be the
+	// GetBVH() of a scene initialized with the same objects, in the same
+	// order, and the same t0, t1 and options, whose BVH hasn't been rebuilt
+	// since, such as one saved to a file.
+	bool Initialize( Traceable** list, uint32_t listSize, MaterialTable* materials,
+					 float t0 = 0.0f, float t1 = 0.0f, const BVHBuildOptions& options = BVHBuildOptions(),
+					 const LinearBVH* bvh = nullptr );
 	void Shutdown( void );
 
 	uint32_t GetListSize( void ) const;
 
+	// The instances, in the order Initialize() got them
+	inline uint32_t GetInstanceCount( void ) const;
+	inline const Instance& GetInstance( uint32_t index ) const;
+
+	// Moves an instance; the BVH doesn't fit the scene again until
+	// RebuildBVH() is called
+	void SetInstanceTransform( uint32_t index, const Transform& transform );
+
+	// Rebuilds the scene's BVH over the objects' current bounding boxes,
+	// after instances have moved. Only the scene's own BVH is rebuilt: the
+	// instances' objects, and any BVHs of their own, aren't touched. It
+	// mustn't be called while rays are being traced.
+	void RebuildBVH( void );
+
+	inline const MaterialTable& GetMaterials( void ) const;
+
+	// The BVH over the objects that have bounding boxes. The scene stores
+	// those objects in the BVH's leaf order, so the BVH's primitive indices
+	// say where each leaf slot's object was before the BVH was built: after
+	// Initialize(), whether it built the BVH or was given it, that's the
+	// object's place among the bounded objects in the order Initialize()
+	// got them; after RebuildBVH(), it's the object's slot in the BVH
+	// before.
+	inline const LinearBVH& GetBVH( void ) const;
+
+	// The objects that are lights (see Traceable::IsLight()), for next
+	// event estimation
+	inline uint32_t GetLightCount( void ) const;
+	inline const Traceable* GetLight( uint32_t index ) const;
+
+	// Returns the probability density, per unit solid angle, of next
+	// event estimation picking the direction of r, which hit hit, by
+	// choosing a light uniformly and then a direction towards it
+	float GetLightPdf( const Ray& r, const HitRecord& hit ) const;
+
+	// Intersect() for each of rays[ 0 ] to rays[ count - 1 ], which should
+	// be coherent, such as the camera rays of neighboring pixels. They are
+	// traced RayPacket::kSize at a time, as packets, through the same BVH
+	// as Intersect(); packets whose rays diverge are traced one ray at a
+	// time instead.
+	// hits[ i ].object is null if rays[ i ] hits nothing.
+	void IntersectPackets( const Ray* rays, uint32_t count, float t_min, float t_max, RayHit* hits ) const;
+
+	// Hit() and Occluded() use one of these according to
+	// PATHTRACER_BVH_WIDTH; both are always available so that they can be
+	// compared
+	bool HitBinaryBVH( const Ray& r, float t_min, float t_max, HitRecord& rec ) const;
+	bool HitWideBVH( const Ray& r, float t_min, float t_max, HitRecord& rec ) const;
+	bool OccludedBinaryBVH( const Ray& r, float t_min, float t_max ) const;
+	bool OccludedWideBVH( const Ray& r, float t_min, float t_max ) const;
+
+	// The width of the WideBVH that HitWideBVH() traverses
+	static const uint32_t kWideBVHWidth = PATHTRACER_BVH_WIDTH > 2 ? PATHTRACER_BVH_WIDTH : 4;
+
 private:
+	// Builds mBVH, mWideBVH and mSphereSet over the objects in
+	// mPrimitives, and puts mPrimitives in the BVH's leaf order; mBVH is
+	// copied from bvh instead of built, if it isn't null
+	void BuildBVH( const LinearBVH* bvh = nullptr );
+
+	// The object a PrimitiveRef refers to, through its Traceable interface
+	inline const Traceable* GetPrimitive( const PrimitiveRef& primitive ) const;
+
+	template< class BVH >
+	bool IntersectBVH( const BVH& bvh, const Ray& r, float t_min, float t_max, RayHit& hit ) const;
+	void IntersectPacket( const RayPacket& packet, float t_min, float t_max, RayHit* hits ) const;
+
+	template< class BVH >
+	bool OccludedBVH( const BVH& bvh, const Ray& r, float t_min, float t_max ) const;
+
+	// Test one of the primitives in a BVH leaf; spheres are left to
+	// mSphereSet, which tests a leaf's spheres together
+	inline bool IntersectPrimitive( const PrimitiveRef& primitive, const Ray& r, float t_min, float t_max,
+									RayHit& hit ) const;
+	inline bool OccludedPrimitive( const PrimitiveRef& primitive, const Ray& r, float t_min, float t_max ) const;
+
+	// Every object, wherever it is stored, in the order Initialize() got them
 	Traceable**	mList;
 	uint32_t	mListSize;
 
+	// The objects, one array per PrimitiveType
+	Sphere*		mSpheres;
+	uint32_t	mSphereCount;
+	xyRect*		mRects;
+	uint32_t	mRectCount;
+	Mesh**		mMeshes;
+	uint32_t	mMeshCount;
+	Instance*	mInstances;
+	uint32_t	mInstanceCount;
+	Traceable**	mCustom;
+	uint32_t	mCustomCount;
+
+	// The objects that have bounding boxes, in the order mBVH's leaves reference them
+	PrimitiveRef*	mPrimitives;
+	uint32_t		mPrimitiveCount;
+	uint32_t		mBoundedSphereCount;
+	LinearBVH	mBVH;
+	WideBVH< kWideBVHWidth > mWideBVH; // collapsed from mBVH
+	SphereSet	mSphereSet; // the spheres in mPrimitives, tested in batches
+
+	Traceable**	mUnbounded; // Objects without a bounding box
+	uint32_t	mUnboundedSize;
+
+	Traceable**	mLights;
+	uint32_t	mLightCount;
+
+	MaterialTable*	mMaterials;
+
+	float		mTime0, mTime1; // The shutter interval mBVH was built for
+	BVHBuildOptions	mBVHOptions; // and the options it was built with
+
 }; // class Scene
 
 inline Scene::Scene()
 	: mList( nullptr )
 	, mListSize( 0 )
+	, mSpheres( nullptr )
+	, mSphereCount( 0 )
+	, mRects( nullptr )
+	, mRectCount( 0 )
+	, mMeshes( nullptr )
+	, mMeshCount( 0 )
+	, mInstances( nullptr )
+	, mInstanceCount( 0 )
+	, mCustom( nullptr )
+	, mCustomCount( 0 )
+	, mPrimitives( nullptr )
+	, mPrimitiveCount( 0 )
+	, mBoundedSphereCount( 0 )
+	, mUnbounded( nullptr )
+	, mUnboundedSize( 0 )
+	, mLights( nullptr )
+	, mLightCount( 0 )
+	, mMaterials( nullptr )
+	, mTime0( 0.0f )
+	, mTime1( 0.0f )
 {
 }
 
@@ -52,3 +236,107 @@ inline uint32_t Scene::GetListSize( void ) const
 {
 	return mListSize;
 }
+
+inline uint32_t Scene::GetInstanceCount( void ) const
+{
+	return mInstanceCount;
+}
+
+inline const Instance& Scene::GetInstance( uint32_t index ) const
+{
+	return mInstances[ index ];
+}
+
+inline const MaterialTable& Scene::GetMaterials( void ) const
+{
+	return *mMaterials;
+}
+
+inline const LinearBVH& Scene::GetBVH( void ) const
+{
+	return mBVH;
+}
+
+inline uint32_t Scene::GetLightCount( void ) const
+{
+	return mLightCount;
+}
+
+inline const Traceable* Scene::GetLight( uint32_t index ) const
+{
+	return mLights[ index ];
+}
+
+inline const Traceable* Scene::GetPrimitive( const PrimitiveRef& primitive ) const
+{
+	switch( primitive.type )
+	{
+	case PrimitiveType::kSphere:
+		return &mSpheres[ primitive.index ];
+
+	case PrimitiveType::kRect:
+		return &mRects[ primitive.index ];
+
+	case PrimitiveType::kMesh:
+		return mMeshes[ primitive.index ];
+
+	case PrimitiveType::kInstance:
+		return &mInstances[ primitive.index ];
+
+	case PrimitiveType::kCustom:
+		return mCustom[ primitive.index ];
+
+	} // switch( primitive.type )
+
+	return nullptr;
+}
+
+inline bool Scene::IntersectPrimitive( const PrimitiveRef& primitive, const Ray& r, float t_min, float t_max,
+									   RayHit& hit ) const
+{
+	// The qualified calls aren't virtual, and can be inlined
+	switch( primitive.type )
+	{
+	case PrimitiveType::kSphere:
+		return false; // see mSphereSet
+
+	case PrimitiveType::kRect:
+		return mRects[ primitive.index ].xyRect::Intersect( r, t_min, t_max, hit );
+
+	case PrimitiveType::kMesh:
+		return mMeshes[ primitive.index ]->Mesh::Intersect( r, t_min, t_max, hit );
+
+	case PrimitiveType::kInstance:
+		return mInstances[ primitive.index ].Instance::Intersect( r, t_min, t_max, hit );
+
+	case PrimitiveType::kCustom:
+		return mCustom[ primitive.index ]->Intersect( r, t_min, t_max, hit );
+
+	} // switch( primitive.type )
+
+	return false;
+}
+
+inline bool Scene::OccludedPrimitive( const PrimitiveRef& primitive, const Ray& r, float t_min, float t_max ) const
+{
+	switch( primitive.type )
+	{
+	case PrimitiveType::kSphere:
+		return false; // see mSphereSet
+
+	case PrimitiveType::kRect:
+		return mRects[ primitive.index ].xyRect::Occluded( r, t_min, t_max );
+
+	case PrimitiveType::kMesh:
+		return mMeshes[ primitive.index ]->Mesh::Occluded( r, t_min, t_max );
+
+	case PrimitiveType::kInstance:
+		return mInstances[ primitive.index ].Instance::Occluded( r, t_min, t_max );
+
+	case PrimitiveType::kCustom:
+		return mCustom[ primitive.index ]->Occluded( r, t_min, t_max );
+
+	} // switch( primitive.type )
+
+	return false;
+}
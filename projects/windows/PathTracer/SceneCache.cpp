@@ -0,0 +1,226 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include "SceneCache.h"
+
+#include <ee/core/Debug.h>
+#include <ee/io/FileOutputStream.h>
+#include <ee/utility/HashUtils.h>
+
+// "EESCENE1" in little-endian byte order, so a file written on a machine
+// of the other byte order doesn't have the magic number
+static const uint64_t kMagic = 0x31454E4543534545ull;
+static const uint32_t kVersion = 1;
+
+// Where one section is in the file
+struct FileSection
+{
+	uint64_t	offset;
+	uint64_t	size;		// in bytes
+	uint32_t	recordSize;
+	uint32_t	pad;
+
+}; // struct FileSection
+
+// The start of the file
+struct FileHeader
+{
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	sectionCount;
+	uint64_t	key;
+	uint64_t	fileSize;
+	FileSection	sections[ SceneCache::kMaxSectionCount ];
+
+}; // struct FileHeader
+
+static inline uint64_t AlignUp( uint64_t offset )
+{
+	return ( offset + SceneCache::kAlignment - 1 ) & ~uint64_t( SceneCache::kAlignment - 1 );
+}
+
+SceneCache::SceneCache()
+{
+	Close();
+}
+
+SceneCache::~SceneCache()
+{
+}
+
+bool SceneCache::Write( const char* filename, uint64_t key ) const
+{
+	FileHeader header = {};
+	header.magic = kMagic;
+	header.version = kVersion;
+	header.sectionCount = kMaxSectionCount;
+	header.key = key;
+
+	uint64_t offset = AlignUp( sizeof( FileHeader ) );
+	for( uint32_t i = 0; i < kMaxSectionCount; ++i )
+	{
+		const Section& section = mSections[ i ];
+		header.sections[ i ] = { offset, section.data.size(), section.recordSize, 0 };
+		offset = AlignUp( offset + section.data.size() );
+	}
+
+	header.fileSize = offset;
+
+	std::unique_ptr< FileOutputStream > stream = MakeFileOutputStream( filename );
+	if( !stream->Open() )
+	{
+		eeDebug( "SceneCache: can't create %s\n", filename );
+		return false;
+	}
+
+	// OutputStream::Write() returns a 32 bit count, so write 1GB at a time
+	auto write = [&stream]( const void* data, uint64_t size )
+	{
+		static const uint64_t kMaxWriteSize = 1 << 30;
+		const uint8_t* bytes = static_cast< const uint8_t* >( data );
+
+		while( size > 0 )
+		{
+			const uint32_t writeSize = uint32_t( eeMin( size, kMaxWriteSize ) );
+			if( stream->Write( bytes, writeSize ) != writeSize )
+				return false;
+
+			bytes += writeSize;
+			size -= writeSize;
+		}
+
+		return true;
+	};
+
+	auto pad = [&write]( uint64_t size )
+	{
+		static const uint8_t kZeros[ kAlignment ] = {};
+		return write( kZeros, AlignUp( size ) - size );
+	};
+
+	// The header is written last, so a file that's cut short has no magic
+	// number, and can't be mistaken for a whole one
+	const FileHeader placeholder = {};
+	bool result = write( &placeholder, sizeof( placeholder ) ) && pad( sizeof( placeholder ) );
+
+	for( uint32_t i = 0; result && ( i < kMaxSectionCount ); ++i )
+	{
+		const std::vector< uint8_t >& data = mSections[ i ].data;
+		result = write( data.data(), data.size() ) && pad( data.size() );
+	}
+
+	result = result && stream->Seek( 0, SeekOrigin::kFromStart ) && write( &header, sizeof( header ) );
+	stream->Close();
+
+	eeDebugIf( !result, "SceneCache: couldn't write %s\n", filename );
+	return result;
+}
+
+bool SceneCache::Open( const char* filename, uint64_t key )
+{
+	Close();
+
+	mFile = MakeMappedFile( filename );
+	if( !mFile->Open() )
+	{
+		Close();
+		return false;
+	}
+
+	const uint8_t* data = mFile->GetData();
+	const size_t size = mFile->GetSize();
+
+	FileHeader header;
+	if( size < sizeof( header ) )
+	{
+		eeDebug( "SceneCache: %s is too small to be a cache file\n", filename );
+		Close();
+		return false;
+	}
+
+	memcpy( &header, data, sizeof( header ) );
+
+	if( ( header.magic != kMagic ) || ( header.version != kVersion ) || ( header.sectionCount != kMaxSectionCount ) )
+	{
+		eeDebug( "SceneCache: %s isn't a cache file of this version, or wasn't completely written\n", filename );
+		Close();
+		return false;
+	}
+
+	if( header.fileSize != size )
+	{
+		eeDebug( "SceneCache: %s should be %llu bytes, but is %zu\n", filename,
+				 static_cast< unsigned long long >( header.fileSize ), size );
+		Close();
+		return false;
+	}
+
+	if( header.key != key )
+	{
+		eeDebug( "SceneCache: %s is out of date\n", filename );
+		Close();
+		return false;
+	}
+
+	for( uint32_t i = 0; i < kMaxSectionCount; ++i )
+	{
+		const FileSection& section = header.sections[ i ];
+		if( section.size == 0 )
+			continue;
+
+		if( ( section.offset % kAlignment != 0 ) || ( section.offset > size ) || ( section.size > size - section.offset ) ||
+			( section.recordSize == 0 ) || ( section.size % section.recordSize != 0 ) )
+		{
+			eeDebug( "SceneCache: section %u of %s isn't within the file\n", i, filename );
+			Close();
+			return false;
+		}
+
+		mSectionData[ i ] = data + section.offset;
+		mSectionSizes[ i ] = section.size;
+		mRecordSizes[ i ] = section.recordSize;
+	}
+
+	return true;
+}
+
+void SceneCache::Close( void )
+{
+	for( uint32_t i = 0; i < kMaxSectionCount; ++i )
+	{
+		mSectionData[ i ] = nullptr;
+		mSectionSizes[ i ] = 0;
+		mRecordSizes[ i ] = 0;
+	}
+
+	mFile.reset();
+}
+
+bool SceneCache::HashFile( const char* filename, uint64_t& hash )
+{
+	std::unique_ptr< MappedFile > file = MakeMappedFile( filename );
+	if( !file->Open() )
+		return false;
+
+	hash = HashUtils::CalculateCRC64( file->GetData(), file->GetSize() );
+	return true;
+}
+
+bool SceneCache::GetFileStatus( const char* filename, uint64_t& size, int64_t& lastModified )
+{
+	// Making a MappedFile fills in its File's status, without opening it;
+	// see MakeMappedFile()
+	std::shared_ptr< File > file = std::make_shared< File >( filename );
+	std::unique_ptr< MappedFile > mapped = MakeMappedFile( file );
+
+	const FileStatus& status = file->GetStatus();
+	if( !status.IsFile() )
+		return false;
+
+	size = status.GetSize();
+	lastModified = int64_t( status.GetLastModified() );
+	return true;
+}
@@ -0,0 +1,122 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <ee/io/MappedFile.h>
+
+using namespace ee;
+
+// A file of numbered sections, each an array of fixed-size records, for
+// saving what took a long time to compute, such as a scene's BVHs, and
+// using it again later without recomputing or parsing anything.
+//
+// The file is written in native byte order, with every section starting
+// at an offset that's a multiple of kAlignment, and the sections found
+// through offsets from the start of the file rather than pointers; so it
+// can be mapped anywhere in memory and its records used where they are.
+// Records must be plain data that can be copied byte for byte, with no
+// virtual functions and nothing that points outside the file: they refer
+// to each other by index.
+//
+// Each file is written for a key, which should be a hash of whatever the
+// records were computed from, and of the format of the records; Open()
+// rejects a file written for another key, so a stale file is never used.
+class SceneCache
+{
+public:
+	static const uint32_t kMaxSectionCount = 32;
+	static const uint32_t kAlignment = 64;
+
+	SceneCache();
+	~SceneCache();
+
+	// Appends records to section, to be written by Write(), and returns
+	// the index of the first of them in the section
+	template< class T >
+	inline uint64_t Append( uint32_t section, const T* records, size_t count );
+
+	// Writes the appended sections to filename, replacing it. The file
+	// only becomes valid once it has been completely written.
+	bool Write( const char* filename, uint64_t key ) const;
+
+	// Maps filename, and checks that it's a whole file, written for key.
+	// Returns false if it isn't, with the reason in the debug output.
+	bool Open( const char* filename, uint64_t key );
+	void Close( void );
+
+	// The records of section of the file that's open, where it's mapped,
+	// and how many there are. Returns null if the section is empty, or its
+	// records aren't the size of a T.
+	template< class T >
+	inline const T* Get( uint32_t section, size_t& count ) const;
+
+	// The CRC-64 of the contents of filename, for making keys
+	static bool HashFile( const char* filename, uint64_t& hash );
+
+	// The size of filename and when it was last modified, which change
+	// with its contents in practice, so a file whose status hasn't changed
+	// since it was hashed needn't be read and hashed again
+	static bool GetFileStatus( const char* filename, uint64_t& size, int64_t& lastModified );
+
+private:
+	// The sections being built for Write()
+	struct Section
+	{
+		std::vector< uint8_t >	data;
+		uint32_t				recordSize = 0;
+	};
+
+	Section		mSections[ kMaxSectionCount ];
+
+	// The file that's open, and where its sections are in it
+	std::unique_ptr< MappedFile >	mFile;
+	const uint8_t*					mSectionData[ kMaxSectionCount ];
+	uint64_t						mSectionSizes[ kMaxSectionCount ];
+	uint32_t						mRecordSizes[ kMaxSectionCount ];
+
+}; // class SceneCache
+
+template< class T >
+inline uint64_t SceneCache::Append( uint32_t section, const T* records, size_t count )
+{
+	static_assert( std::is_standard_layout< T >::value, "SceneCache records are copied byte for byte" );
+
+	Section& appended = mSections[ section ];
+	appended.recordSize = uint32_t( sizeof( T ) );
+
+	const size_t size = appended.data.size();
+	appended.data.resize( size + count * sizeof( T ) );
+
+	if( count > 0 )
+	{
+		memcpy( appended.data.data() + size, records, count * sizeof( T ) );
+	}
+
+	return size / sizeof( T );
+}
+
+template< class T >
+inline const T* SceneCache::Get( uint32_t section, size_t& count ) const
+{
+	static_assert( std::is_standard_layout< T >::value, "SceneCache records are copied byte for byte" );
+	static_assert( alignof( T ) <= kAlignment, "SceneCache sections aren't aligned for T" );
+
+	count = 0;
+
+	if( ( section >= kMaxSectionCount ) || ( mSectionData[ section ] == nullptr ) ||
+		( mRecordSizes[ section ] != sizeof( T ) ) )
+	{
+		return nullptr;
+	}
+
+	count = size_t( mSectionSizes[ section ] / sizeof( T ) );
+	return reinterpret_cast< const T* >( mSectionData[ section ] );
+}
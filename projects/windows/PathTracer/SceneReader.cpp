@@ -0,0 +1,1720 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "SceneReader.h"
+#include "Instance.h"
+#include "LineReader.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "ObjReader.h"
+#include "SceneCache.h"
+#include "Texture.h"
+
+#include <ee/core/Debug.h>
+#include <ee/io/FileInputStream.h>
+#include <ee/io/FilePath.h>
+#include <ee/utility/HashUtils.h>
+
+enum class SceneTextureType
+{
+	kConstant,
+	kChecker,
+	kNoise,
+	kImage
+};
+
+enum class SceneMaterialType
+{
+	kLambertian,
+	kMetal,
+	kGlass,
+	kLight
+};
+
+// The definitions a scene file's lines make; line is the line's number
+// in the chunk it's in, and then, once every chunk has been parsed, in
+// the file
+
+struct SceneTexture
+{
+	std::string			name;
+	SceneTextureType	type;
+	vec3				color;
+	float				scale;
+	std::string			odd, even;	// the names of a checker's textures
+	std::string			filename;
+	uint64_t			line;
+
+}; // struct SceneTexture
+
+struct SceneMaterial
+{
+	std::string			name;
+	SceneMaterialType	type;
+	vec3				color;
+	float				parameter;	// fuzziness or refractive index
+	std::string			texture;	// the name of the texture used instead of color, if any
+	uint64_t			line;
+
+}; // struct SceneMaterial
+
+struct SceneMesh
+{
+	std::string	name;
+	std::string	material;
+	std::string	filename;
+	uint64_t	line;
+
+}; // struct SceneMesh
+
+struct SceneCamera
+{
+	vec3	eye = vec3( 0.0f, 0.0f, 0.0f );
+	vec3	lookat = vec3( 0.0f, 0.0f, -1.0f );
+	vec3	up = vec3( 0.0f, 1.0f, 0.0f );
+	float	verticalFOV = 20.0f; // degrees
+	float	aperture = 0.0f;
+	float	focalDistance = 0.0f; // 0 to focus on lookat
+
+}; // struct SceneCamera
+
+// The objects a chunk's lines describe, which refer to materials and
+// meshes by the index of their name in SceneChunk::names
+
+static const uint32_t kNoName = 0xFFFFFFFF;
+
+struct SceneSphere
+{
+	uint32_t	material;
+	vec3		center0, center1;
+	float		time0, time1;
+	float		radius;
+
+}; // struct SceneSphere
+
+struct SceneRect
+{
+	uint32_t	material;
+	float		x0, x1, y0, y1, k;
+
+}; // struct SceneRect
+
+struct SceneInstance
+{
+	uint32_t	mesh;
+	uint32_t	material; // kNoName to keep the mesh's
+	Transform	transform;
+
+}; // struct SceneInstance
+
+// One chunk of a scene file, and what parsing it found. Its error is
+// also set if one of its objects can't be created.
+struct SceneChunk : public TextChunk
+{
+	std::vector< SceneTexture >		textures;
+	std::vector< SceneMaterial >	materials;
+	std::vector< SceneMesh >		meshes;
+
+	bool			hasCamera = false;
+	SceneCamera		camera;
+	bool			hasShutter = false;
+	float			shutter[ 2 ];
+
+	// The names the chunk's objects use
+	std::vector< std::string >						names;
+	std::unordered_map< std::string, uint32_t >	nameIndices;
+
+	std::vector< SceneSphere >		spheres;
+	std::vector< SceneRect >		rects;
+	std::vector< SceneInstance >	instances;
+
+	// Every object, in file order, as its type and its index in the
+	// array of that type, and the line it's on
+	std::vector< PrimitiveRef >		objects;
+	std::vector< uint32_t >			objectLines;
+
+	// The number of lines and objects in the chunks before this one
+	uint64_t	firstLine = 0;
+	size_t		firstObject = 0;
+
+	bool ParseLine( const char* p, const char* end ) override;
+	bool ParseCamera( const char* p, const char* end );
+	bool ParseTexture( const char* p, const char* end );
+	bool ParseMaterial( const char* p, const char* end );
+	bool ParseInstance( const char* p, const char* end );
+
+	uint32_t GetNameIndex( const std::string_view& name );
+
+}; // struct SceneChunk
+
+// The sections of a scene's cache file, and the records in them. Names
+// and file names are offsets in kCacheStrings, of strings that end in a
+// 0, with kNoName for none. Spheres, rects and instances are stored as
+// SceneSphere, SceneRect and SceneInstance, but with MaterialIds in place
+// of material names, and the index of the mesh in kCacheMeshes in place
+// of its name; objects are PrimitiveRefs into those three sections, in
+// file order. Change kCacheVersion whenever any of this changes.
+
+static const uint32_t kCacheVersion = 2;
+
+static const uint32_t kCacheScene = 0;				// one CachedScene
+static const uint32_t kCacheStrings = 1;			// char
+static const uint32_t kCacheDependencies = 2;		// CachedDependency
+static const uint32_t kCacheTextures = 3;			// CachedTexture
+static const uint32_t kCacheMaterials = 4;			// CachedMaterial
+static const uint32_t kCacheMeshes = 5;				// CachedMesh
+static const uint32_t kCacheMeshPositions = 6;		// vec3
+static const uint32_t kCacheMeshNormals = 7;		// vec3
+static const uint32_t kCacheMeshUVs = 8;			// float
+static const uint32_t kCacheMeshIndices = 9;		// uint32_t
+static const uint32_t kCacheMeshNormalIndices = 10;	// uint32_t
+static const uint32_t kCacheMeshUVIndices = 11;		// uint32_t
+static const uint32_t kCacheMeshNodes = 12;			// LinearBVHNode
+static const uint32_t kCacheMeshPrimitives = 13;	// uint32_t
+static const uint32_t kCacheSpheres = 14;			// SceneSphere
+static const uint32_t kCacheRects = 15;				// SceneRect
+static const uint32_t kCacheInstances = 16;			// SceneInstance
+static const uint32_t kCacheObjects = 17;			// PrimitiveRef
+static const uint32_t kCacheNodes = 18;				// LinearBVHNode, of the scene's BVH
+static const uint32_t kCachePrimitives = 19;		// uint32_t, the scene BVH's primitive indices
+
+struct CachedScene
+{
+	SceneCamera		camera;
+	float			shutter[ 2 ];
+	uint64_t		lineCount;
+	BVHBuildOptions	bvhOptions; // that the scene's BVH was built with
+
+}; // struct CachedScene
+
+// A file the scene was read from, besides the scene file itself
+struct CachedDependency
+{
+	uint64_t	hash; // the CRC-64 of the file
+	uint64_t	size;
+	int64_t		lastModified; // as SceneCache::GetFileStatus() gives them
+	uint32_t	filename;
+	uint32_t	pad;
+
+}; // struct CachedDependency
+
+struct CachedTexture
+{
+	uint32_t			name;
+	SceneTextureType	type;
+	vec3				color;
+	float				scale;
+	uint32_t			odd, even;
+	uint32_t			filename;
+
+}; // struct CachedTexture
+
+struct CachedMaterial
+{
+	uint32_t			name;
+	SceneMaterialType	type;
+	vec3				color;
+	float				parameter;
+	uint32_t			texture;
+
+}; // struct CachedMaterial
+
+// The records [ first, first + count ) of a section
+struct CachedRange
+{
+	uint64_t	first;
+	uint64_t	count;
+
+}; // struct CachedRange
+
+// A mesh's MeshData and BVH, as Mesh::GetData() and GetBVH() return them
+struct CachedMesh
+{
+	MaterialId		material;
+	BVHBuildOptions	bvhOptions;
+	CachedRange		positions, normals, uvs;
+	CachedRange		indices, normalIndices, uvIndices;
+	CachedRange		nodes, primitives;
+
+}; // struct CachedMesh
+
+// What SceneReader has created so far, by name
+struct SceneReader::Definitions
+{
+	std::unordered_map< std::string, const SceneTexture* >			textures;
+	std::unordered_map< std::string, MaterialId >					materials;
+	std::unordered_map< std::string, std::shared_ptr< const Mesh > >	meshes;
+
+}; // struct SceneReader::Definitions
+
+static inline bool ParseVector( const char*& p, const char* end, vec3& value )
+{
+	return ParseFloat( p, end, value.x ) && ParseFloat( p, end, value.y ) && ParseFloat( p, end, value.z );
+}
+
+// Parses the next run of characters that aren't spaces
+static inline bool ParseWord( const char*& p, const char* end, std::string_view& word )
+{
+	p = SkipSpace( p, end );
+
+	const char* start = p;
+	while( ( p < end ) && ( *p != ' ' ) && ( *p != '\t' ) && ( *p != '\r' ) )
+	{
+		++p;
+	}
+
+	word = std::string_view( start, p - start );
+	return !word.empty();
+}
+
+// A word that starts with a letter or an underscore, so it can't be
+// mistaken for a number
+static inline bool ParseName( const char*& p, const char* end, std::string_view& name )
+{
+	if( !ParseWord( p, end, name ) )
+		return false;
+
+	const char c = name[ 0 ];
+	return ( ( c >= 'a' ) && ( c <= 'z' ) ) || ( ( c >= 'A' ) && ( c <= 'Z' ) ) || ( c == '_' );
+}
+
+// The rest of the line, without the spaces around it
+static inline bool ParseFilename( const char*& p, const char* end, std::string& filename )
+{
+	p = SkipSpace( p, end );
+
+	const char* last = end;
+	while( ( last > p ) && ( ( last[ -1 ] == ' ' ) || ( last[ -1 ] == '\t' ) || ( last[ -1 ] == '\r' ) ) )
+	{
+		--last;
+	}
+
+	filename.assign( p, last );
+	p = end;
+
+	return !filename.empty();
+}
+
+// Whether there's nothing left of the line
+static inline bool AtEnd( const char* p, const char* end )
+{
+	return SkipSpace( p, end ) == end;
+}
+
+bool SceneChunk::ParseLine( const char* p, const char* end )
+{
+	end = FindComment( p, end );
+
+	std::string_view keyword;
+	if( !ParseWord( p, end, keyword ) )
+		return true; // a blank line
+
+	if( keyword == "sphere" )
+	{
+		std::string_view material;
+		SceneSphere sphere;
+		if( !ParseName( p, end, material ) || !ParseVector( p, end, sphere.center0 ) ||
+			!ParseFloat( p, end, sphere.radius ) )
+		{
+			error = "a sphere needs a material, a center and a radius";
+			return false;
+		}
+
+		sphere.material = GetNameIndex( material );
+		sphere.center1 = sphere.center0;
+		sphere.time0 = 0.0f;
+		sphere.time1 = 0.0f;
+
+		if( !AtEnd( p, end ) &&
+			( !ParseVector( p, end, sphere.center1 ) || !ParseFloat( p, end, sphere.time0 ) ||
+			  !ParseFloat( p, end, sphere.time1 ) ) )
+		{
+			error = "a moving sphere needs a second center, and the times it's at each";
+			return false;
+		}
+
+		objects.push_back( { PrimitiveType::kSphere, uint32_t( spheres.size() ) } );
+		objectLines.push_back( uint32_t( lineCount ) );
+		spheres.push_back( sphere );
+	}
+	else if( keyword == "rect" )
+	{
+		std::string_view material;
+		SceneRect rect;
+		if( !ParseName( p, end, material ) || !ParseFloat( p, end, rect.x0 ) || !ParseFloat( p, end, rect.x1 ) ||
+			!ParseFloat( p, end, rect.y0 ) || !ParseFloat( p, end, rect.y1 ) || !ParseFloat( p, end, rect.k ) )
+		{
+			error = "a rect needs a material, its x and y ranges and its z";
+			return false;
+		}
+
+		rect.material = GetNameIndex( material );
+
+		objects.push_back( { PrimitiveType::kRect, uint32_t( rects.size() ) } );
+		objectLines.push_back( uint32_t( lineCount ) );
+		rects.push_back( rect );
+	}
+	else if( keyword == "instance" )
+	{
+		return ParseInstance( p, end );
+	}
+	else if( keyword == "material" )
+	{
+		return ParseMaterial( p, end );
+	}
+	else if( keyword == "texture" )
+	{
+		return ParseTexture( p, end );
+	}
+	else if( keyword == "mesh" )
+	{
+		std::string_view name, material;
+		SceneMesh mesh;
+		if( !ParseName( p, end, name ) || !ParseName( p, end, material ) || !ParseFilename( p, end, mesh.filename ) )
+		{
+			error = "a mesh needs a name, a material and a file";
+			return false;
+		}
+
+		mesh.name = name;
+		mesh.material = material;
+		mesh.line = lineCount;
+		meshes.push_back( std::move( mesh ) );
+		return true;
+	}
+	else if( keyword == "camera" )
+	{
+		return ParseCamera( p, end );
+	}
+	else if( keyword == "shutter" )
+	{
+		if( !ParseFloat( p, end, shutter[ 0 ] ) || !ParseFloat( p, end, shutter[ 1 ] ) )
+		{
+			error = "the shutter needs the times it opens and closes";
+			return false;
+		}
+
+		hasShutter = true;
+	}
+	else
+	{
+		error = "unknown statement";
+		return false;
+	}
+
+	if( !AtEnd( p, end ) )
+	{
+		error = "unexpected text at the end of the line";
+		return false;
+	}
+
+	return true;
+}
+
+bool SceneChunk::ParseCamera( const char* p, const char* end )
+{
+	camera = SceneCamera();
+	hasCamera = true;
+
+	std::string_view parameter;
+	while( ParseWord( p, end, parameter ) )
+	{
+		bool valid;
+		if( parameter == "eye" )
+		{
+			valid = ParseVector( p, end, camera.eye );
+		}
+		else if( parameter == "lookat" )
+		{
+			valid = ParseVector( p, end, camera.lookat );
+		}
+		else if( parameter == "up" )
+		{
+			valid = ParseVector( p, end, camera.up );
+		}
+		else if( parameter == "fov" )
+		{
+			valid = ParseFloat( p, end, camera.verticalFOV );
+		}
+		else if( parameter == "aperture" )
+		{
+			valid = ParseFloat( p, end, camera.aperture );
+		}
+		else if( parameter == "focus" )
+		{
+			valid = ParseFloat( p, end, camera.focalDistance );
+		}
+		else
+		{
+			error = "unknown camera parameter";
+			return false;
+		}
+
+		if( !valid )
+		{
+			error = "a camera parameter is missing its value";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool SceneChunk::ParseTexture( const char* p, const char* end )
+{
+	std::string_view name, type;
+	if( !ParseName( p, end, name ) || !ParseWord( p, end, type ) )
+	{
+		error = "a texture needs a name and a type";
+		return false;
+	}
+
+	SceneTexture texture;
+	texture.name = name;
+	texture.line = lineCount;
+
+	bool valid;
+	if( type == "constant" )
+	{
+		texture.type = SceneTextureType::kConstant;
+		valid = ParseVector( p, end, texture.color );
+	}
+	else if( type == "checker" )
+	{
+		std::string_view odd, even;
+		texture.type = SceneTextureType::kChecker;
+		valid = ParseName( p, end, odd ) && ParseName( p, end, even );
+		texture.odd = odd;
+		texture.even = even;
+	}
+	else if( type == "noise" )
+	{
+		texture.type = SceneTextureType::kNoise;
+		valid = ParseFloat( p, end, texture.scale );
+	}
+	else if( type == "image" )
+	{
+		texture.type = SceneTextureType::kImage;
+		valid = ParseFilename( p, end, texture.filename );
+	}
+	else
+	{
+		error = "unknown texture type";
+		return false;
+	}
+
+	if( !valid || !AtEnd( p, end ) )
+	{
+		error = "invalid texture parameters";
+		return false;
+	}
+
+	textures.push_back( std::move( texture ) );
+	return true;
+}
+
+bool SceneChunk::ParseMaterial( const char* p, const char* end )
+{
+	std::string_view name, type;
+	if( !ParseName( p, end, name ) || !ParseWord( p, end, type ) )
+	{
+		error = "a material needs a name and a type";
+		return false;
+	}
+
+	SceneMaterial material;
+	material.name = name;
+	material.parameter = 0.0f;
+	material.line = lineCount;
+
+	// Lambertians and lights take a color or the name of a texture
+	auto parseColor = [&]()
+	{
+		const char* start = p;
+		if( ParseVector( p, end, material.color ) )
+			return true;
+
+		p = start;
+
+		std::string_view texture;
+		if( !ParseName( p, end, texture ) )
+			return false;
+
+		material.texture = texture;
+		return true;
+	};
+
+	bool valid;
+	if( type == "lambertian" )
+	{
+		material.type = SceneMaterialType::kLambertian;
+		valid = parseColor();
+	}
+	else if( type == "metal" )
+	{
+		material.type = SceneMaterialType::kMetal;
+		valid = ParseVector( p, end, material.color ) && ParseFloat( p, end, material.parameter );
+	}
+	else if( type == "glass" )
+	{
+		material.type = SceneMaterialType::kGlass;
+		valid = ParseFloat( p, end, material.parameter );
+	}
+	else if( type == "light" )
+	{
+		material.type = SceneMaterialType::kLight;
+		valid = parseColor();
+	}
+	else
+	{
+		error = "unknown material type";
+		return false;
+	}
+
+	if( !valid || !AtEnd( p, end ) )
+	{
+		error = "invalid material parameters";
+		return false;
+	}
+
+	materials.push_back( std::move( material ) );
+	return true;
+}
+
+bool SceneChunk::ParseInstance( const char* p, const char* end )
+{
+	std::string_view mesh;
+	if( !ParseName( p, end, mesh ) )
+	{
+		error = "an instance needs a mesh";
+		return false;
+	}
+
+	SceneInstance instance;
+	instance.mesh = GetNameIndex( mesh );
+	instance.material = kNoName;
+
+	// Each transform applies to the result of those before it
+	std::string_view parameter;
+	while( ParseWord( p, end, parameter ) )
+	{
+		bool valid;
+		if( parameter == "material" )
+		{
+			std::string_view material;
+			valid = ParseName( p, end, material );
+			if( valid )
+			{
+				instance.material = GetNameIndex( material );
+			}
+		}
+		else if( parameter == "translate" )
+		{
+			vec3 offset;
+			valid = ParseVector( p, end, offset );
+			instance.transform = Transform::Translation( offset ) * instance.transform;
+		}
+		else if( parameter == "rotate" )
+		{
+			vec3 axis;
+			float degrees;
+			valid = ParseVector( p, end, axis ) && ParseFloat( p, end, degrees ) && !axis.IsZero( 0.0f );
+			if( valid )
+			{
+				instance.transform = Transform::Rotation( axis, degrees ) * instance.transform;
+			}
+		}
+		else if( parameter == "scale" )
+		{
+			// One factor for every axis, or one per axis
+			vec3 scale;
+			valid = ParseFloat( p, end, scale.x );
+			if( valid && ParseFloat( p, end, scale.y ) )
+			{
+				valid = ParseFloat( p, end, scale.z );
+			}
+			else
+			{
+				scale.y = scale.z = scale.x;
+			}
+
+			valid = valid && ( scale.x != 0.0f ) && ( scale.y != 0.0f ) && ( scale.z != 0.0f );
+			if( valid )
+			{
+				instance.transform = Transform::Scaling( scale ) * instance.transform;
+			}
+		}
+		else
+		{
+			error = "unknown instance parameter";
+			return false;
+		}
+
+		if( !valid )
+		{
+			error = "invalid instance parameters";
+			return false;
+		}
+	}
+
+	objects.push_back( { PrimitiveType::kInstance, uint32_t( instances.size() ) } );
+	objectLines.push_back( uint32_t( lineCount ) );
+	instances.push_back( instance );
+
+	return true;
+}
+
+uint32_t SceneChunk::GetNameIndex( const std::string_view& name )
+{
+	auto inserted = nameIndices.emplace( std::string( name ), uint32_t( names.size() ) );
+	if( inserted.second )
+	{
+		names.emplace_back( name );
+	}
+
+	return inserted.first->second;
+}
+
+static Camera* CreateCamera( const SceneCamera& camera, const float shutter[ 2 ], float aspectRatio )
+{
+	float focalDistance = camera.focalDistance;
+	if( focalDistance <= 0.0f )
+	{
+		focalDistance = ( camera.lookat - camera.eye ).Length();
+	}
+
+	return new Camera( camera.eye, camera.lookat, camera.up, camera.verticalFOV, aspectRatio, camera.aperture,
+					   focalDistance, shutter[ 0 ], shutter[ 1 ] );
+}
+
+SceneReader::SceneReader( const SceneReadOptions& options )
+	: mOptions( options )
+	, mLineCount( 0 )
+	, mObjectCount( 0 )
+	, mCacheKey( 0 )
+	, mFromCache( false )
+{
+	if( mOptions.threadCount == 0 )
+	{
+		mOptions.threadCount = eeMax( 1u, std::thread::hardware_concurrency() );
+	}
+
+	mOptions.chunkSize = eeMax( mOptions.chunkSize, 4096u );
+}
+
+SceneReader::~SceneReader()
+{
+}
+
+bool SceneReader::Read( const char* filename, float aspectRatio, Scene*& scene, Camera*& camera )
+{
+	// File names in the scene are relative to its directory
+	const char* name = filename + strlen( filename );
+	while( ( name > filename ) && ( name[ -1 ] != '/' ) && ( name[ -1 ] != '\\' ) )
+	{
+		--name;
+	}
+
+	BeginRead( std::string( filename, name ) );
+
+	uint64_t sourceHash;
+	if( mOptions.useCache && SceneCache::HashFile( filename, sourceHash ) )
+	{
+		mCacheFilename = std::string( filename ) + ".cache";
+		mCacheKey = GetCacheKey( sourceHash );
+
+		SceneCache cache;
+		mFromCache = cache.Open( mCacheFilename.c_str(), mCacheKey ) && ReadCache( cache, aspectRatio, scene, camera );
+
+		mChunks.clear();
+		mDefinitions.reset();
+
+		if( mFromCache )
+		{
+			eeDebug( "SceneReader: created the scene from %s\n", mCacheFilename.c_str() );
+			EndRead();
+			return true;
+		}
+
+		// However far it got, the time spent on the cache is the cache's
+		const double cacheTime = mTimes.cache + mTimes.materials + mTimes.meshes + mTimes.objects + mTimes.scene;
+		mTimes = SceneReadTimes();
+		mTimes.cache = cacheTime + EndStage();
+	}
+
+	std::unique_ptr< FileInputStream > stream = MakeFileInputStream( filename );
+	if( !stream->Open() )
+	{
+		eeDebug( "SceneReader: can't open %s\n", filename );
+		return false;
+	}
+
+	bool result = ReadStream( *stream, aspectRatio, scene, camera );
+	stream->Close();
+	mCacheFilename.clear();
+
+	if( result )
+	{
+		EndRead();
+	}
+	else
+	{
+		eeDebug( "SceneReader: couldn't read %s\n", filename );
+	}
+
+	return result;
+}
+
+bool SceneReader::Read( InputStream& stream, const char* directory, float aspectRatio, Scene*& scene, Camera*& camera )
+{
+	BeginRead( directory );
+
+	bool result = ReadStream( stream, aspectRatio, scene, camera );
+	if( result )
+	{
+		EndRead();
+	}
+
+	return result;
+}
+
+bool SceneReader::ReadStream( InputStream& stream, float aspectRatio, Scene*& scene, Camera*& camera )
+{
+	mDefinitions = std::make_unique< Definitions >();
+
+	auto newChunk = [&]() -> TextChunk*
+	{
+		mChunks.push_back( std::make_unique< SceneChunk >() );
+		return mChunks.back().get();
+	};
+
+	if( !ReadLines( stream, mOptions.threadCount, mOptions.chunkSize, newChunk ) )
+	{
+		eeDebug( "SceneReader: the stream couldn't be read\n" );
+		mChunks.clear();
+		return false;
+	}
+
+	// Number the lines and objects through the whole file, and find the
+	// camera; later definitions of it replace earlier ones
+	SceneCamera sceneCamera;
+	float shutter[ 2 ] = { 0.0f, 0.0f };
+	size_t objectCount = 0;
+
+	for( const std::unique_ptr< SceneChunk >& chunk : mChunks )
+	{
+		chunk->firstLine = mLineCount;
+		chunk->firstObject = objectCount;
+		mLineCount += chunk->lineCount;
+		objectCount += chunk->objects.size();
+
+		if( chunk->error != nullptr )
+		{
+			eeDebug( "SceneReader: line %llu: %s\n", static_cast< unsigned long long >( mLineCount ), chunk->error );
+			mChunks.clear();
+			return false;
+		}
+
+		for( SceneTexture& texture : chunk->textures )
+		{
+			texture.line += chunk->firstLine;
+		}
+
+		for( SceneMaterial& material : chunk->materials )
+		{
+			material.line += chunk->firstLine;
+		}
+
+		for( SceneMesh& mesh : chunk->meshes )
+		{
+			mesh.line += chunk->firstLine;
+		}
+
+		if( chunk->hasCamera )
+		{
+			sceneCamera = chunk->camera;
+		}
+
+		if( chunk->hasShutter )
+		{
+			shutter[ 0 ] = chunk->shutter[ 0 ];
+			shutter[ 1 ] = chunk->shutter[ 1 ];
+		}
+	}
+
+	mTimes.parse = EndStage();
+
+	if( objectCount == 0 )
+	{
+		eeDebug( "SceneReader: the scene has no objects\n" );
+		mChunks.clear();
+		return false;
+	}
+
+	MaterialTable* materials = new MaterialTable;
+
+	bool result = CreateMaterials( *materials );
+	mTimes.materials = EndStage();
+
+	result = result && CreateMeshes();
+	mTimes.meshes = EndStage();
+
+	std::vector< Traceable* > objects;
+	result = result && CreateObjects( objects );
+	mTimes.objects = EndStage();
+
+	// All of the cache but the scene's BVH is made of the definitions
+	std::unique_ptr< SceneCache > cache;
+	if( result && !mCacheFilename.empty() )
+	{
+		cache = std::make_unique< SceneCache >();
+		if( !AddToCache( *cache ) )
+		{
+			cache.reset();
+		}
+
+		mTimes.cache += EndStage();
+	}
+
+	// The objects have all been created, and hold what they need of the
+	// definitions, or there was an error
+	mChunks.clear();
+	mDefinitions.reset();
+
+	if( !result )
+	{
+		delete materials;
+		return false;
+	}
+
+	scene = new Scene;
+	if( !scene->Initialize( objects.data(), uint32_t( objects.size() ), materials, shutter[ 0 ], shutter[ 1 ],
+							mOptions.bvhOptions ) )
+	{
+		delete scene;
+		scene = nullptr;
+		return false;
+	}
+
+	mTimes.scene = EndStage();
+	mObjectCount = objects.size();
+
+	camera = CreateCamera( sceneCamera, shutter, aspectRatio );
+
+	if( cache != nullptr )
+	{
+		const LinearBVH& bvh = scene->GetBVH();
+		cache->Append( kCacheNodes, bvh.GetNodes(), bvh.GetNodeCount() );
+		cache->Append( kCachePrimitives, bvh.GetPrimitiveIndices(), bvh.GetPrimitiveCount() );
+
+		CachedScene cached = { sceneCamera, { shutter[ 0 ], shutter[ 1 ] }, mLineCount, bvh.GetBuildOptions() };
+		cache->Append( kCacheScene, &cached, 1 );
+
+		if( cache->Write( mCacheFilename.c_str(), mCacheKey ) )
+		{
+			eeDebug( "SceneReader: compiled the scene into %s\n", mCacheFilename.c_str() );
+		}
+
+		mTimes.cache += EndStage();
+	}
+
+	return true;
+}
+
+void SceneReader::BeginRead( const std::string& directory )
+{
+	mChunks.clear();
+	mDefinitions.reset();
+	mLineCount = 0;
+	mObjectCount = 0;
+	mTimes = SceneReadTimes();
+	mDirectory = directory;
+	mCacheFilename.clear();
+	mFromCache = false;
+
+	mStageStart = std::chrono::steady_clock::now();
+}
+
+double SceneReader::EndStage( void )
+{
+	auto now = std::chrono::steady_clock::now();
+	std::chrono::duration< double, std::milli > elapsed = now - mStageStart;
+	mStageStart = now;
+	return elapsed.count();
+}
+
+void SceneReader::EndRead( void )
+{
+	// The stages follow each other, so they add up to the whole
+	mTimes.total = mTimes.parse + mTimes.materials + mTimes.meshes + mTimes.objects + mTimes.scene + mTimes.cache;
+
+	eeDebug( "SceneReader: read %llu lines and %zu objects in %.1f ms: parsing %.1f ms, materials %.1f ms, "
+			 "meshes %.1f ms, objects %.1f ms, scene %.1f ms, cache %.1f ms\n",
+			 static_cast< unsigned long long >( mLineCount ), mObjectCount, mTimes.total, mTimes.parse,
+			 mTimes.materials, mTimes.meshes, mTimes.objects, mTimes.scene, mTimes.cache );
+}
+
+uint64_t SceneReader::GetCacheKey( uint64_t sourceHash ) const
+{
+	// Besides the scene file, the cache depends on the format of its
+	// records and on everything that shapes the BVHs, including the batch
+	// widths of the build, which the meshes' and sphere leaves' BVHs suit
+	const BVHBuildOptions& options = mOptions.bvhOptions;
+
+	uint32_t key[] =
+	{
+		uint32_t( sourceHash ), uint32_t( sourceHash >> 32 ), kCacheVersion,
+		uint32_t( options.splitMethod ), options.maxLeafSize, options.intersectionBatchSize, options.binCount,
+		0, 0, Mesh::kBatchWidth, SphereSet::kBatchWidth
+	};
+
+	memcpy( &key[ 7 ], &options.traversalCost, sizeof( float ) );
+	memcpy( &key[ 8 ], &options.intersectionCost, sizeof( float ) );
+
+	return HashUtils::CalculateCRC64( reinterpret_cast< const uint8_t* >( key ), sizeof( key ) );
+}
+
+bool SceneReader::AddToCache( SceneCache& cache )
+{
+	auto addString = [&cache]( const std::string& string )
+	{
+		return uint32_t( cache.Append( kCacheStrings, string.c_str(), string.size() + 1 ) );
+	};
+
+	auto addDependency = [&]( const std::string& filename )
+	{
+		const std::string path = GetPath( filename );
+
+		CachedDependency dependency = {};
+		if( !SceneCache::GetFileStatus( path.c_str(), dependency.size, dependency.lastModified ) ||
+			!SceneCache::HashFile( path.c_str(), dependency.hash ) )
+		{
+			return false;
+		}
+
+		dependency.filename = addString( filename );
+		cache.Append( kCacheDependencies, &dependency, 1 );
+		return true;
+	};
+
+	auto addArray = [&cache]( uint32_t section, const auto& array )
+	{
+		return CachedRange{ cache.Append( section, array.data(), array.size() ), array.size() };
+	};
+
+	for( const std::unique_ptr< SceneChunk >& chunk : mChunks )
+	{
+		for( const SceneTexture& texture : chunk->textures )
+		{
+			// An image that couldn't be read wasn't used, or there'd have
+			// been an error, so it can't make the cache out of date
+			if( texture.type == SceneTextureType::kImage )
+			{
+				addDependency( texture.filename );
+			}
+
+			CachedTexture cached = { addString( texture.name ), texture.type, texture.color, texture.scale,
+									 addString( texture.odd ), addString( texture.even ), addString( texture.filename ) };
+			cache.Append( kCacheTextures, &cached, 1 );
+		}
+
+		for( const SceneMaterial& material : chunk->materials )
+		{
+			CachedMaterial cached = { addString( material.name ), material.type, material.color, material.parameter,
+									  material.texture.empty() ? kNoName : addString( material.texture ) };
+			cache.Append( kCacheMaterials, &cached, 1 );
+		}
+	}
+
+	// Instances refer to meshes by their index in the file
+	std::unordered_map< std::string, uint32_t > meshIndices;
+
+	for( const std::unique_ptr< SceneChunk >& chunk : mChunks )
+	{
+		for( const SceneMesh& mesh : chunk->meshes )
+		{
+			if( !addDependency( mesh.filename ) )
+				return false;
+
+			const Mesh& created = *mDefinitions->meshes[ mesh.name ];
+			const MeshData& data = created.GetData();
+			const LinearBVH& bvh = created.GetBVH();
+
+			CachedMesh cached = {};
+			cached.material = mDefinitions->materials[ mesh.material ];
+			cached.bvhOptions = bvh.GetBuildOptions();
+			cached.positions = addArray( kCacheMeshPositions, data.positions );
+			cached.normals = addArray( kCacheMeshNormals, data.normals );
+			cached.uvs = addArray( kCacheMeshUVs, data.uvs );
+			cached.indices = addArray( kCacheMeshIndices, data.indices );
+			cached.normalIndices = addArray( kCacheMeshNormalIndices, data.normalIndices );
+			cached.uvIndices = addArray( kCacheMeshUVIndices, data.uvIndices );
+			cached.nodes = { cache.Append( kCacheMeshNodes, bvh.GetNodes(), bvh.GetNodeCount() ), bvh.GetNodeCount() };
+			cached.primitives = { cache.Append( kCacheMeshPrimitives, bvh.GetPrimitiveIndices(), bvh.GetPrimitiveCount() ),
+								  bvh.GetPrimitiveCount() };
+
+			meshIndices[ mesh.name ] = uint32_t( cache.Append( kCacheMeshes, &cached, 1 ) );
+		}
+	}
+
+	// CreateObjects() has checked that every name an object uses is defined
+	for( const std::unique_ptr< SceneChunk >& chunk : mChunks )
+	{
+		std::vector< MaterialId > materials( chunk->names.size(), kNoName );
+		std::vector< uint32_t > meshes( chunk->names.size(), kNoName );
+
+		for( size_t n = 0; n < chunk->names.size(); ++n )
+		{
+			auto material = mDefinitions->materials.find( chunk->names[ n ] );
+			if( material != mDefinitions->materials.end() )
+			{
+				materials[ n ] = material->second;
+			}
+
+			auto mesh = meshIndices.find( chunk->names[ n ] );
+			if( mesh != meshIndices.end() )
+			{
+				meshes[ n ] = mesh->second;
+			}
+		}
+
+		std::vector< SceneSphere > spheres( chunk->spheres );
+		for( SceneSphere& sphere : spheres )
+		{
+			sphere.material = materials[ sphere.material ];
+		}
+
+		std::vector< SceneRect > rects( chunk->rects );
+		for( SceneRect& rect : rects )
+		{
+			rect.material = materials[ rect.material ];
+		}
+
+		std::vector< SceneInstance > instances( chunk->instances );
+		for( SceneInstance& instance : instances )
+		{
+			instance.mesh = meshes[ instance.mesh ];
+			instance.material = ( instance.material != kNoName ) ? materials[ instance.material ] : kNoName;
+		}
+
+		const uint32_t firstSphere = uint32_t( cache.Append( kCacheSpheres, spheres.data(), spheres.size() ) );
+		const uint32_t firstRect = uint32_t( cache.Append( kCacheRects, rects.data(), rects.size() ) );
+		const uint32_t firstInstance = uint32_t( cache.Append( kCacheInstances, instances.data(), instances.size() ) );
+
+		std::vector< PrimitiveRef > objects( chunk->objects );
+		for( PrimitiveRef& object : objects )
+		{
+			switch( object.type )
+			{
+			case PrimitiveType::kSphere:
+				object.index += firstSphere;
+				break;
+
+			case PrimitiveType::kRect:
+				object.index += firstRect;
+				break;
+
+			case PrimitiveType::kInstance:
+				object.index += firstInstance;
+				break;
+
+			default:
+				break;
+
+			} // switch( object.type )
+		}
+
+		cache.Append( kCacheObjects, objects.data(), objects.size() );
+	}
+
+	return true;
+}
+
+bool SceneReader::ReadCache( const SceneCache& cache, float aspectRatio, Scene*& scene, Camera*& camera )
+{
+	size_t count;
+	const CachedScene* cached = cache.Get< CachedScene >( kCacheScene, count );
+	if( count != 1 )
+	{
+		eeDebug( "SceneReader: %s has no scene\n", mCacheFilename.c_str() );
+		return false;
+	}
+
+	size_t stringsSize;
+	const char* strings = cache.Get< char >( kCacheStrings, stringsSize );
+
+	auto getString = [&]( uint32_t offset ) -> const char*
+	{
+		if( ( offset >= stringsSize ) || ( memchr( strings + offset, 0, stringsSize - offset ) == nullptr ) )
+			return nullptr;
+
+		return strings + offset;
+	};
+
+	// The cache is out of date if any file the scene was read from has
+	// changed since it was written. Only the files whose size or time
+	// has changed are hashed, to tell whether their contents have too.
+	const CachedDependency* dependencies = cache.Get< CachedDependency >( kCacheDependencies, count );
+	for( size_t i = 0; i < count; ++i )
+	{
+		const CachedDependency& dependency = dependencies[ i ];
+		const char* filename = getString( dependency.filename );
+
+		bool current = false;
+		if( filename != nullptr )
+		{
+			const std::string path = GetPath( filename );
+
+			uint64_t size, hash;
+			int64_t lastModified;
+			if( SceneCache::GetFileStatus( path.c_str(), size, lastModified ) && ( size == dependency.size ) &&
+				( lastModified == dependency.lastModified ) )
+			{
+				current = true;
+			}
+			else
+			{
+				current = SceneCache::HashFile( path.c_str(), hash ) && ( hash == dependency.hash );
+			}
+		}
+
+		if( !current )
+		{
+			eeDebug( "SceneReader: %s is out of date; %s has changed\n", mCacheFilename.c_str(),
+					 ( filename != nullptr ) ? filename : "a file" );
+			return false;
+		}
+	}
+
+	mTimes.cache += EndStage();
+
+	// The textures and materials are created just as they are from the
+	// file, as if it were one chunk of nothing but their definitions
+	std::unique_ptr< SceneChunk > definitions = std::make_unique< SceneChunk >();
+
+	const CachedTexture* textures = cache.Get< CachedTexture >( kCacheTextures, count );
+	for( size_t i = 0; i < count; ++i )
+	{
+		const CachedTexture& texture = textures[ i ];
+		const char* name = getString( texture.name );
+		const char* odd = getString( texture.odd );
+		const char* even = getString( texture.even );
+		const char* filename = getString( texture.filename );
+		if( ( name == nullptr ) || ( odd == nullptr ) || ( even == nullptr ) || ( filename == nullptr ) )
+			return false;
+
+		definitions->textures.push_back( { name, texture.type, texture.color, texture.scale, odd, even, filename, 0 } );
+	}
+
+	const CachedMaterial* materialRecords = cache.Get< CachedMaterial >( kCacheMaterials, count );
+	for( size_t i = 0; i < count; ++i )
+	{
+		const CachedMaterial& material = materialRecords[ i ];
+		const char* name = getString( material.name );
+		const char* texture = ( material.texture != kNoName ) ? getString( material.texture ) : "";
+		if( ( name == nullptr ) || ( texture == nullptr ) || ( uint32_t( material.type ) > uint32_t( SceneMaterialType::kLight ) ) )
+			return false;
+
+		definitions->materials.push_back( { name, material.type, material.color, material.parameter, texture, 0 } );
+	}
+
+	mChunks.push_back( std::move( definitions ) );
+	mDefinitions = std::make_unique< Definitions >();
+
+	std::unique_ptr< MaterialTable > materials = std::make_unique< MaterialTable >();
+	if( !CreateMaterials( *materials ) )
+		return false;
+
+	mTimes.materials = EndStage();
+
+	// The meshes' buffers and BVHs are copied straight out of the mapping
+	size_t positionCount, normalCount, uvCount, indexCount, normalIndexCount, uvIndexCount, nodeCount, primitiveCount;
+	const vec3* positions = cache.Get< vec3 >( kCacheMeshPositions, positionCount );
+	const vec3* normals = cache.Get< vec3 >( kCacheMeshNormals, normalCount );
+	const float* uvs = cache.Get< float >( kCacheMeshUVs, uvCount );
+	const uint32_t* indices = cache.Get< uint32_t >( kCacheMeshIndices, indexCount );
+	const uint32_t* normalIndices = cache.Get< uint32_t >( kCacheMeshNormalIndices, normalIndexCount );
+	const uint32_t* uvIndices = cache.Get< uint32_t >( kCacheMeshUVIndices, uvIndexCount );
+	const LinearBVHNode* nodes = cache.Get< LinearBVHNode >( kCacheMeshNodes, nodeCount );
+	const uint32_t* primitives = cache.Get< uint32_t >( kCacheMeshPrimitives, primitiveCount );
+
+	auto inRange = []( const CachedRange& range, size_t count )
+	{
+		return ( range.first <= count ) && ( range.count <= count - range.first );
+	};
+
+	size_t meshCount;
+	const CachedMesh* meshRecords = cache.Get< CachedMesh >( kCacheMeshes, meshCount );
+	std::vector< std::shared_ptr< const Mesh > > meshes( meshCount );
+
+	for( size_t i = 0; i < meshCount; ++i )
+	{
+		const CachedMesh& mesh = meshRecords[ i ];
+		if( !inRange( mesh.positions, positionCount ) || !inRange( mesh.normals, normalCount ) ||
+			!inRange( mesh.uvs, uvCount ) || !inRange( mesh.indices, indexCount ) ||
+			!inRange( mesh.normalIndices, normalIndexCount ) || !inRange( mesh.uvIndices, uvIndexCount ) ||
+			!inRange( mesh.nodes, nodeCount ) || !inRange( mesh.primitives, primitiveCount ) ||
+			( mesh.material >= materials->GetCount() ) )
+		{
+			return false;
+		}
+
+		MeshData data;
+		data.positions.assign( positions + mesh.positions.first, positions + mesh.positions.first + mesh.positions.count );
+		data.normals.assign( normals + mesh.normals.first, normals + mesh.normals.first + mesh.normals.count );
+		data.uvs.assign( uvs + mesh.uvs.first, uvs + mesh.uvs.first + mesh.uvs.count );
+		data.indices.assign( indices + mesh.indices.first, indices + mesh.indices.first + mesh.indices.count );
+		data.normalIndices.assign( normalIndices + mesh.normalIndices.first,
+								   normalIndices + mesh.normalIndices.first + mesh.normalIndices.count );
+		data.uvIndices.assign( uvIndices + mesh.uvIndices.first, uvIndices + mesh.uvIndices.first + mesh.uvIndices.count );
+
+		LinearBVH bvh;
+		std::shared_ptr< Mesh > created = std::make_shared< Mesh >();
+		if( !bvh.Assign( nodes + mesh.nodes.first, uint32_t( mesh.nodes.count ), primitives + mesh.primitives.first,
+						 uint32_t( mesh.primitives.count ), mesh.bvhOptions ) ||
+			!created->Initialize( std::move( data ), mesh.material, bvh ) )
+		{
+			return false;
+		}
+
+		meshes[ i ] = std::move( created );
+	}
+
+	mTimes.meshes = EndStage();
+
+	size_t sphereCount, rectCount, instanceCount, objectCount;
+	const SceneSphere* spheres = cache.Get< SceneSphere >( kCacheSpheres, sphereCount );
+	const SceneRect* rects = cache.Get< SceneRect >( kCacheRects, rectCount );
+	const SceneInstance* instances = cache.Get< SceneInstance >( kCacheInstances, instanceCount );
+	const PrimitiveRef* objectRefs = cache.Get< PrimitiveRef >( kCacheObjects, objectCount );
+
+	const MaterialId materialCount = materials->GetCount();
+	std::vector< Traceable* > objects( objectCount, nullptr );
+
+	for( size_t i = 0; i < objectCount; ++i )
+	{
+		const PrimitiveRef& object = objectRefs[ i ];
+
+		switch( object.type )
+		{
+		case PrimitiveType::kSphere:
+		{
+			if( object.index >= sphereCount )
+				break;
+
+			const SceneSphere& sphere = spheres[ object.index ];
+			if( sphere.material < materialCount )
+			{
+				objects[ i ] = new Sphere( sphere.center0, sphere.center1, sphere.time0, sphere.time1, sphere.radius,
+										   sphere.material );
+			}
+			break;
+		}
+
+		case PrimitiveType::kRect:
+		{
+			if( object.index >= rectCount )
+				break;
+
+			const SceneRect& rect = rects[ object.index ];
+			if( rect.material < materialCount )
+			{
+				objects[ i ] = new xyRect( rect.x0, rect.x1, rect.y0, rect.y1, rect.k, rect.material );
+			}
+			break;
+		}
+
+		case PrimitiveType::kInstance:
+		{
+			if( object.index >= instanceCount )
+				break;
+
+			const SceneInstance& instance = instances[ object.index ];
+			const bool hasMaterial = ( instance.material != kNoName );
+			if( ( instance.mesh >= meshCount ) || ( hasMaterial && ( instance.material >= materialCount ) ) )
+				break;
+
+			Instance* placed = new Instance( meshes[ instance.mesh ], instance.transform );
+			if( hasMaterial )
+			{
+				placed->SetMaterial( instance.material );
+			}
+
+			objects[ i ] = placed;
+			break;
+		}
+
+		default:
+			break;
+
+		} // switch( object.type )
+
+		if( objects[ i ] == nullptr )
+		{
+			for( Traceable* created : objects )
+			{
+				delete created;
+			}
+
+			return false;
+		}
+	}
+
+	mTimes.objects = EndStage();
+
+	// Scene::Initialize() copies the scene's BVH rather than building one
+	size_t sceneNodeCount, scenePrimitiveCount;
+	const LinearBVHNode* sceneNodes = cache.Get< LinearBVHNode >( kCacheNodes, sceneNodeCount );
+	const uint32_t* scenePrimitives = cache.Get< uint32_t >( kCachePrimitives, scenePrimitiveCount );
+
+	LinearBVH bvh;
+	if( !bvh.Assign( sceneNodes, uint32_t( sceneNodeCount ), scenePrimitives, uint32_t( scenePrimitiveCount ),
+					 cached->bvhOptions ) )
+	{
+		for( Traceable* created : objects )
+		{
+			delete created;
+		}
+
+		return false;
+	}
+
+	scene = new Scene;
+	if( !scene->Initialize( objects.data(), uint32_t( objects.size() ), materials.release(), cached->shutter[ 0 ],
+							cached->shutter[ 1 ], mOptions.bvhOptions, &bvh ) )
+	{
+		delete scene;
+		scene = nullptr;
+		return false;
+	}
+
+	mTimes.scene = EndStage();
+	mLineCount = cached->lineCount;
+	mObjectCount = objects.size();
+
+	camera = CreateCamera( cached->camera, cached->shutter, aspectRatio );
+	return true;
+}
+
+bool SceneReader::CreateMaterials( MaterialTable& materials )
+{
+	for( const std::unique_ptr< SceneChunk >& chunk : mChunks )
+	{
+		for( const SceneTexture& texture : chunk->textures )
+		{
+			if( !mDefinitions->textures.emplace( texture.name, &texture ).second )
+			{
+				eeDebug( "SceneReader: line %llu: there's already a texture called %s\n",
+						 static_cast< unsigned long long >( texture.line ), texture.name.c_str() );
+				return false;
+			}
+		}
+	}
+
+	for( const std::unique_ptr< SceneChunk >& chunk : mChunks )
+	{
+		for( const SceneMaterial& material : chunk->materials )
+		{
+			Texture* texture = nullptr;
+			if( !material.texture.empty() )
+			{
+				texture = CreateTexture( material.texture, 0 );
+				if( texture == nullptr )
+				{
+					eeDebug( "SceneReader: line %llu: material %s's texture can't be created\n",
+							 static_cast< unsigned long long >( material.line ), material.name.c_str() );
+					return false;
+				}
+			}
+
+			MaterialId id = 0;
+			switch( material.type )
+			{
+			case SceneMaterialType::kLambertian:
+				id = ( texture != nullptr ) ? materials.AddLambertian( texture ) : materials.AddLambertian( material.color );
+				break;
+
+			case SceneMaterialType::kMetal:
+				id = materials.AddMetal( material.color, material.parameter );
+				break;
+
+			case SceneMaterialType::kGlass:
+				id = materials.AddGlass( material.parameter );
+				break;
+
+			case SceneMaterialType::kLight:
+				id = ( texture != nullptr ) ? materials.AddDiffuseLight( texture ) : materials.AddDiffuseLight( material.color );
+				break;
+
+			} // switch( material.type )
+
+			if( !mDefinitions->materials.emplace( material.name, id ).second )
+			{
+				eeDebug( "SceneReader: line %llu: there's already a material called %s\n",
+						 static_cast< unsigned long long >( material.line ), material.name.c_str() );
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+Texture* SceneReader::CreateTexture( const std::string& name, uint32_t depth )
+{
+	// Deep enough for any sensible checker of checkers, but not for a
+	// checker that's made of itself
+	static const uint32_t kMaxDepth = 16;
+
+	auto found = mDefinitions->textures.find( name );
+	if( found == mDefinitions->textures.end() )
+	{
+		eeDebug( "SceneReader: there's no texture called %s\n", name.c_str() );
+		return nullptr;
+	}
+
+	if( depth >= kMaxDepth )
+	{
+		eeDebug( "SceneReader: line %llu: texture %s is made of itself\n",
+				 static_cast< unsigned long long >( found->second->line ), name.c_str() );
+		return nullptr;
+	}
+
+	// Textures belong to the material or texture that uses them, so each
+	// use of a definition creates a texture of its own
+	const SceneTexture& texture = *found->second;
+
+	switch( texture.type )
+	{
+	case SceneTextureType::kConstant:
+		return new ConstantTexture( texture.color );
+
+	case SceneTextureType::kChecker:
+	{
+		Texture* odd = CreateTexture( texture.odd, depth + 1 );
+		Texture* even = ( odd != nullptr ) ? CreateTexture( texture.even, depth + 1 ) : nullptr;
+		if( even == nullptr )
+		{
+			delete odd;
+			return nullptr;
+		}
+
+		return new CheckerTexture( odd, even );
+	}
+
+	case SceneTextureType::kNoise:
+		return new NoiseTexture( texture.scale );
+
+	case SceneTextureType::kImage:
+	{
+		ImageTexture* image = new ImageTexture( GetPath( texture.filename ).c_str() );
+		if( !image->IsLoaded() )
+		{
+			eeDebug( "SceneReader: line %llu: can't read image %s\n",
+					 static_cast< unsigned long long >( texture.line ), texture.filename.c_str() );
+			delete image;
+			return nullptr;
+		}
+
+		return image;
+	}
+
+	} // switch( texture.type )
+
+	return nullptr;
+}
+
+bool SceneReader::CreateMeshes( void )
+{
+	ObjReadOptions objOptions;
+	objOptions.threadCount = mOptions.threadCount;
+	objOptions.chunkSize = mOptions.chunkSize;
+
+	ObjReader reader( objOptions );
+
+	for( const std::unique_ptr< SceneChunk >& chunk : mChunks )
+	{
+		for( const SceneMesh& mesh : chunk->meshes )
+		{
+			auto material = mDefinitions->materials.find( mesh.material );
+			if( material == mDefinitions->materials.end() )
+			{
+				eeDebug( "SceneReader: line %llu: there's no material called %s\n",
+						 static_cast< unsigned long long >( mesh.line ), mesh.material.c_str() );
+				return false;
+			}
+
+			MeshData data;
+			std::shared_ptr< Mesh > created = std::make_shared< Mesh >();
+			if( !reader.Read( GetPath( mesh.filename ).c_str(), data ) ||
+				!created->Initialize( std::move( data ), material->second, mOptions.bvhOptions ) )
+			{
+				eeDebug( "SceneReader: line %llu: can't create mesh %s from %s\n",
+						 static_cast< unsigned long long >( mesh.line ), mesh.name.c_str(), mesh.filename.c_str() );
+				return false;
+			}
+
+			if( !mDefinitions->meshes.emplace( mesh.name, std::move( created ) ).second )
+			{
+				eeDebug( "SceneReader: line %llu: there's already a mesh called %s\n",
+						 static_cast< unsigned long long >( mesh.line ), mesh.name.c_str() );
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool SceneReader::CreateObjects( std::vector< Traceable* >& objects )
+{
+	const SceneChunk& last = *mChunks.back();
+	objects.assign( last.firstObject + last.objects.size(), nullptr );
+
+	// Each chunk's objects are created by one of the threads, into their
+	// places in objects; the definitions are only read by now, so the
+	// threads can share them
+	std::atomic< size_t > nextChunk( 0 );
+
+	auto createChunks = [&]()
+	{
+		for( size_t c = nextChunk++; c < mChunks.size(); c = nextChunk++ )
+		{
+			SceneChunk& chunk = *mChunks[ c ];
+
+			// Look each name up once, rather than once per object
+			std::vector< MaterialId > materials( chunk.names.size(), kNoName );
+			std::vector< std::shared_ptr< const Mesh > > meshes( chunk.names.size() );
+
+			for( size_t n = 0; n < chunk.names.size(); ++n )
+			{
+				auto material = mDefinitions->materials.find( chunk.names[ n ] );
+				if( material != mDefinitions->materials.end() )
+				{
+					materials[ n ] = material->second;
+				}
+
+				auto mesh = mDefinitions->meshes.find( chunk.names[ n ] );
+				if( mesh != mDefinitions->meshes.end() )
+				{
+					meshes[ n ] = mesh->second;
+				}
+			}
+
+			Traceable** created = &objects[ chunk.firstObject ];
+
+			for( size_t i = 0; i < chunk.objects.size(); ++i )
+			{
+				const PrimitiveRef& object = chunk.objects[ i ];
+
+				switch( object.type )
+				{
+				case PrimitiveType::kSphere:
+				{
+					const SceneSphere& sphere = chunk.spheres[ object.index ];
+					const MaterialId material = materials[ sphere.material ];
+					if( material != kNoName )
+					{
+						created[ i ] = new Sphere( sphere.center0, sphere.center1, sphere.time0, sphere.time1,
+												   sphere.radius, material );
+					}
+					break;
+				}
+
+				case PrimitiveType::kRect:
+				{
+					const SceneRect& rect = chunk.rects[ object.index ];
+					const MaterialId material = materials[ rect.material ];
+					if( material != kNoName )
+					{
+						created[ i ] = new xyRect( rect.x0, rect.x1, rect.y0, rect.y1, rect.k, material );
+					}
+					break;
+				}
+
+				case PrimitiveType::kInstance:
+				{
+					const SceneInstance& instance = chunk.instances[ object.index ];
+					const bool hasMaterial = ( instance.material != kNoName );
+					if( ( meshes[ instance.mesh ] == nullptr ) ||
+						( hasMaterial && ( materials[ instance.material ] == kNoName ) ) )
+						break;
+
+					Instance* placed = new Instance( meshes[ instance.mesh ], instance.transform );
+					if( hasMaterial )
+					{
+						placed->SetMaterial( materials[ instance.material ] );
+					}
+
+					created[ i ] = placed;
+					break;
+				}
+
+				default:
+					break;
+
+				} // switch( object.type )
+
+				if( created[ i ] == nullptr )
+				{
+					chunk.error = "an object uses a material or mesh that isn't defined";
+					chunk.lineCount = chunk.objectLines[ i ];
+					break;
+				}
+			}
+		}
+	};
+
+	std::vector< std::thread > threads;
+	const uint32_t threadCount = uint32_t( eeMin( size_t( mOptions.threadCount ), mChunks.size() ) );
+
+	for( uint32_t t = 1; t < threadCount; ++t )
+	{
+		threads.emplace_back( createChunks );
+	}
+
+	createChunks();
+
+	for( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+
+	for( const std::unique_ptr< SceneChunk >& chunk : mChunks )
+	{
+		if( chunk->error != nullptr )
+		{
+			eeDebug( "SceneReader: line %llu: %s\n", static_cast< unsigned long long >( chunk->firstLine + chunk->lineCount ),
+					 chunk->error );
+
+			for( Traceable* object : objects )
+			{
+				delete object;
+			}
+
+			objects.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::string SceneReader::GetPath( const std::string& filename ) const
+{
+	FilePath path( mDirectory );
+	path.Append( filename );
+
+	return std::string( path.c_str() );
+}
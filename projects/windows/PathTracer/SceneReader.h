@@ -0,0 +1,203 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ee/io/InputStream.h>
+
+#include "Camera.h"
+#include "LinearBVH.h"
+#include "Scene.h"
+
+using namespace ee;
+
+struct SceneReadOptions
+{
+	// The number of threads that parse the file while it's read, and then
+	// create its objects; 0 means one per hardware thread
+	uint32_t	threadCount = 0;
+
+	// The file is read this many bytes at a time, and each chunk of whole
+	// lines is parsed by one thread, as ObjReader does
+	uint32_t	chunkSize = 8 << 20;
+
+	// How the scene's BVH, and each mesh's, are built
+	BVHBuildOptions	bvhOptions;
+
+	// Whether reading a file keeps a compiled copy of its scene in a
+	// cache file beside it, and reads that instead while it's up to date
+	bool		useCache = true;
+
+}; // struct SceneReadOptions
+
+// How long each stage of SceneReader::Read() took, in milliseconds
+struct SceneReadTimes
+{
+	double	parse = 0.0;		// reading the file and parsing it, which overlap
+	double	materials = 0.0;	// creating the textures and materials
+	double	meshes = 0.0;		// reading the meshes' OBJ files and building their BVHs
+	double	objects = 0.0;		// creating the primitives and instances
+	double	scene = 0.0;		// Scene::Initialize(), which builds the scene's BVH
+	double	cache = 0.0;		// checking that the cache is up to date, or writing it
+	double	total = 0.0;
+
+}; // struct SceneReadTimes
+
+class MaterialTable;
+class SceneCache;
+class Texture;
+struct SceneChunk;
+
+// Reads a scene, and the camera to view it from, from a text file. Each
+// line is a statement, and a # at the start of a word starts a comment
+// that runs to the end of the line:
+//
+//   camera [eye x y z] [lookat x y z] [up x y z] [fov degrees] [aperture a] [focus distance]
+//   shutter t0 t1
+//   texture name constant r g b
+//   texture name checker oddTexture evenTexture
+//   texture name noise scale
+//   texture name image file
+//   material name lambertian r g b | texture
+//   material name metal r g b fuzziness
+//   material name glass refractiveIndex
+//   material name light r g b | texture
+//   mesh name material file
+//   sphere material x y z radius [x1 y1 z1 t0 t1]
+//   rect material x0 x1 y0 y1 z
+//   instance mesh [material m] [translate x y z] [rotate x y z degrees] [scale x y z | s]...
+//
+// The camera defaults to looking from the origin down -z, with a 20 degree
+// field of view, no aperture and focused on its lookat point; the shutter
+// defaults to [ 0, 0 ]. A sphere with a second center moves to it from its
+// first between times t0 and t1. A rect lies in the plane z = z.
+//
+// Textures, materials and meshes are named, and can be used anywhere in
+// the file, before their definitions as well as after; names start with a
+// letter or an underscore. A mesh is the triangles of an OBJ file (see
+// ObjReader), with a BVH of their own, which only appear in the scene
+// through instances; any number of instances share the mesh. An
+// instance's transforms apply in the order they're written. File names,
+// which are the rest of the line up to any comment, are relative to the
+// scene file; they can contain #s, but not a space followed by one.
+//
+// The file is read and parsed as ObjReader reads OBJ files: a chunk at a
+// time, with worker threads parsing the chunks already read. Once the
+// materials and meshes have been created, one after the other, the
+// primitives and instances are created by the worker threads too, each
+// creating those of one chunk at a time, so files of millions of objects
+// are read in parallel from start to finish.
+//
+// Reading a file, as opposed to a stream, compiles the scene into a cache
+// file, the file's name with .cache added, that holds everything but the
+// textures ready to use: the materials, the objects with their materials
+// and meshes looked up, the meshes' vertices in their BVHs' leaf order,
+// and the BVHs themselves. The next time the file is read, the cache is
+// mapped into memory and the scene created straight from it, with no
+// parsing, no OBJ files read and no BVHs built. The cache is keyed by the
+// CRC-64 of the scene file and the BVH build options, and records the
+// CRC-64, size and modification time of every mesh and image file the
+// scene uses; only those whose size or time has changed are hashed again.
+// If any of them has changed, the cache is ignored, and rewritten once the
+// file has been read.
+class SceneReader
+{
+public:
+	SceneReader( const SceneReadOptions& options = SceneReadOptions() );
+	~SceneReader();
+
+	// Reads stream to its end and creates the scene and camera it
+	// describes. aspectRatio is the image's width over its height, and
+	// directory is where the file names in the scene are relative to.
+	// Returns false if the scene can't be read, with the reason in the
+	// debug output.
+	bool Read( InputStream& stream, const char* directory, float aspectRatio, Scene*& scene, Camera*& camera );
+
+	// Opens filename and reads it
+	bool Read( const char* filename, float aspectRatio, Scene*& scene, Camera*& camera );
+
+	// The number of lines the last Read() parsed, and how long it took
+	inline uint64_t GetLineCount( void ) const;
+	inline const SceneReadTimes& GetTimes( void ) const;
+
+	// Whether the last Read() created the scene from the cache
+	inline bool IsFromCache( void ) const;
+
+private:
+	// Read() once the cache, if any, has been looked at
+	bool ReadStream( InputStream& stream, float aspectRatio, Scene*& scene, Camera*& camera );
+
+	// Creates the scene and camera from an up to date cache. Returns false
+	// if the files it was compiled from have changed, or it's damaged.
+	bool ReadCache( const SceneCache& cache, float aspectRatio, Scene*& scene, Camera*& camera );
+
+	// Adds the materials, meshes and objects read so far to cache; returns
+	// false if the files they came from can't be hashed
+	bool AddToCache( SceneCache& cache );
+
+	// The key of the cache of a scene file whose CRC-64 is sourceHash
+	uint64_t GetCacheKey( uint64_t sourceHash ) const;
+
+	// Starts reading a scene whose file names are relative to directory
+	void BeginRead( const std::string& directory );
+
+	// Ends a stage of reading, and returns how long it took in milliseconds
+	double EndStage( void );
+
+	// Adds up the total time the scene took to read, and logs the times
+	void EndRead( void );
+
+	// The stages of Read() after parsing; each returns false, and the
+	// reason in the debug output, if the scene is invalid
+	bool CreateMaterials( MaterialTable& materials );
+	bool CreateMeshes( void );
+	bool CreateObjects( std::vector< Traceable* >& objects );
+
+	// Creates a new texture from the definition of name, and any it's made of
+	Texture* CreateTexture( const std::string& name, uint32_t depth );
+
+	// directory + filename, unless filename is absolute
+	std::string GetPath( const std::string& filename ) const;
+
+	SceneReadOptions	mOptions;
+	uint64_t			mLineCount;
+	size_t				mObjectCount;
+	SceneReadTimes		mTimes;
+	std::string			mDirectory;
+
+	std::chrono::steady_clock::time_point	mStageStart;
+
+	// The cache file ReadStream() writes, if it isn't empty, and its key
+	std::string			mCacheFilename;
+	uint64_t			mCacheKey;
+	bool				mFromCache;
+
+	// The chunks of the file being read, in file order
+	std::vector< std::unique_ptr< SceneChunk > >	mChunks;
+
+	struct Definitions;
+	std::unique_ptr< Definitions >	mDefinitions;
+
+}; // class SceneReader
+
+inline uint64_t SceneReader::GetLineCount( void ) const
+{
+	return mLineCount;
+}
+
+inline const SceneReadTimes& SceneReader::GetTimes( void ) const
+{
+	return mTimes;
+}
+
+inline bool SceneReader::IsFromCache( void ) const
+{
+	return mFromCache;
+}
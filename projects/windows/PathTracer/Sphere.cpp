@@ -4,46 +4,23 @@
 
 #include "pch.h"
 
+#include <cfloat>
+
 #include "Sphere.h"
+#include "Material.h"
 
 #include <ee/math/AABB.h>
 #include <ee/math/Math.h>
 
-bool Sphere::Hit( const Ray& ray, float t_min, float t_max, HitRecord& hit ) const
+void Sphere::FinalizeHit( const Ray& ray, const RayHit& hit, HitRecord& rec ) const
 {
-	vec3 oc = ray.GetOrigin() - GetCenter( ray.GetTime() );
-	float a = Dot( ray.GetDirection(), ray.GetDirection() );
-	float b = Dot( oc, ray.GetDirection() );
-	float c = Dot( oc, oc ) - mRadius * mRadius;
-
-	// The 4 term in 4 * a * c was cancelled out by the 2 that was in the
-	// b term above and the 2 that was in the temp term below
-	float discriminant = b * b - a * c;
-	if( discriminant > 0.0f )
-	{
-		float temp = ( -b - sqrtf( discriminant ) ) / a;
-		if( temp > t_min && temp < t_max )
-		{
-			hit.t = temp;
-			hit.p = ray.PointAtParameter( hit.t );
-			hit.normal = ( hit.p - GetCenter( ray.GetTime() ) ) / mRadius;
-			hit.material = mMaterial;
-			return true;
-		}
-
-		temp = ( -b + sqrtf( discriminant ) ) / a;
-		if( temp > t_min && temp < t_max )
-		{
-			hit.t = temp;
-			hit.p = ray.PointAtParameter( hit.t );
-			hit.normal = ( hit.p - GetCenter( ray.GetTime() ) ) / mRadius;
-			hit.material = mMaterial;
-			return true;
-		}
-
-	} // if( discriminant > 0.0f )
-
-	return false;
+	rec.t = hit.t;
+	rec.u = 0.0f; // spheres aren't texture mapped
+	rec.v = 0.0f;
+	rec.p = ray.PointAtParameter( hit.t );
+	rec.normal = ( rec.p - GetCenter( ray.GetTime() ) ) / mRadius;
+	rec.material = mMaterial;
+	rec.object = this;
 }
 
 bool Sphere::GetBoundingBox( float t0, float t1, AABB& box ) const
@@ -63,3 +40,64 @@ bool Sphere::GetBoundingBox( float t0, float t1, AABB& box ) const
 
 	return true;
 }
+
+bool Sphere::IsLight( const MaterialTable& materials ) const
+{
+	return materials.IsEmitter( mMaterial );
+}
+
+float Sphere::GetConePdf( const vec3& origin, float time ) const
+{
+	float distanceSquared = ( GetCenter( time ) - origin ).LengthSquared();
+	float radiusSquared = mRadius * mRadius;
+
+	// From inside, every direction leads to the sphere
+	if( distanceSquared <= radiusSquared )
+		return 1.0f / ( 4.0f * float( M_PI ) );
+
+	// The cone's solid angle is 2 pi ( 1 - cosThetaMax ); this form of
+	// 1 - cosThetaMax doesn't lose small, distant spheres to cancellation
+	float sinThetaMaxSquared = radiusSquared / distanceSquared;
+	float cosThetaMax = sqrt( 1.0f - sinThetaMaxSquared );
+	float oneMinusCosThetaMax = sinThetaMaxSquared / ( 1.0f + cosThetaMax );
+
+	return 1.0f / ( 2.0f * float( M_PI ) * oneMinusCosThetaMax );
+}
+
+float Sphere::SampleDirection( const vec3& origin, float time, float u1, float u2, vec3& direction ) const
+{
+	vec3 toCenter = GetCenter( time ) - origin;
+	float distanceSquared = toCenter.LengthSquared();
+	float radiusSquared = mRadius * mRadius;
+
+	if( distanceSquared <= radiusSquared )
+	{
+		direction = SampleUnitSphere( u1, u2 );
+		return GetConePdf( origin, time );
+	}
+
+	float sinThetaMaxSquared = radiusSquared / distanceSquared;
+	float cosThetaMax = sqrt( 1.0f - sinThetaMaxSquared );
+	float oneMinusCosThetaMax = sinThetaMaxSquared / ( 1.0f + cosThetaMax );
+
+	// Uniform in solid angle: cosTheta is uniform in [ cosThetaMax, 1 ]
+	float cosTheta = 1.0f - u1 * oneMinusCosThetaMax;
+	float sinTheta = sqrt( eeMax( 1.0f - cosTheta * cosTheta, 0.0f ) );
+	float phi = 2.0f * float( M_PI ) * u2;
+
+	vec3 w = toCenter / sqrt( distanceSquared );
+	vec3 t, b;
+	BuildOrthonormalBasis( w, t, b );
+
+	direction = ( cos( phi ) * sinTheta ) * t + ( sin( phi ) * sinTheta ) * b + cosTheta * w;
+	return 1.0f / ( 2.0f * float( M_PI ) * oneMinusCosThetaMax );
+}
+
+float Sphere::GetDirectionPdf( const Ray& r ) const
+{
+	RayHit hit;
+	if( !Intersect( r, 0.001f, FLT_MAX, hit ) )
+		return 0.0f;
+
+	return GetConePdf( r.GetOrigin(), r.GetTime() );
+}
@@ -17,10 +17,10 @@ public:
 		, mTime0( 0.0f )
 		, mTime1( 0.0f )
 		, mRadius( 1.0f )
-		, mMaterial( nullptr )
+		, mMaterial( 0 )
 	{}
 
-	Sphere( const vec3& center, float radius, Material* material )
+	Sphere( const vec3& center, float radius, MaterialId material )
 		: mA( center )
 		, mB( center )
 		, mTime0( 0.0f )
@@ -33,7 +33,7 @@ public:
 	// measured in seconds; the sphere is at a at t0 and b at t1.
 	// If t0 == t1 the sphere is stationary.
 	Sphere( const vec3& a, const vec3& b, float t0, float t1,
-			float radius, Material* material )
+			float radius, MaterialId material )
 		: mA( a )
 		, mB( b )
 		, mTime0( t0 )
@@ -44,10 +44,20 @@ public:
 
 	// Traceable interface implementation
 
-	virtual bool Hit( const Ray& r, float tmin, float tmax, HitRecord& hit ) const;
+	virtual bool Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const;
+	virtual void FinalizeHit( const Ray& r, const RayHit& hit, HitRecord& rec ) const;
+
+	virtual bool Occluded( const Ray& r, float t_min, float t_max ) const;
 
 	virtual bool GetBoundingBox( float t0, float t1, AABB& box ) const;
 
+	virtual bool IsLight( const MaterialTable& materials ) const;
+
+	// Picks directions uniformly from the cone the sphere fills as seen
+	// from origin
+	virtual float SampleDirection( const vec3& origin, float time, float u1, float u2, vec3& direction ) const;
+	virtual float GetDirectionPdf( const Ray& r ) const;
+
 	// Sphere member functions
 
 	vec3 GetCenter( float time ) const
@@ -62,9 +72,75 @@ public:
 		}
 	}
 
+	// The center's path: at a at time t0 and b at time t1
+	const vec3& GetStartCenter( void ) const { return mA; }
+	const vec3& GetEndCenter( void ) const { return mB; }
+	float GetStartTime( void ) const { return mTime0; }
+	float GetEndTime( void ) const { return mTime1; }
+
+	float GetRadius( void ) const { return mRadius; }
+
 private:
+	// The probability density of each direction in the cone the sphere
+	// fills as seen from origin at time
+	float GetConePdf( const vec3& origin, float time ) const;
+
 	vec3		mA, mB; // The endpoints of the path the center follows
 	float		mTime0, mTime1; // in seconds
 	float		mRadius;
-	Material*	mMaterial;
+	MaterialId	mMaterial;
 };
+
+inline bool Sphere::Intersect( const Ray& ray, float t_min, float t_max, RayHit& hit ) const
+{
+	vec3 oc = ray.GetOrigin() - GetCenter( ray.GetTime() );
+	float a = Dot( ray.GetDirection(), ray.GetDirection() );
+	float b = Dot( oc, ray.GetDirection() );
+	float c = Dot( oc, oc ) - mRadius * mRadius;
+
+	// The 4 term in 4 * a * c was cancelled out by the 2 that was in the
+	// b term above and the 2 that was in the temp term below
+	float discriminant = b * b - a * c;
+	if( discriminant > 0.0f )
+	{
+		float temp = ( -b - sqrtf( discriminant ) ) / a;
+		if( temp > t_min && temp < t_max )
+		{
+			hit.t = temp;
+			hit.object = this;
+			return true;
+		}
+
+		temp = ( -b + sqrtf( discriminant ) ) / a;
+		if( temp > t_min && temp < t_max )
+		{
+			hit.t = temp;
+			hit.object = this;
+			return true;
+		}
+
+	} // if( discriminant > 0.0f )
+
+	return false;
+}
+
+inline bool Sphere::Occluded( const Ray& ray, float t_min, float t_max ) const
+{
+	vec3 oc = ray.GetOrigin() - GetCenter( ray.GetTime() );
+	float a = Dot( ray.GetDirection(), ray.GetDirection() );
+	float b = Dot( oc, ray.GetDirection() );
+	float c = Dot( oc, oc ) - mRadius * mRadius;
+
+	float discriminant = b * b - a * c;
+	if( discriminant <= 0.0f )
+		return false;
+
+	float root = sqrtf( discriminant );
+
+	float t = ( -b - root ) / a;
+	if( t > t_min && t < t_max )
+		return true;
+
+	t = ( -b + root ) / a;
+	return t > t_min && t < t_max;
+}
@@ -0,0 +1,70 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include <limits>
+
+#include "SphereSet.h"
+#include "Sphere.h"
+
+void SphereSet::Build( const Sphere* const* spheres, uint32_t count )
+{
+	Clear();
+
+	// Pad the arrays so that a batch starting at the last slot stays inside them
+	const uint32_t paddedCount = count + kBatchWidth - 1;
+	const float nan = std::numeric_limits< float >::quiet_NaN();
+
+	mCenterX.assign( paddedCount, nan );
+	mCenterY.assign( paddedCount, nan );
+	mCenterZ.assign( paddedCount, nan );
+	mMotionX.assign( paddedCount, 0.0f );
+	mMotionY.assign( paddedCount, 0.0f );
+	mMotionZ.assign( paddedCount, 0.0f );
+	mTime0.assign( paddedCount, 0.0f );
+	mDuration.assign( paddedCount, 1.0f );
+	mRadiusSquared.assign( paddedCount, 0.0f );
+
+	for( uint32_t i = 0; i < count; ++i )
+	{
+		const Sphere* sphere = spheres[ i ];
+		if( sphere == nullptr )
+			continue;
+
+		const vec3& a = sphere->GetStartCenter();
+		mCenterX[ i ] = a.x;
+		mCenterY[ i ] = a.y;
+		mCenterZ[ i ] = a.z;
+
+		// Sphere::GetCenter() special cases stationary spheres in the
+		// same way, by leaving the center where it is
+		if( sphere->GetStartTime() != sphere->GetEndTime() )
+		{
+			vec3 motion = sphere->GetEndCenter() - a;
+			mMotionX[ i ] = motion.x;
+			mMotionY[ i ] = motion.y;
+			mMotionZ[ i ] = motion.z;
+			mTime0[ i ] = sphere->GetStartTime();
+			mDuration[ i ] = sphere->GetEndTime() - sphere->GetStartTime();
+		}
+
+		mRadiusSquared[ i ] = sphere->GetRadius() * sphere->GetRadius();
+		++mSphereCount;
+	}
+}
+
+void SphereSet::Clear( void )
+{
+	mCenterX.clear();
+	mCenterY.clear();
+	mCenterZ.clear();
+	mMotionX.clear();
+	mMotionY.clear();
+	mMotionZ.clear();
+	mTime0.clear();
+	mDuration.clear();
+	mRadiusSquared.clear();
+	mSphereCount = 0;
+}
@@ -0,0 +1,427 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+
+#if defined( EE_BUILD_X86 )
+#  include <immintrin.h>
+#endif
+
+#include <ee/math/Ray.h>
+
+#include "RayPacket.h"
+#include "Traceable.h"
+
+using namespace ee;
+
+class Sphere;
+
+// The spheres of a scene packed into structure-of-arrays form, so that a
+// ray can be tested against a batch of them at once with SIMD instructions:
+// 8 at a time with AVX, 4 with SSE, and a scalar loop otherwise. Slots
+// line up with the owner's primitive array (the Scene's BVH leaf order), so
+// a BVH leaf's range of primitives is also its range of slots; slots
+// holding other kinds of primitive are left empty, and never report a hit.
+class SphereSet
+{
+public:
+#if defined( EE_BUILD_X86 ) && defined( __AVX__ )
+	static const uint32_t kBatchWidth = 8;
+#else
+	static const uint32_t kBatchWidth = 4;
+#endif
+
+	SphereSet();
+
+	// Packs spheres, one per slot; a null entry leaves its slot empty
+	void Build( const Sphere* const* spheres, uint32_t count );
+	void Clear( void );
+
+	inline uint32_t GetSphereCount( void ) const;
+
+	// Finds the closest sphere in slots [first, first + count) that r hits
+	// in (t_min, t_max); if there is one, reduces t_max to its distance,
+	// sets index to its slot and returns true. Gives the same hits as
+	// Sphere::Intersect().
+	inline bool Intersect( const Ray& r, uint32_t first, uint32_t count, float t_min, float& t_max,
+						   uint32_t& index ) const;
+
+	// Returns true if r hits any sphere in slots [first, first + count)
+	// in (t_min, t_max)
+	inline bool Occluded( const Ray& r, uint32_t first, uint32_t count, float t_min, float t_max ) const;
+
+	// Intersect() for each ray of packet in laneMask at once, testing one
+	// sphere against every lane. Reduces tMax[ lane ] and sets
+	// index[ lane ] for each ray that hits a sphere closer than tMax[ lane ],
+	// and returns a bitmask of those lanes.
+	inline uint32_t IntersectPacket( const RayPacket& packet, uint32_t laneMask, uint32_t first, uint32_t count,
+									 float t_min, float tMax[ RayPacket::kSize ], uint32_t index[ RayPacket::kSize ] ) const;
+
+private:
+	// Tests the ray against the kBatchWidth slots from first, returning a
+	// bitmask of the slots hit in (t_min, t_max) and their distances in t
+	inline uint32_t IntersectBatch( const Ray& r, uint32_t first, float t_min, float t_max,
+									float t[ kBatchWidth ] ) const;
+
+	// The center at time is center + ( ( time - time0 ) / duration ) * motion,
+	// worked out exactly as Sphere::GetCenter() does it, so that hits agree
+	// with the normals FinalizeHit() finds; a stationary sphere has no
+	// motion, so its center is exactly center. Slots that aren't spheres
+	// have NaN centers, which no comparison lets through. Every array has
+	// kBatchWidth - 1 such slots past the end, so that a batch can start
+	// at any slot.
+	std::vector< float >	mCenterX, mCenterY, mCenterZ;
+	std::vector< float >	mMotionX, mMotionY, mMotionZ;
+	std::vector< float >	mTime0, mDuration;
+	std::vector< float >	mRadiusSquared;
+
+	uint32_t				mSphereCount;
+
+}; // class SphereSet
+
+inline SphereSet::SphereSet()
+	: mSphereCount( 0 )
+{
+}
+
+inline uint32_t SphereSet::GetSphereCount( void ) const
+{
+	return mSphereCount;
+}
+
+inline uint32_t SphereSet::IntersectBatch( const Ray& r, uint32_t first, float t_min, float t_max,
+										   float t[ kBatchWidth ] ) const
+{
+	const vec3& origin = r.GetOrigin();
+	const vec3& direction = r.GetDirection();
+	const float a = Dot( direction, direction );
+
+	// The same arithmetic as Sphere::Intersect(), in the same order, so
+	// that both find exactly the same hits
+#if defined( EE_BUILD_X86 ) && defined( __AVX__ )
+	const __m256 time = _mm256_set1_ps( r.GetTime() );
+	const __m256 progress = _mm256_div_ps( _mm256_sub_ps( time, _mm256_loadu_ps( &mTime0[ first ] ) ),
+										   _mm256_loadu_ps( &mDuration[ first ] ) );
+
+	__m256 ocX = _mm256_sub_ps( _mm256_set1_ps( origin.x ),
+		_mm256_add_ps( _mm256_loadu_ps( &mCenterX[ first ] ), _mm256_mul_ps( progress, _mm256_loadu_ps( &mMotionX[ first ] ) ) ) );
+	__m256 ocY = _mm256_sub_ps( _mm256_set1_ps( origin.y ),
+		_mm256_add_ps( _mm256_loadu_ps( &mCenterY[ first ] ), _mm256_mul_ps( progress, _mm256_loadu_ps( &mMotionY[ first ] ) ) ) );
+	__m256 ocZ = _mm256_sub_ps( _mm256_set1_ps( origin.z ),
+		_mm256_add_ps( _mm256_loadu_ps( &mCenterZ[ first ] ), _mm256_mul_ps( progress, _mm256_loadu_ps( &mMotionZ[ first ] ) ) ) );
+
+	__m256 b = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ocX, _mm256_set1_ps( direction.x ) ),
+											 _mm256_mul_ps( ocY, _mm256_set1_ps( direction.y ) ) ),
+							  _mm256_mul_ps( ocZ, _mm256_set1_ps( direction.z ) ) );
+	__m256 c = _mm256_sub_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ocX, ocX ), _mm256_mul_ps( ocY, ocY ) ),
+											 _mm256_mul_ps( ocZ, ocZ ) ),
+							  _mm256_loadu_ps( &mRadiusSquared[ first ] ) );
+
+	const __m256 aa = _mm256_set1_ps( a );
+	__m256 discriminant = _mm256_sub_ps( _mm256_mul_ps( b, b ), _mm256_mul_ps( aa, c ) );
+	__m256 root = _mm256_sqrt_ps( discriminant );
+	__m256 negativeB = _mm256_sub_ps( _mm256_setzero_ps(), b );
+
+	const __m256 tMin = _mm256_set1_ps( t_min );
+	const __m256 tMax = _mm256_set1_ps( t_max );
+	__m256 hasRoots = _mm256_cmp_ps( discriminant, _mm256_setzero_ps(), _CMP_GT_OQ );
+
+	__m256 nearT = _mm256_div_ps( _mm256_sub_ps( negativeB, root ), aa );
+	__m256 nearHit = _mm256_and_ps( hasRoots, _mm256_and_ps( _mm256_cmp_ps( nearT, tMin, _CMP_GT_OQ ),
+															  _mm256_cmp_ps( nearT, tMax, _CMP_LT_OQ ) ) );
+	__m256 farT = _mm256_div_ps( _mm256_add_ps( negativeB, root ), aa );
+	__m256 farHit = _mm256_and_ps( hasRoots, _mm256_and_ps( _mm256_cmp_ps( farT, tMin, _CMP_GT_OQ ),
+															 _mm256_cmp_ps( farT, tMax, _CMP_LT_OQ ) ) );
+
+	_mm256_storeu_ps( t, _mm256_blendv_ps( farT, nearT, nearHit ) );
+	return uint32_t( _mm256_movemask_ps( _mm256_or_ps( nearHit, farHit ) ) );
+#elif defined( EE_BUILD_X86 )
+	const __m128 time = _mm_set1_ps( r.GetTime() );
+	const __m128 progress = _mm_div_ps( _mm_sub_ps( time, _mm_loadu_ps( &mTime0[ first ] ) ),
+										_mm_loadu_ps( &mDuration[ first ] ) );
+
+	__m128 ocX = _mm_sub_ps( _mm_set1_ps( origin.x ),
+		_mm_add_ps( _mm_loadu_ps( &mCenterX[ first ] ), _mm_mul_ps( progress, _mm_loadu_ps( &mMotionX[ first ] ) ) ) );
+	__m128 ocY = _mm_sub_ps( _mm_set1_ps( origin.y ),
+		_mm_add_ps( _mm_loadu_ps( &mCenterY[ first ] ), _mm_mul_ps( progress, _mm_loadu_ps( &mMotionY[ first ] ) ) ) );
+	__m128 ocZ = _mm_sub_ps( _mm_set1_ps( origin.z ),
+		_mm_add_ps( _mm_loadu_ps( &mCenterZ[ first ] ), _mm_mul_ps( progress, _mm_loadu_ps( &mMotionZ[ first ] ) ) ) );
+
+	__m128 b = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ocX, _mm_set1_ps( direction.x ) ),
+									   _mm_mul_ps( ocY, _mm_set1_ps( direction.y ) ) ),
+						   _mm_mul_ps( ocZ, _mm_set1_ps( direction.z ) ) );
+	__m128 c = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( ocX, ocX ), _mm_mul_ps( ocY, ocY ) ),
+									   _mm_mul_ps( ocZ, ocZ ) ),
+						   _mm_loadu_ps( &mRadiusSquared[ first ] ) );
+
+	const __m128 aa = _mm_set1_ps( a );
+	__m128 discriminant = _mm_sub_ps( _mm_mul_ps( b, b ), _mm_mul_ps( aa, c ) );
+	__m128 root = _mm_sqrt_ps( discriminant );
+	__m128 negativeB = _mm_sub_ps( _mm_setzero_ps(), b );
+
+	const __m128 tMin = _mm_set1_ps( t_min );
+	const __m128 tMax = _mm_set1_ps( t_max );
+	__m128 hasRoots = _mm_cmpgt_ps( discriminant, _mm_setzero_ps() );
+
+	__m128 nearT = _mm_div_ps( _mm_sub_ps( negativeB, root ), aa );
+	__m128 nearHit = _mm_and_ps( hasRoots, _mm_and_ps( _mm_cmpgt_ps( nearT, tMin ), _mm_cmplt_ps( nearT, tMax ) ) );
+	__m128 farT = _mm_div_ps( _mm_add_ps( negativeB, root ), aa );
+	__m128 farHit = _mm_and_ps( hasRoots, _mm_and_ps( _mm_cmpgt_ps( farT, tMin ), _mm_cmplt_ps( farT, tMax ) ) );
+
+	// SSE2 has no blend; pick nearT where it hit and farT elsewhere
+	_mm_storeu_ps( t, _mm_or_ps( _mm_and_ps( nearHit, nearT ), _mm_andnot_ps( nearHit, farT ) ) );
+	return uint32_t( _mm_movemask_ps( _mm_or_ps( nearHit, farHit ) ) );
+#else
+	uint32_t mask = 0;
+
+	for( uint32_t i = 0; i < kBatchWidth; ++i )
+	{
+		const uint32_t slot = first + i;
+		const float progress = ( r.GetTime() - mTime0[ slot ] ) / mDuration[ slot ];
+
+		float ocX = origin.x - ( mCenterX[ slot ] + progress * mMotionX[ slot ] );
+		float ocY = origin.y - ( mCenterY[ slot ] + progress * mMotionY[ slot ] );
+		float ocZ = origin.z - ( mCenterZ[ slot ] + progress * mMotionZ[ slot ] );
+
+		float b = ocX * direction.x + ocY * direction.y + ocZ * direction.z;
+		float c = ( ocX * ocX + ocY * ocY + ocZ * ocZ ) - mRadiusSquared[ slot ];
+
+		float discriminant = b * b - a * c;
+		if( !( discriminant > 0.0f ) )
+			continue;
+
+		float root = sqrtf( discriminant );
+
+		t[ i ] = ( -b - root ) / a;
+		if( ( t[ i ] > t_min ) && ( t[ i ] < t_max ) )
+		{
+			mask |= 1u << i;
+			continue;
+		}
+
+		t[ i ] = ( -b + root ) / a;
+		if( ( t[ i ] > t_min ) && ( t[ i ] < t_max ) )
+		{
+			mask |= 1u << i;
+		}
+	}
+
+	return mask;
+#endif
+}
+
+inline bool SphereSet::Intersect( const Ray& r, uint32_t first, uint32_t count, float t_min, float& t_max,
+								  uint32_t& index ) const
+{
+	bool hitAnything = false;
+
+	for( uint32_t batch = first; batch < first + count; batch += kBatchWidth )
+	{
+		float t[ kBatchWidth ];
+		uint32_t mask = IntersectBatch( r, batch, t_min, t_max, t );
+
+		// Ignore the slots past the end of the range
+		const uint32_t remaining = first + count - batch;
+		if( remaining < kBatchWidth )
+		{
+			mask &= ( 1u << remaining ) - 1;
+		}
+
+		// Lowest slot first, so that of two hits at the same distance the
+		// one a scalar loop would have kept wins
+		while( mask != 0 )
+		{
+			uint32_t i = 0;
+			while( ( mask & ( 1u << i ) ) == 0 )
+			{
+				++i;
+			}
+			mask &= mask - 1;
+
+			if( t[ i ] < t_max )
+			{
+				t_max = t[ i ];
+				index = batch + i;
+				hitAnything = true;
+			}
+		}
+	}
+
+	return hitAnything;
+}
+
+inline bool SphereSet::Occluded( const Ray& r, uint32_t first, uint32_t count, float t_min, float t_max ) const
+{
+	for( uint32_t batch = first; batch < first + count; batch += kBatchWidth )
+	{
+		float t[ kBatchWidth ];
+		uint32_t mask = IntersectBatch( r, batch, t_min, t_max, t );
+
+		const uint32_t remaining = first + count - batch;
+		if( remaining < kBatchWidth )
+		{
+			mask &= ( 1u << remaining ) - 1;
+		}
+
+		if( mask != 0 )
+			return true;
+	}
+
+	return false;
+}
+
+inline uint32_t SphereSet::IntersectPacket( const RayPacket& packet, uint32_t laneMask, uint32_t first, uint32_t count,
+											float t_min, float tMax[ RayPacket::kSize ], uint32_t index[ RayPacket::kSize ] ) const
+{
+	uint32_t hitMask = 0;
+
+	for( uint32_t slot = first; slot < first + count; ++slot )
+	{
+		if( std::isnan( mCenterX[ slot ] ) )
+			continue; // not a sphere
+
+		// The same arithmetic as IntersectBatch(), with the sphere
+		// broadcast and the rays spread over the lanes
+#if defined( EE_BUILD_X86 ) && defined( __AVX__ )
+		const __m256 progress = _mm256_div_ps( _mm256_sub_ps( _mm256_load_ps( packet.time ), _mm256_set1_ps( mTime0[ slot ] ) ),
+											   _mm256_set1_ps( mDuration[ slot ] ) );
+
+		__m256 ocX = _mm256_sub_ps( _mm256_load_ps( packet.origin[ 0 ] ),
+			_mm256_add_ps( _mm256_set1_ps( mCenterX[ slot ] ), _mm256_mul_ps( progress, _mm256_set1_ps( mMotionX[ slot ] ) ) ) );
+		__m256 ocY = _mm256_sub_ps( _mm256_load_ps( packet.origin[ 1 ] ),
+			_mm256_add_ps( _mm256_set1_ps( mCenterY[ slot ] ), _mm256_mul_ps( progress, _mm256_set1_ps( mMotionY[ slot ] ) ) ) );
+		__m256 ocZ = _mm256_sub_ps( _mm256_load_ps( packet.origin[ 2 ] ),
+			_mm256_add_ps( _mm256_set1_ps( mCenterZ[ slot ] ), _mm256_mul_ps( progress, _mm256_set1_ps( mMotionZ[ slot ] ) ) ) );
+
+		__m256 b = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ocX, _mm256_load_ps( packet.direction[ 0 ] ) ),
+												 _mm256_mul_ps( ocY, _mm256_load_ps( packet.direction[ 1 ] ) ) ),
+								  _mm256_mul_ps( ocZ, _mm256_load_ps( packet.direction[ 2 ] ) ) );
+		__m256 c = _mm256_sub_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ocX, ocX ), _mm256_mul_ps( ocY, ocY ) ),
+												 _mm256_mul_ps( ocZ, ocZ ) ),
+								  _mm256_set1_ps( mRadiusSquared[ slot ] ) );
+
+		const __m256 aa = _mm256_load_ps( packet.directionLengthSquared );
+		__m256 discriminant = _mm256_sub_ps( _mm256_mul_ps( b, b ), _mm256_mul_ps( aa, c ) );
+		__m256 root = _mm256_sqrt_ps( discriminant );
+		__m256 negativeB = _mm256_sub_ps( _mm256_setzero_ps(), b );
+
+		const __m256 tMin = _mm256_set1_ps( t_min );
+		const __m256 tMaxes = _mm256_loadu_ps( tMax );
+		__m256 hasRoots = _mm256_cmp_ps( discriminant, _mm256_setzero_ps(), _CMP_GT_OQ );
+
+		__m256 nearT = _mm256_div_ps( _mm256_sub_ps( negativeB, root ), aa );
+		__m256 nearHit = _mm256_and_ps( hasRoots, _mm256_and_ps( _mm256_cmp_ps( nearT, tMin, _CMP_GT_OQ ),
+																  _mm256_cmp_ps( nearT, tMaxes, _CMP_LT_OQ ) ) );
+		__m256 farT = _mm256_div_ps( _mm256_add_ps( negativeB, root ), aa );
+		__m256 farHit = _mm256_and_ps( hasRoots, _mm256_and_ps( _mm256_cmp_ps( farT, tMin, _CMP_GT_OQ ),
+																 _mm256_cmp_ps( farT, tMaxes, _CMP_LT_OQ ) ) );
+
+		uint32_t mask = uint32_t( _mm256_movemask_ps( _mm256_or_ps( nearHit, farHit ) ) ) & laneMask;
+		if( mask == 0 )
+			continue;
+
+		float t[ RayPacket::kSize ];
+		_mm256_storeu_ps( t, _mm256_blendv_ps( farT, nearT, nearHit ) );
+#elif defined( EE_BUILD_X86 )
+		const __m128 progress = _mm_div_ps( _mm_sub_ps( _mm_load_ps( packet.time ), _mm_set1_ps( mTime0[ slot ] ) ),
+											_mm_set1_ps( mDuration[ slot ] ) );
+
+		__m128 ocX = _mm_sub_ps( _mm_load_ps( packet.origin[ 0 ] ),
+			_mm_add_ps( _mm_set1_ps( mCenterX[ slot ] ), _mm_mul_ps( progress, _mm_set1_ps( mMotionX[ slot ] ) ) ) );
+		__m128 ocY = _mm_sub_ps( _mm_load_ps( packet.origin[ 1 ] ),
+			_mm_add_ps( _mm_set1_ps( mCenterY[ slot ] ), _mm_mul_ps( progress, _mm_set1_ps( mMotionY[ slot ] ) ) ) );
+		__m128 ocZ = _mm_sub_ps( _mm_load_ps( packet.origin[ 2 ] ),
+			_mm_add_ps( _mm_set1_ps( mCenterZ[ slot ] ), _mm_mul_ps( progress, _mm_set1_ps( mMotionZ[ slot ] ) ) ) );
+
+		__m128 b = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ocX, _mm_load_ps( packet.direction[ 0 ] ) ),
+										   _mm_mul_ps( ocY, _mm_load_ps( packet.direction[ 1 ] ) ) ),
+							   _mm_mul_ps( ocZ, _mm_load_ps( packet.direction[ 2 ] ) ) );
+		__m128 c = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( ocX, ocX ), _mm_mul_ps( ocY, ocY ) ),
+										   _mm_mul_ps( ocZ, ocZ ) ),
+							   _mm_set1_ps( mRadiusSquared[ slot ] ) );
+
+		const __m128 aa = _mm_load_ps( packet.directionLengthSquared );
+		__m128 discriminant = _mm_sub_ps( _mm_mul_ps( b, b ), _mm_mul_ps( aa, c ) );
+		__m128 root = _mm_sqrt_ps( discriminant );
+		__m128 negativeB = _mm_sub_ps( _mm_setzero_ps(), b );
+
+		const __m128 tMin = _mm_set1_ps( t_min );
+		const __m128 tMaxes = _mm_loadu_ps( tMax );
+		__m128 hasRoots = _mm_cmpgt_ps( discriminant, _mm_setzero_ps() );
+
+		__m128 nearT = _mm_div_ps( _mm_sub_ps( negativeB, root ), aa );
+		__m128 nearHit = _mm_and_ps( hasRoots, _mm_and_ps( _mm_cmpgt_ps( nearT, tMin ), _mm_cmplt_ps( nearT, tMaxes ) ) );
+		__m128 farT = _mm_div_ps( _mm_add_ps( negativeB, root ), aa );
+		__m128 farHit = _mm_and_ps( hasRoots, _mm_and_ps( _mm_cmpgt_ps( farT, tMin ), _mm_cmplt_ps( farT, tMaxes ) ) );
+
+		uint32_t mask = uint32_t( _mm_movemask_ps( _mm_or_ps( nearHit, farHit ) ) ) & laneMask;
+		if( mask == 0 )
+			continue;
+
+		float t[ RayPacket::kSize ];
+		_mm_storeu_ps( t, _mm_or_ps( _mm_and_ps( nearHit, nearT ), _mm_andnot_ps( nearHit, farT ) ) );
+#else
+		uint32_t mask = 0;
+		float t[ RayPacket::kSize ];
+
+		for( uint32_t lane = 0; lane < RayPacket::kSize; ++lane )
+		{
+			if( ( laneMask & ( 1u << lane ) ) == 0 )
+				continue;
+
+			const float progress = ( packet.time[ lane ] - mTime0[ slot ] ) / mDuration[ slot ];
+
+			float ocX = packet.origin[ 0 ][ lane ] - ( mCenterX[ slot ] + progress * mMotionX[ slot ] );
+			float ocY = packet.origin[ 1 ][ lane ] - ( mCenterY[ slot ] + progress * mMotionY[ slot ] );
+			float ocZ = packet.origin[ 2 ][ lane ] - ( mCenterZ[ slot ] + progress * mMotionZ[ slot ] );
+
+			float b = ocX * packet.direction[ 0 ][ lane ] + ocY * packet.direction[ 1 ][ lane ] + ocZ * packet.direction[ 2 ][ lane ];
+			float c = ( ocX * ocX + ocY * ocY + ocZ * ocZ ) - mRadiusSquared[ slot ];
+
+			const float a = packet.directionLengthSquared[ lane ];
+			float discriminant = b * b - a * c;
+			if( !( discriminant > 0.0f ) )
+				continue;
+
+			float root = sqrtf( discriminant );
+
+			t[ lane ] = ( -b - root ) / a;
+			if( ( t[ lane ] > t_min ) && ( t[ lane ] < tMax[ lane ] ) )
+			{
+				mask |= 1u << lane;
+				continue;
+			}
+
+			t[ lane ] = ( -b + root ) / a;
+			if( ( t[ lane ] > t_min ) && ( t[ lane ] < tMax[ lane ] ) )
+			{
+				mask |= 1u << lane;
+			}
+		}
+#endif
+
+		// Every hit is closer than its ray's tMax, and slots are visited in
+		// order, so each ray keeps the hit a scalar loop would
+		hitMask |= mask;
+
+		while( mask != 0 )
+		{
+			uint32_t lane = 0;
+			while( ( mask & ( 1u << lane ) ) == 0 )
+			{
+				++lane;
+			}
+			mask &= mask - 1;
+
+			tMax[ lane ] = t[ lane ];
+			index[ lane ] = slot;
+		}
+	}
+
+	return hitMask;
+}
@@ -118,6 +118,10 @@ static void* ReadTextureFile( const char* filename, uint16_t& width, uint16_t& h
 }
 
 ImageTexture::ImageTexture( const char* filename )
+	: mWidth( 0 )
+	, mHeight( 0 )
+	, mBytesPerPixel( 0 )
+	, mPixels( nullptr )
 {
 	mFile = ReadTextureFile( filename, mWidth, mHeight, mBytesPerPixel, mPixels );
 }
@@ -12,6 +12,8 @@ using namespace ee;
 class Texture
 {
 public:
+	virtual ~Texture() {}
+
 	virtual vec3 GetValue( float u, float v, const vec3& p ) const = 0;
 
 }; // class Texture
@@ -131,10 +133,17 @@ public:
 		, mPixels( pixels )
 	{}
 
+	// Reads a .tga or .bmp file; see IsLoaded()
 	ImageTexture( const char* filename );
 
 	virtual ~ImageTexture();
 
+	// Whether the image could be read
+	bool IsLoaded( void ) const
+	{
+		return mPixels != nullptr;
+	}
+
 	// Texture interface implementation
 
 	virtual vec3 GetValue( float u, float v, const vec3& p ) const;
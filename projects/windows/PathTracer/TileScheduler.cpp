@@ -0,0 +1,157 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include <algorithm>
+
+#include "TileScheduler.h"
+
+// Spreads the low 16 bits of v out to the even bits of the result
+static uint32_t SeparateBits( uint32_t v )
+{
+	v &= 0x0000ffff;
+	v = ( v | ( v << 8 ) ) & 0x00ff00ff;
+	v = ( v | ( v << 4 ) ) & 0x0f0f0f0f;
+	v = ( v | ( v << 2 ) ) & 0x33333333;
+	v = ( v | ( v << 1 ) ) & 0x55555555;
+	return v;
+}
+
+static uint32_t MortonCode( uint32_t x, uint32_t y )
+{
+	return SeparateBits( x ) | ( SeparateBits( y ) << 1 );
+}
+
+TileScheduler::TileScheduler()
+	: mWorkerCount( 0 )
+{
+}
+
+void TileScheduler::Initialize( uint16_t width, uint16_t height, uint16_t tileSize, uint32_t workerCount )
+{
+	if( tileSize == 0 )
+	{
+		tileSize = 1;
+	}
+
+	if( workerCount == 0 )
+	{
+		workerCount = 1;
+	}
+
+	const uint32_t tilesX = ( uint32_t( width ) + tileSize - 1 ) / tileSize;
+	const uint32_t tilesY = ( uint32_t( height ) + tileSize - 1 ) / tileSize;
+
+	std::vector< std::pair< uint32_t, Tile > > ordered;
+	ordered.reserve( tilesX * tilesY );
+
+	for( uint32_t ty = 0; ty < tilesY; ++ty )
+	{
+		for( uint32_t tx = 0; tx < tilesX; ++tx )
+		{
+			Tile tile;
+			tile.x0 = uint16_t( tx * tileSize );
+			tile.y0 = uint16_t( ty * tileSize );
+			tile.x1 = uint16_t( std::min< uint32_t >( ( tx + 1 ) * tileSize, width ) );
+			tile.y1 = uint16_t( std::min< uint32_t >( ( ty + 1 ) * tileSize, height ) );
+
+			ordered.emplace_back( MortonCode( tx, ty ), tile );
+		}
+	}
+
+	// Grids that aren't a power of two on a side leave gaps in the codes,
+	// so sort rather than index by them
+	std::sort( ordered.begin(), ordered.end(),
+			   []( const std::pair< uint32_t, Tile >& a, const std::pair< uint32_t, Tile >& b )
+			   {
+				   return a.first < b.first;
+			   } );
+
+	mTiles.resize( ordered.size() );
+	for( size_t i = 0; i < ordered.size(); ++i )
+	{
+		mTiles[ i ] = ordered[ i ].second;
+	}
+
+	mWorkerCount = workerCount;
+	mQueues.reset( new WorkerQueue[ mWorkerCount ] );
+
+	Reset();
+}
+
+void TileScheduler::Reset( void )
+{
+	// Deal out the tiles in equal contiguous runs
+	const uint32_t tileCount = uint32_t( mTiles.size() );
+	for( uint32_t w = 0; w < mWorkerCount; ++w )
+	{
+		mQueues[ w ].begin = uint32_t( uint64_t( tileCount ) * w / mWorkerCount );
+		mQueues[ w ].end = uint32_t( uint64_t( tileCount ) * ( w + 1 ) / mWorkerCount );
+	}
+}
+
+bool TileScheduler::GetNextTile( uint32_t worker, Tile& tile )
+{
+	WorkerQueue& queue = mQueues[ worker ];
+
+	{
+		std::lock_guard< std::mutex > lock( queue.mutex );
+		if( queue.begin < queue.end )
+		{
+			tile = mTiles[ queue.begin++ ];
+			return true;
+		}
+	}
+
+	return Steal( worker, tile );
+}
+
+bool TileScheduler::Steal( uint32_t worker, Tile& tile )
+{
+	for( ;; )
+	{
+		// Pick the worker with the most tiles left; the counts may change
+		// before the victim is locked, which only makes the choice less good
+		uint32_t victim = worker;
+		uint32_t mostLeft = 0;
+		for( uint32_t i = 1; i < mWorkerCount; ++i )
+		{
+			uint32_t w = ( worker + i ) % mWorkerCount;
+			std::lock_guard< std::mutex > lock( mQueues[ w ].mutex );
+			uint32_t left = mQueues[ w ].end - mQueues[ w ].begin;
+			if( left > mostLeft )
+			{
+				victim = w;
+				mostLeft = left;
+			}
+		}
+
+		if( mostLeft == 0 )
+			return false; // every tile has been handed out
+
+		uint32_t begin, end;
+		{
+			std::lock_guard< std::mutex > lock( mQueues[ victim ].mutex );
+			WorkerQueue& queue = mQueues[ victim ];
+			if( queue.begin >= queue.end )
+				continue; // its owner or another thief got there first
+
+			// Take the back half, rounding up so a single tile can be stolen
+			uint32_t middle = queue.end - ( queue.end - queue.begin + 1 ) / 2;
+			begin = middle;
+			end = queue.end;
+			queue.end = middle;
+		}
+
+		tile = mTiles[ begin ];
+
+		// Thieves read this queue under its lock, so update it under it too
+		std::lock_guard< std::mutex > lock( mQueues[ worker ].mutex );
+		mQueues[ worker ].begin = begin + 1;
+		mQueues[ worker ].end = end;
+
+		return true;
+	}
+}
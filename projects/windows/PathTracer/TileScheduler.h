@@ -0,0 +1,78 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A rectangle of pixels, [ x0, x1 ) x [ y0, y1 )
+struct Tile
+{
+	uint16_t	x0, y0;
+	uint16_t	x1, y1;
+
+	inline uint32_t GetPixelCount( void ) const;
+
+}; // struct Tile
+
+// Hands out the tiles of an image to a fixed set of worker threads. Tiles
+// are ordered along a Morton (Z-order) curve and each worker starts with
+// a contiguous run of them, so a worker's tiles are close together in the
+// image and in the scene. A worker that runs out steals the second half of
+// the largest run left, which keeps every thread busy until the last few
+// tiles however unevenly the cost of the image is spread.
+class TileScheduler
+{
+public:
+	TileScheduler();
+
+	// Not thread safe; call before any worker asks for a tile
+	void Initialize( uint16_t width, uint16_t height, uint16_t tileSize, uint32_t workerCount );
+
+	// Deals out every tile again, for another pass over the image. Not
+	// thread safe; no worker may be asking for a tile.
+	void Reset( void );
+
+	// Returns the next tile for worker to trace, or false once every tile
+	// has been handed out. Workers may call this concurrently.
+	bool GetNextTile( uint32_t worker, Tile& tile );
+
+	inline uint32_t GetTileCount( void ) const;
+	inline uint32_t GetWorkerCount( void ) const;
+
+private:
+	// A worker's remaining tiles, [ begin, end ) in mTiles. The owner takes
+	// tiles from the front and thieves take them from the back.
+	struct alignas( 64 ) WorkerQueue
+	{
+		std::mutex	mutex;
+		uint32_t	begin;
+		uint32_t	end;
+	};
+
+	bool Steal( uint32_t worker, Tile& tile );
+
+	std::vector< Tile >				mTiles; // in Morton order
+	std::unique_ptr< WorkerQueue[] >	mQueues;
+	uint32_t						mWorkerCount;
+
+}; // class TileScheduler
+
+inline uint32_t Tile::GetPixelCount( void ) const
+{
+	return uint32_t( x1 - x0 ) * uint32_t( y1 - y0 );
+}
+
+inline uint32_t TileScheduler::GetTileCount( void ) const
+{
+	return uint32_t( mTiles.size() );
+}
+
+inline uint32_t TileScheduler::GetWorkerCount( void ) const
+{
+	return mWorkerCount;
+}
@@ -0,0 +1,220 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include "TraceJob.h"
+
+TraceJob::TraceJob( TileScheduler& scheduler, uint32_t pixelCount, uint32_t passCount,
+					std::chrono::duration< double > timeBudget, TileFunction traceTile, PassEndFunction endPass,
+					const Callbacks& callbacks )
+	: mScheduler( scheduler )
+	, mTraceTile( traceTile )
+	, mEndPass( endPass )
+	, mCallbacks( callbacks )
+	, mStartTime( std::chrono::steady_clock::now() )
+	, mTimeBudget( timeBudget )
+	, mCancelled( false )
+	, mOutOfTime( false )
+	, mTotalWork( uint64_t( pixelCount ) * passCount )
+	, mCompletedWork( 0 )
+	, mPassCount( passCount )
+	, mPass( 0 )
+	, mCompletedPasses( 0 )
+	, mWorkerCount( 0 )
+	, mWaitingWorkers( 0 )
+	, mActiveWorkers( 0 )
+	, mFinished( passCount == 0 )
+	, mReportedPercent( 0 )
+	, mReportedPasses( 0 )
+	, mStatus( Status::kRunning )
+{
+}
+
+TraceJob::~TraceJob()
+{
+	Cancel();
+
+	for( std::thread& thread : mThreads )
+	{
+		if( thread.joinable() )
+		{
+			thread.join();
+		}
+	}
+}
+
+void TraceJob::Start( void )
+{
+	mWorkerCount = mScheduler.GetWorkerCount();
+	mActiveWorkers = mWorkerCount;
+	mThreads.reserve( mWorkerCount );
+
+	for( uint32_t worker = 0; worker < mWorkerCount; ++worker )
+	{
+		mThreads.emplace_back( &TraceJob::WorkerMain, this, worker );
+	}
+}
+
+TraceJob::Status TraceJob::Poll( void )
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+	return Dispatch( lock );
+}
+
+TraceJob::Status TraceJob::Wait( void )
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	for( ;; )
+	{
+		Status status = Dispatch( lock );
+		if( status != Status::kRunning )
+			return status;
+
+		mCondition.wait( lock, [this]() { return HasNews(); } );
+	}
+}
+
+TraceJob::Status TraceJob::WaitFor( uint32_t milliseconds )
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	Status status = Dispatch( lock );
+	if( status != Status::kRunning )
+		return status;
+
+	mCondition.wait_for( lock, std::chrono::milliseconds( milliseconds ), [this]() { return HasNews(); } );
+
+	return Dispatch( lock );
+}
+
+void TraceJob::Cancel( void )
+{
+	mCancelled.store( true, std::memory_order_relaxed );
+}
+
+void TraceJob::WorkerMain( uint32_t worker )
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	while( !mFinished )
+	{
+		const uint32_t pass = mPass;
+
+		lock.unlock();
+
+		Tile tile;
+		while( !ShouldStop() && mScheduler.GetNextTile( worker, tile ) )
+		{
+			mTraceTile( tile, pass, worker );
+
+			{
+				std::lock_guard< std::mutex > tileLock( mMutex );
+				mCompletedWork += tile.GetPixelCount();
+			}
+
+			mCondition.notify_all();
+		}
+
+		lock.lock();
+
+		// Wait for the other workers to finish the pass; the last one to
+		// get here sets up the next pass, or ends the job
+		if( ++mWaitingWorkers == mWorkerCount )
+		{
+			mWaitingWorkers = 0;
+
+			if( ShouldStop() )
+			{
+				mFinished = true;
+			}
+			else
+			{
+				++mCompletedPasses;
+
+				// The other workers are all waiting, so endPass has the
+				// image to itself
+				bool morePasses = !mEndPass || mEndPass();
+
+				if( !morePasses || ( mCompletedPasses == mPassCount ) )
+				{
+					mFinished = true;
+				}
+				else
+				{
+					mScheduler.Reset();
+					++mPass;
+				}
+			}
+
+			mCondition.notify_all();
+		}
+		else
+		{
+			mCondition.wait( lock, [this, pass]() { return mFinished || ( mPass != pass ); } );
+		}
+
+	} // while( !mFinished )
+
+	--mActiveWorkers;
+
+	lock.unlock();
+	mCondition.notify_all();
+}
+
+// Makes any callbacks that are due, with mMutex unlocked so that the
+// workers aren't held up by them
+TraceJob::Status TraceJob::Dispatch( std::unique_lock< std::mutex >& lock )
+{
+	uint16_t percent = GetPercent();
+	if( percent != mReportedPercent )
+	{
+		mReportedPercent = percent;
+
+		if( mCallbacks.onProgress )
+		{
+			lock.unlock();
+			mCallbacks.onProgress( percent );
+			lock.lock();
+		}
+	}
+
+	if( mCompletedPasses != mReportedPasses )
+	{
+		mReportedPasses = mCompletedPasses;
+
+		if( mCallbacks.onPass )
+		{
+			uint32_t passCount = mReportedPasses;
+
+			lock.unlock();
+			mCallbacks.onPass( passCount );
+			lock.lock();
+		}
+	}
+
+	if( ( mStatus == Status::kRunning ) && ( mActiveWorkers == 0 ) )
+	{
+		mStatus = mCancelled.load( std::memory_order_relaxed ) ? Status::kCancelled : Status::kComplete;
+		Status status = mStatus;
+
+		lock.unlock();
+
+		// The workers have all returned, so these won't block for long
+		for( std::thread& thread : mThreads )
+		{
+			thread.join();
+		}
+
+		if( mCallbacks.onComplete )
+		{
+			mCallbacks.onComplete( status );
+		}
+
+		lock.lock();
+	}
+
+	return mStatus;
+}
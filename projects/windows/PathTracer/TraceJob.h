@@ -0,0 +1,149 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TileScheduler.h"
+
+// One render in flight: a set of worker threads tracing the tiles handed
+// out by a TileScheduler, in one or more passes over the whole image. No
+// tile of a pass is started until every tile of the previous pass is done.
+// The thread that started the job owns it, and is the only one that should
+// call Poll(), Wait() or WaitFor(); those are also where the callbacks are
+// made, so the owner never hears from the job on any other thread.
+class TraceJob
+{
+public:
+	enum class Status
+	{
+		kRunning,
+		kComplete,	// every pass was traced, or the time budget ran out
+		kCancelled	// Cancel() stopped the job
+	};
+
+	typedef std::function< void( const Tile& tile, uint32_t pass, uint32_t worker ) > TileFunction;
+	typedef std::function< void( uint16_t percent ) > ProgressFunction;
+	typedef std::function< void( uint32_t passCount ) > PassFunction;
+	typedef std::function< bool( void ) > PassEndFunction;
+	typedef std::function< void( Status status ) > CompleteFunction;
+
+	struct Callbacks
+	{
+		ProgressFunction	onProgress;	// the percentage of the work done changed
+		PassFunction		onPass;		// passCount passes have been traced
+		CompleteFunction	onComplete;	// the job has stopped
+	};
+
+	// traceTile is called on the worker threads, with the worker's number,
+	// below the scheduler's worker count, so that each worker can keep
+	// scratch space of its own from tile to tile. endPass, which may be
+	// empty, is called on a worker thread after each pass while no tile is
+	// being traced, and returns false if no more passes are needed. Any of
+	// the callbacks may be empty. A timeBudget of zero means the job runs
+	// until every pass is done; otherwise workers stop taking tiles once it
+	// has elapsed. scheduler must already be initialized and must outlive
+	// the job.
+	TraceJob( TileScheduler& scheduler, uint32_t pixelCount, uint32_t passCount,
+			  std::chrono::duration< double > timeBudget, TileFunction traceTile, PassEndFunction endPass,
+			  const Callbacks& callbacks );
+
+	// Cancels the job and waits for its threads, without any callbacks
+	~TraceJob();
+
+	// Spawns one thread per scheduler worker and returns immediately
+	void Start( void );
+
+	// Reports any progress since the last call and returns the job's status
+	// without blocking. onComplete is called by whichever of Poll(), Wait()
+	// or WaitFor() first sees that the job has finished.
+	Status Poll( void );
+
+	// Blocks until the job has finished, reporting progress as it is made
+	Status Wait( void );
+
+	// Blocks until the job makes at least one percent of progress, finishes
+	// a pass or the job, or the timeout elapses, whichever is first
+	Status WaitFor( uint32_t milliseconds );
+
+	// Asks the workers to stop once they finish their current tile; the
+	// job has stopped when Poll() or Wait() no longer return kRunning
+	void Cancel( void );
+
+private:
+	void WorkerMain( uint32_t worker );
+
+	inline bool ShouldStop( void );
+
+	// Called with mMutex held
+	inline uint16_t GetPercent( void ) const;
+	inline bool HasNews( void ) const;
+	Status Dispatch( std::unique_lock< std::mutex >& lock );
+
+	TileScheduler&						mScheduler;
+	TileFunction						mTraceTile;
+	PassEndFunction						mEndPass;
+	Callbacks							mCallbacks;
+
+	const std::chrono::steady_clock::time_point	mStartTime;
+	const std::chrono::duration< double >		mTimeBudget;
+
+	std::vector< std::thread >			mThreads;
+	std::atomic_bool					mCancelled;
+	std::atomic_bool					mOutOfTime;
+
+	// Guards everything below. The workers notify mCondition whenever they
+	// finish a tile, a pass or the job.
+	std::mutex							mMutex;
+	std::condition_variable				mCondition;
+	const uint64_t						mTotalWork;		// pixels * passes
+	uint64_t							mCompletedWork;
+	const uint32_t						mPassCount;
+	uint32_t							mPass;			// the pass being traced
+	uint32_t							mCompletedPasses;
+	uint32_t							mWorkerCount;
+	uint32_t							mWaitingWorkers;	// at the end of mPass
+	uint32_t							mActiveWorkers;
+	bool								mFinished;		// no more passes will start
+	uint16_t							mReportedPercent;
+	uint32_t							mReportedPasses;
+	Status								mStatus;
+
+}; // class TraceJob
+
+inline bool TraceJob::ShouldStop( void )
+{
+	if( mCancelled.load( std::memory_order_relaxed ) || mOutOfTime.load( std::memory_order_relaxed ) )
+		return true;
+
+	if( ( mTimeBudget.count() > 0.0 ) && ( std::chrono::steady_clock::now() - mStartTime >= mTimeBudget ) )
+	{
+		mOutOfTime.store( true, std::memory_order_relaxed );
+		return true;
+	}
+
+	return false;
+}
+
+inline uint16_t TraceJob::GetPercent( void ) const
+{
+	if( mTotalWork == 0 )
+		return 100;
+
+	return uint16_t( mCompletedWork * 100 / mTotalWork );
+}
+
+inline bool TraceJob::HasNews( void ) const
+{
+	return ( mActiveWorkers == 0 ) || ( GetPercent() != mReportedPercent ) ||
+		   ( mCompletedPasses != mReportedPasses );
+}
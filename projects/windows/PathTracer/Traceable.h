@@ -4,31 +4,110 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <ee/math/Ray.h>
 #include <ee/math/AABB.h>
 
 using namespace ee;
 
-class Material;
+class MaterialTable;
+class Traceable;
+
+// The index of a material in the scene's MaterialTable
+typedef uint32_t MaterialId;
+
+// What a closest-hit search keeps about the nearest hit found so far:
+// just enough to compare hits and to work out the rest of the HitRecord
+// later, for the one hit that turns out to be closest
+struct RayHit
+{
+	float				t;
+	float				u;		// any surface parameters the primitive found while
+	float				v;		// intersecting, for FinalizeHit() (e.g. barycentrics)
+	uint32_t			index;	// which part of the primitive was hit (e.g. a mesh's triangle)
+	const Traceable*	object; // the primitive that was hit
+};
 
 struct HitRecord
 {
-	float		t;
-	float		u;
-	float		v;
-	vec3		p;
-	vec3		normal;
-	Material*	material;
+	float				t;
+	float				u;
+	float				v;
+	vec3				p;
+	vec3				normal;
+	MaterialId			material;
+	const Traceable*	object = nullptr; // the primitive that was hit, if its FinalizeHit() set it
 };
 
 class Traceable
 {
 public:
-	virtual bool Hit( const Ray& r, float t_min, float t_max, HitRecord& rec ) const = 0;
+	virtual ~Traceable() {}
+
+	// Finds the closest hit of r in [t_min, t_max] and fills in rec for it;
+	// Intersect() followed by FinalizeHit() on the primitive it found
+	inline bool Hit( const Ray& r, float t_min, float t_max, HitRecord& rec ) const;
+
+	// The search half of Hit(): returns true and sets hit if r hits this
+	// object closer than t_max. hit is left alone otherwise, so one RayHit
+	// can be passed to object after object with a shrinking t_max.
+	virtual bool Intersect( const Ray& r, float t_min, float t_max, RayHit& hit ) const = 0;
+
+	// The other half: works out position, normal, uv and material for a
+	// hit on this object that Intersect() reported. Hit() only calls it
+	// on the primitive in hit.object, so objects that just hold other
+	// objects (such as BVHNode) needn't override it.
+	virtual void FinalizeHit( const Ray& r, const RayHit& hit, HitRecord& rec ) const
+	{
+	}
+
+	// Returns true if anything blocks r in [t_min, t_max]; for shadow rays,
+	// which only need to know whether there is a hit, not which is closest
+	// or what it looks like. Objects should override this with a test
+	// that stops at the first hit rather than looking for the closest.
+	virtual bool Occluded( const Ray& r, float t_min, float t_max ) const
+	{
+		RayHit hit;
+		return Intersect( r, t_min, t_max, hit );
+	}
 
 	// Returns true if this object has a bounding box, and initializes box
 	// to contain that bounding box's parameters; objects with infinite extent
 	// (e.g. planes) should return false, and the box argument is not touched.
 	virtual bool GetBoundingBox( float t0, float t1, AABB& box ) const = 0;
 
+	// Lights are primitives with an emitting material that can be aimed
+	// at, for next event estimation; the rest keep these defaults
+
+	virtual bool IsLight( const MaterialTable& materials ) const
+	{
+		return false;
+	}
+
+	// Picks a direction from origin towards this object as it is at time,
+	// from u1 and u2 in [ 0, 1 ), and returns its probability density per
+	// unit solid angle, or 0 if no direction could be picked
+	virtual float SampleDirection( const vec3& origin, float time, float u1, float u2, vec3& direction ) const
+	{
+		return 0.0f;
+	}
+
+	// Returns the probability density that SampleDirection() picks the
+	// direction of r from its origin at its time; 0 if r misses the object
+	virtual float GetDirectionPdf( const Ray& r ) const
+	{
+		return 0.0f;
+	}
+
 }; // class Traceable
+
+inline bool Traceable::Hit( const Ray& r, float t_min, float t_max, HitRecord& rec ) const
+{
+	RayHit hit;
+	if( !Intersect( r, t_min, t_max, hit ) )
+		return false;
+
+	hit.object->FinalizeHit( r, hit, rec );
+	return true;
+}
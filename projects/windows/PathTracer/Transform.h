@@ -0,0 +1,246 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <cmath>
+
+#include <ee/math/vec3.h>
+#include <ee/math/AABB.h>
+#include <ee/math/Math.h>
+
+using namespace ee;
+
+// An affine transform from object space to world space, kept together
+// with its inverse as two 3x4 matrices (the bottom row of both is always
+// 0 0 0 1). Transforms are built from translations, rotations and scales
+// and combined by multiplying them, which multiplies the inverses in the
+// opposite order, so no matrix ever needs inverting.
+class Transform
+{
+public:
+	// The identity
+	inline Transform();
+
+	static inline Transform Translation( const vec3& offset );
+	// The scale factors must not be zero
+	static inline Transform Scaling( const vec3& scale );
+	// A rotation of degrees counterclockwise about axis, looking down the
+	// axis towards the origin
+	static inline Transform Rotation( const vec3& axis, float degrees );
+
+	// The transform that applies rhs and then this
+	inline Transform operator * ( const Transform& rhs ) const;
+
+	inline Transform GetInverse( void ) const;
+
+	// Object space to world space
+	inline vec3 TransformPoint( const vec3& p ) const;
+	inline vec3 TransformVector( const vec3& v ) const;
+	// Normals transform by the inverse transpose, so that they stay
+	// perpendicular to the surface; the result isn't normalized
+	inline vec3 TransformNormal( const vec3& n ) const;
+	// A box that encloses box's eight corners once transformed
+	inline AABB TransformBox( const AABB& box ) const;
+
+	// World space to object space
+	inline vec3 InverseTransformPoint( const vec3& p ) const;
+	inline vec3 InverseTransformVector( const vec3& v ) const;
+
+private:
+	inline Transform( const float matrix[ 3 ][ 4 ], const float inverse[ 3 ][ 4 ] );
+
+	static inline void Multiply( const float lhs[ 3 ][ 4 ], const float rhs[ 3 ][ 4 ], float result[ 3 ][ 4 ] );
+	static inline vec3 MultiplyPoint( const float matrix[ 3 ][ 4 ], const vec3& p );
+	static inline vec3 MultiplyVector( const float matrix[ 3 ][ 4 ], const vec3& v );
+
+	float	mMatrix[ 3 ][ 4 ];
+	float	mInverse[ 3 ][ 4 ];
+
+}; // class Transform
+
+inline Transform::Transform()
+{
+	for( int row = 0; row < 3; ++row )
+	{
+		for( int column = 0; column < 4; ++column )
+		{
+			mMatrix[ row ][ column ] = ( row == column ) ? 1.0f : 0.0f;
+			mInverse[ row ][ column ] = ( row == column ) ? 1.0f : 0.0f;
+		}
+	}
+}
+
+inline Transform::Transform( const float matrix[ 3 ][ 4 ], const float inverse[ 3 ][ 4 ] )
+{
+	for( int row = 0; row < 3; ++row )
+	{
+		for( int column = 0; column < 4; ++column )
+		{
+			mMatrix[ row ][ column ] = matrix[ row ][ column ];
+			mInverse[ row ][ column ] = inverse[ row ][ column ];
+		}
+	}
+}
+
+inline Transform Transform::Translation( const vec3& offset )
+{
+	const float matrix[ 3 ][ 4 ] =
+	{
+		{ 1.0f, 0.0f, 0.0f, offset.x },
+		{ 0.0f, 1.0f, 0.0f, offset.y },
+		{ 0.0f, 0.0f, 1.0f, offset.z }
+	};
+
+	const float inverse[ 3 ][ 4 ] =
+	{
+		{ 1.0f, 0.0f, 0.0f, -offset.x },
+		{ 0.0f, 1.0f, 0.0f, -offset.y },
+		{ 0.0f, 0.0f, 1.0f, -offset.z }
+	};
+
+	return Transform( matrix, inverse );
+}
+
+inline Transform Transform::Scaling( const vec3& scale )
+{
+	const float matrix[ 3 ][ 4 ] =
+	{
+		{ scale.x, 0.0f, 0.0f, 0.0f },
+		{ 0.0f, scale.y, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, scale.z, 0.0f }
+	};
+
+	const float inverse[ 3 ][ 4 ] =
+	{
+		{ 1.0f / scale.x, 0.0f, 0.0f, 0.0f },
+		{ 0.0f, 1.0f / scale.y, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, 1.0f / scale.z, 0.0f }
+	};
+
+	return Transform( matrix, inverse );
+}
+
+inline Transform Transform::Rotation( const vec3& axis, float degrees )
+{
+	// Rodrigues' rotation formula; a rotation's inverse is its transpose
+	const vec3 a = axis.GetNormalized();
+	const float radians = degrees * float( M_PI ) / 180.0f;
+	const float s = sinf( radians );
+	const float c = cosf( radians );
+	const float t = 1.0f - c;
+
+	const float matrix[ 3 ][ 4 ] =
+	{
+		{ t * a.x * a.x + c,		t * a.x * a.y - s * a.z,	t * a.x * a.z + s * a.y,	0.0f },
+		{ t * a.x * a.y + s * a.z,	t * a.y * a.y + c,			t * a.y * a.z - s * a.x,	0.0f },
+		{ t * a.x * a.z - s * a.y,	t * a.y * a.z + s * a.x,	t * a.z * a.z + c,			0.0f }
+	};
+
+	float inverse[ 3 ][ 4 ];
+	for( int row = 0; row < 3; ++row )
+	{
+		for( int column = 0; column < 3; ++column )
+		{
+			inverse[ row ][ column ] = matrix[ column ][ row ];
+		}
+
+		inverse[ row ][ 3 ] = 0.0f;
+	}
+
+	return Transform( matrix, inverse );
+}
+
+inline void Transform::Multiply( const float lhs[ 3 ][ 4 ], const float rhs[ 3 ][ 4 ], float result[ 3 ][ 4 ] )
+{
+	for( int row = 0; row < 3; ++row )
+	{
+		for( int column = 0; column < 4; ++column )
+		{
+			result[ row ][ column ] = lhs[ row ][ 0 ] * rhs[ 0 ][ column ] +
+									  lhs[ row ][ 1 ] * rhs[ 1 ][ column ] +
+									  lhs[ row ][ 2 ] * rhs[ 2 ][ column ];
+		}
+
+		result[ row ][ 3 ] += lhs[ row ][ 3 ];
+	}
+}
+
+inline Transform Transform::operator * ( const Transform& rhs ) const
+{
+	float matrix[ 3 ][ 4 ];
+	float inverse[ 3 ][ 4 ];
+
+	Multiply( mMatrix, rhs.mMatrix, matrix );
+	Multiply( rhs.mInverse, mInverse, inverse );
+
+	return Transform( matrix, inverse );
+}
+
+inline Transform Transform::GetInverse( void ) const
+{
+	return Transform( mInverse, mMatrix );
+}
+
+inline vec3 Transform::MultiplyPoint( const float matrix[ 3 ][ 4 ], const vec3& p )
+{
+	return vec3( matrix[ 0 ][ 0 ] * p.x + matrix[ 0 ][ 1 ] * p.y + matrix[ 0 ][ 2 ] * p.z + matrix[ 0 ][ 3 ],
+				 matrix[ 1 ][ 0 ] * p.x + matrix[ 1 ][ 1 ] * p.y + matrix[ 1 ][ 2 ] * p.z + matrix[ 1 ][ 3 ],
+				 matrix[ 2 ][ 0 ] * p.x + matrix[ 2 ][ 1 ] * p.y + matrix[ 2 ][ 2 ] * p.z + matrix[ 2 ][ 3 ] );
+}
+
+inline vec3 Transform::MultiplyVector( const float matrix[ 3 ][ 4 ], const vec3& v )
+{
+	return vec3( matrix[ 0 ][ 0 ] * v.x + matrix[ 0 ][ 1 ] * v.y + matrix[ 0 ][ 2 ] * v.z,
+				 matrix[ 1 ][ 0 ] * v.x + matrix[ 1 ][ 1 ] * v.y + matrix[ 1 ][ 2 ] * v.z,
+				 matrix[ 2 ][ 0 ] * v.x + matrix[ 2 ][ 1 ] * v.y + matrix[ 2 ][ 2 ] * v.z );
+}
+
+inline vec3 Transform::TransformPoint( const vec3& p ) const
+{
+	return MultiplyPoint( mMatrix, p );
+}
+
+inline vec3 Transform::TransformVector( const vec3& v ) const
+{
+	return MultiplyVector( mMatrix, v );
+}
+
+inline vec3 Transform::TransformNormal( const vec3& n ) const
+{
+	return vec3( mInverse[ 0 ][ 0 ] * n.x + mInverse[ 1 ][ 0 ] * n.y + mInverse[ 2 ][ 0 ] * n.z,
+				 mInverse[ 0 ][ 1 ] * n.x + mInverse[ 1 ][ 1 ] * n.y + mInverse[ 2 ][ 1 ] * n.z,
+				 mInverse[ 0 ][ 2 ] * n.x + mInverse[ 1 ][ 2 ] * n.y + mInverse[ 2 ][ 2 ] * n.z );
+}
+
+inline AABB Transform::TransformBox( const AABB& box ) const
+{
+	vec3 lower = TransformPoint( box.GetMin() );
+	vec3 upper = lower;
+
+	for( int corner = 1; corner < 8; ++corner )
+	{
+		const vec3 p = TransformPoint( vec3( ( corner & 1 ) ? box.GetMax().x : box.GetMin().x,
+											 ( corner & 2 ) ? box.GetMax().y : box.GetMin().y,
+											 ( corner & 4 ) ? box.GetMax().z : box.GetMin().z ) );
+
+		for( int a = 0; a < 3; ++a )
+		{
+			lower[ a ] = fminf( lower[ a ], p[ a ] );
+			upper[ a ] = fmaxf( upper[ a ], p[ a ] );
+		}
+	}
+
+	return AABB( lower, upper );
+}
+
+inline vec3 Transform::InverseTransformPoint( const vec3& p ) const
+{
+	return MultiplyPoint( mInverse, p );
+}
+
+inline vec3 Transform::InverseTransformVector( const vec3& v ) const
+{
+	return MultiplyVector( mInverse, v );
+}
@@ -0,0 +1,95 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <ee/math/vec3.h>
+#include <ee/math/Ray.h>
+
+#include "Material.h"
+#include "PathTracer.h"
+#include "Traceable.h"
+
+using namespace ee;
+
+// The paths of a batch of samples that PathTracer::TraceWavefront() traces
+// together. Rather than following each path to its end in turn, it takes
+// every path through a bounce one stage at a time, with each stage working
+// through a queue of all the paths that reach it: intersecting every ray,
+// then shading the hits sorted by material type, then testing every
+// shadow ray, then queueing the rays of the paths that go on for the next
+// bounce. Each stage runs the same code over contiguous arrays, so its
+// code and data stay in cache, and the hits on each type of material are
+// scattered in one MaterialTable::ScatterBatch() call.
+//
+// The paths' state is held in arrays indexed by path, and each queue in
+// arrays indexed by queue entry, with a paths array giving the path each
+// entry belongs to. Each hit's ScatterQuery is written once, in place; the
+// material queues are runs of indices into the queries, so sorting them
+// moves four bytes per hit rather than the whole query. The vectors keep
+// their capacity from batch to batch, so a batch should be kept and
+// Reset() for the next one rather than made again.
+struct WavefrontBatch
+{
+	// Empties every queue, keeping the memory allocated for them
+	inline void Reset( void );
+
+	// Per path: the sample it traces, filled in by the caller; the light
+	// it brings back, which is the result; and, as in GetColor(), the
+	// fraction of light it carries and the density its last ray was
+	// scattered with
+	std::vector< PixelSample >	pixelSamples;
+	std::vector< vec3 >			colors;
+	std::vector< vec3 >			throughputs;
+	std::vector< float >		scatteringPdfs;
+
+	// The ray queue: the rays traced this bounce, and what each one hit
+	std::vector< uint32_t >		rayPaths;
+	std::vector< Ray >			rays;
+	std::vector< RayHit >		rayHits;
+
+	// The hits of the paths that go on, in ray queue order, and their
+	// material types; queryOrder sorts them by type into one material
+	// queue per type
+	std::vector< uint32_t >		queryPaths;
+	std::vector< ScatterQuery >	queries;
+	std::vector< MaterialType >	queryTypes;
+	std::vector< uint32_t >		queryOrder;
+	uint32_t					queryStarts[ kMaterialTypeCount + 1 ]; // where each type's queue starts in queryOrder
+
+	// The shadow queue
+	std::vector< uint32_t >		lightPaths;
+	std::vector< LightSample >	lightSamples;
+
+	// The rays of the paths that go on, which become the next ray queue
+	std::vector< uint32_t >		nextRayPaths;
+	std::vector< Ray >			nextRays;
+
+}; // struct WavefrontBatch
+
+inline void WavefrontBatch::Reset( void )
+{
+	pixelSamples.clear();
+	colors.clear();
+	throughputs.clear();
+	scatteringPdfs.clear();
+
+	rayPaths.clear();
+	rays.clear();
+	rayHits.clear();
+
+	queryPaths.clear();
+	queries.clear();
+	queryTypes.clear();
+	queryOrder.clear();
+
+	lightPaths.clear();
+	lightSamples.clear();
+
+	nextRayPaths.clear();
+	nextRays.clear();
+}
@@ -0,0 +1,133 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#include "pch.h"
+
+#include <limits>
+
+#include "WideBVH.h"
+
+#include <ee/math/AABB.h>
+
+template< uint32_t Width >
+bool WideBVH< Width >::Build( const LinearBVH& bvh )
+{
+	Clear();
+
+	if( bvh.IsEmpty() )
+		return false;
+
+	// Each wide node replaces at least one binary interior node
+	mNodes.reserve( bvh.GetNodeCount() / 2 + 1 );
+
+	BuildRecursive( bvh.GetNodes(), 0 );
+
+	return true;
+}
+
+template< uint32_t Width >
+void WideBVH< Width >::Clear( void )
+{
+	mNodes.clear();
+}
+
+// Collapses the binary subtree rooted at binaryIndex into a wide node,
+// returning the wide node's index
+template< uint32_t Width >
+uint32_t WideBVH< Width >::BuildRecursive( const LinearBVHNode* binaryNodes, uint32_t binaryIndex )
+{
+	uint32_t nodeIndex = uint32_t( mNodes.size() );
+	mNodes.emplace_back();
+
+	// Start with the binary node's two children, then keep opening up the
+	// interior child with the largest surface area (the one most likely to
+	// be hit) until the wide node is full or only leaves are left
+	uint32_t children[ Width ];
+	uint32_t childCount = 0;
+
+	const LinearBVHNode& binary = binaryNodes[ binaryIndex ];
+	if( binary.primitiveCount > 0 )
+	{
+		// Only happens at the root, when the whole tree is a single leaf
+		children[ childCount++ ] = binaryIndex;
+	}
+	else
+	{
+		children[ childCount++ ] = binaryIndex + 1;
+		children[ childCount++ ] = binary.secondChildOffset;
+	}
+
+	while( childCount < Width )
+	{
+		int largest = -1;
+		float largestArea = -1.0f;
+		for( uint32_t c = 0; c < childCount; ++c )
+		{
+			const LinearBVHNode& child = binaryNodes[ children[ c ] ];
+			if( child.primitiveCount == 0 )
+			{
+				float area = child.bounds.GetSurfaceArea();
+				if( area > largestArea )
+				{
+					largest = int( c );
+					largestArea = area;
+				}
+			}
+		}
+
+		if( largest < 0 )
+			break;
+
+		uint32_t opened = children[ largest ];
+		children[ largest ] = opened + 1;
+		children[ childCount++ ] = binaryNodes[ opened ].secondChildOffset;
+	}
+
+	WideBVHNode< Width > node;
+
+	const float infinity = std::numeric_limits< float >::infinity();
+
+	for( uint32_t c = 0; c < Width; ++c )
+	{
+		if( c < childCount )
+		{
+			const LinearBVHNode& child = binaryNodes[ children[ c ] ];
+			for( int a = 0; a < 3; ++a )
+			{
+				node.bounds[ 0 ][ a ][ c ] = child.bounds.GetMin()[ a ];
+				node.bounds[ 1 ][ a ][ c ] = child.bounds.GetMax()[ a ];
+			}
+
+			if( child.primitiveCount > 0 )
+			{
+				node.child[ c ] = child.primitivesOffset;
+				node.primitiveCount[ c ] = child.primitiveCount;
+			}
+			else
+			{
+				// Note: this may reallocate mNodes, hence the local node
+				node.child[ c ] = BuildRecursive( binaryNodes, children[ c ] );
+				node.primitiveCount[ c ] = 0;
+			}
+		}
+		else
+		{
+			for( int a = 0; a < 3; ++a )
+			{
+				node.bounds[ 0 ][ a ][ c ] = infinity;
+				node.bounds[ 1 ][ a ][ c ] = -infinity;
+			}
+
+			node.child[ c ] = 0;
+			node.primitiveCount[ c ] = 0;
+		}
+	}
+
+	mNodes[ nodeIndex ] = node;
+
+	return nodeIndex;
+}
+
+template class WideBVH< 4 >;
+template class WideBVH< 8 >;
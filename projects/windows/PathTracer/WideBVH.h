@@ -0,0 +1,402 @@
+// PathTracer application - part of Elevation Engine
+//
+// Copyright (c) 2025 Azimuth Studios
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#if defined( EE_BUILD_X86 )
+#  include <immintrin.h>
+#endif
+
+#include <ee/math/Ray.h>
+
+#include "LinearBVH.h"
+#include "RayPacket.h"
+
+using namespace ee;
+
+// One node of a WideBVH: up to Width children, whose bounding boxes are
+// stored in structure-of-arrays form so that a ray can be tested against
+// all of them at once with SIMD instructions. Unused child slots have an
+// empty (inverted, infinite) box that no ray can hit.
+template< uint32_t Width >
+struct alignas( 64 ) WideBVHNode
+{
+	// bounds[ 0 ] holds the children's minimums and bounds[ 1 ] their
+	// maximums, each indexed by axis and then by child
+	float		bounds[ 2 ][ 3 ][ Width ];
+
+	// Interior child: the index of its node. Leaf child: the index of its
+	// first primitive in the LinearBVH's primitive order.
+	uint32_t	child[ Width ];
+	uint16_t	primitiveCount[ Width ]; // 0 -> interior child
+
+}; // struct WideBVHNode
+
+// A BVH with a branching factor of Width, made by collapsing the levels of
+// a binary LinearBVH. Leaves reference the same primitive ranges as the
+// LinearBVH it was built from, so the owner's primitive order is unchanged.
+// Width 4 uses SSE and width 8 uses AVX to test a node's children; other
+// widths, or 8 without AVX, fall back to a scalar loop.
+template< uint32_t Width >
+class WideBVH
+{
+public:
+	static_assert( Width >= 2 && Width <= 16, "WideBVH child masks are 16 bits wide" );
+
+	bool Build( const LinearBVH& bvh );
+	void Clear( void );
+
+	inline uint32_t GetNodeCount( void ) const;
+	inline bool IsEmpty( void ) const;
+
+	// Walk the hierarchy, calling leafHit for each leaf whose bounds the
+	// ray intersects in [t_min, t_max], nearest child first and skipping
+	// children the ray enters beyond the closest hit found so far. leafHit
+	// has the same signature and semantics as for LinearBVH::Hit().
+	template< class LeafHit >
+	inline bool Hit( const Ray& r, float t_min, float t_max, LeafHit& leafHit ) const;
+
+	// Walk the hierarchy until any primitive is found in [t_min, t_max];
+	// leafOccluded has the same signature and semantics as for
+	// LinearBVH::Occluded(). Children are visited in node order, and a
+	// node's leaves are tested as soon as the node is.
+	template< class LeafOccluded >
+	inline bool Occluded( const Ray& r, float t_min, float t_max, LeafOccluded& leafOccluded ) const;
+
+	// Hit() for a coherent packet of rays; leafHit has the same signature
+	// and semantics as for LinearBVH::HitPacket(). Each child is tested
+	// against every ray at once when it's popped, so hits found since it
+	// was pushed can cull it, and children are visited nearest first along
+	// the first ray's direction.
+	template< class LeafHit >
+	inline void HitPacket( const RayPacket& packet, float t_min, float tMax[ RayPacket::kSize ], LeafHit& leafHit ) const;
+
+private:
+	uint32_t BuildRecursive( const LinearBVHNode* binaryNodes, uint32_t binaryIndex );
+
+	// Tests the ray against every child box of node, returning a bitmask of
+	// the children hit and each child's entry distance in tNear
+	static inline uint32_t IntersectChildren( const WideBVHNode< Width >& node,
+											  const float origin[ 3 ], const float invDirection[ 3 ],
+											  const int dirIsNegative[ 3 ], float t_min, float t_max,
+											  float tNear[ Width ] );
+
+	// Every level of the tree can leave Width - 1 siblings on the stack
+	static const uint32_t kStackSize = LinearBVH::kMaxDepth * ( Width - 1 ) + 1;
+
+	std::vector< WideBVHNode< Width > > mNodes;
+
+}; // class WideBVH
+
+template< uint32_t Width >
+inline uint32_t WideBVH< Width >::GetNodeCount( void ) const
+{
+	return uint32_t( mNodes.size() );
+}
+
+template< uint32_t Width >
+inline bool WideBVH< Width >::IsEmpty( void ) const
+{
+	return mNodes.empty();
+}
+
+template< uint32_t Width >
+inline uint32_t WideBVH< Width >::IntersectChildren( const WideBVHNode< Width >& node,
+													 const float origin[ 3 ], const float invDirection[ 3 ],
+													 const int dirIsNegative[ 3 ], float t_min, float t_max,
+													 float tNear[ Width ] )
+{
+#if defined( EE_BUILD_X86 )
+	if constexpr( Width == 4 )
+	{
+		__m128 nearT = _mm_set1_ps( t_min );
+		__m128 farT = _mm_set1_ps( t_max );
+
+		// Selecting the near and far slab by the direction's sign keeps
+		// each interval in increasing order, and makes empty slots miss
+		for( int a = 0; a < 3; ++a )
+		{
+			__m128 o = _mm_set1_ps( origin[ a ] );
+			__m128 d = _mm_set1_ps( invDirection[ a ] );
+			__m128 t0 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.bounds[ dirIsNegative[ a ] ][ a ] ), o ), d );
+			__m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.bounds[ 1 - dirIsNegative[ a ] ][ a ] ), o ), d );
+			nearT = _mm_max_ps( t0, nearT );
+			farT = _mm_min_ps( t1, farT );
+		}
+
+		_mm_storeu_ps( tNear, nearT );
+		return uint32_t( _mm_movemask_ps( _mm_cmplt_ps( nearT, farT ) ) );
+	}
+#if defined( __AVX__ )
+	else if constexpr( Width == 8 )
+	{
+		__m256 nearT = _mm256_set1_ps( t_min );
+		__m256 farT = _mm256_set1_ps( t_max );
+
+		for( int a = 0; a < 3; ++a )
+		{
+			__m256 o = _mm256_set1_ps( origin[ a ] );
+			__m256 d = _mm256_set1_ps( invDirection[ a ] );
+			__m256 t0 = _mm256_mul_ps( _mm256_sub_ps( _mm256_load_ps( node.bounds[ dirIsNegative[ a ] ][ a ] ), o ), d );
+			__m256 t1 = _mm256_mul_ps( _mm256_sub_ps( _mm256_load_ps( node.bounds[ 1 - dirIsNegative[ a ] ][ a ] ), o ), d );
+			nearT = _mm256_max_ps( t0, nearT );
+			farT = _mm256_min_ps( t1, farT );
+		}
+
+		_mm256_storeu_ps( tNear, nearT );
+		return uint32_t( _mm256_movemask_ps( _mm256_cmp_ps( nearT, farT, _CMP_LT_OQ ) ) );
+	}
+#endif // #if defined( __AVX__ )
+	else
+#endif // #if defined( EE_BUILD_X86 )
+	{
+		uint32_t mask = 0;
+
+		for( uint32_t c = 0; c < Width; ++c )
+		{
+			float nearT = t_min;
+			float farT = t_max;
+
+			for( int a = 0; a < 3; ++a )
+			{
+				float t0 = ( node.bounds[ dirIsNegative[ a ] ][ a ][ c ] - origin[ a ] ) * invDirection[ a ];
+				float t1 = ( node.bounds[ 1 - dirIsNegative[ a ] ][ a ][ c ] - origin[ a ] ) * invDirection[ a ];
+				nearT = t0 > nearT ? t0 : nearT;
+				farT = t1 < farT ? t1 : farT;
+			}
+
+			tNear[ c ] = nearT;
+			if( nearT < farT )
+			{
+				mask |= 1u << c;
+			}
+		}
+
+		return mask;
+	}
+}
+
+template< uint32_t Width >
+template< class LeafHit >
+inline bool WideBVH< Width >::Hit( const Ray& r, float t_min, float t_max, LeafHit& leafHit ) const
+{
+	if( mNodes.empty() )
+		return false;
+
+	const float origin[ 3 ] = { r.GetOrigin().x, r.GetOrigin().y, r.GetOrigin().z };
+	const float invDirection[ 3 ] = { 1.0f / r.GetDirection().x, 1.0f / r.GetDirection().y, 1.0f / r.GetDirection().z };
+	const int dirIsNegative[ 3 ] = { invDirection[ 0 ] < 0.0f, invDirection[ 1 ] < 0.0f, invDirection[ 2 ] < 0.0f };
+
+	const WideBVHNode< Width >* nodes = mNodes.data();
+
+	// Stack entries are either a node to visit or a leaf to intersect, with
+	// the distance at which the ray enters its bounds
+	struct Entry
+	{
+		uint32_t	index;
+		uint32_t	primitiveCount; // 0 -> index is a node
+		float		tEntry;
+	};
+
+	Entry stack[ kStackSize ];
+	uint32_t stackSize = 0;
+	stack[ stackSize++ ] = { 0, 0, t_min };
+
+	bool hitAnything = false;
+
+	while( stackSize > 0 )
+	{
+		Entry entry = stack[ --stackSize ];
+
+		// A hit found since this entry was pushed may be closer than it
+		if( entry.tEntry >= t_max )
+			continue;
+
+		if( entry.primitiveCount > 0 )
+		{
+			if( leafHit( entry.index, entry.primitiveCount, t_min, t_max ) )
+			{
+				hitAnything = true;
+			}
+
+			continue;
+		}
+
+		const WideBVHNode< Width >& node = nodes[ entry.index ];
+
+		float tNear[ Width ];
+		uint32_t mask = IntersectChildren( node, origin, invDirection, dirIsNegative, t_min, t_max, tNear );
+		if( mask == 0 )
+			continue;
+
+		// Sort the children that were hit from farthest to nearest, so that
+		// the nearest ends up on top of the stack and is visited first
+		uint32_t order[ Width ];
+		uint32_t hitCount = 0;
+		while( mask != 0 )
+		{
+			uint32_t c = 0;
+			while( ( mask & ( 1u << c ) ) == 0 )
+			{
+				++c;
+			}
+			mask &= mask - 1;
+
+			uint32_t i = hitCount++;
+			while( ( i > 0 ) && ( tNear[ order[ i - 1 ] ] < tNear[ c ] ) )
+			{
+				order[ i ] = order[ i - 1 ];
+				--i;
+			}
+			order[ i ] = c;
+		}
+
+		for( uint32_t i = 0; i < hitCount; ++i )
+		{
+			uint32_t c = order[ i ];
+			stack[ stackSize++ ] = { node.child[ c ], node.primitiveCount[ c ], tNear[ c ] };
+		}
+
+	} // while( stackSize > 0 )
+
+	return hitAnything;
+}
+
+template< uint32_t Width >
+template< class LeafOccluded >
+inline bool WideBVH< Width >::Occluded( const Ray& r, float t_min, float t_max, LeafOccluded& leafOccluded ) const
+{
+	if( mNodes.empty() )
+		return false;
+
+	const float origin[ 3 ] = { r.GetOrigin().x, r.GetOrigin().y, r.GetOrigin().z };
+	const float invDirection[ 3 ] = { 1.0f / r.GetDirection().x, 1.0f / r.GetDirection().y, 1.0f / r.GetDirection().z };
+	const int dirIsNegative[ 3 ] = { invDirection[ 0 ] < 0.0f, invDirection[ 1 ] < 0.0f, invDirection[ 2 ] < 0.0f };
+
+	const WideBVHNode< Width >* nodes = mNodes.data();
+
+	uint32_t stack[ kStackSize ];
+	uint32_t stackSize = 0;
+	stack[ stackSize++ ] = 0;
+
+	while( stackSize > 0 )
+	{
+		const WideBVHNode< Width >& node = nodes[ stack[ --stackSize ] ];
+
+		float tNear[ Width ];
+		uint32_t mask = IntersectChildren( node, origin, invDirection, dirIsNegative, t_min, t_max, tNear );
+
+		while( mask != 0 )
+		{
+			uint32_t c = 0;
+			while( ( mask & ( 1u << c ) ) == 0 )
+			{
+				++c;
+			}
+			mask &= mask - 1;
+
+			if( node.primitiveCount[ c ] > 0 )
+			{
+				if( leafOccluded( node.child[ c ], node.primitiveCount[ c ], t_min, t_max ) )
+					return true;
+			}
+			else
+			{
+				stack[ stackSize++ ] = node.child[ c ];
+			}
+		}
+
+	} // while( stackSize > 0 )
+
+	return false;
+}
+
+template< uint32_t Width >
+template< class LeafHit >
+inline void WideBVH< Width >::HitPacket( const RayPacket& packet, float t_min, float tMax[ RayPacket::kSize ],
+										 LeafHit& leafHit ) const
+{
+	if( mNodes.empty() )
+		return;
+
+	const uint32_t laneMask = packet.GetLaneMask();
+
+	const WideBVHNode< Width >* nodes = mNodes.data();
+
+	// Stack entries are children still to be tested, as their node and slot
+	struct Entry
+	{
+		uint32_t	node;
+		uint32_t	slot;
+	};
+
+	Entry stack[ kStackSize ];
+	uint32_t stackSize = 0;
+
+	// Pushes the used slots of a node, farthest first, by how far along the
+	// first ray's direction the corner of each child's box nearest the
+	// packet lies
+	auto pushChildren = [&]( uint32_t index )
+	{
+		const WideBVHNode< Width >& node = nodes[ index ];
+
+		float distances[ Width ];
+		uint32_t order[ Width ];
+		uint32_t childCount = 0;
+
+		for( uint32_t c = 0; c < Width; ++c )
+		{
+			if( node.bounds[ 0 ][ 0 ][ c ] > node.bounds[ 1 ][ 0 ][ c ] )
+				continue; // an unused slot
+
+			distances[ c ] = 0.0f;
+			for( int a = 0; a < 3; ++a )
+			{
+				distances[ c ] += node.bounds[ packet.dirIsNegative[ a ] ][ a ][ c ] * packet.direction[ a ][ 0 ];
+			}
+
+			uint32_t i = childCount++;
+			while( ( i > 0 ) && ( distances[ order[ i - 1 ] ] < distances[ c ] ) )
+			{
+				order[ i ] = order[ i - 1 ];
+				--i;
+			}
+			order[ i ] = c;
+		}
+
+		for( uint32_t i = 0; i < childCount; ++i )
+		{
+			stack[ stackSize++ ] = { index, order[ i ] };
+		}
+	};
+
+	pushChildren( 0 );
+
+	while( stackSize > 0 )
+	{
+		const Entry entry = stack[ --stackSize ];
+		const WideBVHNode< Width >& node = nodes[ entry.node ];
+		const uint32_t c = entry.slot;
+
+		const AABB box( vec3( node.bounds[ 0 ][ 0 ][ c ], node.bounds[ 0 ][ 1 ][ c ], node.bounds[ 0 ][ 2 ][ c ] ),
+						vec3( node.bounds[ 1 ][ 0 ][ c ], node.bounds[ 1 ][ 1 ][ c ], node.bounds[ 1 ][ 2 ][ c ] ) );
+
+		uint32_t mask = packet.IntersectBounds( box, t_min, tMax ) & laneMask;
+		if( mask == 0 )
+			continue;
+
+		if( node.primitiveCount[ c ] > 0 )
+		{
+			leafHit( node.child[ c ], node.primitiveCount[ c ], mask );
+		}
+		else
+		{
+			pushChildren( node.child[ c ] );
+		}
+
+	} // while( stackSize > 0 )
+}
@@ -14,6 +14,7 @@
 #define IDR_MAINFRAME                   128
 #define ID_FILE_SAVE                    32771
 #define IDM_SAVE                        32772
+#define IDM_BENCHMARK                   32773
 #define IDC_STATIC                      -1
 
 // Next default values for new objects
@@ -22,7 +23,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NO_MFC                     1
 #define _APS_NEXT_RESOURCE_VALUE        129
-#define _APS_NEXT_COMMAND_VALUE         32773
+#define _APS_NEXT_COMMAND_VALUE         32774
 #define _APS_NEXT_CONTROL_VALUE         1000
 #define _APS_NEXT_SYMED_VALUE           110
 #endif